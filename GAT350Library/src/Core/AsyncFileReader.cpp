@@ -0,0 +1,283 @@
+#include "AsyncFileReader.h"
+
+#include <fstream>
+#include <algorithm>
+
+namespace Engine
+{
+
+	static const size_t s_ReadChunkSize = 1024 * 1024; // cancellation is checked between chunks
+
+	bool AsyncFileReader::Handle::IsReady() const
+	{
+		State state = m_Request->state;
+		return state == State::Done || state == State::Failed || state == State::Cancelled;
+	}
+
+	const std::vector<uint8_t>& AsyncFileReader::Handle::Wait()
+	{
+		static const std::vector<uint8_t> empty;
+		if (m_Request == nullptr)
+			return empty;
+
+		AsyncFileReader& reader = AsyncFileReader::Get();
+
+		// a request that has not started would wait behind everything else in the queue so read it here
+		reader.ReadRequest(*m_Request);
+
+		std::unique_lock<std::mutex> lock(reader.m_Mutex);
+		reader.m_RequestDone.wait(lock, [&]() { return IsReady(); });
+		return m_Request->state == State::Done ? m_Request->data : empty;
+	}
+
+	void AsyncFileReader::Handle::Cancel()
+	{
+		// NOTE : this cancels the read for every handle sharing the request
+		if (m_Request == nullptr)
+			return;
+
+		m_Request->cancel = true;
+		State expected = State::Queued;
+		if (m_Request->state.compare_exchange_strong(expected, State::Reading))
+			AsyncFileReader::Get().Complete(*m_Request, State::Cancelled);
+	}
+
+	AsyncFileReader::AsyncFileReader()
+	{
+		uint32_t count = std::clamp(std::thread::hardware_concurrency() / 2, 1u, 4u);
+		StartThreads(count);
+	}
+
+	AsyncFileReader::~AsyncFileReader()
+	{
+		StopThreads();
+	}
+
+	AsyncFileReader::Handle AsyncFileReader::Read(const fs::path& path, Priority priority)
+	{
+		std::string key = path.lexically_normal().string();
+
+		std::lock_guard<std::mutex> lock(m_Mutex);
+
+		// join a read of the same file that is still around
+		auto it = m_InFlight.find(key);
+		if (it != m_InFlight.end())
+		{
+			Ref<Request> request = it->second.lock();
+			if (request != nullptr && CanJoin(*request, path))
+			{
+				if (priority > request->priority)
+				{
+					request->priority = priority;
+					if (request->state == State::Queued)
+						Enqueue(request); // the old entry is skipped once this one is taken
+				}
+				m_Statistics.sharedRequests++;
+				return Handle(request);
+			}
+		}
+
+		Ref<Request> request = std::make_shared<Request>();
+		request->path = path;
+		request->priority = priority;
+		m_InFlight[key] = request;
+
+		// forget requests nobody holds anymore
+		if (m_Order % 256 == 0)
+		{
+			for (auto i = m_InFlight.begin(); i != m_InFlight.end();)
+			{
+				if (i->second.expired())
+					i = m_InFlight.erase(i);
+				else
+					i++;
+			}
+		}
+
+		Enqueue(request);
+		m_WorkAvailable.notify_one();
+		return Handle(request);
+	}
+
+	std::vector<AsyncFileReader::Handle> AsyncFileReader::ReadBatch(const std::vector<fs::path>& paths, Priority priority)
+	{
+		std::vector<Handle> handles;
+		handles.reserve(paths.size());
+		for (const fs::path& path : paths)
+			handles.push_back(Read(path, priority));
+		return handles;
+	}
+
+	void AsyncFileReader::Forget(const fs::path& path)
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_InFlight.erase(path.lexically_normal().string());
+	}
+
+	void AsyncFileReader::SetThreadCount(uint32_t count)
+	{
+		StopThreads();
+		StartThreads(std::max(count, 1u));
+	}
+
+	AsyncFileReader::Statistics AsyncFileReader::GetStatistics()
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		Statistics stats = m_Statistics;
+		stats.pending = (uint32_t)std::count_if(m_Queue.begin(), m_Queue.end(), [](const QueueEntry& entry) {
+			return entry.request->state == State::Queued;
+		});
+		return stats;
+	}
+
+	AsyncFileReader& AsyncFileReader::Get()
+	{
+		static AsyncFileReader* instance = new AsyncFileReader();
+		return *instance;
+	}
+
+	bool AsyncFileReader::QueueEntry::operator<(const QueueEntry& other) const
+	{
+		if (priority != other.priority)
+			return priority < other.priority;
+		return order > other.order;
+	}
+
+	bool AsyncFileReader::CanJoin(const Request& request, const fs::path& path) const
+	{
+		switch (request.state)
+		{
+		case State::Queued:
+		case State::Reading:
+			return !request.cancel; // a cancelled read ends empty for everyone sharing it
+		case State::Done:
+		{
+			// the data is only still good if nothing wrote the file since
+			std::error_code error;
+			fs::file_time_type writeTime = fs::last_write_time(path, error);
+			return !error && writeTime == request.writeTime;
+		}
+		default:
+			return false;
+		}
+	}
+
+	void AsyncFileReader::Enqueue(const Ref<Request>& request)
+	{
+		m_Queue.push_back({ request, request->priority, m_Order++ });
+		std::push_heap(m_Queue.begin(), m_Queue.end());
+	}
+
+	void AsyncFileReader::WorkerLoop()
+	{
+		while (true)
+		{
+			Ref<Request> request;
+			{
+				std::unique_lock<std::mutex> lock(m_Mutex);
+				m_WorkAvailable.wait(lock, [&]() { return m_Stop || !m_Queue.empty(); });
+				if (m_Stop)
+					return;
+
+				std::pop_heap(m_Queue.begin(), m_Queue.end());
+				request = m_Queue.back().request;
+				m_Queue.pop_back();
+			}
+
+			ReadRequest(*request);
+		}
+	}
+
+	bool AsyncFileReader::ReadRequest(Request& request)
+	{
+		// only one thread gets to read each request
+		State expected = State::Queued;
+		if (!request.state.compare_exchange_strong(expected, State::Reading))
+			return false;
+
+		// taken before reading so a write during the read makes the next Read go to the disk again
+		std::error_code error;
+		request.writeTime = fs::last_write_time(request.path, error);
+
+		std::ifstream file(request.path, std::ios::binary | std::ios::ate);
+		if (!file)
+		{
+			Complete(request, State::Failed);
+			return true;
+		}
+
+		size_t size = (size_t)file.tellg();
+		file.seekg(0);
+		request.data.resize(size);
+
+		for (size_t offset = 0; offset < size; offset += s_ReadChunkSize)
+		{
+			if (request.cancel)
+			{
+				Complete(request, State::Cancelled);
+				return true;
+			}
+
+			file.read((char*)request.data.data() + offset, std::min(s_ReadChunkSize, size - offset));
+			if (!file)
+			{
+				Complete(request, State::Failed);
+				return true;
+			}
+		}
+
+		Complete(request, State::Done);
+		return true;
+	}
+
+	void AsyncFileReader::Complete(Request& request, State state)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			switch (state)
+			{
+			case State::Done:
+				m_Statistics.bytesRead += request.data.size();
+				m_Statistics.filesRead++;
+				break;
+			case State::Failed:
+				m_Statistics.failed++;
+				break;
+			case State::Cancelled:
+				m_Statistics.cancelled++;
+				break;
+			default:
+				break;
+			}
+
+			if (state != State::Done)
+			{
+				request.data.clear();
+				request.data.shrink_to_fit();
+			}
+			request.state = state;
+		}
+		m_RequestDone.notify_all();
+	}
+
+	void AsyncFileReader::StartThreads(uint32_t count)
+	{
+		for (uint32_t i = 0; i < count; i++)
+			m_Threads.emplace_back(&AsyncFileReader::WorkerLoop, this);
+	}
+
+	void AsyncFileReader::StopThreads()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Stop = true;
+		}
+		m_WorkAvailable.notify_all();
+
+		for (std::thread& thread : m_Threads)
+			thread.join();
+		m_Threads.clear();
+		m_Stop = false;
+	}
+
+}
@@ -0,0 +1,123 @@
+#pragma once
+#include "Core.h"
+
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <unordered_map>
+
+namespace Engine
+{
+	// reads whole files on a pool of worker threads so loaders can decode one file while the next ones are read
+	// reading the same path again while it is still in flight shares the request, so loaders can prefetch
+	// everything they are about to need and then open the files one by one as usual
+	// a finished read is only shared while the file has not been written since it was read
+	class AsyncFileReader
+	{
+	public:
+		enum class Priority
+		{
+			Low, // read ahead
+			Normal,
+			High, // something is waiting on it
+		};
+
+		enum class State
+		{
+			Queued,
+			Reading,
+			Done,
+			Failed,
+			Cancelled,
+		};
+
+		struct Request
+		{
+			fs::path path;
+			std::atomic<State> state = State::Queued;
+			std::atomic<Priority> priority = Priority::Normal;
+			std::atomic<bool> cancel = false;
+			fs::file_time_type writeTime; // of the file when the read started
+			std::vector<uint8_t> data;
+		};
+
+		class Handle
+		{
+		public:
+			Handle() = default;
+			Handle(const Ref<Request>& request) : m_Request(request) {}
+
+			bool IsValid() const { return m_Request != nullptr; }
+			bool IsReady() const; // done, failed or cancelled
+			State GetState() const { return m_Request->state; }
+			const fs::path& GetPath() const { return m_Request->path; }
+
+			// blocks until the file is read, a request that has not started yet is read on the calling thread
+			// the data is empty if the read failed or was cancelled and lives as long as the handle
+			const std::vector<uint8_t>& Wait();
+			void Cancel();
+
+		private:
+			Ref<Request> m_Request;
+		};
+
+		struct Statistics
+		{
+			uint64_t bytesRead = 0;
+			uint32_t filesRead = 0;
+			uint32_t sharedRequests = 0; // reads that joined a request already in flight
+			uint32_t failed = 0;
+			uint32_t cancelled = 0;
+			uint32_t pending = 0;
+		};
+
+	public:
+		~AsyncFileReader();
+
+		Handle Read(const fs::path& path, Priority priority = Priority::Normal);
+		std::vector<Handle> ReadBatch(const std::vector<fs::path>& paths, Priority priority = Priority::Normal);
+		// the next read of the path goes to the disk again instead of joining a request that is still held, for files that changed
+		void Forget(const fs::path& path);
+
+		void SetThreadCount(uint32_t count);
+		Statistics GetStatistics();
+
+		static AsyncFileReader& Get();
+
+	private:
+		AsyncFileReader();
+
+		struct QueueEntry
+		{
+			Ref<Request> request;
+			Priority priority;
+			uint64_t order;
+
+			bool operator<(const QueueEntry& other) const; // for the heap, highest priority and oldest on top
+		};
+
+		bool CanJoin(const Request& request, const fs::path& path) const; // expects the lock to be held
+		void Enqueue(const Ref<Request>& request); // expects the lock to be held
+		void WorkerLoop();
+		bool ReadRequest(Request& request); // returns false if the request was already taken
+		void Complete(Request& request, State state);
+
+		void StartThreads(uint32_t count);
+		void StopThreads();
+
+	private:
+		std::mutex m_Mutex;
+		std::condition_variable m_WorkAvailable;
+		std::condition_variable m_RequestDone;
+
+		std::vector<QueueEntry> m_Queue; // heap
+		std::unordered_map<std::string, std::weak_ptr<Request>> m_InFlight;
+		uint64_t m_Order = 0;
+
+		std::vector<std::thread> m_Threads;
+		bool m_Stop = false;
+
+		Statistics m_Statistics;
+	};
+}
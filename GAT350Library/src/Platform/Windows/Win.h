@@ -49,6 +49,7 @@
 #include <Windows.h>
 #include <string>
 #include <d3d11.h>
+#include <d3d11_1.h>
 #include <d3dcompiler.h>
 #include <wrl.h>
 
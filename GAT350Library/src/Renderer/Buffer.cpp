@@ -1,5 +1,11 @@
 #include "Buffer.h"
 #include "RendererAPI.h"
+#include "BufferPool.h"
+#include "ShaderCache.h"
+
+#include <algorithm>
+#include <string.h>
+#include <ctype.h>
 
 namespace Engine
 {
@@ -27,6 +33,63 @@ namespace Engine
 		return DXGI_FORMAT_UNKNOWN;
 	}
 
+	// ------------------------------------- Vertex Layout ------------------------------------- //
+
+#pragma region Vertex Layout
+
+	VertexLayout::VertexLayout(std::initializer_list<std::vector<VertexElement>> streams)
+	{
+		for (const std::vector<VertexElement>& elements : streams)
+			AddStream(elements);
+	}
+
+	uint32_t VertexLayout::AddStream(std::vector<VertexElement> elements)
+	{
+		if (m_Streams.size() == MaxStreams)
+		{
+			DBOUT("vertex layouts can only have " << MaxStreams << " streams" << std::endl);
+			return InvalidStream;
+		}
+
+		Stream stream;
+		for (VertexElement& element : elements)
+		{
+			element.offset = stream.stride;
+			stream.stride += ShaderDataTypeSize(element.type);
+
+			m_Hash = ShaderCache::Hash(element.semantic.data(), element.semantic.size(), m_Hash);
+			uint32_t key[] = { (uint32_t)m_Streams.size(), element.semanticIndex, (uint32_t)element.type };
+			m_Hash = ShaderCache::Hash(key, sizeof(key), m_Hash);
+		}
+		stream.elements = std::move(elements);
+		m_Streams.push_back(std::move(stream));
+		return (uint32_t)m_Streams.size() - 1;
+	}
+
+	uint32_t VertexLayout::Find(const std::string& semantic, uint32_t semanticIndex, const VertexElement** element) const
+	{
+		auto equal = [](const std::string& a, const std::string& b) {
+			return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) { return tolower(x) == tolower(y); });
+		};
+
+		for (uint32_t stream = 0; stream < m_Streams.size(); stream++)
+		{
+			for (const VertexElement& other : m_Streams[stream].elements)
+			{
+				if (other.semanticIndex != semanticIndex || !equal(other.semantic, semantic))
+					continue;
+				if (element != nullptr)
+					*element = &other;
+				return stream;
+			}
+		}
+		return InvalidStream;
+	}
+
+#pragma endregion
+
+	// ------------------------------------- End Vertex Layout ------------------------------------- //
+
 	// ------------------------------------- Vertex Buffer ------------------------------------- //
 
 #pragma region Vertex Buffer
@@ -37,42 +100,42 @@ namespace Engine
 		RendererAPI& graphics = RendererAPI::Get();
 		D3D11_BUFFER_DESC vbufferDesc = { 0 };
 		vbufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-		vbufferDesc.Usage = (vertices == nullptr ? D3D11_USAGE_DYNAMIC : D3D11_USAGE_DEFAULT);
-		vbufferDesc.CPUAccessFlags = (vertices == nullptr ? D3D11_CPU_ACCESS_WRITE : 0u);
+		vbufferDesc.Usage = D3D11_USAGE_DEFAULT; // updated with UpdateSubresource so a partial write can not touch data a draw still uses
+		vbufferDesc.CPUAccessFlags = 0u;
 		vbufferDesc.MiscFlags = 0u;
 		vbufferDesc.ByteWidth = count * stride;
 
-		D3D11_SUBRESOURCE_DATA vbufferData = { 0 };
-		if (vertices == nullptr)
-			vbufferData.pSysMem = (const void*)new byte[count * stride]{ 0 };
-		else
-			vbufferData.pSysMem = vertices;
-
-		HRESULT hr = graphics.GetDivice()->CreateBuffer(&vbufferDesc, &vbufferData, &m_Buffer);
+		m_Buffer = BufferPool::Get().Acquire(vbufferDesc, stride);
+		if (m_Buffer == nullptr)
+		{
+			DBOUT("failed to create vertex buffer" << std::endl);
+			return;
+		}
 
-		if (FAILED(hr))
-			DBOUT("failed to create vertex buffer " << TranslateError(hr) << std::endl);
+		// the pooled buffer can be bigger than the data so only the used part is written
+		if (vertices != nullptr)
+		{
+			D3D11_BOX box = { 0, 0, 0, count * stride, 1, 1 };
+			graphics.GetContext()->UpdateSubresource(m_Buffer.Get(), 0, &box, vertices, 0, 0);
+		}
+	}
 
-		if (vertices == nullptr)
-			delete[] vbufferData.pSysMem;
+	VertexBuffer::~VertexBuffer()
+	{
+		BufferPool::Get().Release(m_Buffer);
 	}
 
 	void VertexBuffer::SetData(const void* data, uint32_t count)
 	{
 		RendererAPI& graphics = RendererAPI::Get();
 
-		D3D11_MAPPED_SUBRESOURCE msub = {};
-
-		HRESULT hr = graphics.GetContext()->Map(m_Buffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &msub);
-
-		if (FAILED(hr))
-		{
-			DBOUT("failed to update vertex buffer " << TranslateError(hr) << std::endl);
-			return;
-		}
+		D3D11_BOX box = { 0, 0, 0, count * m_Stride, 1, 1 };
+		graphics.GetContext()->UpdateSubresource(m_Buffer.Get(), 0, &box, data, 0, 0);
+	}
 
-		CopyMemory(msub.pData, data, count * m_Stride);
-		graphics.GetContext()->Unmap(m_Buffer.Get(), 0);
+	void VertexBuffer::QueueData(const void* data, uint32_t count, uint32_t first, UploadQueue::Priority priority)
+	{
+		UploadQueue::Get().Upload(m_Buffer, first * m_Stride, data, count * m_Stride, priority);
 	}
 
 	Ref<VertexBuffer> VertexBuffer::Create(uint32_t stride, uint32_t count)
@@ -101,42 +164,43 @@ namespace Engine
 
 		D3D11_BUFFER_DESC ibufferDesc = { 0 };
 		ibufferDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
-		ibufferDesc.Usage = (indices == nullptr ? D3D11_USAGE_DYNAMIC : D3D11_USAGE_DEFAULT);
-		ibufferDesc.CPUAccessFlags = (indices == nullptr ? D3D11_CPU_ACCESS_WRITE : 0u);
+		ibufferDesc.Usage = D3D11_USAGE_DEFAULT;
+		ibufferDesc.CPUAccessFlags = 0u;
 		ibufferDesc.MiscFlags = 0u;
 		ibufferDesc.ByteWidth = sizeof(uint32_t) * count;
 		ibufferDesc.StructureByteStride = sizeof(uint32_t);
 
-		D3D11_SUBRESOURCE_DATA ibufferData = { 0 };
-		if (indices == nullptr)
-			ibufferData.pSysMem = (const void*)new uint32_t[count]{ 0 };
-		else
-			ibufferData.pSysMem = indices;
+		m_Buffer = BufferPool::Get().Acquire(ibufferDesc, sizeof(uint32_t));
+		if (m_Buffer == nullptr)
+		{
+			DBOUT("failed to create index buffer" << std::endl);
+			return;
+		}
 
-		graphics.GetDivice()->CreateBuffer(&ibufferDesc, &ibufferData, &m_Buffer);
+		if (indices != nullptr)
+		{
+			D3D11_BOX box = { 0, 0, 0, count * (uint32_t)sizeof(uint32_t), 1, 1 };
+			graphics.GetContext()->UpdateSubresource(m_Buffer.Get(), 0, &box, indices, 0, 0);
+		}
+	}
 
-		if (indices == nullptr)
-			delete[] ibufferData.pSysMem;
+	IndexBuffer::~IndexBuffer()
+	{
+		BufferPool::Get().Release(m_Buffer);
 	}
 
 	void IndexBuffer::SetData(const uint32_t* indices, uint32_t count)
 	{
 		RendererAPI& graphics = RendererAPI::Get();
 
-		D3D11_MAPPED_SUBRESOURCE msub = {};
-
-		HRESULT hr = graphics.GetContext()->Map(m_Buffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &msub);
-
-		if (FAILED(hr))
-		{
-			DBOUT("failed to update index buffer " << TranslateError(hr) << std::endl);
-			return;
-		}
-
-		CopyMemory(msub.pData, indices, count * sizeof(uint32_t));
-		graphics.GetContext()->Unmap(m_Buffer.Get(), 0);
+		D3D11_BOX box = { 0, 0, 0, count * (uint32_t)sizeof(uint32_t), 1, 1 };
+		graphics.GetContext()->UpdateSubresource(m_Buffer.Get(), 0, &box, indices, 0, 0);
 	}
 
+	void IndexBuffer::QueueData(const uint32_t* indices, uint32_t count, uint32_t first, UploadQueue::Priority priority)
+	{
+		UploadQueue::Get().Upload(m_Buffer, first * sizeof(uint32_t), indices, count * sizeof(uint32_t), priority);
+	}
 
 	Ref<IndexBuffer> IndexBuffer::Create(const uint32_t count)
 	{
@@ -160,8 +224,6 @@ namespace Engine
 	ConstantBuffer::ConstantBuffer(const void* data, uint32_t size) :
 		m_Size(size)
 	{
-		RendererAPI& graphics = RendererAPI::Get();
-
 		D3D11_BUFFER_DESC cbufferDesc = {  };
 		cbufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
 		cbufferDesc.Usage = D3D11_USAGE_DYNAMIC;
@@ -169,19 +231,22 @@ namespace Engine
 		cbufferDesc.MiscFlags = 0u;
 		cbufferDesc.ByteWidth = size;
 		cbufferDesc.StructureByteStride = 0u;
-		D3D11_SUBRESOURCE_DATA cbufferData = {  };
-		if (data == nullptr)
-			cbufferData.pSysMem = (const void*) new byte[size]{ 0 };
-		else
-			cbufferData.pSysMem = data;
 
-		HRESULT hr = graphics.GetDivice()->CreateBuffer(&cbufferDesc, &cbufferData, &m_Buffer);
+		// constant buffers are sized in 16 byte constants
+		m_Buffer = BufferPool::Get().Acquire(cbufferDesc, 16);
+		if (m_Buffer == nullptr)
+		{
+			DBOUT("faild to create constent buffer" << std::endl);
+			return;
+		}
 
-		if (FAILED(hr))
-			DBOUT("faild to create constent buffer " << TranslateError(hr) << std::endl);
+		if (data != nullptr)
+			SetData(data);
+	}
 
-		if (data == nullptr)
-			delete[] cbufferData.pSysMem;
+	ConstantBuffer::~ConstantBuffer()
+	{
+		BufferPool::Get().Release(m_Buffer);
 	}
 
 	void ConstantBuffer::SetData(const void* data)
@@ -202,6 +267,11 @@ namespace Engine
 		graphics.GetContext()->Unmap(m_Buffer.Get(), 0);
 	}
 
+	void ConstantBuffer::QueueData(const void* data, UploadQueue::Priority priority)
+	{
+		UploadQueue::Get().Upload(m_Buffer, 0, data, m_Size, priority);
+	}
+
 	Ref<ConstantBuffer> ConstantBuffer::ConstantBuffer::Create(uint32_t size)
 	{
 		return Create(nullptr, size);
@@ -217,8 +287,11 @@ namespace Engine
 
 	// ------------------------------------- End Constant Buffer ------------------------------------- //
 
+	// dirty ranges closer than this are written as one, a call costs more than a few extra bytes
+	static const uint32_t s_StructuredMergeGap = 256;
+
 	StructuredBuffer::StructuredBuffer(uint32_t stride, uint32_t count) :
-		m_Stride(stride), m_Count(count)
+		m_Stride(stride), m_Count(count), m_Data((size_t)stride * count, 0)
 	{
 		if (count == 0)
 			return;
@@ -227,21 +300,18 @@ namespace Engine
 
 		D3D11_BUFFER_DESC sbufferDesc = {  };
 		sbufferDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
-		sbufferDesc.Usage = D3D11_USAGE_DYNAMIC;
-		sbufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+		sbufferDesc.Usage = D3D11_USAGE_DEFAULT; // a dynamic buffer can only be written whole
+		sbufferDesc.CPUAccessFlags = 0u;
 		sbufferDesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
 		sbufferDesc.ByteWidth = count * stride;
 		sbufferDesc.StructureByteStride = stride;
 
-		D3D11_SUBRESOURCE_DATA sbufferData = { 0 };
-		sbufferData.pSysMem = new uint8_t[count * stride]{ 0 };
-
-		HRESULT hr = graphics.GetDivice()->CreateBuffer(&sbufferDesc, &sbufferData, &m_Buffer);
-
-		if (FAILED(hr))
-			DBOUT("failed to create structured buffer " << TranslateError(hr) << std::endl);
-
-		delete[] sbufferData.pSysMem;
+		m_Buffer = BufferPool::Get().Acquire(sbufferDesc, stride);
+		if (m_Buffer == nullptr)
+		{
+			DBOUT("failed to create structured buffer" << std::endl);
+			return;
+		}
 
 		D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc;
 		srvDesc.Format = DXGI_FORMAT_UNKNOWN;
@@ -249,30 +319,103 @@ namespace Engine
 		srvDesc.Buffer.FirstElement = 0;
 		srvDesc.Buffer.NumElements = count;
 
-		hr = graphics.GetDivice()->CreateShaderResourceView(m_Buffer.Get(), &srvDesc, &m_SRV);
+		HRESULT hr = graphics.GetDivice()->CreateShaderResourceView(m_Buffer.Get(), &srvDesc, &m_SRV);
 		if (FAILED(hr))
 			DBOUT("failed to create structured buffer resource view " << TranslateError(hr) << std::endl);
+
+		// pooled buffers are not cleared, the zeros go up the first time it is bound
+		MarkDirty(0, count);
 	}
 
 	void StructuredBuffer::SetData(const void* data)
 	{
-		if (m_Count == 0)
+		SetElements(0, data, m_Count);
+	}
+
+	void StructuredBuffer::SetElements(uint32_t first, const void* data, uint32_t count)
+	{
+		if (first + count > m_Count)
+		{
+			DBOUT("setting elements " << first << " to " << first + count << " of a structured buffer with " << m_Count << std::endl);
+			return;
+		}
+		if (count == 0)
 			return;
 
+		// elements set to what they already are do not need to go to the gpu
+		uint8_t* dest = m_Data.data() + (size_t)first * m_Stride;
+		if (memcmp(dest, data, (size_t)count * m_Stride) == 0)
+			return;
+
+		memcpy(dest, data, (size_t)count * m_Stride);
+		MarkDirty(first, count);
+	}
+
+	void StructuredBuffer::QueueData(const void* data)
+	{
+		SetData(data);
+	}
+
+	uint32_t StructuredBuffer::Upload()
+	{
+		if (m_DirtyRanges.empty() || m_Buffer == nullptr)
+			return 0;
+
 		RendererAPI& graphics = RendererAPI::Get();
 
-		D3D11_MAPPED_SUBRESOURCE msub = {};
+		// join ranges with small gaps between them
+		uint32_t gap = std::max(s_StructuredMergeGap / std::max(m_Stride, 1u), 1u);
+		std::vector<Range> ranges;
+		uint32_t dirty = 0;
+		for (const Range& range : m_DirtyRanges)
+		{
+			if (!ranges.empty() && range.first - (ranges.back().first + ranges.back().count) <= gap)
+				ranges.back().count = range.first + range.count - ranges.back().first;
+			else
+				ranges.push_back(range);
+		}
+		for (const Range& range : ranges)
+			dirty += range.count;
+		m_DirtyRanges.clear();
 
-		HRESULT hr = graphics.GetContext()->Map(m_Buffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &msub);
+		// past half the buffer one write of everything is cheaper than many small ones
+		if (dirty * 2 >= m_Count)
+			ranges = { { 0, m_Count } };
 
-		if (FAILED(hr))
+		uint32_t bytes = 0;
+		for (const Range& range : ranges)
 		{
-			DBOUT("failed to update Structured buffer " << TranslateError(hr) << std::endl);
+			D3D11_BOX box = { range.first * m_Stride, 0, 0, (range.first + range.count) * m_Stride, 1, 1 };
+			graphics.GetContext()->UpdateSubresource(m_Buffer.Get(), 0, &box, m_Data.data() + (size_t)range.first * m_Stride, 0, 0);
+			bytes += range.count * m_Stride;
+		}
+		return bytes;
+	}
+
+	void StructuredBuffer::MarkDirty(uint32_t first, uint32_t count)
+	{
+		if (count == 0)
 			return;
+
+		// swallow every range the new one touches
+		uint32_t last = first + count;
+		auto begin = std::lower_bound(m_DirtyRanges.begin(), m_DirtyRanges.end(), first, [](const Range& r, uint32_t value) {
+			return r.first + r.count < value;
+		});
+		auto end = begin;
+		while (end != m_DirtyRanges.end() && end->first <= last)
+		{
+			first = std::min(first, end->first);
+			last = std::max(last, end->first + end->count);
+			end++;
 		}
+		begin = m_DirtyRanges.erase(begin, end);
+		m_DirtyRanges.insert(begin, { first, last - first });
+	}
 
-		CopyMemory(msub.pData, data, m_Count * m_Stride);
-		graphics.GetContext()->Unmap(m_Buffer.Get(), 0);
+	StructuredBuffer::~StructuredBuffer()
+	{
+		BufferPool::Get().Release(m_Buffer);
 	}
 
 	Ref<StructuredBuffer> StructuredBuffer::Create(uint32_t stride, uint32_t count)
@@ -1,6 +1,7 @@
 #pragma once
 #include "Platform/Windows/Win.h"
 #include "Core/Core.h"
+#include "UploadQueue.h"
 
 namespace Engine
 {
@@ -35,14 +36,60 @@ namespace Engine
 		return 0;
 	}
 
+	struct VertexElement
+	{
+		std::string semantic;
+		ShaderDataType type = ShaderDataType::None;
+		uint32_t semanticIndex = 0;
+		uint32_t offset = 0; // set by the layout, elements are packed in the order they are given
+	};
+
+	// which vertex attributes are in which vertex buffer, each stream is its own buffer in its own input slot
+	// a shader only needs the streams with the attributes it reads bound
+	class VertexLayout
+	{
+	public:
+		static constexpr uint32_t MaxStreams = 8;
+		static constexpr uint32_t InvalidStream = ~0u;
+
+	public:
+		VertexLayout() = default;
+		VertexLayout(std::initializer_list<std::vector<VertexElement>> streams);
+
+		uint32_t AddStream(std::vector<VertexElement> elements); // returns the input slot of the stream
+
+		uint32_t GetStreamCount() const { return (uint32_t)m_Streams.size(); }
+		uint32_t GetStride(uint32_t stream) const { return m_Streams[stream].stride; }
+		const std::vector<VertexElement>& GetElements(uint32_t stream) const { return m_Streams[stream].elements; }
+
+		// InvalidStream if no stream has the attribute, semantics are not case sensitive like in hlsl
+		uint32_t Find(const std::string& semantic, uint32_t semanticIndex, const VertexElement** element = nullptr) const;
+
+		// layouts with the same streams have the same hash
+		uint64_t GetHash() const { return m_Hash; }
+
+	private:
+		struct Stream
+		{
+			std::vector<VertexElement> elements;
+			uint32_t stride = 0;
+		};
+
+		std::vector<Stream> m_Streams;
+		uint64_t m_Hash = 0;
+	};
+
 #pragma endregion
 
 	class VertexBuffer
 	{
 	public:
 		VertexBuffer(const void* vertices, uint32_t stride, uint32_t count);
+		~VertexBuffer(); // the buffer goes back to the BufferPool
 
 		void SetData(const void* data, uint32_t count);
+		// written at the start of the next frame with the other queued updates, safe to call from any thread
+		void QueueData(const void* data, uint32_t count, uint32_t first = 0, UploadQueue::Priority priority = UploadQueue::Priority::Normal);
 
 		uint32_t GetStride() { return m_Stride; }
 		uint32_t GetCount() { return m_Count; }
@@ -63,8 +110,10 @@ namespace Engine
 	{
 	public:
 		IndexBuffer(const uint32_t* indices, uint32_t count);
+		~IndexBuffer(); // the buffer goes back to the BufferPool
 
 		void SetData(const uint32_t* indices, uint32_t count);
+		void QueueData(const uint32_t* indices, uint32_t count, uint32_t first = 0, UploadQueue::Priority priority = UploadQueue::Priority::Normal);
 
 		uint32_t GetCount() const { return m_Count; };
 		wrl::ComPtr<ID3D11Buffer> GetBuffer() { return m_Buffer; }
@@ -83,8 +132,10 @@ namespace Engine
 	{
 	public:
 		ConstantBuffer(const void* data, uint32_t size);
+		~ConstantBuffer(); // the buffer goes back to the BufferPool
 
 		void SetData(const void* data);
+		void QueueData(const void* data, UploadQueue::Priority priority = UploadQueue::Priority::Normal);
 
 		uint32_t GetSize() { return m_Size; }
 		wrl::ComPtr<ID3D11Buffer> GetBuffer() { return m_Buffer; }
@@ -99,12 +150,22 @@ namespace Engine
 
 
 
+	// keeps a copy of the elements on the cpu, changes are written to the gpu when the buffer is bound
+	// and only the ranges that changed are written
 	class StructuredBuffer
 	{
 	public:
 		StructuredBuffer(uint32_t stride, uint32_t count);
+		~StructuredBuffer(); // the buffer goes back to the BufferPool
 
 		void SetData(const void* data);
+		void SetElements(uint32_t first, const void* data, uint32_t count);
+		// the same as SetData, everything goes up when the buffer is bound so a queued write can not land over a newer one
+		void QueueData(const void* data);
+
+		// writes the changed ranges and returns how many bytes that was, done by RendererCommand when the buffer is bound
+		uint32_t Upload();
+		bool IsDirty() const { return !m_DirtyRanges.empty(); }
 
 		uint32_t GetStride() { return m_Stride; }
 		uint32_t GetCount() { return m_Count; }
@@ -114,6 +175,13 @@ namespace Engine
 		static Ref<StructuredBuffer> Create(uint32_t stride, uint32_t count);
 
 	private:
+		struct Range
+		{
+			uint32_t first;
+			uint32_t count;
+		};
+
+		void MarkDirty(uint32_t first, uint32_t count);
 
 	private:
 		wrl::ComPtr<ID3D11Buffer> m_Buffer;
@@ -122,5 +190,8 @@ namespace Engine
 		uint32_t m_Stride;
 		uint32_t m_Count;
 
+		std::vector<uint8_t> m_Data;
+		std::vector<Range> m_DirtyRanges; // in elements, sorted and never touching
+
 	};
 }
@@ -0,0 +1,599 @@
+#include "BufferHeap.h"
+#include "RendererAPI.h"
+#include "UploadQueue.h"
+
+#include <algorithm>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace Engine
+{
+
+	static uint32_t LowestBit(uint32_t value)
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanForward(&index, value);
+		return (uint32_t)index;
+#else
+		return (uint32_t)__builtin_ctz(value);
+#endif
+	}
+
+	static uint32_t HighestBit(uint32_t value)
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanReverse(&index, value);
+		return (uint32_t)index;
+#else
+		return 31 - (uint32_t)__builtin_clz(value);
+#endif
+	}
+
+	// ------------------------------------- Range Allocator ------------------------------------- //
+
+#pragma region Range Allocator
+
+	RangeAllocator::RangeAllocator(uint32_t capacity) :
+		m_Capacity(capacity)
+	{
+		for (uint32_t i = 0; i < FirstLevelCount; i++)
+		{
+			for (uint32_t j = 0; j < SecondLevelCount; j++)
+				m_FreeLists[i][j] = InvalidHandle;
+		}
+
+		if (capacity == 0)
+			return;
+
+		uint32_t block = NewBlock();
+		m_Blocks[block].offset = 0;
+		m_Blocks[block].size = capacity;
+		InsertFreeBlock(block);
+	}
+
+	bool RangeAllocator::Allocate(uint32_t size, Allocation& allocation)
+	{
+		if (size == 0 || size > m_Capacity)
+			return false;
+
+		uint32_t block = FindFreeBlock(size);
+		if (block == InvalidHandle)
+			return false;
+		RemoveFreeBlock(block);
+
+		// give the rest of the block back
+		if (m_Blocks[block].size > size)
+		{
+			uint32_t rest = NewBlock();
+			Block& used = m_Blocks[block];
+			Block& remainder = m_Blocks[rest];
+			remainder.offset = used.offset + size;
+			remainder.size = used.size - size;
+			remainder.prev = block;
+			remainder.next = used.next;
+			if (used.next != InvalidHandle)
+				m_Blocks[used.next].prev = rest;
+			used.next = rest;
+			used.size = size;
+			InsertFreeBlock(rest);
+		}
+
+		m_Used += size;
+		m_AllocationCount++;
+
+		allocation.handle = block;
+		allocation.offset = m_Blocks[block].offset;
+		allocation.size = size;
+		return true;
+	}
+
+	void RangeAllocator::Free(Allocation& allocation)
+	{
+		if (!allocation.IsValid())
+			return;
+
+		uint32_t block = allocation.handle;
+		m_Used -= m_Blocks[block].size;
+		m_AllocationCount--;
+		allocation = Allocation();
+
+		// merge with the free neighbours so the space does not stay split up
+		uint32_t next = m_Blocks[block].next;
+		if (next != InvalidHandle && m_Blocks[next].free)
+		{
+			RemoveFreeBlock(next);
+			m_Blocks[block].size += m_Blocks[next].size;
+			m_Blocks[block].next = m_Blocks[next].next;
+			if (m_Blocks[next].next != InvalidHandle)
+				m_Blocks[m_Blocks[next].next].prev = block;
+			DeleteBlock(next);
+		}
+
+		uint32_t prev = m_Blocks[block].prev;
+		if (prev != InvalidHandle && m_Blocks[prev].free)
+		{
+			RemoveFreeBlock(prev);
+			m_Blocks[prev].size += m_Blocks[block].size;
+			m_Blocks[prev].next = m_Blocks[block].next;
+			if (m_Blocks[block].next != InvalidHandle)
+				m_Blocks[m_Blocks[block].next].prev = prev;
+			DeleteBlock(block);
+			block = prev;
+		}
+
+		InsertFreeBlock(block);
+	}
+
+	RangeAllocator::Statistics RangeAllocator::GetStatistics() const
+	{
+		Statistics stats;
+		stats.capacity = m_Capacity;
+		stats.used = m_Used;
+		stats.allocations = m_AllocationCount;
+		for (uint32_t i = 0; i < FirstLevelCount; i++)
+		{
+			for (uint32_t j = 0; j < SecondLevelCount; j++)
+			{
+				for (uint32_t block = m_FreeLists[i][j]; block != InvalidHandle; block = m_Blocks[block].nextFree)
+				{
+					stats.freeBlocks++;
+					stats.largestFreeBlock = std::max(stats.largestFreeBlock, m_Blocks[block].size);
+				}
+			}
+		}
+		return stats;
+	}
+
+	void RangeAllocator::GetBin(uint32_t size, uint32_t& firstLevel, uint32_t& secondLevel)
+	{
+		// small sizes get a bin each, past that every power of two is split into SecondLevelCount bins
+		if (size < SecondLevelCount)
+		{
+			firstLevel = 0;
+			secondLevel = size;
+			return;
+		}
+
+		uint32_t highestBit = HighestBit(size);
+		firstLevel = highestBit - SecondLevelBits + 1;
+		secondLevel = (size >> (highestBit - SecondLevelBits)) - SecondLevelCount;
+	}
+
+	uint32_t RangeAllocator::FindFreeBlock(uint32_t size) const
+	{
+		// round up to the next bin so any block found is big enough without looking through the list
+		uint32_t rounded = size;
+		if (size >= SecondLevelCount)
+			rounded += (1u << (HighestBit(size) - SecondLevelBits)) - 1;
+
+		uint32_t firstLevel, secondLevel;
+		GetBin(rounded, firstLevel, secondLevel);
+		if (firstLevel < FirstLevelCount)
+		{
+			uint32_t secondLevelMap = m_SecondLevelBitmaps[firstLevel] & (~0u << secondLevel);
+			if (secondLevelMap == 0)
+			{
+				uint32_t firstLevelMap = firstLevel + 1 < FirstLevelCount ? m_FirstLevelBitmap & (~0u << (firstLevel + 1)) : 0;
+				if (firstLevelMap != 0)
+				{
+					firstLevel = LowestBit(firstLevelMap);
+					secondLevelMap = m_SecondLevelBitmaps[firstLevel];
+				}
+			}
+			if (secondLevelMap != 0)
+				return m_FreeLists[firstLevel][LowestBit(secondLevelMap)];
+		}
+
+		// the only blocks left that could fit are in the bin of the size itself
+		GetBin(size, firstLevel, secondLevel);
+		for (uint32_t block = m_FreeLists[firstLevel][secondLevel]; block != InvalidHandle; block = m_Blocks[block].nextFree)
+		{
+			if (m_Blocks[block].size >= size)
+				return block;
+		}
+		return InvalidHandle;
+	}
+
+	void RangeAllocator::InsertFreeBlock(uint32_t block)
+	{
+		uint32_t firstLevel, secondLevel;
+		GetBin(m_Blocks[block].size, firstLevel, secondLevel);
+
+		uint32_t& head = m_FreeLists[firstLevel][secondLevel];
+		m_Blocks[block].free = true;
+		m_Blocks[block].prevFree = InvalidHandle;
+		m_Blocks[block].nextFree = head;
+		if (head != InvalidHandle)
+			m_Blocks[head].prevFree = block;
+		head = block;
+
+		m_FirstLevelBitmap |= 1u << firstLevel;
+		m_SecondLevelBitmaps[firstLevel] |= 1u << secondLevel;
+	}
+
+	void RangeAllocator::RemoveFreeBlock(uint32_t block)
+	{
+		uint32_t firstLevel, secondLevel;
+		GetBin(m_Blocks[block].size, firstLevel, secondLevel);
+
+		Block& b = m_Blocks[block];
+		if (b.prevFree != InvalidHandle)
+			m_Blocks[b.prevFree].nextFree = b.nextFree;
+		else
+			m_FreeLists[firstLevel][secondLevel] = b.nextFree;
+		if (b.nextFree != InvalidHandle)
+			m_Blocks[b.nextFree].prevFree = b.prevFree;
+		b.prevFree = InvalidHandle;
+		b.nextFree = InvalidHandle;
+		b.free = false;
+
+		if (m_FreeLists[firstLevel][secondLevel] == InvalidHandle)
+		{
+			m_SecondLevelBitmaps[firstLevel] &= ~(1u << secondLevel);
+			if (m_SecondLevelBitmaps[firstLevel] == 0)
+				m_FirstLevelBitmap &= ~(1u << firstLevel);
+		}
+	}
+
+	uint32_t RangeAllocator::NewBlock()
+	{
+		if (!m_UnusedBlocks.empty())
+		{
+			uint32_t block = m_UnusedBlocks.back();
+			m_UnusedBlocks.pop_back();
+			m_Blocks[block] = Block();
+			return block;
+		}
+		m_Blocks.emplace_back();
+		return (uint32_t)m_Blocks.size() - 1;
+	}
+
+	void RangeAllocator::DeleteBlock(uint32_t block)
+	{
+		m_Blocks[block] = Block();
+		m_UnusedBlocks.push_back(block);
+	}
+
+#pragma endregion
+
+	// ------------------------------------- End Range Allocator ------------------------------------- //
+
+	// ------------------------------------- Range Heap ------------------------------------- //
+
+#pragma region Range Heap
+
+	RangeHeap::RangeHeap(uint32_t pageSize) :
+		m_PageSize(pageSize)
+	{}
+
+	uint32_t RangeHeap::Allocate(uint32_t count, bool* newPage)
+	{
+		if (newPage != nullptr)
+			*newPage = false;
+		if (count == 0)
+			return InvalidHandle;
+
+		Record record;
+		for (uint32_t i = 0; i < m_Pages.size() && record.page == InvalidPage; i++)
+		{
+			if (m_Pages[i].Allocate(count, record.range))
+				record.page = i;
+		}
+
+		if (record.page == InvalidPage)
+		{
+			// nothing fits, reuse a released page slot or add one
+			uint32_t page = 0;
+			while (page < m_Pages.size() && m_Pages[page].GetCapacity() != 0)
+				page++;
+			if (page == m_Pages.size())
+				m_Pages.emplace_back(0);
+
+			m_Pages[page] = RangeAllocator(std::max(count, m_PageSize));
+			m_Pages[page].Allocate(count, record.range);
+			record.page = page;
+			if (newPage != nullptr)
+				*newPage = true;
+		}
+
+		uint32_t handle;
+		if (!m_UnusedRecords.empty())
+		{
+			handle = m_UnusedRecords.back();
+			m_UnusedRecords.pop_back();
+		}
+		else
+		{
+			handle = (uint32_t)m_Records.size();
+			m_Records.emplace_back();
+		}
+		m_Records[handle] = record;
+		return handle;
+	}
+
+	bool RangeHeap::Free(uint32_t handle)
+	{
+		if (handle >= m_Records.size() || m_Records[handle].page == InvalidPage)
+			return false;
+
+		Record& record = m_Records[handle];
+		RangeAllocator& page = m_Pages[record.page];
+		page.Free(record.range);
+		bool released = false;
+
+		// keep the first page around so loading and unloading one mesh does not make a buffer every time
+		if (page.IsEmpty() && record.page != 0)
+		{
+			page = RangeAllocator(0);
+			released = true;
+		}
+
+		record = Record();
+		m_UnusedRecords.push_back(handle);
+		return released;
+	}
+
+	void RangeHeap::ReleasePage(uint32_t page)
+	{
+		if (page < m_Pages.size() && m_Pages[page].IsEmpty())
+			m_Pages[page] = RangeAllocator(0);
+	}
+
+	uint32_t RangeHeap::Compact(uint32_t maxElements, std::vector<Move>& moves, std::vector<uint32_t>& releasedPages)
+	{
+		// the emptiest page that is at most half used, the first is kept anyway so emptying it would not free anything
+		uint32_t source = InvalidPage;
+		float sourceUsage = 0.5f;
+		for (uint32_t i = 1; i < m_Pages.size(); i++)
+		{
+			uint32_t capacity = m_Pages[i].GetCapacity();
+			if (capacity == 0)
+				continue;
+
+			float usage = (float)m_Pages[i].GetStatistics().used / (float)capacity;
+			if (usage <= sourceUsage)
+			{
+				source = i;
+				sourceUsage = usage;
+			}
+		}
+		if (source == InvalidPage)
+			return 0;
+
+		uint32_t moved = 0;
+		for (uint32_t handle = 0; handle < m_Records.size() && moved < maxElements; handle++)
+		{
+			Record& record = m_Records[handle];
+			if (record.page != source)
+				continue;
+
+			// only into the first page or pages at least as full, so ranges do not go back and forth between two emptying pages
+			Record destination;
+			for (uint32_t i = 0; i < m_Pages.size() && destination.page == InvalidPage; i++)
+			{
+				uint32_t capacity = m_Pages[i].GetCapacity();
+				if (i == source || capacity == 0 || (i != 0 && (float)m_Pages[i].GetStatistics().used / (float)capacity < sourceUsage))
+					continue;
+				if (m_Pages[i].Allocate(record.range.size, destination.range))
+					destination.page = i;
+			}
+
+			// a smaller range further on may still fit
+			if (destination.page == InvalidPage)
+				continue;
+
+			moves.push_back({ handle, { source, record.range.offset, record.range.size }, { destination.page, destination.range.offset, destination.range.size } });
+			moved += record.range.size;
+			m_Pages[source].Free(record.range);
+			record = destination;
+		}
+
+		if (m_Pages[source].IsEmpty())
+		{
+			m_Pages[source] = RangeAllocator(0);
+			releasedPages.push_back(source);
+		}
+		return moved;
+	}
+
+	RangeHeap::Range RangeHeap::GetRange(uint32_t handle) const
+	{
+		if (handle >= m_Records.size())
+			return Range();
+
+		const Record& record = m_Records[handle];
+		return { record.page, record.range.offset, record.range.size };
+	}
+
+	RangeHeap::Statistics RangeHeap::GetStatistics() const
+	{
+		Statistics stats;
+		for (const RangeAllocator& page : m_Pages)
+		{
+			if (page.GetCapacity() == 0)
+				continue;
+
+			RangeAllocator::Statistics pageStats = page.GetStatistics();
+			stats.pages++;
+			stats.elements.capacity += pageStats.capacity;
+			stats.elements.used += pageStats.used;
+			stats.elements.allocations += pageStats.allocations;
+			stats.elements.freeBlocks += pageStats.freeBlocks;
+			stats.elements.largestFreeBlock = std::max(stats.elements.largestFreeBlock, pageStats.largestFreeBlock);
+		}
+		return stats;
+	}
+
+#pragma endregion
+
+	// ------------------------------------- End Range Heap ------------------------------------- //
+
+	// ------------------------------------- Buffer Heap ------------------------------------- //
+
+#pragma region Buffer Heap
+
+	BufferHeap::BufferHeap(UINT bindFlags, uint32_t stride, uint32_t pageSize) :
+		BufferHeap(bindFlags, std::vector<uint32_t>{ stride }, pageSize)
+	{}
+
+	BufferHeap::BufferHeap(UINT bindFlags, const std::vector<uint32_t>& strides, uint32_t pageSize) :
+		m_BindFlags(bindFlags), m_Strides(strides), m_Ranges(pageSize)
+	{}
+
+	BufferHeap::Allocation BufferHeap::Allocate(uint32_t count)
+	{
+		std::unique_lock<std::shared_mutex> lock(m_Mutex);
+
+		bool newPage;
+		Allocation allocation;
+		allocation.handle = m_Ranges.Allocate(count, &newPage);
+		if (!allocation.IsValid() || !newPage)
+			return allocation;
+
+		uint32_t page = m_Ranges.GetRange(allocation.handle).page;
+		if (!CreatePage(page))
+		{
+			m_Ranges.Free(allocation.handle);
+			m_Ranges.ReleasePage(page);
+			return Allocation();
+		}
+		return allocation;
+	}
+
+	void BufferHeap::Free(Allocation& allocation)
+	{
+		if (!allocation.IsValid())
+			return;
+
+		std::unique_lock<std::shared_mutex> lock(m_Mutex);
+		uint32_t page = m_Ranges.GetRange(allocation.handle).page;
+		if (m_Ranges.Free(allocation.handle))
+			m_Buffers[page].clear();
+		allocation = Allocation();
+	}
+
+	void BufferHeap::Upload(const Allocation& allocation, const void* data, uint32_t count, uint32_t offset, uint32_t stream)
+	{
+		if (!allocation.IsValid() || count == 0 || stream >= m_Strides.size())
+			return;
+
+		std::unique_lock<std::shared_mutex> lock(m_Mutex);
+		RangeHeap::Range range = m_Ranges.GetRange(allocation.handle);
+		if (offset + count > range.size)
+		{
+			DBOUT("uploading " << count << " elements at " << offset << " into an allocation of " << range.size << std::endl);
+			return;
+		}
+
+		if (m_Buffers[range.page][stream] == nullptr && !CreateStreamBuffer(range.page, stream))
+			return;
+
+		// goes through the upload queue so meshes loaded together land in a few merged writes before they are drawn
+		uint32_t stride = m_Strides[stream];
+		UploadQueue::Get().Upload(m_Buffers[range.page][stream], (range.offset + offset) * stride, data, count * stride, UploadQueue::Priority::High);
+	}
+
+	uint32_t BufferHeap::Compact(uint32_t maxElements)
+	{
+		std::unique_lock<std::shared_mutex> lock(m_Mutex);
+
+		std::vector<RangeHeap::Move> moves;
+		std::vector<uint32_t> releasedPages;
+		uint32_t moved = m_Ranges.Compact(maxElements, moves, releasedPages);
+		if (moves.empty())
+			return 0;
+
+		// writes still queued for the old ranges have to land before they are copied
+		UploadQueue::Get().FlushHighPriority();
+
+		// the source and destination never overlap, even in the same buffer, so the copies can go straight through
+		wrl::ComPtr<ID3D11DeviceContext> context = RendererAPI::Get().GetImmediateContext();
+		for (const RangeHeap::Move& move : moves)
+		{
+			for (uint32_t stream = 0; stream < m_Strides.size(); stream++)
+			{
+				ID3D11Buffer* source = m_Buffers[move.from.page][stream].Get();
+				if (source == nullptr)
+					continue;
+				if (m_Buffers[move.to.page][stream] == nullptr && !CreateStreamBuffer(move.to.page, stream))
+					continue;
+
+				uint32_t stride = m_Strides[stream];
+				D3D11_BOX box = { move.from.offset * stride, 0, 0, (move.from.offset + move.from.size) * stride, 1, 1 };
+				context->CopySubresourceRegion(m_Buffers[move.to.page][stream].Get(), 0, move.to.offset * stride, 0, 0, source, 0, &box);
+			}
+		}
+
+		for (uint32_t page : releasedPages)
+			m_Buffers[page].clear();
+		return moved;
+	}
+
+	wrl::ComPtr<ID3D11Buffer> BufferHeap::GetBuffer(const Allocation& allocation, uint32_t stream) const
+	{
+		if (!allocation.IsValid() || stream >= m_Strides.size())
+			return nullptr;
+
+		std::shared_lock<std::shared_mutex> lock(m_Mutex);
+		return m_Buffers[m_Ranges.GetRange(allocation.handle).page][stream];
+	}
+
+	uint32_t BufferHeap::GetOffset(const Allocation& allocation) const
+	{
+		std::shared_lock<std::shared_mutex> lock(m_Mutex);
+		return m_Ranges.GetRange(allocation.handle).offset;
+	}
+
+	uint32_t BufferHeap::GetSize(const Allocation& allocation) const
+	{
+		std::shared_lock<std::shared_mutex> lock(m_Mutex);
+		return m_Ranges.GetRange(allocation.handle).size;
+	}
+
+	BufferHeap::Statistics BufferHeap::GetStatistics() const
+	{
+		std::shared_lock<std::shared_mutex> lock(m_Mutex);
+		return m_Ranges.GetStatistics();
+	}
+
+	bool BufferHeap::CreatePage(uint32_t page)
+	{
+		if (page >= m_Buffers.size())
+			m_Buffers.resize(page + 1);
+
+		m_Buffers[page].assign(m_Strides.size(), nullptr);
+		if (!CreateStreamBuffer(page, 0))
+		{
+			m_Buffers[page].clear();
+			return false;
+		}
+		return true;
+	}
+
+	bool BufferHeap::CreateStreamBuffer(uint32_t page, uint32_t stream)
+	{
+		D3D11_BUFFER_DESC bufferDesc = {};
+		bufferDesc.BindFlags = m_BindFlags;
+		bufferDesc.Usage = D3D11_USAGE_DEFAULT;
+		bufferDesc.CPUAccessFlags = 0u;
+		bufferDesc.MiscFlags = 0u;
+		bufferDesc.ByteWidth = m_Ranges.GetPageCapacity(page) * m_Strides[stream];
+
+		HRESULT hr = RendererAPI::Get().GetDivice()->CreateBuffer(&bufferDesc, nullptr, m_Buffers[page][stream].ReleaseAndGetAddressOf());
+		if (FAILED(hr))
+		{
+			DBOUT("failed to create buffer heap page " << TranslateError(hr) << std::endl);
+			m_Buffers[page][stream] = nullptr;
+			return false;
+		}
+		return true;
+	}
+
+#pragma endregion
+
+	// ------------------------------------- End Buffer Heap ------------------------------------- //
+
+}
@@ -0,0 +1,196 @@
+#pragma once
+#include "Platform/Windows/Win.h"
+#include "Core/Core.h"
+
+#include <vector>
+#include <shared_mutex>
+
+namespace Engine
+{
+	// two level segregated fit allocator over a range of elements, it only does the bookkeeping so it works without a device
+	// allocating and freeing are constant time, freed blocks are merged with free neighbours straight away
+	class RangeAllocator
+	{
+	public:
+		static constexpr uint32_t InvalidHandle = ~0u;
+
+		struct Allocation
+		{
+			uint32_t handle = InvalidHandle;
+			uint32_t offset = 0;
+			uint32_t size = 0;
+
+			bool IsValid() const { return handle != InvalidHandle; }
+		};
+
+		struct Statistics
+		{
+			uint32_t capacity = 0;
+			uint32_t used = 0;
+			uint32_t allocations = 0;
+			uint32_t freeBlocks = 0;
+			uint32_t largestFreeBlock = 0;
+
+			// 0 when all the free space is in one block, close to 1 when it is split into many small ones
+			float GetFragmentation() const { uint32_t free = capacity - used; return free == 0 ? 0.0f : 1.0f - (float)largestFreeBlock / (float)free; }
+		};
+
+	public:
+		RangeAllocator(uint32_t capacity);
+
+		bool Allocate(uint32_t size, Allocation& allocation); // false if there is no free block big enough
+		void Free(Allocation& allocation);
+
+		uint32_t GetCapacity() const { return m_Capacity; }
+		bool IsEmpty() const { return m_AllocationCount == 0; }
+		Statistics GetStatistics() const;
+
+	private:
+		static constexpr uint32_t SecondLevelBits = 4;
+		static constexpr uint32_t SecondLevelCount = 1 << SecondLevelBits;
+		static constexpr uint32_t FirstLevelCount = 32;
+
+		struct Block
+		{
+			uint32_t offset = 0;
+			uint32_t size = 0;
+			uint32_t prev = InvalidHandle; // neighbours in the range
+			uint32_t next = InvalidHandle;
+			uint32_t prevFree = InvalidHandle; // neighbours in the free list
+			uint32_t nextFree = InvalidHandle;
+			bool free = false;
+		};
+
+		static void GetBin(uint32_t size, uint32_t& firstLevel, uint32_t& secondLevel);
+		uint32_t FindFreeBlock(uint32_t size) const;
+		void InsertFreeBlock(uint32_t block);
+		void RemoveFreeBlock(uint32_t block);
+		uint32_t NewBlock();
+		void DeleteBlock(uint32_t block);
+
+	private:
+		uint32_t m_Capacity;
+		uint32_t m_Used = 0;
+		uint32_t m_AllocationCount = 0;
+
+		std::vector<Block> m_Blocks;
+		std::vector<uint32_t> m_UnusedBlocks;
+
+		uint32_t m_FirstLevelBitmap = 0;
+		uint32_t m_SecondLevelBitmaps[FirstLevelCount] = {};
+		uint32_t m_FreeLists[FirstLevelCount][SecondLevelCount];
+	};
+
+	// pages of ranges found through handles, the bookkeeping of a BufferHeap without the buffers so it works without a device
+	// a range keeps its handle when Compact moves it to another page
+	class RangeHeap
+	{
+	public:
+		static constexpr uint32_t InvalidHandle = ~0u;
+		static constexpr uint32_t InvalidPage = ~0u;
+
+		struct Range
+		{
+			uint32_t page = InvalidPage;
+			uint32_t offset = 0; // in elements
+			uint32_t size = 0;
+		};
+
+		struct Move
+		{
+			uint32_t handle;
+			Range from;
+			Range to;
+		};
+
+		struct Statistics
+		{
+			uint32_t pages = 0;
+			RangeAllocator::Statistics elements; // summed over all the pages, largestFreeBlock is the largest in any page
+		};
+
+	public:
+		RangeHeap(uint32_t pageSize);
+
+		// count is in elements, a range bigger than a page gets a page of its own
+		// newPage is set when a page was added for it, the caller makes what backs the page
+		uint32_t Allocate(uint32_t count, bool* newPage = nullptr);
+		// returns true if it was the last range in its page, the first page is only released by ReleasePage
+		bool Free(uint32_t handle);
+		void ReleasePage(uint32_t page); // the page has to be empty
+
+		// moves ranges out of the emptiest page past the first into fuller pages until maxElements were moved
+		// nothing is moved unless a page is at most half used, a page left empty is released and put in releasedPages
+		uint32_t Compact(uint32_t maxElements, std::vector<Move>& moves, std::vector<uint32_t>& releasedPages);
+
+		Range GetRange(uint32_t handle) const;
+		uint32_t GetPageCount() const { return (uint32_t)m_Pages.size(); }
+		uint32_t GetPageCapacity(uint32_t page) const { return m_Pages[page].GetCapacity(); } // 0 if the page was released
+		Statistics GetStatistics() const;
+
+	private:
+		struct Record
+		{
+			uint32_t page = InvalidPage;
+			RangeAllocator::Allocation range;
+		};
+
+	private:
+		uint32_t m_PageSize;
+		std::vector<RangeAllocator> m_Pages;
+		std::vector<Record> m_Records;
+		std::vector<uint32_t> m_UnusedRecords;
+	};
+
+	// places many small vertex or index ranges in a few large gpu buffers
+	// a page is one buffer per stream, a new one is made when nothing fits and released again when it empties
+	// all the streams of a page share one allocator so a range has the same offset in each of them
+	// it is locked so meshes can be made and freed from worker threads while others draw
+	class BufferHeap
+	{
+	public:
+		using Statistics = RangeHeap::Statistics;
+
+		struct Allocation
+		{
+			uint32_t handle = RangeHeap::InvalidHandle;
+
+			bool IsValid() const { return handle != RangeHeap::InvalidHandle; }
+		};
+
+	public:
+		BufferHeap(UINT bindFlags, uint32_t stride, uint32_t pageSize);
+		// the buffer for a stream other than the first is made the first time something is written to it in the page
+		BufferHeap(UINT bindFlags, const std::vector<uint32_t>& strides, uint32_t pageSize);
+
+		// count is in elements, a range bigger than a page gets a page of its own
+		Allocation Allocate(uint32_t count);
+		void Free(Allocation& allocation);
+
+		// writes count elements starting at offset elements into the allocation
+		void Upload(const Allocation& allocation, const void* data, uint32_t count, uint32_t offset = 0, uint32_t stream = 0);
+
+		// copies ranges out of a mostly empty page on the gpu so the page can be released, at most maxElements a call
+		// the offsets change, so it has to run between frames and not while command lists are recorded
+		uint32_t Compact(uint32_t maxElements);
+
+		// nullptr if nothing was ever written to the stream in the allocation's page
+		wrl::ComPtr<ID3D11Buffer> GetBuffer(const Allocation& allocation, uint32_t stream = 0) const;
+		uint32_t GetOffset(const Allocation& allocation) const; // in elements
+		uint32_t GetSize(const Allocation& allocation) const;
+		uint32_t GetStride(uint32_t stream = 0) const { return m_Strides[stream]; }
+		uint32_t GetStreamCount() const { return (uint32_t)m_Strides.size(); }
+		Statistics GetStatistics() const;
+
+	private:
+		bool CreatePage(uint32_t page);
+		bool CreateStreamBuffer(uint32_t page, uint32_t stream);
+
+	private:
+		UINT m_BindFlags;
+		std::vector<uint32_t> m_Strides;
+		RangeHeap m_Ranges;
+		std::vector<std::vector<wrl::ComPtr<ID3D11Buffer>>> m_Buffers; // by page then stream, empty if the page was released
+		mutable std::shared_mutex m_Mutex;
+	};
+}
@@ -0,0 +1,133 @@
+#include "BufferPool.h"
+#include "RendererAPI.h"
+#include "UploadQueue.h"
+
+#include <algorithm>
+
+namespace Engine
+{
+
+	static const uint32_t s_MinSizeClass = 16;
+	static const uint64_t s_PoolTimeout = 120; // frames a buffer can sit in the pool before it is freed
+
+	bool BufferPool::Key::operator==(const Key& other) const
+	{
+		return byteWidth == other.byteWidth && usage == other.usage && bindFlags == other.bindFlags &&
+			cpuAccessFlags == other.cpuAccessFlags && miscFlags == other.miscFlags && structureByteStride == other.structureByteStride;
+	}
+
+	size_t BufferPool::KeyHash::operator()(const Key& key) const
+	{
+		size_t hash = key.byteWidth;
+		hash = hash * 31 + key.usage;
+		hash = hash * 31 + key.bindFlags;
+		hash = hash * 31 + key.cpuAccessFlags;
+		hash = hash * 31 + key.miscFlags;
+		hash = hash * 31 + key.structureByteStride;
+		return hash;
+	}
+
+	wrl::ComPtr<ID3D11Buffer> BufferPool::Acquire(D3D11_BUFFER_DESC& desc, uint32_t elementSize)
+	{
+		elementSize = std::max(elementSize, 1u);
+		desc.ByteWidth = GetSizeClass((desc.ByteWidth + elementSize - 1) / elementSize) * elementSize;
+		Key key = GetKey(desc);
+
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			auto it = m_Free.find(key);
+			if (it != m_Free.end() && !it->second.empty() && it->second.front().releasedFrame + m_FrameLatency <= m_Frame)
+			{
+				wrl::ComPtr<ID3D11Buffer> buffer = it->second.front().buffer;
+				it->second.erase(it->second.begin());
+				m_Statistics.reused++;
+				m_Statistics.pooledBuffers--;
+				m_Statistics.pooledBytes -= desc.ByteWidth;
+				return buffer;
+			}
+		}
+
+		wrl::ComPtr<ID3D11Buffer> buffer;
+		HRESULT hr = RendererAPI::Get().GetDivice()->CreateBuffer(&desc, nullptr, &buffer);
+		if (FAILED(hr))
+		{
+			DBOUT("failed to create buffer " << TranslateError(hr) << std::endl);
+			return nullptr;
+		}
+
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Statistics.created++;
+		return buffer;
+	}
+
+	void BufferPool::Release(wrl::ComPtr<ID3D11Buffer> buffer)
+	{
+		if (buffer == nullptr)
+			return;
+
+		// queued writes were meant for the old owner
+		UploadQueue::Get().Cancel(buffer.Get());
+
+		D3D11_BUFFER_DESC desc;
+		buffer->GetDesc(&desc);
+
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Free[GetKey(desc)].push_back({ buffer, m_Frame });
+		m_Statistics.released++;
+		m_Statistics.pooledBuffers++;
+		m_Statistics.pooledBytes += desc.ByteWidth;
+	}
+
+	void BufferPool::Update()
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Frame++;
+		m_Statistics.created = 0;
+		m_Statistics.reused = 0;
+		m_Statistics.released = 0;
+
+		for (auto it = m_Free.begin(); it != m_Free.end();)
+		{
+			std::vector<Entry>& entries = it->second;
+			auto expired = std::find_if(entries.begin(), entries.end(), [&](const Entry& e) { return m_Frame - e.releasedFrame <= s_PoolTimeout; });
+			m_Statistics.pooledBuffers -= (uint32_t)(expired - entries.begin());
+			m_Statistics.pooledBytes -= (uint64_t)(expired - entries.begin()) * it->first.byteWidth;
+			entries.erase(entries.begin(), expired);
+
+			if (entries.empty())
+				it = m_Free.erase(it);
+			else
+				it++;
+		}
+	}
+
+	BufferPool::Statistics BufferPool::GetStatistics()
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		return m_Statistics;
+	}
+
+	uint32_t BufferPool::GetSizeClass(uint32_t count)
+	{
+		if (count <= s_MinSizeClass)
+			return s_MinSizeClass;
+
+		uint32_t highestBit = 31;
+		while (!(count & (1u << highestBit)))
+			highestBit--;
+		uint32_t step = 1u << (highestBit - 2);
+		return (count + step - 1) & ~(step - 1);
+	}
+
+	BufferPool& BufferPool::Get()
+	{
+		static BufferPool* instance = new BufferPool();
+		return *instance;
+	}
+
+	BufferPool::Key BufferPool::GetKey(const D3D11_BUFFER_DESC& desc)
+	{
+		return { desc.ByteWidth, desc.Usage, desc.BindFlags, desc.CPUAccessFlags, desc.MiscFlags, desc.StructureByteStride };
+	}
+
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include "Platform/Windows/Win.h"
+#include "Core/Core.h"
+
+#include <mutex>
+#include <unordered_map>
+
+namespace Engine
+{
+	// recycles gpu buffers so short lived buffers do not turn into a driver allocation every time
+	// buffers are bucketed by a size class and everything else in the descriptor, a released buffer
+	// can only be handed out again once the frame latency has passed so the gpu is done with it
+	class BufferPool
+	{
+	public:
+		struct Statistics
+		{
+			uint32_t created = 0; // this frame
+			uint32_t reused = 0; // this frame
+			uint32_t released = 0; // this frame
+			uint32_t pooledBuffers = 0;
+			uint64_t pooledBytes = 0;
+		};
+
+	public:
+		void SetFrameLatency(uint32_t frames) { m_FrameLatency = frames; }
+
+		// the ByteWidth is rounded up to a size class of whole elements, desc is updated with the real size
+		// the contents are undefined, nothing is zero filled
+		wrl::ComPtr<ID3D11Buffer> Acquire(D3D11_BUFFER_DESC& desc, uint32_t elementSize);
+		void Release(wrl::ComPtr<ID3D11Buffer> buffer); // safe to call from any thread
+
+		// call once per frame, frees buffers that have not been reused for a while
+		void Update();
+
+		Statistics GetStatistics();
+
+		// rounds up to a quarter of a power of two so no more than a quarter of a buffer is wasted
+		static uint32_t GetSizeClass(uint32_t count);
+
+		static BufferPool& Get();
+
+	private:
+		struct Key
+		{
+			UINT byteWidth;
+			D3D11_USAGE usage;
+			UINT bindFlags;
+			UINT cpuAccessFlags;
+			UINT miscFlags;
+			UINT structureByteStride;
+
+			bool operator==(const Key& other) const;
+		};
+
+		struct KeyHash
+		{
+			size_t operator()(const Key& key) const;
+		};
+
+		struct Entry
+		{
+			wrl::ComPtr<ID3D11Buffer> buffer;
+			uint64_t releasedFrame;
+		};
+
+		static Key GetKey(const D3D11_BUFFER_DESC& desc);
+
+	private:
+		std::mutex m_Mutex;
+		std::unordered_map<Key, std::vector<Entry>, KeyHash> m_Free; // oldest release first
+		uint64_t m_Frame = 0;
+		uint32_t m_FrameLatency = 3;
+		Statistics m_Statistics;
+	};
+}
@@ -0,0 +1,227 @@
+#include "CommandRecorder.h"
+#include "UploadQueue.h"
+#include "Mesh.h"
+#include "Util/Parallel.h"
+
+#include <algorithm>
+#include <chrono>
+
+std::vector<Engine::Scope<Engine::CommandRecorder>> Engine::CommandRecorder::s_Recorders;
+Engine::CommandRecorder::Statistics Engine::CommandRecorder::s_Statistics;
+
+namespace Engine
+{
+
+	// ------------------------------------- Targets ------------------------------------- //
+
+#pragma region Targets
+
+	CommandRecorder::Targets::~Targets()
+	{
+		for (ID3D11RenderTargetView* view : views)
+		{
+			if (view != nullptr)
+				view->Release();
+		}
+		if (depth != nullptr)
+			depth->Release();
+	}
+
+	void CommandRecorder::Targets::Read(ID3D11DeviceContext* context)
+	{
+		// the getters add a reference to every view they return
+		context->OMGetRenderTargets(StateCache::MaxRenderTargets, views, &depth);
+		count = 0;
+		for (uint32_t i = 0; i < StateCache::MaxRenderTargets; i++)
+		{
+			if (views[i] != nullptr)
+				count = i + 1;
+		}
+
+		UINT viewportCount = 1;
+		context->RSGetViewports(&viewportCount, &viewport);
+		hasViewport = viewportCount != 0;
+	}
+
+	void CommandRecorder::Targets::Bind(StateCache& cache) const
+	{
+		cache.SetRenderTargets(count, views, depth);
+		if (hasViewport)
+			cache.SetViewport(viewport);
+	}
+
+#pragma endregion
+
+	// ------------------------------------- End Targets ------------------------------------- //
+
+	// ------------------------------------- CommandRecorder ------------------------------------- //
+
+#pragma region CommandRecorder
+
+	CommandRecorder::CommandRecorder()
+	{
+		HRESULT hr = RendererAPI::Get().GetDivice()->CreateDeferredContext(0, &m_Context);
+		if (FAILED(hr))
+		{
+			DBOUT("failed to create deferred context " << TranslateError(hr) << std::endl);
+			return;
+		}
+
+		m_StateCache.SetContext(m_Context);
+		m_ThreadContext.context = m_Context;
+		m_Context.As(&m_ThreadContext.context1);
+		m_ThreadContext.stateCache = &m_StateCache;
+		m_ThreadContext.constants = &m_Constants;
+	}
+
+	void CommandRecorder::Record(uint32_t count, const std::function<void(uint32_t)>& record)
+	{
+		s_Statistics = Statistics();
+		if (count == 0)
+			return;
+		if (RendererAPI::GetThreadContext() != nullptr)
+		{
+			DBOUT("command lists can not be recorded while recording another one" << std::endl);
+			return;
+		}
+
+		RendererAPI& graphics = RendererAPI::Get();
+		wrl::ComPtr<ID3D11DeviceContext> immediate = graphics.GetImmediateContext();
+
+		while (s_Recorders.size() < count)
+			s_Recorders.push_back(std::make_unique<CommandRecorder>());
+
+		auto start = std::chrono::steady_clock::now();
+		bool deferred = std::all_of(s_Recorders.begin(), s_Recorders.begin() + count, [](const Scope<CommandRecorder>& recorder) {
+			return recorder->m_Context != nullptr;
+		});
+		if (!deferred)
+		{
+			// the frame still gets drawn the same, just on this thread
+			for (uint32_t list = 0; list < count; list++)
+				record(list);
+			s_Statistics.recordMilliseconds = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+			return;
+		}
+
+		// the lists play after everything already on the immediate context, so what it has queued goes first
+		ConstantBufferAllocator::Get().Flush();
+		UploadQueue::Get().FlushHighPriority();
+
+		Targets targets;
+		targets.Read(immediate.Get());
+
+		start = std::chrono::steady_clock::now();
+		Parallel::For(count, [&](uint32_t list) {
+			CommandRecorder& recorder = *s_Recorders[list];
+			recorder.Begin(targets);
+			record(list);
+			recorder.End();
+		});
+		s_Statistics.recordMilliseconds = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		start = std::chrono::steady_clock::now();
+		for (uint32_t list = 0; list < count; list++)
+			s_Recorders[list]->Submit();
+
+		// playing a list without keeping the state clears the immediate context, which is cheaper than saving it for every
+		// list, so the cache forgets everything and only the topology and targets are put back
+		StateCache& cache = graphics.GetStateCache();
+		cache.Invalidate();
+		immediate->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY::D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+		targets.Bind(cache);
+		RendererCommand::ResetBindings();
+
+		s_Statistics.submitMilliseconds = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+		s_Statistics.lists = count;
+	}
+
+	uint32_t CommandRecorder::GetListCount(uint32_t requested)
+	{
+		return RendererAPI::Get().SupportsCommandLists() ? std::max(requested, 1u) : 1;
+	}
+
+	float CommandRecorder::Benchmark(const Ref<Shader>& shader, const Ref<Mesh>& mesh, PropertyID transform, uint32_t draws, uint32_t lists, uint32_t iterations)
+	{
+		// laid out like the per draw constants RenderQueue writes
+		struct DrawConstants
+		{
+			glm::mat4 transform;
+			int32_t textureLayer[4];
+		};
+
+		Shader::BindPointInfo bindPoint = shader->GetBindPoint(transform);
+		float milliseconds = 0.0f;
+		for (uint32_t i = 0; i < iterations; i++)
+		{
+			auto start = std::chrono::steady_clock::now();
+			Record(lists, [&](uint32_t list) {
+				uint32_t first = (uint32_t)((uint64_t)draws * list / lists);
+				uint32_t last = (uint32_t)((uint64_t)draws * (list + 1) / lists);
+				RendererCommand::SetShader(shader);
+				for (uint32_t draw = first; draw < last; draw++)
+				{
+					if (bindPoint.type != 0)
+					{
+						DrawConstants constants = { glm::mat4(1.0f), { -1, 0, 0, 0 } };
+						constants.transform[3].x = (float)draw;
+						RendererCommand::SetConstants(bindPoint, &constants, sizeof(constants));
+					}
+					RendererCommand::DrawMesh(mesh);
+				}
+			});
+			milliseconds += std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+		}
+		return iterations == 0 ? 0.0f : milliseconds / iterations;
+	}
+
+	void CommandRecorder::Begin(const Targets& targets)
+	{
+		RendererAPI::SetThreadContext(&m_ThreadContext);
+
+		// a deferred context starts every list with nothing bound
+		m_StateCache.Invalidate();
+		m_StateCache.ResetStatistics();
+		m_Context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY::D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+		targets.Bind(m_StateCache);
+		m_Constants.BeginFrame(); // the first map in a list has to discard
+
+		// the thread may be the main thread with its own bindings and statistics
+		m_ThreadStatistics = RendererCommand::s_Statistics;
+		RendererCommand::ResetStatistics();
+		RendererCommand::ResetBindings();
+	}
+
+	void CommandRecorder::End()
+	{
+		m_Constants.Flush();
+		m_CommandList = nullptr;
+		HRESULT hr = m_Context->FinishCommandList(FALSE, &m_CommandList);
+		if (FAILED(hr))
+			DBOUT("failed to finish command list " << TranslateError(hr) << std::endl);
+
+		m_Statistics = RendererCommand::s_Statistics;
+		RendererCommand::s_Statistics = m_ThreadStatistics;
+		RendererCommand::ResetBindings();
+
+		RendererAPI::SetThreadContext(nullptr);
+	}
+
+	void CommandRecorder::Submit()
+	{
+		if (m_CommandList == nullptr)
+			return;
+
+		RendererAPI& graphics = RendererAPI::Get();
+		graphics.GetImmediateContext()->ExecuteCommandList(m_CommandList.Get(), FALSE);
+		m_CommandList = nullptr;
+
+		RendererCommand::s_Statistics += m_Statistics;
+		graphics.GetStateCache().AddStatistics(m_StateCache.GetStatistics());
+	}
+
+#pragma endregion
+
+	// ------------------------------------- End CommandRecorder ------------------------------------- //
+
+}
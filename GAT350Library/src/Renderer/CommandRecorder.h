@@ -0,0 +1,84 @@
+#pragma once
+#include "Platform/Windows/Win.h"
+#include "Core/Core.h"
+#include "RendererAPI.h"
+#include "RendererCommand.h"
+#include "StateCache.h"
+#include "ConstantBufferAllocator.h"
+
+#include <functional>
+
+namespace Engine
+{
+	// records the RendererCommand calls made on a thread into a command list on a deferred context of its own
+	// each recorder has its own state cache and constant buffer allocator so recording threads share nothing
+	// a list starts from the render targets and viewport bound on the immediate context when recording began
+	// anything the lists read has to be ready first, parameter blocks and structured buffers uploaded and
+	// shader keywords set, recording threads do not flush the upload queue
+	class CommandRecorder
+	{
+	public:
+		struct Statistics
+		{
+			uint32_t lists = 0; // 0 when there were no deferred contexts and everything was drawn on the immediate context
+			float recordMilliseconds = 0.0f; // all the lists, they are recorded at the same time
+			float submitMilliseconds = 0.0f;
+		};
+
+	public:
+		CommandRecorder();
+
+		// calls record(list) for every list in [0, count) spread over the threads, the RendererCommand calls made
+		// go into that list, then the lists are played on the immediate context in list order so the frame does not
+		// depend on which thread recorded what, the immediate context keeps its targets but everything else has to be set again
+		// if a deferred context could not be made the lists are recorded one after another on the immediate context
+		static void Record(uint32_t count, const std::function<void(uint32_t)>& record);
+
+		// how many lists to split work over, one if the driver does not do command lists itself as the runtime's
+		// emulation is slower to play back than drawing straight on the immediate context
+		static uint32_t GetListCount(uint32_t requested);
+
+		// records draws of the mesh split over lists and returns the milliseconds recording and submitting took
+		// transform is the shader's per draw constant buffer, it gets a different matrix for every draw
+		static float Benchmark(const Ref<Shader>& shader, const Ref<Mesh>& mesh, PropertyID transform, uint32_t draws, uint32_t lists, uint32_t iterations);
+
+		// of the last Record
+		static const Statistics& GetStatistics() { return s_Statistics; }
+
+	private:
+		// the render targets and viewport bound on the immediate context, the references are released with it
+		struct Targets
+		{
+			ID3D11RenderTargetView* views[StateCache::MaxRenderTargets] = {};
+			ID3D11DepthStencilView* depth = nullptr;
+			uint32_t count = 0;
+			D3D11_VIEWPORT viewport = {};
+			bool hasViewport = false;
+
+			Targets() = default;
+			Targets(const Targets&) = delete;
+			Targets& operator=(const Targets&) = delete;
+			~Targets();
+
+			void Read(ID3D11DeviceContext* context);
+			void Bind(StateCache& cache) const;
+		};
+
+		void Begin(const Targets& targets);
+		void End();
+		void Submit();
+
+	private:
+		wrl::ComPtr<ID3D11DeviceContext> m_Context;
+		wrl::ComPtr<ID3D11CommandList> m_CommandList;
+		StateCache m_StateCache;
+		ConstantBufferAllocator m_Constants;
+		RendererAPI::ThreadContext m_ThreadContext;
+
+		RendererCommand::Statistics m_Statistics; // of the recorded list, added to the main thread's when it is submitted
+		RendererCommand::Statistics m_ThreadStatistics; // the recording thread's own, put back at End
+
+		static std::vector<Scope<CommandRecorder>> s_Recorders; // reused by every Record
+		static Statistics s_Statistics;
+	};
+}
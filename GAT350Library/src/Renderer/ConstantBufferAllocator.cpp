@@ -0,0 +1,113 @@
+#include "ConstantBufferAllocator.h"
+#include "RendererAPI.h"
+
+namespace Engine
+{
+
+	ConstantBufferAllocator::Slice ConstantBufferAllocator::Allocate(uint32_t size)
+	{
+		Slice slice;
+		if (size == 0 || size > s_MaxSliceSize)
+		{
+			DBOUT("constant buffer slice of " << size << " bytes is not allowed" << std::endl);
+			return slice;
+		}
+		if (!IsSupported())
+			return slice;
+
+		uint32_t alignedSize = (size + s_Alignment - 1) & ~(s_Alignment - 1);
+		if (m_Offset + alignedSize > s_Capacity)
+		{
+			// discarding would also throw away slices that were handed out but not drawn yet, so move on to the next buffer
+			Flush();
+			m_Current++;
+			m_Offset = 0;
+			m_Discard = true;
+			m_Statistics.wraps++;
+		}
+
+		if (m_Mapped == nullptr && !Map(m_Discard ? D3D11_MAP_WRITE_DISCARD : D3D11_MAP_WRITE_NO_OVERWRITE))
+			return slice;
+		m_Discard = false;
+
+		slice.buffer = m_Buffers[m_Current].Get();
+		slice.firstConstant = m_Offset / 16;
+		slice.constantCount = alignedSize / 16;
+		slice.data = m_Mapped + m_Offset;
+		m_Offset += alignedSize;
+
+		m_Statistics.allocations++;
+		m_Statistics.bytes += size;
+		return slice;
+	}
+
+	void ConstantBufferAllocator::Flush()
+	{
+		if (m_Mapped == nullptr)
+			return;
+
+		RendererAPI::Get().GetContext()->Unmap(m_Buffers[m_Current].Get(), 0);
+		m_Mapped = nullptr;
+	}
+
+	void ConstantBufferAllocator::BeginFrame()
+	{
+		Flush();
+		m_Current = 0;
+		m_Offset = 0;
+		m_Discard = true;
+		m_Statistics = Statistics();
+	}
+
+	bool ConstantBufferAllocator::IsSupported()
+	{
+		return RendererAPI::Get().SupportsConstantBufferOffsets();
+	}
+
+	ConstantBufferAllocator& ConstantBufferAllocator::Get()
+	{
+		RendererAPI::ThreadContext* context = RendererAPI::GetThreadContext();
+		if (context != nullptr && context->constants != nullptr)
+			return *context->constants;
+
+		static ConstantBufferAllocator* instance = new ConstantBufferAllocator();
+		return *instance;
+	}
+
+	bool ConstantBufferAllocator::Map(D3D11_MAP mapType)
+	{
+		RendererAPI& graphics = RendererAPI::Get();
+		if (m_Current == m_Buffers.size())
+		{
+			D3D11_BUFFER_DESC bufferDesc = {};
+			bufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+			bufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+			bufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+			bufferDesc.MiscFlags = 0u;
+			bufferDesc.ByteWidth = s_Capacity;
+
+			wrl::ComPtr<ID3D11Buffer> buffer;
+			HRESULT hr = graphics.GetDivice()->CreateBuffer(&bufferDesc, nullptr, &buffer);
+			if (FAILED(hr))
+			{
+				DBOUT("failed to create constant buffer allocator " << TranslateError(hr) << std::endl);
+				return false;
+			}
+			m_Buffers.push_back(buffer);
+			mapType = D3D11_MAP_WRITE_DISCARD;
+		}
+
+		D3D11_MAPPED_SUBRESOURCE msub = {};
+		HRESULT hr = graphics.GetContext()->Map(m_Buffers[m_Current].Get(), 0, mapType, 0, &msub);
+		if (FAILED(hr))
+		{
+			DBOUT("failed to map constant buffer allocator " << TranslateError(hr) << std::endl);
+			return false;
+		}
+
+		m_Mapped = (uint8_t*)msub.pData;
+		m_Statistics.maps++;
+		return true;
+	}
+
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include "Platform/Windows/Win.h"
+#include "Core/Core.h"
+
+#include <vector>
+
+namespace Engine
+{
+	// hands out slices of big dynamic constant buffers that are bound by offset, for constants that change every draw
+	// the buffer stays mapped while slices are handed out and is unmapped before the next draw, the first map
+	// of a frame discards and the rest write without overwrite so a map never waits on the gpu
+	// a buffer is never discarded inside a frame as slices in it may not be drawn yet, when it fills up the next one is used
+	// each command recorder has its own as a deferred context has to discard the first time it maps a buffer
+	class ConstantBufferAllocator
+	{
+	public:
+		struct Slice
+		{
+			ID3D11Buffer* buffer = nullptr;
+			UINT firstConstant = 0; // in 16 byte constants, what *SetConstantBuffers1 wants
+			UINT constantCount = 0;
+			void* data = nullptr; // only valid until Flush
+
+			bool IsValid() const { return buffer != nullptr; }
+		};
+
+		struct Statistics
+		{
+			uint32_t allocations = 0;
+			uint32_t maps = 0;
+			uint32_t wraps = 0; // times a buffer filled up inside a frame and the next one was used
+			uint64_t bytes = 0;
+		};
+
+	public:
+		ConstantBufferAllocator() = default;
+
+		// size is in bytes and at most 64KB, the slice is rounded up to 256 bytes
+		Slice Allocate(uint32_t size);
+		// unmaps the buffer, call before anything that reads the slices is drawn
+		// slices handed out together before a flush cost one map, so a run of draws can write all its constants first
+		void Flush();
+		void BeginFrame();
+
+		bool IsSupported();
+		const Statistics& GetStatistics() const { return m_Statistics; }
+
+		// the recording thread's allocator while it is recording, the immediate context's otherwise
+		static ConstantBufferAllocator& Get();
+
+	private:
+		bool Map(D3D11_MAP mapType);
+
+	private:
+		static constexpr uint32_t s_Alignment = 256; // offsets have to be multiples of 16 constants
+		static constexpr uint32_t s_MaxSliceSize = 4096 * 16;
+		static constexpr uint32_t s_Capacity = 4 * 1024 * 1024;
+
+		std::vector<wrl::ComPtr<ID3D11Buffer>> m_Buffers; // as many as the busiest frame filled
+		uint32_t m_Current = 0;
+		uint8_t* m_Mapped = nullptr;
+		uint32_t m_Offset = 0;
+		bool m_Discard = true;
+		Statistics m_Statistics;
+	};
+}
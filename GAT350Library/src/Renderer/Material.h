@@ -13,6 +13,20 @@ namespace Engine
 		Ref<Texture2D> m_Metal;
 		Ref<Texture2D> m_AO;
 
+		// set when the material was grouped into texture arrays at import, the textures above are then nullptr
+		// the textures of the material live in m_Layer of each array, RenderQueue puts the layer in the per draw constants
+		struct TextureArrays
+		{
+			Ref<Texture2DArray> m_Diffuse;
+			Ref<Texture2DArray> m_Normal;
+			Ref<Texture2DArray> m_Roughness;
+			Ref<Texture2DArray> m_Metal;
+			Ref<Texture2DArray> m_AO;
+		} m_Arrays;
+		uint32_t m_Layer = 0;
+
+		bool UsesTextureArrays() const { return m_Arrays.m_Diffuse || m_Arrays.m_Normal || m_Arrays.m_Roughness || m_Arrays.m_Metal || m_Arrays.m_AO; }
+
 		static Ref<Material> Create() {
 			return std::make_shared<Material>();
 		}
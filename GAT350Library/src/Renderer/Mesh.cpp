@@ -1,31 +1,133 @@
 #include "Mesh.h"
 
+#include <string.h>
+
 namespace Engine
 {
 
+	struct NormalVertex
+	{
+		glm::vec3 Normal;
+		glm::vec3 Tangent;
+	};
+
 	Mesh::Mesh(Vertex* vertices, uint32_t vertCount, uint32_t* indeces, uint32_t indexCount)
 	{
 		SetData(vertices, vertCount, indeces, indexCount);
 	}
 
+	Mesh::~Mesh()
+	{
+		GetVertexHeap().Free(m_Vertices);
+		GetIndexHeap().Free(m_Indices);
+	}
+
 	void Mesh::UpdateVertexBuffer(Vertex* vertices, uint32_t count)
 	{
-		vb->SetData(vertices, count * sizeof(Vertex));
+		// only move to a new range if the old one is too small
+		if (count > GetVertexHeap().GetSize(m_Vertices))
+		{
+			GetVertexHeap().Free(m_Vertices);
+			m_Vertices = GetVertexHeap().Allocate(count);
+			m_Layout = GetStandardLayout(); // the extra data stayed in the old range
+		}
+		UploadVertices(vertices, count);
+		m_VertexCount = count;
 	}
 
 	void Mesh::UpdateIndexBuffer(uint32_t* indeces, uint32_t count)
 	{
-		ib->SetData(indeces, count);
+		if (count > GetIndexHeap().GetSize(m_Indices))
+		{
+			GetIndexHeap().Free(m_Indices);
+			m_Indices = GetIndexHeap().Allocate(count);
+		}
+		GetIndexHeap().Upload(m_Indices, indeces, count);
+		m_IndexCount = count;
 	}
 
 	void Mesh::SetData(Vertex* vertices, uint32_t vertCount, uint32_t* indeces, uint32_t indexCount)
 	{
-		vb = VertexBuffer::Create(vertices, sizeof(Vertex), vertCount);
-		ib = IndexBuffer::Create(indeces, indexCount);
+		GetVertexHeap().Free(m_Vertices);
+		GetIndexHeap().Free(m_Indices);
+
+		m_Vertices = GetVertexHeap().Allocate(vertCount);
+		m_Indices = GetIndexHeap().Allocate(indexCount);
+		m_Layout = GetStandardLayout();
+		UploadVertices(vertices, vertCount);
+		GetIndexHeap().Upload(m_Indices, indeces, indexCount);
+		m_VertexCount = vertCount;
+		m_IndexCount = indexCount;
+	}
+
+	void Mesh::SetExtraData(const VertexElement& element, const void* data, uint32_t count)
+	{
+		uint32_t size = ShaderDataTypeSize(element.type);
+		if (size == 0 || size > ExtraStride)
+		{
+			DBOUT("extra vertex data has to be 1 to " << ExtraStride << " bytes a vertex" << std::endl);
+			return;
+		}
+		if (count > GetVertexHeap().GetSize(m_Vertices))
+		{
+			DBOUT("setting extra data for " << count << " vertices on a mesh with " << GetVertexHeap().GetSize(m_Vertices) << std::endl);
+			return;
+		}
+
+		// the stream has a fixed stride so every mesh in a heap page can share one buffer
+		std::vector<uint8_t> padded((size_t)count * ExtraStride, 0);
+		for (uint32_t i = 0; i < count; i++)
+			memcpy(padded.data() + (size_t)i * ExtraStride, (const uint8_t*)data + (size_t)i * size, size);
+		GetVertexHeap().Upload(m_Vertices, padded.data(), count, 0, ExtraStream);
+
+		VertexElement extra = element;
+		m_Layout = std::make_shared<VertexLayout>(*GetStandardLayout());
+		m_Layout->AddStream({ extra });
+	}
+
+	void Mesh::UploadVertices(const Vertex* vertices, uint32_t count)
+	{
+		std::vector<glm::vec4> positions(count);
+		std::vector<NormalVertex> normals(count);
+		std::vector<glm::vec2> uvs(count);
+		for (uint32_t i = 0; i < count; i++)
+		{
+			positions[i] = vertices[i].Position;
+			normals[i] = { vertices[i].Normal, vertices[i].Tangent };
+			uvs[i] = vertices[i].UV;
+		}
+
+		BufferHeap& heap = GetVertexHeap();
+		heap.Upload(m_Vertices, positions.data(), count, 0, PositionStream);
+		heap.Upload(m_Vertices, normals.data(), count, 0, NormalStream);
+		heap.Upload(m_Vertices, uvs.data(), count, 0, UVStream);
 	}
 
 	Ref<Mesh> Mesh::Create(Vertex* vertices, uint32_t vertCount, uint32_t* indeces, uint32_t indexCount)
 	{
 		return std::make_shared<Mesh>(vertices, vertCount, indeces, indexCount);
 	}
-}
\ No newline at end of file
+
+	BufferHeap& Mesh::GetVertexHeap()
+	{
+		// 256k vertices is 12MB a page, plus 4MB for the extra stream in pages where a mesh has extra data
+		static BufferHeap* heap = new BufferHeap(D3D11_BIND_VERTEX_BUFFER, { sizeof(glm::vec4), sizeof(NormalVertex), sizeof(glm::vec2), ExtraStride }, 1 << 18);
+		return *heap;
+	}
+
+	BufferHeap& Mesh::GetIndexHeap()
+	{
+		static BufferHeap* heap = new BufferHeap(D3D11_BIND_INDEX_BUFFER, sizeof(uint32_t), 1 << 20);
+		return *heap;
+	}
+
+	const Ref<VertexLayout>& Mesh::GetStandardLayout()
+	{
+		static Ref<VertexLayout> layout = std::make_shared<VertexLayout>(VertexLayout{
+			{ { "POSITION", ShaderDataType::Float4 } },
+			{ { "NORMAL", ShaderDataType::Float3 }, { "TANGENT", ShaderDataType::Float3 } },
+			{ { "UV", ShaderDataType::Float2 } },
+		});
+		return layout;
+	}
+}
@@ -1,6 +1,7 @@
 #pragma once
 #include "Core/Core.h"
 #include "Buffer.h"
+#include "BufferHeap.h"
 #include "Material.h"
 
 #include <glm/glm.hpp>
@@ -10,9 +11,12 @@
 namespace Engine
 {
 
+	// mesh data lives in the shared vertex and index heaps, the mesh only keeps where it was placed
+	// the vertices are split into streams so a pass that only reads positions only fetches positions
 	class Mesh
 	{
 	public:
+		// how meshes are built, it is split into the streams when it is uploaded
 		struct Vertex {
 			glm::vec4 Position;
 			glm::vec3 Normal;
@@ -20,23 +24,54 @@ namespace Engine
 			glm::vec2 UV;
 		};
 
+		enum Stream : uint32_t
+		{
+			PositionStream,	// POSITION
+			NormalStream,	// NORMAL, TANGENT
+			UVStream,		// UV
+			ExtraStream,	// optional, set with SetExtraData
+			StreamCount
+		};
+
+		static constexpr uint32_t ExtraStride = 16;
+
 		Mesh(Vertex* vertices, uint32_t vertCount, uint32_t* indeces, uint32_t indexCount);
+		Mesh(const Mesh&) = delete;
+		~Mesh();
 
 		void UpdateVertexBuffer(Vertex* vertices, uint32_t count);
 		void UpdateIndexBuffer(uint32_t* indeces, uint32_t count);
 
 		void SetData(Vertex* vertices, uint32_t vertCount, uint32_t* indeces, uint32_t indexCount);
 
-		Ref<VertexBuffer> GetVertexBuffer() { return vb; };
-		Ref<IndexBuffer> GetIndexBuffer() { return ib; };
+		// one attribute of up to 16 bytes a vertex the standard streams do not have, like a vertex color
+		// data has count tightly packed elements, it has to be set again if the vertices move to a bigger range
+		void SetExtraData(const VertexElement& element, const void* data, uint32_t count);
+
+		const VertexLayout& GetLayout() const { return *m_Layout; }
+		wrl::ComPtr<ID3D11Buffer> GetVertexBuffer(uint32_t stream = PositionStream) { return GetVertexHeap().GetBuffer(m_Vertices, stream); }
+		wrl::ComPtr<ID3D11Buffer> GetIndexBuffer() { return GetIndexHeap().GetBuffer(m_Indices); }
+		uint32_t GetBaseVertex() const { return GetVertexHeap().GetOffset(m_Vertices); }
+		uint32_t GetStartIndex() const { return GetIndexHeap().GetOffset(m_Indices); }
+		uint32_t GetVertexCount() const { return m_VertexCount; }
+		uint32_t GetIndexCount() const { return m_IndexCount; }
 
 		static Ref<Mesh> Create(Vertex* vertices, uint32_t vertCount, uint32_t* indeces, uint32_t indexCount);
 
+		static BufferHeap& GetVertexHeap();
+		static BufferHeap& GetIndexHeap();
+		static const Ref<VertexLayout>& GetStandardLayout(); // position, normal and tangent, uv
+
+	private:
+		void UploadVertices(const Vertex* vertices, uint32_t count);
 
 	private:
-		Ref<VertexBuffer> vb;
-		Ref<IndexBuffer> ib;
+		BufferHeap::Allocation m_Vertices;
+		BufferHeap::Allocation m_Indices;
+		uint32_t m_VertexCount = 0;
+		uint32_t m_IndexCount = 0;
+		Ref<VertexLayout> m_Layout = GetStandardLayout();
 		
 		static const std::string& s_TexturesFolder;
 	};
-}
\ No newline at end of file
+}
@@ -5,9 +5,31 @@
 #include <assimp/material.h>
 #include <assimp/scene.h>
 
+#include "Core/AsyncFileReader.h"
+#include "stb_image.h"
+#include <array>
+#include <map>
+#include <tuple>
+
 namespace Engine
 {
 
+	struct MaterialSlot
+	{
+		aiTextureType type;
+		Ref<Texture2D> Material::* texture;
+		Ref<Texture2DArray> Material::TextureArrays::* array;
+	};
+
+	static const MaterialSlot s_MaterialSlots[] = {
+		{ aiTextureType_DIFFUSE,			&Material::m_Diffuse,	&Material::TextureArrays::m_Diffuse },
+		{ aiTextureType_NORMALS,			&Material::m_Normal,	&Material::TextureArrays::m_Normal },
+		{ aiTextureType_METALNESS,			&Material::m_Metal,		&Material::TextureArrays::m_Metal },
+		{ aiTextureType_DIFFUSE_ROUGHNESS,	&Material::m_Roughness,	&Material::TextureArrays::m_Roughness },
+		{ aiTextureType_AMBIENT_OCCLUSION,	&Material::m_AO,		&Material::TextureArrays::m_AO },
+	};
+	static constexpr uint32_t s_MaterialSlotCount = (uint32_t)_countof(s_MaterialSlots);
+
 	glm::vec2 GetUVCoords(aiMesh* mesh, uint32_t index)
 	{
 		if (mesh->mTextureCoords[0] == nullptr)
@@ -24,14 +46,15 @@ namespace Engine
 		return { color.r, color.g, color.b, color.a };
 	}
 
-	Model::Model(const fs::path& path)
+	Model::Model(const fs::path& path, const ModelLoadOptions& options)
 	{
-		LoadFromFile(path);
+		LoadFromFile(path, options);
 	}
 
-	void Model::LoadFromFile(const fs::path& path)
+	void Model::LoadFromFile(const fs::path& path, const ModelLoadOptions& options)
 	{
 		m_Nodes.clear();
+		m_Atlas = nullptr;
 		fs::path folder = path.parent_path();
 
 		// load mesh data from the file
@@ -51,32 +74,18 @@ namespace Engine
 			return;
 		}
 
-		// Generate all materials
-		std::vector<Ref<Material>> materials;
-		materials.reserve(model->mNumMaterials);
+		// start reading every texture now so the files come in while the meshes are built and the textures decoded
+		std::vector<fs::path> texturePaths;
 		for (uint32_t i = 0; i < model->mNumMaterials; i++)
 		{
-			Ref<Material> mat = std::make_shared<Material>();
-			auto& material = *model->mMaterials[i];
-
 			aiString fileName;
-			if (material.GetTexture(aiTextureType_DIFFUSE, 0, &fileName) == aiReturn_SUCCESS)
-				mat->m_Diffuse = Texture2D::Create(folder / fileName.C_Str());
-
-			if (material.GetTexture(aiTextureType_NORMALS, 0, &fileName) == aiReturn_SUCCESS)
-				mat->m_Normal = Texture2D::Create(folder / fileName.C_Str());
-
-			if (material.GetTexture(aiTextureType_METALNESS, 0, &fileName) == aiReturn_SUCCESS)
-				mat->m_Metal = Texture2D::Create(folder / fileName.C_Str());
-
-			if (material.GetTexture(aiTextureType_DIFFUSE_ROUGHNESS, 0, &fileName) == aiReturn_SUCCESS)
-				mat->m_Roughness = Texture2D::Create(folder / fileName.C_Str());
-
-			if (material.GetTexture(aiTextureType_AMBIENT_OCCLUSION, 0, &fileName) == aiReturn_SUCCESS)
-				mat->m_AO = Texture2D::Create(folder / fileName.C_Str());
-
-			materials.push_back(mat);
+			for (const MaterialSlot& slot : s_MaterialSlots)
+			{
+				if (model->mMaterials[i]->GetTexture(slot.type, 0, &fileName) == aiReturn_SUCCESS)
+					texturePaths.push_back(folder / fileName.C_Str());
+			}
 		}
+		std::vector<AsyncFileReader::Handle> textureFiles = AsyncFileReader::Get().ReadBatch(texturePaths);
 
 		// Generate all the meshes
 		std::vector<MeshBuilder> meshBuilders;
@@ -114,11 +123,278 @@ namespace Engine
 			);
 		}
 
+		// Generate all materials
+		std::vector<Ref<Material>> materials(model->mNumMaterials);
+		if (options.packAtlas)
+			PackMaterialAtlas(model, folder, options, meshBuilders, materials);
+		if (options.groupTextureArrays)
+			GroupMaterialTextureArrays(model, folder, options, materials);
+
+		for (uint32_t i = 0; i < model->mNumMaterials; i++)
+		{
+			if (materials[i] != nullptr)
+				continue; // already loaded from the atlas or texture arrays
+
+			Ref<Material> mat = std::make_shared<Material>();
+			auto& material = *model->mMaterials[i];
+
+			aiString fileName;
+			for (const MaterialSlot& slot : s_MaterialSlots)
+			{
+				if (material.GetTexture(slot.type, 0, &fileName) == aiReturn_SUCCESS)
+					(*mat).*slot.texture = Texture2D::Create(folder / fileName.C_Str());
+			}
+
+			materials[i] = mat;
+		}
+
 		// Generate Node tree
 		LoadNodeData(model, model->mRootNode, meshBuilders, materials, glm::identity<glm::mat4>());
 	}
 
 
+	void Model::PackMaterialAtlas(const aiScene* model, const fs::path& folder, const ModelLoadOptions& options, std::vector<MeshBuilder>& meshBuilders, std::vector<Ref<Material>>& materials)
+	{
+		// uvs that wrap would sample the neighboring images so only materials whose meshes stay inside the texture can be packed
+		const float epsilon = 0.001f;
+		std::vector<bool> uvsInRange(model->mNumMaterials, true);
+		for (uint32_t i = 0; i < model->mNumMeshes; i++)
+		{
+			uint32_t materialIndex = model->mMeshes[i]->mMaterialIndex;
+			for (const Mesh::Vertex& vertex : meshBuilders[i].m_Vertices)
+			{
+				if (glm::any(glm::lessThan(vertex.UV, glm::vec2(-epsilon))) || glm::any(glm::greaterThan(vertex.UV, glm::vec2(1.0f + epsilon))))
+				{
+					uvsInRange[materialIndex] = false;
+					break;
+				}
+			}
+		}
+
+		TextureAtlas::Desc desc = options.atlasDesc;
+		desc.layers = s_MaterialSlotCount;
+		m_Atlas = TextureAtlas::Create(desc);
+
+		// materials that use the exact same set of textures share one region
+		std::unordered_map<std::string, uint32_t> regions;
+		std::vector<uint32_t> materialRegions(model->mNumMaterials, UINT32_MAX);
+		std::vector<uint32_t> materialSlotMasks(model->mNumMaterials, 0);
+
+		for (uint32_t i = 0; i < model->mNumMaterials; i++)
+		{
+			if (!uvsInRange[i])
+				continue;
+
+			auto& material = *model->mMaterials[i];
+
+			std::array<fs::path, s_MaterialSlotCount> paths;
+			std::string key;
+			uint32_t slotMask = 0;
+			for (uint32_t s = 0; s < s_MaterialSlotCount; s++)
+			{
+				aiString fileName;
+				if (material.GetTexture(s_MaterialSlots[s].type, 0, &fileName) == aiReturn_SUCCESS)
+				{
+					paths[s] = folder / fileName.C_Str();
+					slotMask |= BIT(s);
+				}
+				key += paths[s].string() + '|';
+			}
+
+			if (slotMask == 0)
+				continue;
+
+			auto it = regions.find(key);
+			if (it != regions.end())
+			{
+				materialRegions[i] = it->second;
+				materialSlotMasks[i] = slotMask;
+				continue;
+			}
+
+			// every slot has to be small and the same size to share a region
+			std::array<stbi_uc*, s_MaterialSlotCount> images = {};
+			int width = -1, height = -1;
+			bool packable = true;
+			for (uint32_t s = 0; s < s_MaterialSlotCount && packable; s++)
+			{
+				if (!(slotMask & BIT(s)))
+					continue;
+
+				int w, h, channels;
+				AsyncFileReader::Handle file = AsyncFileReader::Get().Read(paths[s], AsyncFileReader::Priority::High);
+				const std::vector<uint8_t>& buffer = file.Wait();
+				images[s] = stbi_load_from_memory(buffer.data(), (int)buffer.size(), &w, &h, &channels, 4);
+				if (images[s] == nullptr)
+					packable = false;
+				else if (width == -1)
+				{
+					width = w;
+					height = h;
+					packable = (uint32_t)w <= options.atlasMaxTextureSize && (uint32_t)h <= options.atlasMaxTextureSize;
+				}
+				else
+					packable = (w == width && h == height);
+			}
+
+			if (packable)
+			{
+				std::vector<const uint8_t*> layers(images.begin(), images.end());
+				uint32_t region = m_Atlas->AddImage((uint32_t)width, (uint32_t)height, layers);
+				regions[key] = region;
+				materialRegions[i] = region;
+				materialSlotMasks[i] = slotMask;
+			}
+
+			for (stbi_uc* image : images)
+			{
+				if (image != nullptr)
+					stbi_image_free(image);
+			}
+		}
+
+		if (m_Atlas->GetImageCount() == 0)
+		{
+			m_Atlas = nullptr;
+			return;
+		}
+
+		m_Atlas->Build();
+
+		// point the materials at the atlas pages
+		for (uint32_t i = 0; i < model->mNumMaterials; i++)
+		{
+			uint32_t region = materialRegions[i];
+			if (region == UINT32_MAX || !m_Atlas->IsPacked(region))
+				continue;
+
+			Ref<Material> mat = std::make_shared<Material>();
+			uint32_t page = m_Atlas->GetRegion(region).page;
+			for (uint32_t s = 0; s < s_MaterialSlotCount; s++)
+			{
+				if (materialSlotMasks[i] & BIT(s))
+					(*mat).*s_MaterialSlots[s].texture = m_Atlas->GetPage(page, s);
+			}
+			materials[i] = mat;
+		}
+
+		// move the uvs into the region of the material
+		for (uint32_t i = 0; i < model->mNumMeshes; i++)
+		{
+			uint32_t region = materialRegions[model->mMeshes[i]->mMaterialIndex];
+			if (region == UINT32_MAX || !m_Atlas->IsPacked(region))
+				continue;
+
+			for (Mesh::Vertex& vertex : meshBuilders[i].m_Vertices)
+				vertex.UV = m_Atlas->RemapUV(region, glm::clamp(vertex.UV, glm::vec2(0.0f), glm::vec2(1.0f)));
+		}
+
+		DBOUT("texture atlas: " << m_Atlas->GetImageCount() << " images in " << m_Atlas->GetPageCount() << " pages, " << (m_Atlas->GetOccupancy() * 100.0f) << "% occupied" << std::endl);
+	}
+
+	void Model::GroupMaterialTextureArrays(const aiScene* model, const fs::path& folder, const ModelLoadOptions& options, std::vector<Ref<Material>>& materials)
+	{
+		struct ArrayGroup
+		{
+			std::vector<std::array<fs::path, s_MaterialSlotCount>> layers;
+			std::unordered_map<std::string, uint32_t> layerIndices; // materials with the same textures share a layer
+			std::vector<std::pair<uint32_t, uint32_t>> materials; // material index, layer
+		};
+
+		// materials can share arrays if they have the same slots and every texture is the same size
+		// all images are loaded as RGBA8 so the format always matches
+		std::map<std::tuple<uint32_t, uint32_t, uint32_t>, ArrayGroup> groups; // width, height, slot mask
+		for (uint32_t i = 0; i < model->mNumMaterials; i++)
+		{
+			if (materials[i] != nullptr)
+				continue;
+
+			auto& material = *model->mMaterials[i];
+
+			std::array<fs::path, s_MaterialSlotCount> paths;
+			std::string key;
+			uint32_t slotMask = 0;
+			int width = -1, height = -1;
+			bool groupable = true;
+			for (uint32_t s = 0; s < s_MaterialSlotCount && groupable; s++)
+			{
+				aiString fileName;
+				if (material.GetTexture(s_MaterialSlots[s].type, 0, &fileName) != aiReturn_SUCCESS)
+					continue;
+
+				paths[s] = folder / fileName.C_Str();
+				slotMask |= BIT(s);
+				key += paths[s].string() + '|';
+
+				// only read the header, the pixels get loaded once the arrays are created
+				int w, h, channels;
+				if (!stbi_info(paths[s].string().c_str(), &w, &h, &channels))
+					groupable = false;
+				else if (width == -1)
+				{
+					width = w;
+					height = h;
+				}
+				else
+					groupable = (w == width && h == height);
+			}
+
+			if (!groupable || slotMask == 0)
+				continue;
+
+			ArrayGroup& group = groups[{ (uint32_t)width, (uint32_t)height, slotMask }];
+			auto it = group.layerIndices.find(key);
+			uint32_t layer;
+			if (it != group.layerIndices.end())
+				layer = it->second;
+			else
+			{
+				layer = (uint32_t)group.layers.size();
+				if (layer >= D3D11_REQ_TEXTURE2D_ARRAY_AXIS_DIMENSION)
+					continue; // the group is full so this material keeps its own textures
+				group.layers.push_back(paths);
+				group.layerIndices[key] = layer;
+			}
+			group.materials.push_back({ i, layer });
+		}
+
+		uint32_t arrayCount = 0, groupedMaterials = 0;
+		for (auto& [groupKey, group] : groups)
+		{
+			if (group.layers.size() < options.minArrayLayers)
+				continue;
+
+			uint32_t slotMask = std::get<2>(groupKey);
+
+			// one array per slot, the layers line up across all of them
+			Material::TextureArrays arrays;
+			for (uint32_t s = 0; s < s_MaterialSlotCount; s++)
+			{
+				if (!(slotMask & BIT(s)))
+					continue;
+
+				std::vector<fs::path> slotPaths;
+				slotPaths.reserve(group.layers.size());
+				for (const auto& layerPaths : group.layers)
+					slotPaths.push_back(layerPaths[s]);
+
+				arrays.*s_MaterialSlots[s].array = Texture2DArray::Create(slotPaths);
+				arrayCount++;
+			}
+
+			for (auto [materialIndex, layer] : group.materials)
+			{
+				Ref<Material> mat = std::make_shared<Material>();
+				mat->m_Arrays = arrays;
+				mat->m_Layer = layer;
+				materials[materialIndex] = mat;
+				groupedMaterials++;
+			}
+		}
+
+		DBOUT("texture arrays: " << groupedMaterials << " materials grouped into " << arrayCount << " arrays" << std::endl);
+	}
+
 	void Model::LoadNodeData(const aiScene* model, aiNode* node, std::vector<MeshBuilder>& meshBuilders, std::vector<Ref<Material>>& materials, glm::mat4 transform)
 	{
 
@@ -141,9 +417,9 @@ namespace Engine
 
 	}
 
-	Ref<Model> Model::Create(const fs::path& path)
+	Ref<Model> Model::Create(const fs::path& path, const ModelLoadOptions& options)
 	{
-		return std::make_shared<Model>(path);
+		return std::make_shared<Model>(path, options);
 	}
 }
 
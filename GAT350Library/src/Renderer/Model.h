@@ -4,6 +4,7 @@
 #include "Mesh.h"
 #include "Texture.h"
 #include "Material.h"
+#include "TextureAtlas.h"
 #include <vector>
 #include <unordered_map>
 
@@ -12,6 +13,19 @@ struct aiNode;
 
 namespace Engine
 {
+	struct ModelLoadOptions
+	{
+		// pack small material textures into shared atlas pages and remap the mesh uvs
+		bool packAtlas = false;
+		uint32_t atlasMaxTextureSize = 512; // textures bigger than this keep their own texture
+		TextureAtlas::Desc atlasDesc;
+
+		// group same size material textures into texture arrays and give each material a layer
+		// materials that were packed into the atlas are not grouped
+		bool groupTextureArrays = false;
+		uint32_t minArrayLayers = 2; // smaller groups keep their own textures
+	};
+
 	class Model
 	{
 	public:
@@ -21,22 +35,27 @@ namespace Engine
 			Ref<Material> m_Material;
 		};
 
-		Model(const fs::path& path);
+		Model(const fs::path& path, const ModelLoadOptions& options = ModelLoadOptions());
 
 		size_t GetNumberOfNodes() const { return m_Nodes.size(); }
 		Node& GetNode(uint32_t i) { return m_Nodes[i]; }
 
 		const std::vector<Node> GetNodes() { return m_Nodes; }
 
-		void LoadFromFile(const fs::path& path);
+		Ref<TextureAtlas> GetAtlas() { return m_Atlas; }
+
+		void LoadFromFile(const fs::path& path, const ModelLoadOptions& options = ModelLoadOptions());
 
-		static Ref<Model> Create(const fs::path& path);
+		static Ref<Model> Create(const fs::path& path, const ModelLoadOptions& options = ModelLoadOptions());
 
 	private:
 
+		void PackMaterialAtlas(const aiScene* model, const fs::path& folder, const ModelLoadOptions& options, std::vector<MeshBuilder>& meshBuilders, std::vector<Ref<Material>>& materials);
+		void GroupMaterialTextureArrays(const aiScene* model, const fs::path& folder, const ModelLoadOptions& options, std::vector<Ref<Material>>& materials);
 		void LoadNodeData(const aiScene* model, aiNode* node, std::vector<MeshBuilder>& meshBuilders, std::vector<Ref<Material>>& materials, glm::mat4 transform);
 
 	private:
 		std::vector<Node> m_Nodes;
+		Ref<TextureAtlas> m_Atlas;
 	};
 }
\ No newline at end of file
@@ -0,0 +1,83 @@
+#include "ParameterBlock.h"
+#include "Shader.h"
+#include "Buffer.h"
+
+#include <string.h>
+
+namespace Engine
+{
+
+	ParameterBlock::ParameterBlock(const ConstantBufferLayout& layout) :
+		m_Layout(layout), m_Data(layout.size, 0)
+	{
+		m_Buffer = ConstantBuffer::Create(m_Data.data(), layout.size);
+	}
+
+	uint32_t ParameterBlock::GetVariableID(const std::string& name) const
+	{
+		for (uint32_t i = 0; i < m_Layout.variables.size(); i++)
+		{
+			if (m_Layout.variables[i].name == name)
+				return i;
+		}
+		DBOUT("cbuffer " << m_Layout.name.c_str() << " has no variable " << name.c_str() << std::endl);
+		return InvalidID;
+	}
+
+	void ParameterBlock::Set(uint32_t id, const void* data, uint32_t size)
+	{
+		if (id >= m_Layout.variables.size())
+			return;
+
+		const ShaderVariable& variable = m_Layout.variables[id];
+		if (size > variable.size)
+		{
+			DBOUT("setting " << size << " bytes into " << variable.name.c_str() << " which is only " << variable.size << " bytes" << std::endl);
+			size = variable.size;
+		}
+
+		// setting a variable to the value it already has does not need an upload
+		uint8_t* dest = m_Data.data() + variable.offset;
+		if (memcmp(dest, data, size) == 0)
+			return;
+
+		memcpy(dest, data, size);
+		m_Dirty = true;
+	}
+
+	void ParameterBlock::SetData(const void* data)
+	{
+		if (memcmp(m_Data.data(), data, m_Data.size()) == 0)
+			return;
+
+		memcpy(m_Data.data(), data, m_Data.size());
+		m_Dirty = true;
+	}
+
+	bool ParameterBlock::Upload()
+	{
+		if (!m_Dirty)
+			return false;
+
+		m_Buffer->SetData(m_Data.data());
+		m_Dirty = false;
+		return true;
+	}
+
+	Ref<ParameterBlock> ParameterBlock::Create(const ConstantBufferLayout& layout)
+	{
+		return std::make_shared<ParameterBlock>(layout);
+	}
+
+	Ref<ParameterBlock> ParameterBlock::Create(Ref<Shader> shader, const std::string& name)
+	{
+		const ConstantBufferLayout* layout = shader->GetConstantBufferLayout(name);
+		if (layout == nullptr)
+		{
+			DBOUT("shader has no cbuffer " << name.c_str() << std::endl);
+			return nullptr;
+		}
+		return Create(*layout);
+	}
+
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include "Core/Core.h"
+#include "ShaderReflection.h"
+
+namespace Engine
+{
+	class Shader;
+	class ConstantBuffer;
+
+	// cpu copy of a cbuffer laid out from the shader reflection so variables can be set by name
+	// the gpu buffer is only written when the block is bound after something actually changed
+	class ParameterBlock
+	{
+	public:
+		static constexpr uint32_t InvalidID = ~0u;
+
+	public:
+		ParameterBlock(const ConstantBufferLayout& layout);
+
+		// look the id up once and keep it, setting a variable by id is just a compare and copy
+		uint32_t GetVariableID(const std::string& name) const;
+		const ConstantBufferLayout& GetLayout() const { return m_Layout; }
+
+		void Set(uint32_t id, const void* data, uint32_t size);
+		template<typename T>
+		void Set(uint32_t id, const T& value) { Set(id, &value, (uint32_t)sizeof(T)); }
+		void SetData(const void* data); // the whole cbuffer
+
+		bool IsDirty() const { return m_Dirty; }
+		// writes the cpu copy to the gpu if anything changed since the last upload, returns true if it did
+		bool Upload();
+
+		uint32_t GetSize() const { return m_Layout.size; }
+		Ref<ConstantBuffer> GetBuffer() const { return m_Buffer; }
+
+		static Ref<ParameterBlock> Create(const ConstantBufferLayout& layout);
+		static Ref<ParameterBlock> Create(Ref<Shader> shader, const std::string& name); // nullptr if the shader has no cbuffer with that name
+
+	private:
+		ConstantBufferLayout m_Layout;
+		std::vector<uint8_t> m_Data;
+		Ref<ConstantBuffer> m_Buffer;
+		bool m_Dirty = false;
+	};
+}
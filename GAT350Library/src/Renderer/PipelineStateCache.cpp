@@ -0,0 +1,95 @@
+#include "PipelineStateCache.h"
+#include "RendererAPI.h"
+
+namespace Engine
+{
+
+	PipelineStateCache::StateID PipelineStateCache::GetDepthStencilID(const D3D11_DEPTH_STENCIL_DESC& desc)
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		return GetID(m_DepthStencilStates, desc, m_Statistics.depthStencilStates);
+	}
+
+	PipelineStateCache::StateID PipelineStateCache::GetRasterizerID(const D3D11_RASTERIZER_DESC& desc)
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		return GetID(m_RasterizerStates, desc, m_Statistics.rasterizerStates);
+	}
+
+	PipelineStateCache::StateID PipelineStateCache::GetSamplerID(const D3D11_SAMPLER_DESC& desc)
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		return GetID(m_SamplerStates, desc, m_Statistics.samplerStates);
+	}
+
+	wrl::ComPtr<ID3D11DepthStencilState> PipelineStateCache::GetDepthStencilState(StateID id)
+	{
+		return GetState(m_DepthStencilStates, id, [](const D3D11_DEPTH_STENCIL_DESC& desc, ID3D11DepthStencilState** state) {
+			return RendererAPI::Get().GetDivice()->CreateDepthStencilState(&desc, state);
+		});
+	}
+
+	wrl::ComPtr<ID3D11RasterizerState> PipelineStateCache::GetRasterizerState(StateID id)
+	{
+		return GetState(m_RasterizerStates, id, [](const D3D11_RASTERIZER_DESC& desc, ID3D11RasterizerState** state) {
+			return RendererAPI::Get().GetDivice()->CreateRasterizerState(&desc, state);
+		});
+	}
+
+	wrl::ComPtr<ID3D11SamplerState> PipelineStateCache::GetSamplerState(StateID id)
+	{
+		return GetState(m_SamplerStates, id, [](const D3D11_SAMPLER_DESC& desc, ID3D11SamplerState** state) {
+			return RendererAPI::Get().GetDivice()->CreateSamplerState(&desc, state);
+		});
+	}
+
+	PipelineStateCache::Statistics PipelineStateCache::GetStatistics()
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		return m_Statistics;
+	}
+
+	PipelineStateCache& PipelineStateCache::Get()
+	{
+		static PipelineStateCache* instance = new PipelineStateCache();
+		return *instance;
+	}
+
+	template<typename Desc, typename State>
+	PipelineStateCache::StateID PipelineStateCache::GetID(Table<Desc, State>& table, const Desc& desc, uint32_t& count)
+	{
+		m_Statistics.requests++;
+
+		bool added;
+		StateID id = table.ids.GetID(desc, &added);
+		if (added)
+		{
+			table.states.emplace_back();
+			count++;
+		}
+		return id;
+	}
+
+	template<typename Desc, typename State, typename CreateFunc>
+	wrl::ComPtr<State> PipelineStateCache::GetState(Table<Desc, State>& table, StateID id, CreateFunc create)
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		const Desc* desc = table.ids.GetDesc(id);
+		if (desc == nullptr)
+			return nullptr;
+
+		wrl::ComPtr<State>& state = table.states[id - 1];
+		if (state == nullptr)
+		{
+			HRESULT hr = create(*desc, state.GetAddressOf());
+			if (FAILED(hr))
+			{
+				DBOUT("failed to create pipeline state" << std::endl);
+				return nullptr;
+			}
+			m_Statistics.created++;
+		}
+		return state;
+	}
+
+}
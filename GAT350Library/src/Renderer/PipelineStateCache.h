@@ -0,0 +1,68 @@
+#pragma once
+#include "Platform/Windows/Win.h"
+#include "Core/Core.h"
+#include "PipelineStateTable.h"
+
+#include <mutex>
+
+namespace Engine
+{
+	// hands out one shared state object for every distinct depth stencil, rasterizer and sampler descriptor
+	// descriptors are turned into ids first by a PipelineStateTable without touching the device, the state object
+	// is only created the first time an id is asked for
+	class PipelineStateCache
+	{
+	public:
+		using StateID = uint32_t;
+		static constexpr StateID InvalidID = 0;
+
+		struct Statistics
+		{
+			uint32_t requests = 0; // descriptors turned into ids
+			uint32_t depthStencilStates = 0;
+			uint32_t rasterizerStates = 0;
+			uint32_t samplerStates = 0;
+			uint32_t created = 0; // state objects made on the device
+
+			float GetDedupRate() const { return requests == 0 ? 0.0f : 1.0f - (float)(depthStencilStates + rasterizerStates + samplerStates) / (float)requests; }
+		};
+
+	public:
+		// the same descriptor always gives the same id
+		StateID GetDepthStencilID(const D3D11_DEPTH_STENCIL_DESC& desc);
+		StateID GetRasterizerID(const D3D11_RASTERIZER_DESC& desc);
+		StateID GetSamplerID(const D3D11_SAMPLER_DESC& desc);
+
+		// nullptr for an invalid id
+		wrl::ComPtr<ID3D11DepthStencilState> GetDepthStencilState(StateID id);
+		wrl::ComPtr<ID3D11RasterizerState> GetRasterizerState(StateID id);
+		wrl::ComPtr<ID3D11SamplerState> GetSamplerState(StateID id);
+
+		Statistics GetStatistics();
+
+		// one number for the fixed function state a shader binds, two shaders with the same key set the same states
+		static uint64_t GetPipelineKey(StateID depthStencil, StateID rasterizer) { return ((uint64_t)depthStencil << 32) | rasterizer; }
+
+		static PipelineStateCache& Get();
+
+	private:
+		template<typename Desc, typename State>
+		struct Table
+		{
+			PipelineStateTable<Desc> ids;
+			std::vector<wrl::ComPtr<State>> states; // by id - 1, made when first asked for
+		};
+
+		template<typename Desc, typename State>
+		StateID GetID(Table<Desc, State>& table, const Desc& desc, uint32_t& count);
+		template<typename Desc, typename State, typename CreateFunc>
+		wrl::ComPtr<State> GetState(Table<Desc, State>& table, StateID id, CreateFunc create);
+
+	private:
+		std::mutex m_Mutex;
+		Table<D3D11_DEPTH_STENCIL_DESC, ID3D11DepthStencilState> m_DepthStencilStates;
+		Table<D3D11_RASTERIZER_DESC, ID3D11RasterizerState> m_RasterizerStates;
+		Table<D3D11_SAMPLER_DESC, ID3D11SamplerState> m_SamplerStates;
+		Statistics m_Statistics;
+	};
+}
@@ -0,0 +1,119 @@
+#include "PipelineStateTable.h"
+#include "ShaderCache.h"
+
+#include <string.h>
+
+namespace Engine
+{
+
+	static uint32_t AsUint(float value)
+	{
+		uint32_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+		return bits;
+	}
+
+	static void AddStencilOp(std::vector<uint32_t>& key, const D3D11_DEPTH_STENCILOP_DESC& op)
+	{
+		key.push_back((uint32_t)op.StencilFailOp);
+		key.push_back((uint32_t)op.StencilDepthFailOp);
+		key.push_back((uint32_t)op.StencilPassOp);
+		key.push_back((uint32_t)op.StencilFunc);
+	}
+
+	template<typename Desc>
+	typename PipelineStateTable<Desc>::StateID PipelineStateTable<Desc>::GetID(const Desc& desc, bool* added)
+	{
+		if (added != nullptr)
+			*added = false;
+
+		Key key = GetKey(desc);
+		uint64_t hash = ShaderCache::Hash(key.data(), key.size() * sizeof(uint32_t));
+		auto range = m_IDs.equal_range(hash);
+		for (auto it = range.first; it != range.second; it++)
+		{
+			if (m_Keys[it->second - 1] == key)
+				return it->second;
+		}
+
+		m_Keys.push_back(std::move(key));
+		m_Descs.push_back(desc);
+		StateID id = (StateID)m_Descs.size();
+		m_IDs.emplace(hash, id);
+		if (added != nullptr)
+			*added = true;
+		return id;
+	}
+
+	template<typename Desc>
+	const Desc* PipelineStateTable<Desc>::GetDesc(StateID id) const
+	{
+		if (id == InvalidID || id > m_Descs.size())
+			return nullptr;
+		return &m_Descs[id - 1];
+	}
+
+	template<typename Desc>
+	uint64_t PipelineStateTable<Desc>::Hash(const Desc& desc)
+	{
+		Key key = GetKey(desc);
+		return ShaderCache::Hash(key.data(), key.size() * sizeof(uint32_t));
+	}
+
+	template<>
+	PipelineStateTable<D3D11_DEPTH_STENCIL_DESC>::Key PipelineStateTable<D3D11_DEPTH_STENCIL_DESC>::GetKey(const D3D11_DEPTH_STENCIL_DESC& desc)
+	{
+		Key key;
+		key.reserve(13);
+		key.push_back((uint32_t)desc.DepthEnable);
+		key.push_back((uint32_t)desc.DepthWriteMask);
+		key.push_back((uint32_t)desc.DepthFunc);
+		key.push_back((uint32_t)desc.StencilEnable);
+		key.push_back((uint32_t)desc.StencilReadMask | ((uint32_t)desc.StencilWriteMask << 8));
+		AddStencilOp(key, desc.FrontFace);
+		AddStencilOp(key, desc.BackFace);
+		return key;
+	}
+
+	template<>
+	PipelineStateTable<D3D11_RASTERIZER_DESC>::Key PipelineStateTable<D3D11_RASTERIZER_DESC>::GetKey(const D3D11_RASTERIZER_DESC& desc)
+	{
+		Key key;
+		key.reserve(10);
+		key.push_back((uint32_t)desc.FillMode);
+		key.push_back((uint32_t)desc.CullMode);
+		key.push_back((uint32_t)desc.FrontCounterClockwise);
+		key.push_back((uint32_t)desc.DepthBias);
+		key.push_back(AsUint(desc.DepthBiasClamp));
+		key.push_back(AsUint(desc.SlopeScaledDepthBias));
+		key.push_back((uint32_t)desc.DepthClipEnable);
+		key.push_back((uint32_t)desc.ScissorEnable);
+		key.push_back((uint32_t)desc.MultisampleEnable);
+		key.push_back((uint32_t)desc.AntialiasedLineEnable);
+		return key;
+	}
+
+	template<>
+	PipelineStateTable<D3D11_SAMPLER_DESC>::Key PipelineStateTable<D3D11_SAMPLER_DESC>::GetKey(const D3D11_SAMPLER_DESC& desc)
+	{
+		Key key;
+		key.reserve(13);
+		key.push_back((uint32_t)desc.Filter);
+		key.push_back((uint32_t)desc.AddressU);
+		key.push_back((uint32_t)desc.AddressV);
+		key.push_back((uint32_t)desc.AddressW);
+		key.push_back(AsUint(desc.MipLODBias));
+		key.push_back((uint32_t)desc.MaxAnisotropy);
+		key.push_back((uint32_t)desc.ComparisonFunc);
+		for (float color : desc.BorderColor)
+			key.push_back(AsUint(color));
+		key.push_back(AsUint(desc.MinLOD));
+		key.push_back(AsUint(desc.MaxLOD));
+		return key;
+	}
+
+	template class PipelineStateTable<D3D11_DEPTH_STENCIL_DESC>;
+	template class PipelineStateTable<D3D11_RASTERIZER_DESC>;
+	template class PipelineStateTable<D3D11_SAMPLER_DESC>;
+
+}
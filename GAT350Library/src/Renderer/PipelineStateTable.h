@@ -0,0 +1,36 @@
+#pragma once
+#include "Platform/Windows/Win.h"
+#include "Core/Core.h"
+
+#include <unordered_map>
+
+namespace Engine
+{
+	// turns depth stencil, rasterizer or sampler descriptors into ids, the same descriptor always gives the same id
+	// only the fields are compared, never the padding, and nothing here touches the device
+	// PipelineStateCache keeps one of these for each kind of state and makes the state objects for the ids
+	template<typename Desc>
+	class PipelineStateTable
+	{
+	public:
+		using StateID = uint32_t;
+		static constexpr StateID InvalidID = 0;
+
+		// added is set if the descriptor was not in the table yet
+		StateID GetID(const Desc& desc, bool* added = nullptr);
+		const Desc* GetDesc(StateID id) const; // nullptr for an invalid id
+		uint32_t GetCount() const { return (uint32_t)m_Descs.size(); }
+
+		static uint64_t Hash(const Desc& desc);
+
+	private:
+		using Key = std::vector<uint32_t>;
+
+		static Key GetKey(const Desc& desc);
+
+	private:
+		std::unordered_multimap<uint64_t, StateID> m_IDs; // by hash, more than one if two keys hash the same
+		std::vector<Key> m_Keys; // by id - 1
+		std::vector<Desc> m_Descs;
+	};
+}
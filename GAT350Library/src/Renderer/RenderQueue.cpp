@@ -0,0 +1,404 @@
+#include "RenderQueue.h"
+#include "RendererCommand.h"
+#include "CommandRecorder.h"
+#include "Util/Parallel.h"
+
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+
+namespace Engine
+{
+
+	// ranges this small are sorted by comparison, below the parallel size the whole sort stays on this thread
+	static const uint32_t s_ComparisonSortSize = 64;
+	static const uint32_t s_ParallelSortSize = 4096;
+	static const uint32_t s_ParallelTasks = 64;
+	// fewer draws than this in a command list cost more to record and play than they save
+	static const uint32_t s_MinDrawsPerList = 256;
+
+	// what goes in the transform constant buffer for each draw
+	struct DrawConstants
+	{
+		glm::mat4 transform;
+		int32_t textureLayer; // -1 when the material is not in texture arrays
+		int32_t padding[3];
+	};
+
+	static uint32_t HighestBit(uint64_t value)
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanReverse64(&index, value);
+		return (uint32_t)index;
+#else
+		return 63 - (uint32_t)__builtin_clzll(value);
+#endif
+	}
+
+	static int32_t GetTextureLayer(const Material* material)
+	{
+		return material != nullptr && material->UsesTextureArrays() ? (int32_t)material->m_Layer : -1;
+	}
+
+	static uint32_t Quantize(float value, uint32_t bits)
+	{
+		value = std::min(std::max(value, 0.0f), 1.0f);
+		return (uint32_t)(value * (float)((1u << bits) - 1));
+	}
+
+	// the draw index breaks ties, it grows in submit order so this gives the same order as a stable sort
+	static void ComparisonSort(RenderQueue::Packet* packets, uint32_t count)
+	{
+		std::sort(packets, packets + count, [](const RenderQueue::Packet& a, const RenderQueue::Packet& b) {
+			return a.key < b.key || (a.key == b.key && a.draw < b.draw);
+		});
+	}
+
+	// counts the keys in each bucket of the byte at shift, returns false if they are all in one bucket
+	static bool Histogram(const RenderQueue::Packet* packets, uint32_t count, int shift, uint32_t* offsets)
+	{
+		uint32_t counts[256] = {};
+		for (uint32_t i = 0; i < count; i++)
+			counts[(packets[i].key >> shift) & 0xFF]++;
+		if (counts[(packets[0].key >> shift) & 0xFF] == count)
+			return false;
+
+		uint32_t offset = 0;
+		for (uint32_t i = 0; i < 256; i++)
+		{
+			offsets[i] = offset;
+			offset += counts[i];
+		}
+		offsets[256] = offset;
+		return true;
+	}
+
+	static void Scatter(const RenderQueue::Packet* from, RenderQueue::Packet* to, uint32_t count, int shift, const uint32_t* offsets)
+	{
+		uint32_t next[256];
+		memcpy(next, offsets, sizeof(next));
+		for (uint32_t i = 0; i < count; i++)
+			to[next[(from[i].key >> shift) & 0xFF]++] = from[i];
+	}
+
+	// msd radix sort a byte at a time from shift down, buckets stop splitting once they are small
+	// the two ranges are swapped at every level, inPlace says whether the result has to end up in packets or scratch
+	static void RadixSort(RenderQueue::Packet* packets, RenderQueue::Packet* scratch, uint32_t count, int shift, bool inPlace)
+	{
+		RenderQueue::Packet* result = inPlace ? packets : scratch;
+		if (count <= s_ComparisonSortSize || shift < 0)
+		{
+			if (!inPlace)
+				memcpy(scratch, packets, count * sizeof(RenderQueue::Packet));
+			if (shift >= 0)
+				ComparisonSort(result, count);
+			return;
+		}
+
+		uint32_t offsets[257];
+		while (!Histogram(packets, count, shift, offsets))
+		{
+			shift -= 8;
+			if (shift < 0)
+			{
+				RadixSort(packets, scratch, count, shift, inPlace);
+				return;
+			}
+		}
+
+		Scatter(packets, scratch, count, shift, offsets);
+		for (uint32_t bucket = 0; bucket < 256; bucket++)
+		{
+			uint32_t start = offsets[bucket];
+			uint32_t bucketCount = offsets[bucket + 1] - start;
+			if (bucketCount != 0)
+				RadixSort(scratch + start, packets + start, bucketCount, shift - 8, !inPlace);
+		}
+	}
+
+	void RenderQueue::Submit(const Draw& draw, float depth)
+	{
+		if (draw.shader == nullptr || draw.mesh == nullptr)
+			return;
+
+		m_Packets.push_back({ MakeKey(draw, depth), (uint32_t)m_Draws.size() });
+		m_Draws.push_back(draw);
+	}
+
+	void RenderQueue::Execute(const std::function<void(const Ref<Shader>&)>& onShader, uint32_t lists)
+	{
+		m_Statistics = Statistics();
+		m_Statistics.packets = (uint32_t)m_Packets.size();
+
+		auto start = std::chrono::steady_clock::now();
+		Sort(m_Packets, m_Scratch);
+		m_Statistics.sortMilliseconds = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		uint32_t count = (uint32_t)m_Packets.size();
+		lists = std::max(std::min(CommandRecorder::GetListCount(lists), count / s_MinDrawsPerList), 1u);
+		if (lists == 1)
+		{
+			DrawRange(0, count, onShader, m_Statistics);
+			Clear();
+			return;
+		}
+
+		// every list rebinds the state its first draws need so the splits add a few binds each
+		std::vector<Statistics> listStatistics(lists);
+		CommandRecorder::Record(lists, [&](uint32_t list) {
+			uint32_t first = (uint32_t)((uint64_t)count * list / lists);
+			uint32_t last = (uint32_t)((uint64_t)count * (list + 1) / lists);
+			DrawRange(first, last, onShader, listStatistics[list]);
+		});
+		for (const Statistics& statistics : listStatistics)
+		{
+			m_Statistics.shaderChanges += statistics.shaderChanges;
+			m_Statistics.materialChanges += statistics.materialChanges;
+		}
+
+		Clear();
+	}
+
+	void RenderQueue::DrawRange(uint32_t first, uint32_t last, const std::function<void(const Ref<Shader>&)>& onShader, Statistics& statistics)
+	{
+		Shader* shader = nullptr;
+		Material* material = nullptr;
+		bool materialBound = false; // a draw without a material still has to clear the last one's textures
+		Shader::BindPointInfo transform = {};
+		Shader::BindPointInfo textures[5] = {};
+		Shader::BindPointInfo arrays[5] = {};
+		std::vector<ConstantBufferAllocator::Slice> slices(last - first);
+		for (uint32_t packet = first; packet < last; packet++)
+		{
+			const Draw& draw = m_Draws[m_Packets[packet].draw];
+			if (draw.shader.get() != shader)
+			{
+				shader = draw.shader.get();
+				materialBound = false; // the texture slots may be different in the new shader
+				RendererCommand::SetShader(draw.shader);
+				if (onShader)
+					onShader(draw.shader);
+
+				transform = shader->GetBindPoint(m_Bindings.transform);
+				PropertyID textureIDs[5] = { m_Bindings.diffuse, m_Bindings.normal, m_Bindings.roughness, m_Bindings.metal, m_Bindings.ao };
+				PropertyID arrayIDs[5] = { m_Bindings.diffuseArray, m_Bindings.normalArray, m_Bindings.roughnessArray, m_Bindings.metalArray, m_Bindings.aoArray };
+				for (uint32_t i = 0; i < 5; i++)
+				{
+					textures[i] = shader->GetBindPoint(textureIDs[i]);
+					arrays[i] = shader->GetBindPoint(arrayIDs[i]);
+				}
+				statistics.shaderChanges++;
+
+				if (transform.type != 0)
+					WriteConstants(packet, last, slices.data() + (packet - first));
+			}
+
+			if (!materialBound || draw.material.get() != material)
+			{
+				material = draw.material.get();
+				materialBound = true;
+
+				// textures the material does not have are bound as null so the last material's do not show through
+				if (material != nullptr && material->UsesTextureArrays())
+				{
+					// the whole group shares these so they are only bound again when the arrays change
+					Ref<Texture2DArray> materialArrays[5] = { material->m_Arrays.m_Diffuse, material->m_Arrays.m_Normal, material->m_Arrays.m_Roughness, material->m_Arrays.m_Metal, material->m_Arrays.m_AO };
+					for (uint32_t i = 0; i < 5; i++)
+					{
+						if (arrays[i].type != 0)
+							RendererCommand::SetTexture(arrays[i], materialArrays[i]);
+					}
+				}
+				else
+				{
+					Ref<Texture2D> materialTextures[5];
+					if (material != nullptr)
+					{
+						materialTextures[0] = material->m_Diffuse;
+						materialTextures[1] = material->m_Normal;
+						materialTextures[2] = material->m_Roughness;
+						materialTextures[3] = material->m_Metal;
+						materialTextures[4] = material->m_AO;
+					}
+					for (uint32_t i = 0; i < 5; i++)
+					{
+						if (textures[i].type != 0)
+							RendererCommand::SetTexture(textures[i], materialTextures[i]);
+					}
+				}
+				if (material != nullptr)
+					statistics.materialChanges++;
+			}
+
+			if (transform.type != 0)
+			{
+				const ConstantBufferAllocator::Slice& slice = slices[packet - first];
+				if (slice.IsValid())
+					RendererCommand::SetConstants(transform, slice);
+				else
+				{
+					DrawConstants constants = { draw.transform, GetTextureLayer(draw.material.get()) };
+					RendererCommand::SetConstants(transform, &constants, sizeof(constants));
+				}
+			}
+			RendererCommand::DrawMesh(draw.mesh);
+		}
+	}
+
+	void RenderQueue::WriteConstants(uint32_t first, uint32_t last, ConstantBufferAllocator::Slice* slices)
+	{
+		// every draw up to the next shader change is written in one map instead of a map and unmap for each draw
+		ConstantBufferAllocator& allocator = ConstantBufferAllocator::Get();
+		const Shader* shader = m_Draws[m_Packets[first].draw].shader.get();
+		for (uint32_t packet = first; packet < last; packet++)
+		{
+			const Draw& draw = m_Draws[m_Packets[packet].draw];
+			if (draw.shader.get() != shader)
+				break;
+
+			// an invalid slice falls back to SetConstants when it is drawn
+			ConstantBufferAllocator::Slice& slice = slices[packet - first];
+			slice = allocator.Allocate(sizeof(DrawConstants));
+			if (slice.IsValid())
+			{
+				DrawConstants constants = { draw.transform, GetTextureLayer(draw.material.get()) };
+				memcpy(slice.data, &constants, sizeof(constants));
+			}
+		}
+		allocator.Flush();
+	}
+
+	void RenderQueue::Clear()
+	{
+		m_Draws.clear();
+		m_Packets.clear();
+		m_MaterialIDs.clear();
+		m_MeshIDs.clear();
+	}
+
+	void RenderQueue::Sort(std::vector<Packet>& packets, std::vector<Packet>& scratch)
+	{
+		uint32_t count = (uint32_t)packets.size();
+		if (count < 2)
+			return;
+		scratch.resize(count);
+
+		// bits above the highest one that differs are the same in every key and do not need sorting
+		uint64_t different = 0;
+		for (const Packet& packet : packets)
+			different |= packet.key ^ packets[0].key;
+		if (different == 0)
+			return;
+
+		// the levels have to line up with the bytes or the last one would run past bit 0 and leave the low bits unsorted
+		int shift = (int)HighestBit(different) & ~7;
+		if (count < s_ParallelSortSize)
+		{
+			RadixSort(packets.data(), scratch.data(), count, shift, true);
+			return;
+		}
+
+		// the first split is spread over the worker pool too, every thread counts and then scatters its own chunk.
+		// the chunks go into each bucket in order so packets with the same key still keep their order
+		uint32_t chunks = std::min(Parallel::GetThreadCount(), count / s_ParallelSortSize);
+		std::vector<uint32_t> chunkOffsets(chunks * 256);
+		Parallel::For(chunks, [&](uint32_t chunk) {
+			uint32_t* counts = chunkOffsets.data() + chunk * 256;
+			uint32_t first = (uint32_t)((uint64_t)count * chunk / chunks);
+			uint32_t last = (uint32_t)((uint64_t)count * (chunk + 1) / chunks);
+			for (uint32_t i = first; i < last; i++)
+				counts[(packets[i].key >> shift) & 0xFF]++;
+		});
+
+		uint32_t offsets[257];
+		uint32_t offset = 0;
+		for (uint32_t bucket = 0; bucket < 256; bucket++)
+		{
+			offsets[bucket] = offset;
+			for (uint32_t chunk = 0; chunk < chunks; chunk++)
+			{
+				uint32_t bucketCount = chunkOffsets[chunk * 256 + bucket];
+				chunkOffsets[chunk * 256 + bucket] = offset;
+				offset += bucketCount;
+			}
+		}
+		offsets[256] = offset;
+
+		Parallel::For(chunks, [&](uint32_t chunk) {
+			uint32_t first = (uint32_t)((uint64_t)count * chunk / chunks);
+			uint32_t last = (uint32_t)((uint64_t)count * (chunk + 1) / chunks);
+			Scatter(packets.data() + first, scratch.data(), last - first, shift, chunkOffsets.data() + chunk * 256);
+		});
+
+		// then the buckets are sorted on their own, the byte at shift has the highest bit that differs so it always splits
+
+		Parallel::For(s_ParallelTasks, [&](uint32_t task) {
+			for (uint32_t bucket = task; bucket < 256; bucket += s_ParallelTasks)
+			{
+				uint32_t start = offsets[bucket];
+				uint32_t bucketCount = offsets[bucket + 1] - start;
+				if (bucketCount != 0)
+					RadixSort(scratch.data() + start, packets.data() + start, bucketCount, shift - 8, false);
+			}
+		});
+	}
+
+	float RenderQueue::Benchmark(uint32_t count, uint32_t iterations)
+	{
+		// a few passes and shaders, more materials and meshes and every draw at its own depth
+		std::mt19937_64 random(1234);
+		std::vector<Packet> source(count);
+		for (uint32_t i = 0; i < count; i++)
+		{
+			uint64_t pass = random() % 3;
+			uint64_t transparent = random() % 8 == 0 ? 1 : 0;
+			uint64_t depth = random() & 0xFFFFFF;
+			uint64_t shader = random() % 16;
+			uint64_t material = random() % 512;
+			uint64_t mesh = random() % 4096;
+			if (transparent)
+				source[i].key = (pass << 60) | (1ull << 59) | (depth << 35) | (shader << 23) | (material << 7) | (mesh & 0x7F);
+			else
+				source[i].key = (pass << 60) | ((depth >> 20) << 55) | (shader << 43) | (material << 27) | (mesh << 11) | ((depth >> 9) & 0x7FF);
+			source[i].draw = i;
+		}
+
+		std::vector<Packet> packets;
+		std::vector<Packet> scratch;
+		float milliseconds = 0.0f;
+		for (uint32_t i = 0; i < iterations; i++)
+		{
+			packets = source;
+			auto start = std::chrono::steady_clock::now();
+			Sort(packets, scratch);
+			milliseconds += std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+		}
+		return iterations == 0 ? 0.0f : milliseconds / iterations;
+	}
+
+	uint64_t RenderQueue::MakeKey(const Draw& draw, float depth)
+	{
+		uint64_t pass = draw.pass & 0xF;
+		uint64_t shader = draw.shader->GetID() & 0xFFF;
+		uint64_t material = GetSortID(m_MaterialIDs, draw.material.get()) & 0xFFFF;
+		uint64_t mesh = GetSortID(m_MeshIDs, draw.mesh.get()) & 0xFFFF;
+		uint64_t quantized = Quantize((depth - m_Near) / std::max(m_Far - m_Near, 0.0001f), 24);
+
+		if (draw.transparent)
+		{
+			uint64_t farToNear = 0xFFFFFF - quantized;
+			return (pass << 60) | (1ull << 59) | (farToNear << 35) | (shader << 23) | (material << 7) | (mesh & 0x7F);
+		}
+		return (pass << 60) | ((quantized >> 20) << 55) | (shader << 43) | (material << 27) | (mesh << 11) | ((quantized >> 9) & 0x7FF);
+	}
+
+	uint32_t RenderQueue::GetSortID(std::unordered_map<const void*, uint32_t>& ids, const void* object)
+	{
+		if (object == nullptr)
+			return 0;
+		return ids.emplace(object, (uint32_t)ids.size() + 1).first->second;
+	}
+
+}
@@ -0,0 +1,114 @@
+#pragma once
+#include "Core/Core.h"
+#include "Shader.h"
+#include "Mesh.h"
+#include "Material.h"
+#include "ConstantBufferAllocator.h"
+
+#include <glm/glm.hpp>
+#include <functional>
+#include <unordered_map>
+
+namespace Engine
+{
+	// draws are submitted as small packets with a 64 bit sort key and sorted before they go to RendererCommand
+	// key from the top bit down:
+	//   opaque:      pass 4 | 0 | depth slice 4 | shader 12 | material 16 | mesh 16 | depth 11
+	//   transparent: pass 4 | 1 | far to near depth 24 | shader 12 | material 16 | mesh 7
+	// opaque draws go front to back in 16 slices and are grouped by state inside a slice, transparent draws go back to front
+	class RenderQueue
+	{
+	public:
+		struct Draw
+		{
+			Ref<Shader> shader;
+			Ref<Mesh> mesh;
+			Ref<Material> material; // can be nullptr
+			glm::mat4 transform = glm::mat4(1.0f);
+			uint8_t pass = 0; // passes run in order, 0 to 15
+			bool transparent = false;
+		};
+
+		// the sort only moves these, the draws stay where they were submitted and are read through the sorted indices
+		struct Packet
+		{
+			uint64_t key;
+			uint32_t draw; // index into the draws
+		};
+
+		// where Execute puts the transform and the material textures, properties a shader does not use are skipped
+		// the transform buffer gets the matrix followed by an int with the material's texture array layer,
+		// -1 when the material has textures of its own or there is none, so a shader can pick which textures to sample
+		struct Bindings
+		{
+			PropertyID transform = ShaderProperty::InvalidID;
+			PropertyID diffuse = ShaderProperty::InvalidID;
+			PropertyID normal = ShaderProperty::InvalidID;
+			PropertyID roughness = ShaderProperty::InvalidID;
+			PropertyID metal = ShaderProperty::InvalidID;
+			PropertyID ao = ShaderProperty::InvalidID;
+
+			// for materials grouped into texture arrays at import
+			PropertyID diffuseArray = ShaderProperty::InvalidID;
+			PropertyID normalArray = ShaderProperty::InvalidID;
+			PropertyID roughnessArray = ShaderProperty::InvalidID;
+			PropertyID metalArray = ShaderProperty::InvalidID;
+			PropertyID aoArray = ShaderProperty::InvalidID;
+		};
+
+		struct Statistics
+		{
+			uint32_t packets = 0;
+			uint32_t shaderChanges = 0;
+			uint32_t materialChanges = 0;
+			float sortMilliseconds = 0.0f;
+		};
+
+	public:
+		void SetBindings(const Bindings& bindings) { m_Bindings = bindings; }
+		// depth passed to Submit is quantized over this range, usually the camera's near and far planes
+		void SetDepthRange(float nearDepth, float farDepth) { m_Near = nearDepth; m_Far = farDepth; }
+
+		// depth is the distance from the camera
+		void Submit(const Draw& draw, float depth);
+
+		// sorts the draws and sends them to RendererCommand, then clears the queue
+		// onShader is called after each shader change so per pass constants like the camera can be bound
+		// more than one list splits the sorted draws into that many command lists recorded on different threads,
+		// they are played in order so the frame is the same, onShader is called from the recording threads
+		void Execute(const std::function<void(const Ref<Shader>&)>& onShader = nullptr, uint32_t lists = 1);
+		void Clear();
+
+		const Statistics& GetStatistics() const { return m_Statistics; }
+
+		// radix sort on the keys, packets with the same key keep their order
+		// big queues are split and then have their buckets sorted on the Parallel worker pool
+		static void Sort(std::vector<Packet>& packets, std::vector<Packet>& scratch);
+		// sorts count packets with keys like a real scene has and returns the milliseconds a sort took
+		static float Benchmark(uint32_t count, uint32_t iterations);
+
+		static Ref<RenderQueue> Create() { return std::make_shared<RenderQueue>(); }
+
+	private:
+		uint64_t MakeKey(const Draw& draw, float depth);
+		// sends the sorted packets in [first, last), starting with nothing bound
+		void DrawRange(uint32_t first, uint32_t last, const std::function<void(const Ref<Shader>&)>& onShader, Statistics& statistics);
+		// writes the per draw constants of the packets from first that share its shader, slices starts at first
+		void WriteConstants(uint32_t first, uint32_t last, ConstantBufferAllocator::Slice* slices);
+		uint32_t GetSortID(std::unordered_map<const void*, uint32_t>& ids, const void* object);
+
+	private:
+		std::vector<Draw> m_Draws;
+		std::vector<Packet> m_Packets;
+		std::vector<Packet> m_Scratch;
+
+		// materials and meshes get small ids in the order they are first submitted, cleared with the queue
+		std::unordered_map<const void*, uint32_t> m_MaterialIDs;
+		std::unordered_map<const void*, uint32_t> m_MeshIDs;
+
+		Bindings m_Bindings;
+		float m_Near = 0.0f;
+		float m_Far = 1000.0f;
+		Statistics m_Statistics;
+	};
+}
@@ -18,6 +18,9 @@ namespace Engine
 		GenTextureBuffer(nullptr, 1);
 		GenRTVDSV();
 		GenSRV();
+
+		// the views are new, anything that still has the old ones bound has to bind again
+		RendererAPI::Get().GetStateCache().InvalidateRenderTargets();
 	}
 
 	void RenderTarget::GenRTVDSV()
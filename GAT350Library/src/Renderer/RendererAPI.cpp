@@ -5,6 +5,7 @@
 #pragma comment(lib, "D3DCompiler.lib")
 
 Engine::RendererAPI* Engine::RendererAPI::s_Instance;
+thread_local Engine::RendererAPI::ThreadContext* Engine::RendererAPI::s_ThreadContext = nullptr;
 
 namespace Engine
 {
@@ -36,7 +37,26 @@ namespace Engine
 
 		dxgiAdapter->GetParent(__uuidof(IDXGIFactory), (void**)&pDXGIFactory);
 
+		DXGI_ADAPTER_DESC adapterDesc = {};
+		if (SUCCEEDED(dxgiAdapter->GetDesc(&adapterDesc)))
+			m_VideoMemory = adapterDesc.DedicatedVideoMemory;
+
+		// binding part of a constant buffer needs the 11.1 context
+		if (SUCCEEDED(pContext.As(&pContext1)))
+		{
+			D3D11_FEATURE_DATA_D3D11_OPTIONS options = {};
+			pDevice->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &options, sizeof(options));
+			m_ConstantBufferOffsets = options.ConstantBufferOffsetting && options.MapNoOverwriteOnDynamicConstantBuffer;
+		}
+
+		D3D11_FEATURE_DATA_THREADING threading = {};
+		pDevice->CheckFeatureSupport(D3D11_FEATURE_THREADING, &threading, sizeof(threading));
+		m_CommandLists = threading.DriverCommandLists;
+		if (!m_CommandLists)
+			DBOUT("driver does not support command lists, the runtime will emulate them" << std::endl);
+
 		pContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY::D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+		m_StateCache.SetContext(pContext);
 	}
 
 }
\ No newline at end of file
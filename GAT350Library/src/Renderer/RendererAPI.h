@@ -1,14 +1,27 @@
 #pragma once
 #include "Core/Core.h"
 #include "Platform/Windows/Win.h"
+#include "StateCache.h"
 
 namespace Engine
 {
+	class ConstantBufferAllocator;
+
 	class RendererAPI
 	{
 	private:
 		static RendererAPI* s_Instance;
 
+	public:
+		// what the getters below give on a thread that is recording a command list, see CommandRecorder
+		struct ThreadContext
+		{
+			wrl::ComPtr<ID3D11DeviceContext> context;
+			wrl::ComPtr<ID3D11DeviceContext1> context1;
+			StateCache* stateCache = nullptr;
+			ConstantBufferAllocator* constants = nullptr;
+		};
+
 	public:
 		static void Init();
 		static inline RendererAPI& Get() { return *s_Instance; }
@@ -16,13 +29,30 @@ namespace Engine
 		RendererAPI();
 
 		inline wrl::ComPtr<ID3D11Device> GetDivice() { return pDevice; }
-		inline wrl::ComPtr<ID3D11DeviceContext> GetContext() { return pContext; }
+		// the context, 11.1 context and state cache are the thread's own while it is recording, the immediate ones otherwise
+		inline wrl::ComPtr<ID3D11DeviceContext> GetContext() { return s_ThreadContext != nullptr ? s_ThreadContext->context : pContext; }
+		inline wrl::ComPtr<ID3D11DeviceContext1> GetContext1() { return s_ThreadContext != nullptr ? s_ThreadContext->context1 : pContext1; } // nullptr before d3d 11.1
+		inline wrl::ComPtr<ID3D11DeviceContext> GetImmediateContext() { return pContext; }
+		inline bool SupportsConstantBufferOffsets() { return m_ConstantBufferOffsets; }
+		inline uint64_t GetVideoMemory() { return m_VideoMemory; } // dedicated memory of the adapter, 0 when it shares system memory
+		inline bool SupportsCommandLists() { return m_CommandLists; } // without driver support the runtime emulates them and recording scales less
 		inline wrl::ComPtr<IDXGIFactory> GetFactory() { return pDXGIFactory; }
+		inline StateCache& GetStateCache() { return s_ThreadContext != nullptr ? *s_ThreadContext->stateCache : m_StateCache; }
+
+		static void SetThreadContext(ThreadContext* context) { s_ThreadContext = context; } // nullptr goes back to the immediate context
+		static ThreadContext* GetThreadContext() { return s_ThreadContext; }
 
 	private:
+		static thread_local ThreadContext* s_ThreadContext;
+
 		wrl::ComPtr<ID3D11Device> pDevice;
 		wrl::ComPtr<ID3D11DeviceContext> pContext;
+		wrl::ComPtr<ID3D11DeviceContext1> pContext1;
 		wrl::ComPtr<IDXGIFactory> pDXGIFactory;
+		bool m_ConstantBufferOffsets = false;
+		bool m_CommandLists = false;
+		uint64_t m_VideoMemory = 0;
+		StateCache m_StateCache;
 		
 	};
 }
\ No newline at end of file
@@ -3,14 +3,23 @@
 #include "Core/Core.h"
 #include "Platform/Windows/Win.h"
 #include "Buffer.h"
+#include "BufferPool.h"
+#include "ConstantBufferAllocator.h"
+#include "ParameterBlock.h"
 #include "Mesh.h"
 #include "Shader.h"
+#include "ShaderHotReload.h"
 #include "SwapChain.h"
 #include "Texture.h"
+#include "TextureResidency.h"
+#include "TextureUploader.h"
+#include "UploadQueue.h"
 #include "RenderTarget.h"
 #include "FrameBuffer.h"
 #include "MeshBuilder.h"
 
+#include <string.h>
+
 #pragma comment(lib, "DXGI.lib")
 #pragma comment(lib, "d3d11.lib")
 #pragma comment(lib, "D3DCompiler.lib")
@@ -18,9 +27,29 @@
 
 Engine::Ref<Engine::Shader> Engine::RendererCommand::s_BlitShader;
 Engine::Ref<Engine::Mesh> Engine::RendererCommand::s_ScreenMesh;
+thread_local Engine::RendererCommand::Statistics Engine::RendererCommand::s_Statistics;
+thread_local Engine::Ref<Engine::Shader> Engine::RendererCommand::s_Shader;
+thread_local Engine::Ref<Engine::Mesh> Engine::RendererCommand::s_Mesh;
+thread_local bool Engine::RendererCommand::s_VertexStreamsDirty = true;
+thread_local uint32_t Engine::RendererCommand::s_VertexStride = 0;
 
 namespace Engine
 {
+	RendererCommand::Statistics& RendererCommand::Statistics::operator+=(const Statistics& other)
+	{
+		drawCalls += other.drawCalls;
+		textureBinds += other.textureBinds;
+		meshBufferBinds += other.meshBufferBinds;
+		vertexBytesFetched += other.vertexBytesFetched;
+		parameterUploads += other.parameterUploads;
+		parameterUploadsSkipped += other.parameterUploadsSkipped;
+		parameterBytesUploaded += other.parameterBytesUploaded;
+		parameterBytesSkipped += other.parameterBytesSkipped;
+		structuredBufferUploads += other.structuredBufferUploads;
+		structuredBufferBytesUploaded += other.structuredBufferBytesUploaded;
+		return *this;
+	}
+
 	void RendererCommand::Init()
 	{
 		Time::Init(); // just to make things easier for the students
@@ -96,11 +125,32 @@ namespace Engine
 		s_ScreenMesh = mb.Build();
 	}
 
+	void RendererCommand::BeginFrame()
+	{
+		ResetStatistics();
+		RendererAPI::Get().GetStateCache().ResetStatistics();
+		ConstantBufferAllocator::Get().BeginFrame();
+		UploadQueue::Get().Update();
+		BufferPool::Get().Update();
+		TextureResidency::Get().Update();
+		TextureUploader::Get().Update();
+		ShaderHotReload::Get().Update();
+	}
+
+	void RendererCommand::EndFrame()
+	{
+		TextureUploader::Get().EndFrame();
+
+		// moves meshes out of pages that emptied out a little at a time so a frame never waits long on the copies
+		Mesh::GetVertexHeap().Compact(1 << 16);
+		Mesh::GetIndexHeap().Compact(1 << 18);
+	}
+
 	void RendererCommand::SetSwapChain(SwapChain& swapChain)
 	{
 		RendererAPI& graphics = RendererAPI::Get();
 
-		graphics.GetContext()->OMSetRenderTargets(1u, swapChain.GetRTV().GetAddressOf(), nullptr);
+		graphics.GetStateCache().SetRenderTargets(1u, swapChain.GetRTV().GetAddressOf(), nullptr);
 		SetViewPort(swapChain.GetWidth(), swapChain.GetHeight(), 0, 0);
 	}
 
@@ -117,9 +167,9 @@ namespace Engine
 		RendererAPI& graphics = RendererAPI::Get();
 
 		if(renderTarget->IsDepthStencilTexture())
-			graphics.GetContext()->OMSetRenderTargets(1u, nullptr, renderTarget->GetDSV().Get());
+			graphics.GetStateCache().SetRenderTargets(0u, nullptr, renderTarget->GetDSV().Get());
 		else
-			graphics.GetContext()->OMSetRenderTargets(1u, renderTarget->GetRTV().GetAddressOf(), nullptr);
+			graphics.GetStateCache().SetRenderTargets(1u, renderTarget->GetRTV().GetAddressOf(), nullptr);
 		SetViewPort(renderTarget->GetWidth(), renderTarget->GetHeight(), 0, 0);
 	}
 
@@ -147,7 +197,7 @@ namespace Engine
 		for (Ref<RenderTarget> renderTarget : frameBuffer->GetRenderTargets())
 			rtvs.push_back(renderTarget->GetRTV().Get());
 
-		graphics.GetContext()->OMSetRenderTargets((uint32_t)rtvs.size(), rtvs.data(), dsv);
+		graphics.GetStateCache().SetRenderTargets((uint32_t)rtvs.size(), rtvs.data(), dsv);
 	}
 
 	void RendererCommand::SetViewPort(int width, int height, int x, int y)
@@ -160,7 +210,7 @@ namespace Engine
 		vp.MaxDepth = 1;
 		vp.TopLeftX = (float)x;
 		vp.TopLeftY = (float)y;
-		graphics.GetContext()->RSSetViewports(1u, &vp);
+		graphics.GetStateCache().SetViewport(vp);
 	}
 
 	void RendererCommand::SetVertexBuffer(Ref<VertexBuffer> vb)
@@ -168,40 +218,53 @@ namespace Engine
 		RendererAPI& graphics = RendererAPI::Get();
 
 		const UINT stride = vb->GetStride();
-		const UINT offset = 0u;
-		graphics.GetContext()->IASetVertexBuffers(0u, 1u, vb->GetBuffer().GetAddressOf(), &stride, &offset);
+		graphics.GetStateCache().SetVertexBuffer(0u, vb->GetBuffer().Get(), stride);
+		s_Mesh = nullptr;
+		s_VertexStride = stride;
+		s_VertexStreamsDirty = true;
 	}
 
 	void RendererCommand::SetIndexBuffer(Ref<IndexBuffer> ib)
 	{
 		RendererAPI& graphics = RendererAPI::Get();
-		graphics.GetContext()->IASetIndexBuffer(ib->GetBuffer().Get(), DXGI_FORMAT_R32_UINT, 0);
+		graphics.GetStateCache().SetIndexBuffer(ib->GetBuffer().Get(), DXGI_FORMAT_R32_UINT);
 	}
 
 	void RendererCommand::SetMesh(Ref<Mesh> mesh)
 	{
-		SetVertexBuffer(mesh->GetVertexBuffer());
-		SetIndexBuffer(mesh->GetIndexBuffer());
+		RendererAPI& graphics = RendererAPI::Get();
+
+		// the vertex streams are bound at the draw once it is known which ones the shader reads
+		s_Mesh = mesh;
+		s_VertexStreamsDirty = true;
+
+		// the buffers are whole heap pages, the mesh is picked out with the draw offsets
+		if (graphics.GetStateCache().SetIndexBuffer(mesh->GetIndexBuffer().Get(), DXGI_FORMAT_R32_UINT))
+			s_Statistics.meshBufferBinds++;
 	}
 
 	void RendererCommand::SetShader(Ref<Shader> shader)
 	{
 		RendererAPI& graphics = RendererAPI::Get();
-		graphics.GetContext()->IASetInputLayout(shader->GetInputLayout().Get());
-		graphics.GetContext()->VSSetShader(shader->GetVertexShader().Get(), nullptr, 0u);
-		graphics.GetContext()->PSSetShader(shader->GetPixelShader().Get(), nullptr, 0u);
-		graphics.GetContext()->RSSetState(shader->GetRasterizerState().Get());
-		graphics.GetContext()->OMSetDepthStencilState(shader->GetDepthStencilState().Get(), 0);
+		s_Shader = shader;
+		s_VertexStreamsDirty = true;
+		StateCache& cache = graphics.GetStateCache();
+		cache.SetVertexShader(shader->GetVertexShader().Get());
+		cache.SetPixelShader(shader->GetPixelShader().Get());
+
+		// states come from the pipeline state cache so shaders with the same settings set the same objects
+		cache.SetRasterizerState(shader->GetRasterizerState().Get());
+		cache.SetDepthStencilState(shader->GetDepthStencilState().Get());
 
 		for (Shader::Sampler& sampler : shader->GetSamplers())
 		{
 			switch (sampler.info.type)
 			{
 			case Shader::Vertex:
-				graphics.GetContext()->VSSetSamplers(sampler.info.pixelSlot, 1, sampler.sampler.GetAddressOf());
+				cache.SetSampler(StateCache::Stage::Vertex, sampler.info.pixelSlot, sampler.sampler.Get());
 				break;
 			case Shader::Pixel:
-				graphics.GetContext()->PSSetSamplers(sampler.info.pixelSlot, 1, sampler.sampler.GetAddressOf());
+				cache.SetSampler(StateCache::Stage::Pixel, sampler.info.pixelSlot, sampler.sampler.Get());
 				break;
 			}
 		}
@@ -212,31 +275,98 @@ namespace Engine
 		RendererAPI& graphics = RendererAPI::Get();
 
 		if ((uint32_t)bp.type & (uint32_t)Shader::ShaderType::Vertex)
-			graphics.GetContext()->VSSetConstantBuffers(bp.vertexSlot, 1u, cb->GetBuffer().GetAddressOf());
+			graphics.GetStateCache().SetConstantBuffer(StateCache::Stage::Vertex, bp.vertexSlot, cb->GetBuffer().Get());
 		if ((uint32_t)bp.type & (uint32_t)Shader::ShaderType::Pixel)
-			graphics.GetContext()->PSSetConstantBuffers(bp.pixelSlot, 1u, cb->GetBuffer().GetAddressOf());
+			graphics.GetStateCache().SetConstantBuffer(StateCache::Stage::Pixel, bp.pixelSlot, cb->GetBuffer().Get());
+	}
+
+	void RendererCommand::SetConstants(Shader::BindPointInfo bp, const void* data, uint32_t size)
+	{
+		ConstantBufferAllocator::Slice slice = ConstantBufferAllocator::Get().Allocate(size);
+		if (!slice.IsValid())
+		{
+			// no 11.1 runtime, fall back to a buffer of its own (the size has to be a multiple of 16)
+			std::vector<uint8_t> padded((size + 15) & ~15u, 0);
+			memcpy(padded.data(), data, size);
+			SetConstantBuffer(bp, ConstantBuffer::Create(padded.data(), (uint32_t)padded.size()));
+			return;
+		}
+
+		memcpy(slice.data, data, size);
+		SetConstants(bp, slice);
+	}
+
+	void RendererCommand::SetConstants(Shader::BindPointInfo bp, const ConstantBufferAllocator::Slice& slice)
+	{
+		RendererAPI& graphics = RendererAPI::Get();
+
+		if ((uint32_t)bp.type & (uint32_t)Shader::ShaderType::Vertex)
+			graphics.GetStateCache().SetConstantBuffer(StateCache::Stage::Vertex, bp.vertexSlot, slice.buffer, slice.firstConstant, slice.constantCount);
+		if ((uint32_t)bp.type & (uint32_t)Shader::ShaderType::Pixel)
+			graphics.GetStateCache().SetConstantBuffer(StateCache::Stage::Pixel, bp.pixelSlot, slice.buffer, slice.firstConstant, slice.constantCount);
+	}
+
+	void RendererCommand::SetParameterBlock(Shader::BindPointInfo bp, Ref<ParameterBlock> block)
+	{
+		if (block->Upload())
+		{
+			s_Statistics.parameterUploads++;
+			s_Statistics.parameterBytesUploaded += block->GetSize();
+		}
+		else
+		{
+			s_Statistics.parameterUploadsSkipped++;
+			s_Statistics.parameterBytesSkipped += block->GetSize();
+		}
+
+		SetConstantBuffer(bp, block->GetBuffer());
 	}
 
 	void RendererCommand::SetStructruedBuffer(Shader::BindPointInfo bp, Ref<StructuredBuffer> sb)
 	{
 		RendererAPI& graphics = RendererAPI::Get();
 
+		uint32_t bytes = sb->Upload();
+		if (bytes != 0)
+		{
+			s_Statistics.structuredBufferUploads++;
+			s_Statistics.structuredBufferBytesUploaded += bytes;
+		}
+
 		if ((uint32_t)bp.type & (uint32_t)Shader::ShaderType::Vertex)
-			graphics.GetContext()->VSSetShaderResources(bp.vertexSlot, 1u, sb->GetSRV().GetAddressOf());
+			graphics.GetStateCache().SetShaderResource(StateCache::Stage::Vertex, bp.vertexSlot, sb->GetSRV().Get());
 		if ((uint32_t)bp.type & (uint32_t)Shader::ShaderType::Pixel)
-			graphics.GetContext()->VSSetShaderResources(bp.pixelSlot, 1u, sb->GetSRV().GetAddressOf());
+			graphics.GetStateCache().SetShaderResource(StateCache::Stage::Pixel, bp.pixelSlot, sb->GetSRV().Get());
 	}
 
 	void RendererCommand::SetTexture(Shader::BindPointInfo bp, Ref<Texture2D> texture)
 	{
 		RendererAPI& graphics = RendererAPI::Get();
+		s_Statistics.textureBinds++;
+		TextureResidency::Get().Touch(texture.get());
+		ID3D11ShaderResourceView* srv = texture != nullptr ? texture->GetSRV().Get() : nullptr;
+		if ((uint32_t)bp.type & (uint32_t)Shader::ShaderType::Vertex)
+		{
+			graphics.GetStateCache().SetShaderResource(StateCache::Stage::Vertex, bp.vertexSlot, srv);
+		}
+		if ((uint32_t)bp.type & (uint32_t)Shader::ShaderType::Pixel)
+		{
+			graphics.GetStateCache().SetShaderResource(StateCache::Stage::Pixel, bp.pixelSlot, srv);
+		}
+	}
+
+	void RendererCommand::SetTexture(Shader::BindPointInfo bp, Ref<Texture2DArray> texture)
+	{
+		RendererAPI& graphics = RendererAPI::Get();
+		s_Statistics.textureBinds++;
+		ID3D11ShaderResourceView* srv = texture != nullptr ? texture->GetSRV().Get() : nullptr;
 		if ((uint32_t)bp.type & (uint32_t)Shader::ShaderType::Vertex)
 		{
-			graphics.GetContext()->VSSetShaderResources(bp.vertexSlot, 1u, texture->GetSRV().GetAddressOf());
+			graphics.GetStateCache().SetShaderResource(StateCache::Stage::Vertex, bp.vertexSlot, srv);
 		}
 		if ((uint32_t)bp.type & (uint32_t)Shader::ShaderType::Pixel)
 		{
-			graphics.GetContext()->PSSetShaderResources(bp.pixelSlot, 1u, texture->GetSRV().GetAddressOf());
+			graphics.GetStateCache().SetShaderResource(StateCache::Stage::Pixel, bp.pixelSlot, srv);
 		}
 	}
 
@@ -245,20 +375,65 @@ namespace Engine
 		RendererAPI& graphics = RendererAPI::Get();
 		SetSwapChain(swapChain);
 		SetShader(s_BlitShader);
-		SetTexture(s_BlitShader->GetBindPoint("tex"), renderTarget);
+		static constexpr PropertyID texID = ShaderProperty::ID("tex");
+		SetTexture(s_BlitShader->GetBindPoint(texID), renderTarget);
 		DrawMesh(s_ScreenMesh);
 	}
 
-	void RendererCommand::DrawIndexed(uint32_t count)
+	void RendererCommand::DrawIndexed(uint32_t count, uint32_t startIndex, uint32_t baseVertex)
 	{
 		RendererAPI& graphics = RendererAPI::Get();
-		graphics.GetContext()->DrawIndexed(count, 0u, 0u);
+		ConstantBufferAllocator::Get().Flush(); // slices set since the last draw have to be unmapped
+		if (RendererAPI::GetThreadContext() == nullptr)
+			UploadQueue::Get().FlushHighPriority(); // meshes made this frame, command recorders flush before recording starts
+		BindVertexStreams();
+		s_Statistics.drawCalls++;
+		s_Statistics.vertexBytesFetched += (uint64_t)count * s_VertexStride;
+		graphics.GetContext()->DrawIndexed(count, startIndex, (INT)baseVertex);
 	}
 
 	void RendererCommand::DrawMesh(Ref<Mesh> mesh)
 	{
 		SetMesh(mesh);
-		DrawIndexed(mesh->GetIndexBuffer()->GetCount());
+		DrawIndexed(mesh->GetIndexCount(), mesh->GetStartIndex(), mesh->GetBaseVertex());
+	}
+
+	void RendererCommand::ResetBindings()
+	{
+		s_Shader = nullptr;
+		s_Mesh = nullptr;
+		s_VertexStreamsDirty = true;
+		s_VertexStride = 0;
+	}
+
+	void RendererCommand::BindVertexStreams()
+	{
+		if (!s_VertexStreamsDirty || s_Shader == nullptr)
+			return;
+		s_VertexStreamsDirty = false;
+
+		RendererAPI& graphics = RendererAPI::Get();
+		if (s_Mesh == nullptr)
+		{
+			// a plain vertex buffer has everything interleaved in slot 0
+			graphics.GetStateCache().SetInputLayout(s_Shader->GetInputLayout().Get());
+			return;
+		}
+
+		const VertexLayout& layout = s_Mesh->GetLayout();
+		const Shader::StreamLayout& streamLayout = s_Shader->GetInputLayout(layout);
+		graphics.GetStateCache().SetInputLayout(streamLayout.inputLayout.Get());
+		s_VertexStride = streamLayout.stride;
+
+		// streams the shader does not read are left alone, whatever is in those slots is never fetched
+		for (uint32_t stream = 0; stream < layout.GetStreamCount(); stream++)
+		{
+			if ((streamLayout.streams & BIT(stream)) == 0)
+				continue;
+
+			if (graphics.GetStateCache().SetVertexBuffer(stream, s_Mesh->GetVertexBuffer(stream).Get(), layout.GetStride(stream)))
+				s_Statistics.meshBufferBinds++;
+		}
 	}
 
-}
\ No newline at end of file
+}
@@ -1,6 +1,7 @@
 #pragma once
 #include "Core/Core.h"
 #include "Shader.h"
+#include "ConstantBufferAllocator.h"
 
 namespace Engine
 {
@@ -10,7 +11,9 @@ namespace Engine
 	class Mesh;
 	class ConstantBuffer;
 	class StructuredBuffer;
+	class ParameterBlock;
 	class Texture2D;
+	class Texture2DArray;
 	class RenderTarget;
 	class FrameBuffer;
 }
@@ -19,9 +22,27 @@ namespace Engine
 {
 	class RendererCommand
 	{
+	public:
+		struct Statistics
+		{
+			uint32_t drawCalls = 0;
+			uint32_t textureBinds = 0;
+			uint32_t meshBufferBinds = 0; // meshes in the same heap page share their buffers
+			uint64_t vertexBytesFetched = 0; // index count times the stride of the streams the shader reads
+			uint32_t parameterUploads = 0;
+			uint32_t parameterUploadsSkipped = 0; // parameter blocks bound without changes
+			uint64_t parameterBytesUploaded = 0;
+			uint64_t parameterBytesSkipped = 0;
+			uint32_t structuredBufferUploads = 0;
+			uint64_t structuredBufferBytesUploaded = 0; // only the ranges that changed
+
+			Statistics& operator+=(const Statistics& other);
+		};
 
 	public:
 		static void Init();
+		static void BeginFrame();
+		static void EndFrame(); // after the frame is presented
 
 		static void SetSwapChain(SwapChain& swapChain);
 		static void ClearSwapChain(SwapChain& swapChain, glm::vec3 color);
@@ -34,17 +55,41 @@ namespace Engine
 		static void SetMesh(Ref<Mesh> mesh);
 		static void SetShader(Ref<Shader> shader);
 		static void SetConstantBuffer(Shader::BindPointInfo bp, Ref<ConstantBuffer> cb);
+		// copies the data into this frame's constant buffer slices, for constants that change every draw
+		static void SetConstants(Shader::BindPointInfo bp, const void* data, uint32_t size);
+		static void SetConstants(Shader::BindPointInfo bp, const ConstantBufferAllocator::Slice& slice); // a slice already written
+		static void SetParameterBlock(Shader::BindPointInfo bp, Ref<ParameterBlock> block); // uploads the block first if it changed
 		static void SetStructruedBuffer(Shader::BindPointInfo bp, Ref<StructuredBuffer> sb);
-		static void SetTexture(Shader::BindPointInfo bp, Ref<Texture2D> texture);
+		static void SetTexture(Shader::BindPointInfo bp, Ref<Texture2D> texture); // nullptr unbinds the slot
+		static void SetTexture(Shader::BindPointInfo bp, Ref<Texture2DArray> texture);
 
 		static void BlitToSwapChain(SwapChain& swapChain, Ref<RenderTarget> renderTarget);
 
-		static void DrawIndexed(uint32_t count);
+		static void DrawIndexed(uint32_t count, uint32_t startIndex = 0, uint32_t baseVertex = 0);
 		static void DrawMesh(Ref<Mesh> mesh);
 
+		// for the calling thread, lists recorded with CommandRecorder are added when they are submitted
+		static const Statistics& GetStatistics() { return s_Statistics; }
+		static void ResetStatistics() { s_Statistics = Statistics(); }
+
+	private:
+		friend class CommandRecorder;
+
+		// the input layout and vertex streams depend on both the shader and the mesh so they are bound at the draw
+		static void BindVertexStreams();
+		// forgets the shader and mesh, for when the context starts over like at the start of a command list
+		static void ResetBindings();
+
 	private:
 		static Ref<Shader> s_BlitShader;
 		static Ref<Mesh> s_ScreenMesh;
 
+		// each thread has its own so command recorders on different threads do not share anything
+		static thread_local Statistics s_Statistics;
+		static thread_local Ref<Shader> s_Shader;
+		static thread_local Ref<Mesh> s_Mesh; // nullptr when a plain vertex buffer is set
+		static thread_local bool s_VertexStreamsDirty;
+		static thread_local uint32_t s_VertexStride; // bytes fetched for each vertex by the bound layout
+
 	};
 }
\ No newline at end of file
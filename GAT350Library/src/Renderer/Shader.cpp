@@ -2,6 +2,15 @@
 #include "RendererAPI.h"
 #include "Buffer.h"
 #include "ShaderCompiler.h"
+#include "ShaderInclude.h"
+#include "ShaderHotReload.h"
+#include "Core/AsyncFileReader.h"
+#include "Util/Parallel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <atomic>
 
 namespace Engine
 {
@@ -64,38 +73,72 @@ namespace Engine
 		return DXGI_FORMAT_UNKNOWN;
 	}
 
+	// every shader alive so an include change can find the ones that use it
+	static std::mutex s_ShadersMutex;
+	static std::vector<Shader*> s_Shaders;
+	static std::atomic<uint64_t> s_NextShaderID = 1;
+
+	struct Shader::Compiled
+	{
+		ShaderCompiler::CompiledShader shader;
+		float milliseconds = 0.0f;
+	};
+
 	Shader::Shader(const fs::path& path)
 	{
+		Track(path);
 
-		std::ifstream file(path);
-		file.seekg(0, std::ios::end);
-		size_t size = file.tellg();
-		std::string src(size, ' ');
-		file.seekg(0);
-		file.read(&src[0], size);
+		std::string src;
+		if (!ReadSource(path, src))
+			return;
 		LoadFromSrc(src);
 	}
 
 	Shader::Shader(const std::string& src)
 	{
+		Track("");
 		LoadFromSrc(src);
 	}
 
+	Shader::~Shader()
+	{
+		// the compile threads write to the shader
+		WaitForCompiles();
+
+		// shaders built for a hot reload were never added
+		std::lock_guard<std::mutex> lock(s_ShadersMutex);
+		auto it = std::find(s_Shaders.begin(), s_Shaders.end(), this);
+		if (it != s_Shaders.end())
+			s_Shaders.erase(it);
+	}
+
 	bool Shader::operator==(const Shader& other)
 	{
-		return m_VertexShader == other.m_VertexShader && m_PixelShader == other.m_PixelShader;
+		// every shader creates its own variants so two shaders only match when they are the same one
+		return this == &other;
 	}
 
-	void Shader::LoadFromSrc(const std::string& src)
+	// returns false if the variant has nothing to draw with
+	static bool CreateVariant(const ShaderCompiler::CompiledShader& compiledShader, Shader::Variant& variant)
 	{
 		RendererAPI& graphics = RendererAPI::Get();
-		ShaderCompiler::CompiledShader compiledShader = ShaderCompiler::Compile(src);
+		if (compiledShader.vertexShader == nullptr || compiledShader.pixelShader == nullptr)
+		{
+			DBOUT("shader variant has no vertex or pixel shader" << std::endl);
+			return false;
+		}
 
-		graphics.GetDivice()->CreateVertexShader(compiledShader.vertexShader->GetBufferPointer(), compiledShader.vertexShader->GetBufferSize(), nullptr, &m_VertexShader);
-		graphics.GetDivice()->CreatePixelShader(compiledShader.pixelShader->GetBufferPointer(), compiledShader.pixelShader->GetBufferSize(), nullptr, &m_PixelShader);
+		graphics.GetDivice()->CreateVertexShader(compiledShader.vertexShader->GetBufferPointer(), compiledShader.vertexShader->GetBufferSize(), nullptr, &variant.vertexShader);
+		graphics.GetDivice()->CreatePixelShader(compiledShader.pixelShader->GetBufferPointer(), compiledShader.pixelShader->GetBufferSize(), nullptr, &variant.pixelShader);
+		if (variant.vertexShader == nullptr || variant.pixelShader == nullptr)
+		{
+			DBOUT("failed to create shader variant" << std::endl);
+			return false;
+		}
 
 		for (ShaderCompiler::BindingInfo binding : compiledShader.bindings)
-			AddBindPoint(binding.name, binding.type, binding.point);
+			variant.AddBindPoint(binding.name, binding.type, binding.point);
+		variant.constantBuffers = compiledShader.constantBuffers;
 
 		std::vector<D3D11_INPUT_ELEMENT_DESC> ied(compiledShader.inputSigniture.size());
 		for (uint32_t i = 0; i < compiledShader.inputSigniture.size(); i++)
@@ -108,11 +151,70 @@ namespace Engine
 			};
 		}
 
-		HRESULT hr = graphics.GetDivice()->CreateInputLayout(ied.data(), (uint32_t)ied.size(), compiledShader.vertexShader->GetBufferPointer(), compiledShader.vertexShader->GetBufferSize(), &m_InputLayout);
+		HRESULT hr = graphics.GetDivice()->CreateInputLayout(ied.data(), (uint32_t)ied.size(), compiledShader.vertexShader->GetBufferPointer(), compiledShader.vertexShader->GetBufferSize(), &variant.inputLayout);
 		if (FAILED(hr)) {
 			DBOUT("failed to create layout from reflection" << std::endl);
-			return;
+			return true;
+		}
+
+		for (const ShaderCompiler::InputElement& input : compiledShader.inputSigniture)
+			variant.inputElements.push_back({ input.semanticName, input.semanticIndex });
+		variant.vertexCode = compiledShader.vertexShader;
+
+		// create samplers, shaders using the same sampler settings share one state object
+		PipelineStateCache& stateCache = PipelineStateCache::Get();
+		for (ShaderCompiler::SamplerInfo info : compiledShader.samplers)
+		{
+			D3D11_SAMPLER_DESC samplerDesc = {};
+			samplerDesc.Filter = GetMinMagFilter(info.Min, info.Mag);
+			samplerDesc.AddressU = GetAddressMode(info.U);
+			samplerDesc.AddressV = GetAddressMode(info.V);
+			samplerDesc.AddressW = D3D11_TEXTURE_ADDRESS_WRAP;
+			samplerDesc.MipLODBias = 0;
+			samplerDesc.MinLOD = 0;
+			samplerDesc.MaxLOD = D3D11_FLOAT32_MAX;
+			samplerDesc.MaxAnisotropy = 8;
+
+			Shader::Sampler s;
+			s.stateID = stateCache.GetSamplerID(samplerDesc);
+			s.sampler = stateCache.GetSamplerState(s.stateID);
+			if (s.sampler == nullptr)
+				continue;
+
+			s.info.type = info.bindInfo.type;
+			s.info.pixelSlot = info.bindInfo.point;
+			s.info.vertexSlot = info.bindInfo.point;
+			variant.samplers.push_back(s);
 		}
+		return true;
+	}
+
+	void Shader::Track(const fs::path& path)
+	{
+		m_Path = path;
+		m_ID = s_NextShaderID++;
+		{
+			std::lock_guard<std::mutex> lock(s_ShadersMutex);
+			s_Shaders.push_back(this);
+		}
+		if (!path.empty())
+			ShaderHotReload::Get().Watch(path);
+	}
+
+	void Shader::LoadFromSrc(const std::string& src)
+	{
+		Compiled base = { ShaderCompiler::Compile(src, 0, m_Path) };
+		Load(src, base);
+	}
+
+	void Shader::Load(const std::string& src, Compiled& base)
+	{
+		ShaderCompiler::CompiledShader& compiledShader = base.shader;
+
+		m_Source = src;
+		m_KeywordNames = compiledShader.config.keywords;
+		m_KeywordGroups = compiledShader.config.keywordGroups;
+		m_MaxVariants = compiledShader.config.maxVariants;
 
 		D3D11_DEPTH_STENCIL_DESC dsstate_desc = {};
 		dsstate_desc.DepthEnable = true;
@@ -144,7 +246,6 @@ namespace Engine
 			dsstate_desc.DepthFunc = D3D11_COMPARISON_ALWAYS;
 			break;
 		}
-		dsstate_desc.DepthFunc = D3D11_COMPARISON_LESS;
 		dsstate_desc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ALL;
 		dsstate_desc.BackFace.StencilFailOp = D3D11_STENCIL_OP_KEEP;
 		dsstate_desc.BackFace.StencilPassOp = D3D11_STENCIL_OP_KEEP;
@@ -152,7 +253,9 @@ namespace Engine
 		dsstate_desc.FrontFace.StencilFailOp = D3D11_STENCIL_OP_KEEP;
 		dsstate_desc.FrontFace.StencilPassOp = D3D11_STENCIL_OP_KEEP;
 		dsstate_desc.FrontFace.StencilFunc = D3D11_COMPARISON_ALWAYS;
-		graphics.GetDivice()->CreateDepthStencilState(&dsstate_desc, m_DepthStencilState.GetAddressOf());
+		PipelineStateCache& stateCache = PipelineStateCache::Get();
+		m_DepthStencilID = stateCache.GetDepthStencilID(dsstate_desc);
+		m_DepthStencilState = stateCache.GetDepthStencilState(m_DepthStencilID);
 
 		D3D11_RASTERIZER_DESC rasterizer_desc = {};
 		rasterizer_desc.AntialiasedLineEnable = false;
@@ -177,42 +280,409 @@ namespace Engine
 		rasterizer_desc.MultisampleEnable = false;
 		rasterizer_desc.ScissorEnable = false;
 		rasterizer_desc.SlopeScaledDepthBias = 0.0f;
-		graphics.GetDivice()->CreateRasterizerState(&rasterizer_desc, m_RasterizerState.GetAddressOf());
+		m_RasterizerID = stateCache.GetRasterizerID(rasterizer_desc);
+		m_RasterizerState = stateCache.GetRasterizerState(m_RasterizerID);
 
-		// create samplers
-		for (ShaderCompiler::SamplerInfo info : compiledShader.samplers)
+		// the base variant always exists so there is something to fall back to
+		CreateVariant(compiledShader, m_Variants[0]);
+		AddDependencies(compiledShader.dependencies);
+		m_VariantStatistics.compiled++;
+
+		Preload(compiledShader.config.preloadVariants);
+	}
+
+	const Shader::StreamLayout& Shader::GetInputLayout(const VertexLayout& layout)
+	{
+		Variant& variant = GetActiveVariant();
 		{
-			wrl::ComPtr<ID3D11SamplerState> sampler;
-			D3D11_SAMPLER_DESC samplerDesc = {};
-			samplerDesc.Filter = GetMinMagFilter(info.Min, info.Mag);
-			samplerDesc.AddressU = GetAddressMode(info.U);
-			samplerDesc.AddressV = GetAddressMode(info.V);
-			samplerDesc.AddressW = D3D11_TEXTURE_ADDRESS_WRAP;
-			samplerDesc.MipLODBias = 0;
-			samplerDesc.MinLOD = 0;
-			samplerDesc.MaxLOD = D3D11_FLOAT32_MAX;
-			samplerDesc.MaxAnisotropy = 8;
+			std::shared_lock<std::shared_mutex> lock(m_VariantMutex);
+			auto it = variant.streamLayouts.find(layout.GetHash());
+			if (it != variant.streamLayouts.end())
+				return it->second;
+		}
+
+		// command recorders can get here from several threads at once, the first one in makes the layout
+		// a layout that does not work is kept too so the error is only printed once
+		std::unique_lock<std::shared_mutex> lock(m_VariantMutex);
+		auto [it, inserted] = variant.streamLayouts.try_emplace(layout.GetHash());
+		StreamLayout& streamLayout = it->second;
+		if (!inserted || variant.vertexCode == nullptr)
+			return streamLayout;
 
-			hr = graphics.GetDivice()->CreateSamplerState(&samplerDesc, sampler.GetAddressOf());
-			if (FAILED(hr)) {
-				DBOUT("failed to create sampler" << std::endl);
+		std::vector<D3D11_INPUT_ELEMENT_DESC> ied;
+		uint32_t streams = 0;
+		uint32_t stride = 0;
+		for (const InputElement& input : variant.inputElements)
+		{
+			// system values are made by the input assembler and are not in any stream
+			if (input.semanticName.compare(0, 3, "SV_") == 0)
 				continue;
+
+			const VertexElement* element = nullptr;
+			uint32_t stream = layout.Find(input.semanticName, input.semanticIndex, &element);
+			if (stream == VertexLayout::InvalidStream)
+			{
+				DBOUT("vertex layout has no " << input.semanticName.c_str() << input.semanticIndex << " for shader " << m_Path.c_str() << std::endl);
+				return streamLayout;
 			}
 
-			Sampler s;
-			s.sampler = sampler;
-			s.info.type = info.bindInfo.type;
-			s.info.pixelSlot = info.bindInfo.point;
-			s.info.vertexSlot = info.bindInfo.point;
-			m_Samplers.push_back(s);
+			ShaderDataType type = element->type;
+			ied.push_back({ input.semanticName.c_str(), input.semanticIndex, ShaderDataTypeToDXGIFormat(type), stream, element->offset, D3D11_INPUT_PER_VERTEX_DATA, 0 });
+			if ((streams & BIT(stream)) == 0)
+			{
+				streams |= BIT(stream);
+				stride += layout.GetStride(stream);
+			}
+		}
+
+		HRESULT hr = RendererAPI::Get().GetDivice()->CreateInputLayout(ied.data(), (uint32_t)ied.size(), variant.vertexCode->GetBufferPointer(), variant.vertexCode->GetBufferSize(), &streamLayout.inputLayout);
+		if (FAILED(hr))
+		{
+			DBOUT("failed to create input layout for vertex layout " << TranslateError(hr) << std::endl);
+			return streamLayout;
+		}
+		streamLayout.streams = streams;
+		streamLayout.stride = stride;
+		return streamLayout;
+	}
+
+	const ConstantBufferLayout* Shader::GetConstantBufferLayout(const std::string& name)
+	{
+		for (const ConstantBufferLayout& layout : GetActiveVariant().constantBuffers)
+		{
+			if (layout.name == name)
+				return &layout;
+		}
+		return nullptr;
+	}
+
+	uint64_t Shader::GetKeywordMask(const std::string& keyword) const
+	{
+		auto it = std::find(m_KeywordNames.begin(), m_KeywordNames.end(), keyword);
+		if (it == m_KeywordNames.end())
+			return 0;
+		return 1ull << (it - m_KeywordNames.begin());
+	}
+
+	void Shader::EnableKeyword(const std::string& keyword)
+	{
+		uint64_t mask = GetKeywordMask(keyword);
+		if (mask == 0)
+		{
+			DBOUT("shader has no keyword " << keyword.c_str() << std::endl);
+			return;
+		}
+
+		uint64_t keywords = m_EnabledKeywords;
+		for (uint64_t group : m_KeywordGroups)
+		{
+			if (group & mask)
+				keywords &= ~group;
+		}
+		SetKeywords(keywords | mask);
+	}
+
+	void Shader::DisableKeyword(const std::string& keyword)
+	{
+		SetKeywords(m_EnabledKeywords & ~GetKeywordMask(keyword));
+	}
+
+	void Shader::SetKeywords(uint64_t keywords)
+	{
+		uint64_t declared = m_KeywordNames.size() >= 64 ? ~0ull : (1ull << m_KeywordNames.size()) - 1;
+		keywords &= declared;
+		if (keywords != m_EnabledKeywords)
+		{
+			m_EnabledKeywords = keywords;
+			m_ActiveVariant = nullptr;
+		}
+	}
+
+	void Shader::Preload(const std::vector<uint64_t>& variants)
+	{
+		// a variant that is already compiling lazily is not compiled twice
+		std::vector<uint64_t> missing;
+		for (uint64_t keywords : variants)
+		{
+			if (m_Variants.find(keywords) == m_Variants.end() && m_PendingVariants.find(keywords) == m_PendingVariants.end() &&
+				std::find(missing.begin(), missing.end(), keywords) == missing.end())
+				missing.push_back(keywords);
+		}
+		size_t existing = m_Variants.size() + m_PendingVariants.size();
+		if (existing + missing.size() > m_MaxVariants)
+		{
+			DBOUT("preloading " << missing.size() << " variants would go over the cap of " << m_MaxVariants << std::endl);
+			m_VariantStatistics.overCap += (uint32_t)(existing + missing.size() - m_MaxVariants);
+			missing.resize(m_MaxVariants > existing ? m_MaxVariants - existing : 0);
+		}
+
+		// the variants are independent so compile them all at once and create them in order after
+		auto start = std::chrono::steady_clock::now();
+		std::vector<ShaderCompiler::CompiledShader> compiled(missing.size());
+		Parallel::For((uint32_t)missing.size(), [&](uint32_t i) {
+			compiled[i] = ShaderCompiler::Compile(m_Source, missing[i], m_Path);
+		});
+
+		uint32_t created = 0;
+		for (uint32_t i = 0; i < missing.size(); i++)
+		{
+			// the includes are watched even when it failed so fixing them compiles it again
+			AddDependencies(compiled[i].dependencies);
+
+			Variant variant;
+			if (!CreateVariant(compiled[i], variant))
+			{
+				m_FailedVariants.push_back(missing[i]);
+				m_VariantStatistics.failed++;
+				continue;
+			}
+			m_Variants[missing[i]] = std::move(variant);
+			created++;
+		}
+
+		m_VariantStatistics.compiled += created;
+		m_VariantStatistics.preloaded += created;
+		m_VariantStatistics.compileMilliseconds += std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+		m_ActiveVariant = nullptr;
+	}
+
+	Shader::Variant& Shader::GetActiveVariant()
+	{
+		Variant* active = m_ActiveVariant;
+		if (active != nullptr && !m_CompilesFinished)
+			return *active;
+
+		// command recorders can get here from several threads at once
+		std::unique_lock<std::shared_mutex> lock(m_VariantMutex);
+		if (m_CompilesFinished.exchange(false))
+		{
+			FinishCompiles();
+			m_ActiveVariant = nullptr; // the variant being drawn with may be the one that just finished
+		}
+		active = m_ActiveVariant;
+		if (active != nullptr)
+			return *active;
+
+		auto it = m_Variants.find(m_EnabledKeywords);
+		if (it != m_Variants.end())
+		{
+			active = &it->second;
+		}
+		else
+		{
+			// draw with the base variant until the compile is done
+			StartCompile(m_EnabledKeywords);
+			active = &m_Variants[0];
+		}
+
+		if (!active->used)
+		{
+			active->used = true;
+			m_VariantStatistics.used++;
+		}
+		m_ActiveVariant = active;
+		return *active;
+	}
+
+	void Shader::StartCompile(uint64_t keywords)
+	{
+		if (m_PendingVariants.find(keywords) != m_PendingVariants.end())
+			return;
+		if (std::find(m_FailedVariants.begin(), m_FailedVariants.end(), keywords) != m_FailedVariants.end())
+			return;
+		if (m_Variants.size() + m_PendingVariants.size() >= m_MaxVariants)
+		{
+			DBOUT("shader is at its cap of " << m_MaxVariants << " variants, using the base variant instead" << std::endl);
+			m_VariantStatistics.overCap++;
+			return;
+		}
+
+		// the source and path are copied since a hot reload can swap them out while it compiles
+		m_PendingVariants[keywords] = std::async(std::launch::async, [this, src = m_Source, path = m_Path, keywords]() {
+			auto start = std::chrono::steady_clock::now();
+			Ref<Compiled> compiled = std::make_shared<Compiled>();
+			compiled->shader = ShaderCompiler::Compile(src, keywords, path);
+			compiled->milliseconds = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+			m_CompilesFinished = true;
+			return compiled;
+		});
+	}
+
+	void Shader::FinishCompiles()
+	{
+		bool waiting = false;
+		for (auto it = m_PendingVariants.begin(); it != m_PendingVariants.end();)
+		{
+			// the flag is set just before the result is, so it may not be there yet
+			if (it->second.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+			{
+				waiting = true;
+				it++;
+				continue;
+			}
+
+			uint64_t keywords = it->first;
+			Ref<Compiled> compiled = it->second.get();
+			it = m_PendingVariants.erase(it);
+
+			AddDependencies(compiled->shader.dependencies);
+			m_VariantStatistics.compileMilliseconds += compiled->milliseconds;
+
+			Variant variant;
+			if (!CreateVariant(compiled->shader, variant))
+			{
+				m_FailedVariants.push_back(keywords);
+				m_VariantStatistics.failed++;
+				continue;
+			}
+			m_Variants[keywords] = std::move(variant);
+			m_VariantStatistics.compiled++;
+		}
+
+		if (waiting)
+			m_CompilesFinished = true;
+	}
+
+	void Shader::WaitForCompiles()
+	{
+		for (auto& pending : m_PendingVariants)
+			pending.second.wait();
+		m_PendingVariants.clear();
+		m_CompilesFinished = false;
+	}
+
+	bool Shader::DependsOn(const fs::path& path) const
+	{
+		fs::path key = ShaderIncludeCache::GetKey(path);
+		return std::find(m_Dependencies.begin(), m_Dependencies.end(), key) != m_Dependencies.end();
+	}
+
+	void Shader::Reload()
+	{
+		// compile the same variants again so nothing that was in use has to compile lazily later
+		std::vector<uint64_t> variants;
+		for (auto& variant : m_Variants)
+		{
+			if (variant.first != 0)
+				variants.push_back(variant.first);
 		}
+
+		WaitForCompiles();
+		m_Variants.clear();
+		m_FailedVariants.clear();
+		m_ActiveVariant = nullptr;
+		m_Dependencies.clear();
+
+		LoadFromSrc(m_Source);
+		Preload(variants);
+	}
+
+	uint32_t Shader::ReloadDependents(const fs::path& include)
+	{
+		ShaderIncludeCache::Get().Invalidate(include);
+
+		std::vector<Shader*> dependents = GetDependents(include);
+		for (Shader* shader : dependents)
+			shader->Reload();
+		return (uint32_t)dependents.size();
 	}
 
-	void Shader::AddBindPoint(const std::string& name, ShaderType type, uint32_t slot)
+	bool Shader::ReadSource(const fs::path& path, std::string& src)
 	{
-		BindPointInfo info = {};
-		if (m_BindPoints.find(name) != m_BindPoints.end())
-			info = m_BindPoints.at(name);
+		AsyncFileReader::Handle file = AsyncFileReader::Get().Read(path, AsyncFileReader::Priority::High);
+		const std::vector<uint8_t>& data = file.Wait();
+		if (data.empty())
+		{
+			DBOUT("failed to read shader " << path.c_str() << std::endl);
+			return false;
+		}
+
+		src.assign(data.begin(), data.end());
+		return true;
+	}
+
+	std::vector<Shader*> Shader::GetDependents(const fs::path& path)
+	{
+		fs::path key = ShaderIncludeCache::GetKey(path);
+
+		std::vector<Shader*> dependents;
+		std::lock_guard<std::mutex> lock(s_ShadersMutex);
+		for (Shader* shader : s_Shaders)
+		{
+			bool source = !shader->m_Path.empty() && ShaderIncludeCache::GetKey(shader->m_Path) == key;
+			if (source || shader->DependsOn(key))
+				dependents.push_back(shader);
+		}
+		return dependents;
+	}
+
+	Shader* Shader::Find(uint64_t id)
+	{
+		std::lock_guard<std::mutex> lock(s_ShadersMutex);
+		for (Shader* shader : s_Shaders)
+		{
+			if (shader->m_ID == id)
+				return shader;
+		}
+		return nullptr;
+	}
+
+	bool Shader::IsValid() const
+	{
+		auto it = m_Variants.find(0);
+		return it != m_Variants.end() && it->second.vertexShader != nullptr && it->second.pixelShader != nullptr && it->second.inputLayout != nullptr;
+	}
+
+	void Shader::SwapProgram(Shader& other)
+	{
+		// compiles of the old source would put old variants in with the new ones
+		WaitForCompiles();
+		other.WaitForCompiles();
+		m_FailedVariants.clear();
+
+		// everything that came from the source, the keywords that are on and the statistics stay
+		std::swap(m_Source, other.m_Source);
+		std::swap(m_Dependencies, other.m_Dependencies);
+		std::swap(m_Variants, other.m_Variants);
+		std::swap(m_KeywordNames, other.m_KeywordNames);
+		std::swap(m_KeywordGroups, other.m_KeywordGroups);
+		std::swap(m_MaxVariants, other.m_MaxVariants);
+		std::swap(m_DepthStencilState, other.m_DepthStencilState);
+		std::swap(m_RasterizerState, other.m_RasterizerState);
+		std::swap(m_DepthStencilID, other.m_DepthStencilID);
+		std::swap(m_RasterizerID, other.m_RasterizerID);
+		m_ActiveVariant = nullptr;
+		other.m_ActiveVariant = nullptr;
+
+		// the keywords may have moved or gone away
+		uint64_t keywords = m_EnabledKeywords;
+		m_EnabledKeywords = 0;
+		SetKeywords(keywords);
+	}
+
+	void Shader::AddDependencies(const std::vector<fs::path>& dependencies)
+	{
+		for (const fs::path& dependency : dependencies)
+		{
+			if (std::find(m_Dependencies.begin(), m_Dependencies.end(), dependency) == m_Dependencies.end())
+			{
+				m_Dependencies.push_back(dependency);
+				ShaderHotReload::Get().Watch(dependency);
+			}
+		}
+	}
+
+	void Shader::Variant::AddBindPoint(const std::string& name, ShaderType type, uint32_t slot)
+	{
+		PropertyID id = ShaderProperty::Get().Intern(name);
+		BindPoint* bindPoint = FindBindPoint(id);
+		if (bindPoint == nullptr)
+		{
+			InsertBindPoint({ id, {} });
+			bindPoint = FindBindPoint(id);
+		}
+
+		BindPointInfo& info = bindPoint->info;
 		info.type = (ShaderType)((uint32_t)info.type | (uint32_t)type);
 		switch (type)
 		{
@@ -223,9 +693,72 @@ namespace Engine
 			info.pixelSlot = slot;
 			break;
 		}
+	}
 
-		// create a new constant buffer object and added it to the map
-		m_BindPoints[name] = info;
+	Shader::Variant::BindPoint* Shader::Variant::FindBindPoint(PropertyID id)
+	{
+		if (bindPoints[id & bindMask].id == id)
+			return &bindPoints[id & bindMask];
+		for (BindPoint& bindPoint : overflowBindPoints)
+		{
+			if (bindPoint.id == id)
+				return &bindPoint;
+		}
+		return nullptr;
+	}
+
+	Shader::BindPointInfo Shader::Variant::FindOverflowBindPoint(PropertyID id) const
+	{
+		for (const BindPoint& bindPoint : overflowBindPoints)
+		{
+			if (bindPoint.id == id)
+				return bindPoint.info;
+		}
+		return {};
+	}
+
+	void Shader::Variant::InsertBindPoint(const BindPoint& bindPoint)
+	{
+		// shaders only have a handful of bindings, past this the table is mostly empty slots
+		static const uint32_t maxTableSize = 1024;
+
+		std::vector<BindPoint> entries;
+		for (const BindPoint& entry : bindPoints)
+		{
+			if (entry.id != ShaderProperty::InvalidID)
+				entries.push_back(entry);
+		}
+		entries.push_back(bindPoint);
+
+		// find the smallest table where every id lands in its own slot
+		uint32_t size = (uint32_t)bindPoints.size();
+		while (true)
+		{
+			std::vector<BindPoint> table(size);
+			bool collision = false;
+			for (const BindPoint& entry : entries)
+			{
+				BindPoint& slot = table[entry.id & (size - 1)];
+				if (slot.id != ShaderProperty::InvalidID)
+				{
+					collision = true;
+					break;
+				}
+				slot = entry;
+			}
+
+			if (!collision)
+			{
+				bindPoints = std::move(table);
+				bindMask = size - 1;
+				return;
+			}
+			if (size >= maxTableSize)
+				break;
+			size *= 2;
+		}
+
+		overflowBindPoints.push_back(bindPoint);
 	}
 
 	Ref<Shader> Shader::Create(const fs::path& path)
@@ -238,4 +771,40 @@ namespace Engine
 		return std::make_shared<Shader>(src);
 	}
 
+	std::vector<Ref<Shader>> Shader::CreateBatch(const std::vector<fs::path>& paths)
+	{
+		// start reading every file before the compiles begin waiting on them
+		std::vector<AsyncFileReader::Handle> files = AsyncFileReader::Get().ReadBatch(paths);
+
+		// compiling only touches the include and bytecode caches, which are locked, so that is all that runs on the threads
+		// creating the device objects and tracking the shaders happens below on this thread like any other shader
+		struct Source
+		{
+			std::string src;
+			Compiled base;
+			bool read = false;
+		};
+		std::vector<Source> sources(paths.size());
+		Parallel::For((uint32_t)paths.size(), [&](uint32_t i) {
+			const std::vector<uint8_t>& data = files[i].Wait();
+			if (data.empty())
+				return;
+			sources[i].src.assign(data.begin(), data.end());
+			sources[i].read = true;
+			sources[i].base.shader = ShaderCompiler::Compile(sources[i].src, 0, paths[i]);
+		});
+
+		std::vector<Ref<Shader>> shaders(paths.size());
+		for (uint32_t i = 0; i < paths.size(); i++)
+		{
+			shaders[i] = Ref<Shader>(new Shader());
+			shaders[i]->Track(paths[i]);
+			if (sources[i].read)
+				shaders[i]->Load(sources[i].src, sources[i].base);
+			else
+				DBOUT("failed to read shader " << paths[i].c_str() << std::endl);
+		}
+		return shaders;
+	}
+
 }
\ No newline at end of file
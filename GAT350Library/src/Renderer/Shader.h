@@ -2,8 +2,14 @@
 
 #include "Platform/Windows/Win.h"
 #include "Core/Core.h"
+#include "ShaderReflection.h"
+#include "ShaderProperty.h"
+#include "PipelineStateCache.h"
 #include <string>
 #include <unordered_map>
+#include <shared_mutex>
+#include <atomic>
+#include <future>
 
 namespace Engine
 {
@@ -26,43 +32,175 @@ namespace Engine
 		struct Sampler 
 		{
 			BindPointInfo info;
+			PipelineStateCache::StateID stateID = PipelineStateCache::InvalidID;
 			wrl::ComPtr<ID3D11SamplerState> sampler;
 		};
 
+		struct InputElement
+		{
+			std::string semanticName;
+			uint32_t semanticIndex;
+		};
+
+		// the input layout for one vertex layout, streams has a bit set for each stream the shader reads
+		struct StreamLayout
+		{
+			wrl::ComPtr<ID3D11InputLayout> inputLayout; // nullptr if the vertex layout is missing an attribute
+			uint32_t streams = 0;
+			uint32_t stride = 0; // bytes fetched for each vertex
+		};
+
+		// one compiled combination of keywords
+		struct Variant
+		{
+			wrl::ComPtr<ID3D11InputLayout> inputLayout; // everything interleaved in slot 0
+			wrl::ComPtr<ID3D11VertexShader> vertexShader;
+			wrl::ComPtr<ID3D11PixelShader> pixelShader;
+			std::vector<Sampler> samplers;
+			std::vector<ConstantBufferLayout> constantBuffers;
+			bool used = false;
+
+			std::vector<InputElement> inputElements; // what the vertex shader reads
+			wrl::ComPtr<ID3DBlob> vertexCode; // kept to make input layouts for vertex layouts used later
+			std::unordered_map<uint64_t, StreamLayout> streamLayouts; // by vertex layout hash
+
+			// bind points are kept in a power of two table indexed by the low bits of the property id
+			// the table is grown until no two properties share a slot so a lookup is one index and a compare
+			struct BindPoint
+			{
+				PropertyID id = ShaderProperty::InvalidID;
+				BindPointInfo info = {};
+			};
+			std::vector<BindPoint> bindPoints = std::vector<BindPoint>(1);
+			std::vector<BindPoint> overflowBindPoints; // only used if the table would get too big, searched in order
+			uint32_t bindMask = 0;
+
+			void AddBindPoint(const std::string& name, ShaderType type, uint32_t slot);
+			BindPointInfo GetBindPoint(PropertyID id) const
+			{
+				const BindPoint& bindPoint = bindPoints[id & bindMask];
+				if (bindPoint.id == id)
+					return bindPoint.info;
+				return FindOverflowBindPoint(id);
+			}
+
+		private:
+			BindPoint* FindBindPoint(PropertyID id);
+			BindPointInfo FindOverflowBindPoint(PropertyID id) const;
+			void InsertBindPoint(const BindPoint& bindPoint);
+		};
+
+		struct VariantStatistics
+		{
+			uint32_t compiled = 0;
+			uint32_t preloaded = 0;
+			uint32_t used = 0; // variants that were asked for at least once
+			uint32_t overCap = 0; // requests that got the base variant because the shader hit its variant cap
+			uint32_t failed = 0; // variants that did not compile, the base variant is used instead
+			float compileMilliseconds = 0.0f; // spent on the compile threads for lazy variants
+
+		};
+
 		Shader(const fs::path& path);
 		Shader(const std::string& src);
-
-		BindPointInfo GetBindPoint(const std::string& name) { return m_BindPoints[name]; }
-		wrl::ComPtr<ID3D11InputLayout> GetInputLayout() { return m_InputLayout; }
-		wrl::ComPtr<ID3D11VertexShader> GetVertexShader() { return m_VertexShader; }
-		wrl::ComPtr<ID3D11PixelShader> GetPixelShader() { return m_PixelShader; }
+		~Shader();
+
+		// a property the shader does not use gives an empty bind point
+		BindPointInfo GetBindPoint(PropertyID id) { return GetActiveVariant().GetBindPoint(id); }
+		BindPointInfo GetBindPoint(const std::string& name) { return GetActiveVariant().GetBindPoint(ShaderProperty::ID(name)); }
+		wrl::ComPtr<ID3D11InputLayout> GetInputLayout() { return GetActiveVariant().inputLayout; }
+		// made the first time the shader is used with the layout, the slots are the layout's streams
+		const StreamLayout& GetInputLayout(const VertexLayout& layout);
+		wrl::ComPtr<ID3D11VertexShader> GetVertexShader() { return GetActiveVariant().vertexShader; }
+		wrl::ComPtr<ID3D11PixelShader> GetPixelShader() { return GetActiveVariant().pixelShader; }
 		wrl::ComPtr<ID3D11DepthStencilState> GetDepthStencilState() { return m_DepthStencilState; }
 		wrl::ComPtr<ID3D11RasterizerState> GetRasterizerState() { return m_RasterizerState; }
-		std::vector<Sampler>& GetSamplers() { return m_Samplers; }
+		uint64_t GetPipelineKey() const { return PipelineStateCache::GetPipelineKey(m_DepthStencilID, m_RasterizerID); }
+		std::vector<Sampler>& GetSamplers() { return GetActiveVariant().samplers; }
+		const ConstantBufferLayout* GetConstantBufferLayout(const std::string& name); // nullptr if there is no cbuffer with that name
+
+		// keywords pick which variant the getters above return, a variant is compiled the first time it is asked for
+		// on another thread and the base variant is drawn with until it is ready
+		uint64_t GetKeywordMask(const std::string& keyword) const;
+		void EnableKeyword(const std::string& keyword); // turns off the other keywords from the same multi_compile line
+		void DisableKeyword(const std::string& keyword);
+		void SetKeywords(uint64_t keywords);
+		uint64_t GetKeywords() const { return m_EnabledKeywords; }
+		const std::vector<std::string>& GetKeywordNames() const { return m_KeywordNames; }
+
+		// compiles the variants now instead of when they are first used
+		void Preload(const std::vector<uint64_t>& variants);
+
+		const VariantStatistics& GetVariantStatistics() const { return m_VariantStatistics; }
+
+		// every file pulled in with #include by any compiled variant
+		const std::vector<fs::path>& GetDependencies() const { return m_Dependencies; }
+		bool DependsOn(const fs::path& path) const;
+
+		// compiles the shader again from the same source, picking up changed includes
+		void Reload();
+		// call when an included file changes, only the shaders that include it are recompiled
+		static uint32_t ReloadDependents(const fs::path& include);
+
+		// stays the same across hot reloads
+		uint64_t GetID() const { return m_ID; }
 
 		bool operator==(const Shader& other);
 
 		static Ref<Shader> Create(const fs::path& path);
 		static Ref<Shader> CreateFromSrc(const std::string& src);
+		// reads and compiles all the shaders at the same time, the result is in the same order as paths
+		// only the compiles run on other threads, the shaders are created and registered on the calling thread
+		static std::vector<Ref<Shader>> CreateBatch(const std::vector<fs::path>& paths);
 
 	private:
+		friend class ShaderHotReload;
+
+		struct Compiled; // a ShaderCompiler::CompiledShader, ShaderCompiler.h includes this file so it can not be used here
+
+		Shader() = default; // for building a program off to the side, it is not tracked or watched
+		void Track(const fs::path& path); // gives the shader an id and adds it to the shaders hot reload looks through
+
+		static bool ReadSource(const fs::path& path, std::string& src);
+		static std::vector<Shader*> GetDependents(const fs::path& path); // shaders loaded from or including the file
+		static Shader* Find(uint64_t id);
+
+		bool IsValid() const; // the base variant compiled
+		void SwapProgram(Shader& other);
 
 		void LoadFromSrc(const std::string& src);
+		void Load(const std::string& src, Compiled& base);
 
-		void AddBindPoint(const std::string& name, ShaderType type, uint32_t slot);
+		Variant& GetActiveVariant();
+		// both expect m_VariantMutex to be held
+		void StartCompile(uint64_t keywords); // does nothing if the shader is at its variant cap or the variant failed before
+		void FinishCompiles(); // moves the compiles that are done into m_Variants
+		void WaitForCompiles(); // before the source changes or the shader goes away, the results are thrown out
+		void AddDependencies(const std::vector<fs::path>& dependencies);
 
 	private:
-		wrl::ComPtr<ID3D11InputLayout> m_InputLayout;
-
-		wrl::ComPtr<ID3D11VertexShader> m_VertexShader;
-		wrl::ComPtr<ID3D11PixelShader> m_PixelShader;
+		fs::path m_Path;
+		uint64_t m_ID = 0;
+		std::string m_Source; // kept to compile variants later
+		std::vector<fs::path> m_Dependencies;
+
+		std::unordered_map<uint64_t, Variant> m_Variants;
+		std::atomic<Variant*> m_ActiveVariant = nullptr;
+		std::shared_mutex m_VariantMutex; // for what is made lazily while drawing, keywords are only changed between recordings
+		std::unordered_map<uint64_t, std::future<Ref<Compiled>>> m_PendingVariants;
+		std::atomic<bool> m_CompilesFinished = false; // set by the compile threads so drawing only takes the lock when there is something to pick up
+		std::vector<uint64_t> m_FailedVariants; // not compiled again until the shader is reloaded
+		uint64_t m_EnabledKeywords = 0;
+
+		std::vector<std::string> m_KeywordNames;
+		std::vector<uint64_t> m_KeywordGroups;
+		uint32_t m_MaxVariants = 32;
+		VariantStatistics m_VariantStatistics;
 
 		wrl::ComPtr<ID3D11DepthStencilState> m_DepthStencilState;
 		wrl::ComPtr<ID3D11RasterizerState> m_RasterizerState;
-
-		std::vector<Sampler> m_Samplers;
-
-		std::unordered_map<std::string, BindPointInfo> m_BindPoints;
+		PipelineStateCache::StateID m_DepthStencilID = PipelineStateCache::InvalidID;
+		PipelineStateCache::StateID m_RasterizerID = PipelineStateCache::InvalidID;
 	};
 	
 }
\ No newline at end of file
@@ -0,0 +1,354 @@
+#include "ShaderCache.h"
+#include "Core/AsyncFileReader.h"
+
+#include <string.h>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+
+namespace Engine
+{
+
+	static const uint32_t s_Magic = 0x31435347; // "GSC1"
+	static const uint32_t s_FormatVersion = 3; // bump when the entry layout changes
+
+	// ------------------------------------- Serialization ------------------------------------- //
+
+#pragma region Serialization
+
+	class EntryWriter
+	{
+	public:
+		template<typename T>
+		void Write(const T& value) { m_Stream.write((const char*)&value, sizeof(T)); }
+		void Write(const std::string& str) { Write((uint32_t)str.size()); m_Stream.write(str.data(), str.size()); }
+		void Write(const void* data, uint32_t size) { Write(size); m_Stream.write((const char*)data, size); }
+
+		std::string GetData() { return m_Stream.str(); }
+
+	private:
+		std::ostringstream m_Stream;
+	};
+
+	class EntryReader
+	{
+	public:
+		EntryReader(const std::vector<uint8_t>& data) : m_Data(data) {}
+
+		template<typename T>
+		bool Read(T& value)
+		{
+			if (m_Offset + sizeof(T) > m_Data.size())
+				return false;
+			memcpy(&value, m_Data.data() + m_Offset, sizeof(T));
+			m_Offset += sizeof(T);
+			return true;
+		}
+
+		bool Read(std::string& str)
+		{
+			uint32_t size;
+			if (!Read(size) || m_Offset + size > m_Data.size())
+				return false;
+			str.assign((const char*)m_Data.data() + m_Offset, size);
+			m_Offset += size;
+			return true;
+		}
+
+		const uint8_t* ReadBytes(uint32_t& size)
+		{
+			if (!Read(size) || m_Offset + size > m_Data.size())
+				return nullptr;
+			const uint8_t* bytes = m_Data.data() + m_Offset;
+			m_Offset += size;
+			return bytes;
+		}
+
+	private:
+		const std::vector<uint8_t>& m_Data;
+		size_t m_Offset = 0;
+	};
+
+	static void WriteBindings(EntryWriter& writer, const std::vector<ShaderCompiler::BindingInfo>& bindings)
+	{
+		writer.Write((uint32_t)bindings.size());
+		for (const ShaderCompiler::BindingInfo& binding : bindings)
+		{
+			writer.Write(binding.name);
+			writer.Write((uint32_t)binding.type);
+			writer.Write(binding.point);
+		}
+	}
+
+	static bool ReadBindings(EntryReader& reader, std::vector<ShaderCompiler::BindingInfo>& bindings)
+	{
+		uint32_t count;
+		if (!reader.Read(count))
+			return false;
+		bindings.resize(count);
+		for (ShaderCompiler::BindingInfo& binding : bindings)
+		{
+			uint32_t type;
+			if (!reader.Read(binding.name) || !reader.Read(type) || !reader.Read(binding.point))
+				return false;
+			binding.type = (Shader::ShaderType)type;
+		}
+		return true;
+	}
+
+	static void WriteConstantBuffers(EntryWriter& writer, const std::vector<ConstantBufferLayout>& constantBuffers)
+	{
+		writer.Write((uint32_t)constantBuffers.size());
+		for (const ConstantBufferLayout& layout : constantBuffers)
+		{
+			writer.Write(layout.name);
+			writer.Write(layout.size);
+			writer.Write((uint32_t)layout.variables.size());
+			for (const ShaderVariable& variable : layout.variables)
+			{
+				writer.Write(variable.name);
+				writer.Write(variable.offset);
+				writer.Write(variable.size);
+				writer.Write((uint32_t)variable.type);
+				writer.Write(variable.elements);
+			}
+		}
+	}
+
+	static bool ReadConstantBuffers(EntryReader& reader, std::vector<ConstantBufferLayout>& constantBuffers)
+	{
+		uint32_t count;
+		if (!reader.Read(count))
+			return false;
+		constantBuffers.resize(count);
+		for (ConstantBufferLayout& layout : constantBuffers)
+		{
+			uint32_t variableCount;
+			if (!reader.Read(layout.name) || !reader.Read(layout.size) || !reader.Read(variableCount))
+				return false;
+			layout.variables.resize(variableCount);
+			for (ShaderVariable& variable : layout.variables)
+			{
+				uint32_t type;
+				if (!reader.Read(variable.name) || !reader.Read(variable.offset) || !reader.Read(variable.size) || !reader.Read(type) || !reader.Read(variable.elements))
+					return false;
+				variable.type = (ShaderDataType)type;
+			}
+		}
+		return true;
+	}
+
+#pragma endregion
+
+	// ------------------------------------- End Serialization ------------------------------------- //
+
+	uint64_t ShaderCache::Hash(const void* data, size_t size, uint64_t hash)
+	{
+		const uint8_t* bytes = (const uint8_t*)data;
+		for (size_t i = 0; i < size; i++)
+		{
+			hash ^= bytes[i];
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	uint64_t ShaderCache::GetKey(const std::string& src, const char* target, uint32_t flags, const D3D_SHADER_MACRO* defines)
+	{
+		uint32_t compilerVersion = D3D_COMPILER_VERSION;
+		uint64_t hash = Hash(&s_FormatVersion, sizeof(s_FormatVersion));
+		hash = Hash(&compilerVersion, sizeof(compilerVersion), hash);
+		hash = Hash(&flags, sizeof(flags), hash);
+		hash = Hash(target, strlen(target) + 1, hash);
+		for (const D3D_SHADER_MACRO* define = defines; define != nullptr && define->Name != nullptr; define++)
+		{
+			hash = Hash(define->Name, strlen(define->Name) + 1, hash);
+			if (define->Definition != nullptr)
+				hash = Hash(define->Definition, strlen(define->Definition) + 1, hash);
+		}
+		return Hash(src.data(), src.size(), hash);
+	}
+
+	bool ShaderCache::Load(uint64_t key, Entry& entry)
+	{
+		if (!m_Enabled)
+			return false;
+
+		bool inMemory;
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			auto it = m_Entries.find(key);
+			inMemory = it != m_Entries.end();
+			if (inMemory)
+				entry = it->second;
+		}
+
+		// checking the includes can read files so it is done outside the lock
+		if (inMemory && IsUpToDate(entry))
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Statistics.memoryHits++;
+			m_Statistics.savedMilliseconds += entry.compileMilliseconds;
+			return true;
+		}
+
+		fs::path path = GetEntryPath(key);
+		std::error_code error;
+		bool found = fs::exists(path, error);
+		if (found)
+		{
+			AsyncFileReader::Handle file = AsyncFileReader::Get().Read(path, AsyncFileReader::Priority::High);
+			const std::vector<uint8_t>& data = file.Wait();
+			EntryReader reader(data);
+
+			uint32_t magic = 0, version = 0, size = 0;
+			uint64_t storedKey = 0;
+			const uint8_t* bytecode = nullptr;
+			found = reader.Read(magic) && magic == s_Magic &&
+				reader.Read(version) && version == s_FormatVersion &&
+				reader.Read(storedKey) && storedKey == key &&
+				reader.Read(entry.compileMilliseconds) &&
+				(bytecode = reader.ReadBytes(size)) != nullptr &&
+				ReadBindings(reader, entry.bindings) &&
+				ReadBindings(reader, entry.samplers);
+
+			uint32_t inputCount = 0;
+			found = found && reader.Read(inputCount);
+			entry.inputSigniture.resize(inputCount);
+			for (uint32_t i = 0; i < inputCount && found; i++)
+			{
+				ShaderCompiler::InputElement& element = entry.inputSigniture[i];
+				uint32_t format;
+				found = reader.Read(element.semanticName) && reader.Read(element.semanticIndex) && reader.Read(format);
+				element.format = (DXGI_FORMAT)format;
+			}
+
+			uint32_t dependencyCount = 0;
+			found = found && reader.Read(dependencyCount);
+			entry.dependencies.resize(dependencyCount);
+			for (uint32_t i = 0; i < dependencyCount && found; i++)
+			{
+				std::string dependencyPath;
+				found = reader.Read(dependencyPath) && reader.Read(entry.dependencies[i].hash);
+				entry.dependencies[i].path = dependencyPath;
+			}
+			found = found && ReadConstantBuffers(reader, entry.constantBuffers);
+
+			if (found)
+			{
+				HRESULT hr = D3DCreateBlob(size, entry.bytecode.ReleaseAndGetAddressOf());
+				found = SUCCEEDED(hr);
+				if (found)
+					memcpy(entry.bytecode->GetBufferPointer(), bytecode, size);
+			}
+			else
+				DBOUT("shader cache entry " << path.c_str() << " is corrupt, recompiling" << std::endl);
+		}
+
+		bool stale = found && !IsUpToDate(entry);
+
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		if (!found || stale)
+		{
+			entry = Entry();
+			m_Statistics.misses++;
+			if (stale)
+				m_Statistics.staleIncludes++;
+			return false;
+		}
+
+		m_Entries[key] = entry;
+		m_Statistics.diskHits++;
+		m_Statistics.savedMilliseconds += entry.compileMilliseconds;
+		return true;
+	}
+
+	void ShaderCache::Store(uint64_t key, const Entry& entry)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Entries[key] = entry;
+			m_Statistics.compileMilliseconds += entry.compileMilliseconds;
+		}
+
+		if (!m_Enabled || entry.bytecode == nullptr)
+			return;
+
+		EntryWriter writer;
+		writer.Write(s_Magic);
+		writer.Write(s_FormatVersion);
+		writer.Write(key);
+		writer.Write(entry.compileMilliseconds);
+		writer.Write(entry.bytecode->GetBufferPointer(), (uint32_t)entry.bytecode->GetBufferSize());
+		WriteBindings(writer, entry.bindings);
+		WriteBindings(writer, entry.samplers);
+		writer.Write((uint32_t)entry.inputSigniture.size());
+		for (const ShaderCompiler::InputElement& element : entry.inputSigniture)
+		{
+			writer.Write(element.semanticName);
+			writer.Write(element.semanticIndex);
+			writer.Write((uint32_t)element.format);
+		}
+		writer.Write((uint32_t)entry.dependencies.size());
+		for (const ShaderInclude::Dependency& dependency : entry.dependencies)
+		{
+			writer.Write(dependency.path.string());
+			writer.Write(dependency.hash);
+		}
+		WriteConstantBuffers(writer, entry.constantBuffers);
+
+		// write to a temp file first so a crash or another process never sees half an entry
+		std::error_code error;
+		fs::create_directories(m_Directory, error);
+		fs::path path = GetEntryPath(key);
+		fs::path tempPath = path;
+		tempPath += "." + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id())) + ".tmp";
+
+		std::string data = writer.GetData();
+		bool written;
+		{
+			std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+			file.write(data.data(), data.size());
+			written = file.good();
+		}
+		if (written)
+			fs::rename(tempPath, path, error);
+
+		if (!written || error)
+		{
+			fs::remove(tempPath, error);
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Statistics.writeFailures++;
+		}
+	}
+
+	ShaderCache::Statistics ShaderCache::GetStatistics()
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		return m_Statistics;
+	}
+
+	ShaderCache& ShaderCache::Get()
+	{
+		static ShaderCache* instance = new ShaderCache();
+		return *instance;
+	}
+
+	fs::path ShaderCache::GetEntryPath(uint64_t key) const
+	{
+		std::ostringstream name;
+		name << std::hex << std::setw(16) << std::setfill('0') << key << ".cso";
+		return m_Directory / name.str();
+	}
+
+	bool ShaderCache::IsUpToDate(const Entry& entry)
+	{
+		for (const ShaderInclude::Dependency& dependency : entry.dependencies)
+		{
+			if (ShaderIncludeCache::Get().GetHash(dependency.path) != dependency.hash)
+				return false;
+		}
+		return true;
+	}
+
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include "Platform/Windows/Win.h"
+#include "Core/Core.h"
+#include "ShaderCompiler.h"
+#include "ShaderInclude.h"
+
+#include <mutex>
+#include <unordered_map>
+
+namespace Engine
+{
+	// keeps the compiled bytecode and reflection of every shader section on disk
+	// entries are keyed on a hash of the section source, target, compile flags and compiler version
+	// so any change to one of those is a miss and the old entry is just never looked up again
+	class ShaderCache
+	{
+	public:
+		struct Entry
+		{
+			wrl::ComPtr<ID3DBlob> bytecode;
+			std::vector<ShaderCompiler::BindingInfo> bindings;
+			std::vector<ShaderCompiler::BindingInfo> samplers; // bind points of the samplers
+			std::vector<ShaderCompiler::InputElement> inputSigniture;
+			std::vector<ShaderInclude::Dependency> dependencies;
+			std::vector<ConstantBufferLayout> constantBuffers;
+			float compileMilliseconds = 0.0f; // how long the compile took when the entry was made
+		};
+
+		struct Statistics
+		{
+			uint32_t memoryHits = 0;
+			uint32_t diskHits = 0;
+			uint32_t misses = 0;
+			uint32_t staleIncludes = 0; // entries thrown out because an included file changed
+			uint32_t writeFailures = 0;
+			float compileMilliseconds = 0.0f; // spent compiling misses
+			float savedMilliseconds = 0.0f; // compile time skipped by hits
+
+			float GetHitRate() const { uint32_t total = memoryHits + diskHits + misses; return total == 0 ? 0.0f : (float)(memoryHits + diskHits) / (float)total; }
+		};
+
+	public:
+		void SetDirectory(const fs::path& directory) { m_Directory = directory; }
+		const fs::path& GetDirectory() const { return m_Directory; }
+		void SetEnabled(bool enabled) { m_Enabled = enabled; }
+
+		static uint64_t Hash(const void* data, size_t size, uint64_t hash = 14695981039346656037ull); // 64 bit FNV-1a
+		static uint64_t GetKey(const std::string& src, const char* target, uint32_t flags, const D3D_SHADER_MACRO* defines = nullptr);
+
+		bool Load(uint64_t key, Entry& entry);
+		void Store(uint64_t key, const Entry& entry);
+
+		Statistics GetStatistics();
+
+		static ShaderCache& Get();
+
+	private:
+		fs::path GetEntryPath(uint64_t key) const;
+		static bool IsUpToDate(const Entry& entry);
+
+	private:
+		std::mutex m_Mutex;
+		std::unordered_map<uint64_t, Entry> m_Entries; // everything loaded or compiled this run
+
+		fs::path m_Directory = "ShaderCache";
+		bool m_Enabled = true;
+
+		Statistics m_Statistics;
+	};
+}
@@ -1,6 +1,12 @@
 #include "ShaderCompiler.h"
+#include "ShaderCache.h"
+#include "ShaderInclude.h"
+#include "ShaderPreprocessor.h"
+#include "Util/Parallel.h"
 #include <string.h>
 #include <fstream>
+#include <chrono>
+#include <algorithm>
 
 namespace Engine
 {
@@ -34,110 +40,140 @@ namespace Engine
 		return DXGI_FORMAT_UNKNOWN;
 	}
 
-	ShaderCompiler::SamplerInfo::WrapMode GetWrapMode(const std::string& str)
+	static ShaderDataType GetDataTypeFromDesc(const D3D11_SHADER_TYPE_DESC& desc)
 	{
-		if (str == "repeat")
-			return ShaderCompiler::SamplerInfo::WrapMode::Repeat;
-		else if (str == "repeatMiror")
-			return ShaderCompiler::SamplerInfo::WrapMode::MirroredRepeat;
-		else if (str == "clamp")
-			return ShaderCompiler::SamplerInfo::WrapMode::Clamp;
-		return ShaderCompiler::SamplerInfo::WrapMode::Clamp;
-	}
-
-	ShaderCompiler::SamplerInfo::MinMagFilter GetFilter(const std::string& str)
-	{
-		if (str == "point")
-			return ShaderCompiler::SamplerInfo::MinMagFilter::Point;
-		else if (str == "linear")
-			return ShaderCompiler::SamplerInfo::MinMagFilter::Linear;
-		else if (str == "anisotropic")
-			return ShaderCompiler::SamplerInfo::MinMagFilter::Anisotropic;
-		return ShaderCompiler::SamplerInfo::MinMagFilter::Linear;
+		if (desc.Class == D3D_SVC_SCALAR || desc.Class == D3D_SVC_VECTOR)
+		{
+			const ShaderDataType floats[] = { ShaderDataType::Float, ShaderDataType::Float2, ShaderDataType::Float3, ShaderDataType::Float4 };
+			const ShaderDataType ints[] = { ShaderDataType::Int, ShaderDataType::Int2, ShaderDataType::Int3, ShaderDataType::Int4 };
+			if (desc.Columns < 1 || desc.Columns > 4)
+				return ShaderDataType::None;
+			if (desc.Type == D3D_SVT_FLOAT)
+				return floats[desc.Columns - 1];
+			if (desc.Type == D3D_SVT_INT || desc.Type == D3D_SVT_UINT)
+				return ints[desc.Columns - 1];
+			if (desc.Type == D3D_SVT_BOOL && desc.Columns == 1)
+				return ShaderDataType::Bool;
+		}
+		else if ((desc.Class == D3D_SVC_MATRIX_ROWS || desc.Class == D3D_SVC_MATRIX_COLUMNS) && desc.Type == D3D_SVT_FLOAT)
+		{
+			if (desc.Rows == 3 && desc.Columns == 3)
+				return ShaderDataType::Mat3;
+			if (desc.Rows == 4 && desc.Columns == 4)
+				return ShaderDataType::Mat4;
+		}
+		return ShaderDataType::None;
 	}
 
-	ShaderCompiler::CompiledShader ShaderCompiler::Compile(const std::string& src)
+	ShaderCompiler::CompiledShader ShaderCompiler::Compile(const std::string& src, uint64_t keywords, const fs::path& path)
 	{
 		CompiledShader shader;
 
-		std::stringstream srcStream(src);
+		// the preprocessor keeps its buffers between compiles on the same thread
+		static thread_local ShaderPreprocessor preprocessor;
+		preprocessor.Process(src, shader.config);
 
-		struct SectionInfo 
+		// collect the stages in a fixed order so the merged bindings do not depend on the section order
+		struct Stage
 		{
-			std::stringstream src;
-			std::unordered_map<std::string, SamplerInfo> samplers;
+			Shader::ShaderType type;
+			const ShaderPreprocessor::Section* section;
+			CompiledShader compiled;
 		};
-
-		std::unordered_map<std::string, SectionInfo> ss;
-		SectionInfo* currSection = &ss["config"];
-
-		std::string line;
-		while (getline(srcStream, line))
+		std::vector<Stage> stages;
+		const std::pair<const char*, Shader::ShaderType> stageNames[] = { { "vertex", Shader::Vertex }, { "pixel", Shader::Pixel } };
+		for (auto& stageName : stageNames)
 		{
-			std::vector<std::string> tokens = Tokenize(line);
+			const ShaderPreprocessor::Section* section = preprocessor.GetSection(stageName.first);
+			if (section != nullptr)
+				stages.push_back({ stageName.second, section });
+		}
 
-			if(tokens.empty())
-				continue;
+		// turn the keyword mask into defines
+		std::vector<D3D_SHADER_MACRO> defines;
+		for (uint32_t i = 0; i < shader.config.keywords.size(); i++)
+		{
+			if (keywords & (1ull << i))
+				defines.push_back({ shader.config.keywords[i].c_str(), "1" });
+		}
+		defines.push_back({ nullptr, nullptr });
 
-			if (tokens[0] == "#section")
-				currSection = &ss[tokens[1]];
-			else if (tokens[0] == "StaticSampler")
+		// every stage compiles into its own result so they can run at the same time
+		const ShaderPreprocessor::Section* common = preprocessor.GetSection("common");
+		Parallel::For((uint32_t)stages.size(), [&](uint32_t i) {
+			Stage& stage = stages[i];
+			for (SamplerInfo sampler : stage.section->samplers)
 			{
-				// 0			 1	  2 3			 4 5 6 7 8 9   10 11  12 13
-				// StaticSampler name = StaticSampler( U , V , Min ,  Mag )  ;
-
-				std::string& name = tokens[1];
-				std::string& u = tokens[5];
-				std::string& v = tokens[7];
-				std::string& min = tokens[9];
-				std::string& mag = tokens[11];
-
-				SamplerInfo info;
-				info.U = GetWrapMode(u);
-				info.V = GetWrapMode(v);
+				sampler.bindInfo.type = stage.type;
+				stage.compiled.samplers.push_back(sampler);
+			}
 
-				info.Min = GetFilter(min);
-				info.Mag = GetFilter(mag);
+			std::string sectionSrc;
+			sectionSrc.reserve((common != nullptr ? common->source.size() : 0) + stage.section->source.size());
+			if (common != nullptr)
+				sectionSrc += common->source;
+			sectionSrc += stage.section->source;
+			CompileShaderCode(sectionSrc, stage.compiled, stage.type, defines.data(), path);
+		});
 
-				info.bindInfo.name = name;
+		for (Stage& stage : stages)
+		{
+			if (stage.compiled.vertexShader)
+				shader.vertexShader = stage.compiled.vertexShader;
+			if (stage.compiled.pixelShader)
+				shader.pixelShader = stage.compiled.pixelShader;
+			shader.samplers.insert(shader.samplers.end(), stage.compiled.samplers.begin(), stage.compiled.samplers.end());
+			shader.bindings.insert(shader.bindings.end(), stage.compiled.bindings.begin(), stage.compiled.bindings.end());
+			shader.inputSigniture.insert(shader.inputSigniture.end(), stage.compiled.inputSigniture.begin(), stage.compiled.inputSigniture.end());
+			// a cbuffer used by both stages has the same layout in both
+			for (const ConstantBufferLayout& layout : stage.compiled.constantBuffers)
+			{
+				auto it = std::find_if(shader.constantBuffers.begin(), shader.constantBuffers.end(), [&](const ConstantBufferLayout& other) { return other.name == layout.name; });
+				if (it == shader.constantBuffers.end())
+					shader.constantBuffers.push_back(layout);
+			}
+			for (const fs::path& dependency : stage.compiled.dependencies)
+			{
+				if (std::find(shader.dependencies.begin(), shader.dependencies.end(), dependency) == shader.dependencies.end())
+					shader.dependencies.push_back(dependency);
+			}
+		}
 
-				currSection->samplers[name] = info;
+		return shader;
+	}
 
-				currSection->src << "SamplerState " << name << ";\n";
-			}
-			else
-				currSection->src << line << '\n';
+	static void ApplyCacheEntry(const ShaderCache::Entry& entry, ShaderCompiler::CompiledShader& shader, Shader::ShaderType type)
+	{
+		switch (type)
+		{
+		case Engine::Shader::Vertex:
+			shader.vertexShader = entry.bytecode;
+			break;
+		case Engine::Shader::Pixel:
+			shader.pixelShader = entry.bytecode;
+			break;
 		}
 
-		std::string commonSrc = ss["common"].src.str();
-		for (auto& sectionSource : ss)
+		shader.bindings.insert(shader.bindings.end(), entry.bindings.begin(), entry.bindings.end());
+		shader.inputSigniture.insert(shader.inputSigniture.end(), entry.inputSigniture.begin(), entry.inputSigniture.end());
+		shader.constantBuffers.insert(shader.constantBuffers.end(), entry.constantBuffers.begin(), entry.constantBuffers.end());
+		for (const ShaderInclude::Dependency& dependency : entry.dependencies)
+			shader.dependencies.push_back(dependency.path);
+
+		for (const ShaderCompiler::BindingInfo& samplerBinding : entry.samplers)
 		{
-			if (sectionSource.first != "config" && sectionSource.first != "common")
+			for (auto& sampler : shader.samplers)
 			{
-				std::string sectionSrc = commonSrc + sectionSource.second.src.str();
-				Shader::ShaderType type;
-				if (sectionSource.first == "vertex")
-					type = Shader::Vertex;
-				else if (sectionSource.first == "pixel")
-					type = Shader::Pixel;
-				else
-					continue;
-
-				for (auto& sampler : sectionSource.second.samplers)
+				if (sampler.bindInfo.type == type && sampler.bindInfo.name == samplerBinding.name)
 				{
-					sampler.second.bindInfo.type = type;
-					shader.samplers.push_back(sampler.second);
+					sampler.bindInfo.point = samplerBinding.point;
+					break;
 				}
-
-				CompileShaderCode(sectionSrc, shader, type);
-
 			}
 		}
-
-		return shader;
 	}
 
-	void ShaderCompiler::CompileShaderCode(const std::string& src, CompiledShader& shader, Shader::ShaderType type)
+	void ShaderCompiler::CompileShaderCode(const std::string& src, CompiledShader& shader, Shader::ShaderType type, const D3D_SHADER_MACRO* defines, const fs::path& path)
 	{
 		const char* target = nullptr;
 		switch (type)
@@ -158,25 +194,36 @@ namespace Engine
 		flags |= D3DCOMPILE_OPTIMIZATION_LEVEL3;
 #endif
 
+		// reuse the bytecode and reflection from an earlier run if nothing that affects the output changed
+		ShaderCache& cache = ShaderCache::Get();
+		uint64_t key = ShaderCache::GetKey(src, target, flags, defines);
+		ShaderCache::Entry entry;
+		if (cache.Load(key, entry))
+		{
+			ApplyCacheEntry(entry, shader, type);
+			return;
+		}
+
+		auto start = std::chrono::steady_clock::now();
+
+		ShaderInclude include(path);
+		std::string sourceName = path.string();
+
 		ID3DBlob* blob;
 		ID3DBlob* errors;
-		HRESULT hr = D3DCompile(src.c_str(), src.size() * sizeof(char), nullptr, nullptr, nullptr, "main", target, flags, 0, &blob, &errors);
+		HRESULT hr = D3DCompile(src.c_str(), src.size() * sizeof(char), sourceName.empty() ? nullptr : sourceName.c_str(), defines, &include, "main", target, flags, 0, &blob, &errors);
 		if (FAILED(hr))
 		{
 			DBOUT((char*)errors->GetBufferPointer());
 			DBOUT("failed to compile shaders");
+			// still record the includes so fixing one of them recompiles this shader
+			for (const ShaderInclude::Dependency& dependency : include.GetDependencies())
+				shader.dependencies.push_back(dependency.path);
 			return;
 		}
 
-		switch (type)
-		{
-		case Engine::Shader::Vertex:
-			shader.vertexShader = blob;
-			break;
-		case Engine::Shader::Pixel:
-			shader.pixelShader = blob;
-			break;
-		}
+		entry.bytecode.Attach(blob);
+		entry.dependencies = include.GetDependencies();
 
 		// reflection
 
@@ -204,7 +251,24 @@ namespace Engine
 				D3D11_SHADER_BUFFER_DESC cbDesc;
 				cb->GetDesc(&cbDesc);
 				if (cbDesc.Type == D3D11_CT_CBUFFER)
-					shader.bindings.push_back({cbDesc.Name, type, cbIndex});
+				{
+					entry.bindings.push_back({cbDesc.Name, type, cbIndex});
+
+					// the variable layout so parameters can be set by name instead of mirroring the cbuffer in c++
+					ConstantBufferLayout layout;
+					layout.name = cbDesc.Name;
+					layout.size = cbDesc.Size;
+					for (uint32_t varIndex = 0; varIndex < cbDesc.Variables; varIndex++)
+					{
+						ID3D11ShaderReflectionVariable* var = cb->GetVariableByIndex(varIndex);
+						D3D11_SHADER_VARIABLE_DESC varDesc;
+						D3D11_SHADER_TYPE_DESC typeDesc;
+						var->GetDesc(&varDesc);
+						var->GetType()->GetDesc(&typeDesc);
+						layout.variables.push_back({ varDesc.Name, varDesc.StartOffset, varDesc.Size, GetDataTypeFromDesc(typeDesc), typeDesc.Elements });
+					}
+					entry.constantBuffers.push_back(layout);
+				}
 			}
 		}
 
@@ -216,17 +280,10 @@ namespace Engine
 			{
 			case D3D_SHADER_INPUT_TYPE::D3D_SIT_STRUCTURED:
 			case D3D_SHADER_INPUT_TYPE::D3D_SIT_TEXTURE:
-				shader.bindings.push_back({ bindDesc.Name, type, bindDesc.BindPoint });
+				entry.bindings.push_back({ bindDesc.Name, type, bindDesc.BindPoint });
 				break;
 			case D3D_SHADER_INPUT_TYPE::D3D_SIT_SAMPLER:
-				for (auto& sampler : shader.samplers)
-				{
-					if (sampler.bindInfo.type == type && sampler.bindInfo.name == bindDesc.Name)
-					{
-						sampler.bindInfo.point = bindDesc.BindPoint;
-						break;
-					}
-				}
+				entry.samplers.push_back({ bindDesc.Name, type, bindDesc.BindPoint });
 				break;
 			}
 		}
@@ -239,75 +296,15 @@ namespace Engine
 			{
 				D3D11_SIGNATURE_PARAMETER_DESC ps;
 				pReflector->GetInputParameterDesc(i, &ps);
-				shader.inputSigniture.push_back({ ps.SemanticName, ps.SemanticIndex, GetFormatFromDesc(ps) });
-			}
-		}
-	}
-
-	std::vector<std::string> ShaderCompiler::Tokenize(const std::string& line)
-	{
-		const char delimiters[] = { ' ', '	', '\r', '\n' };
-		const char reservedTokens[] = { "={};\"()," };
-
-		std::vector<std::string> tokens;
-
-		bool lastCharReserved = false;
-		std::string token;
-		for (const char& c : line)
-		{
-			bool endToken = false;
-			// check if it is a delimiter
-			bool delimiter = false;
-			for (uint32_t i = 0; i < _countof(delimiters); i++)
-			{
-				if (c == delimiters[i])
-				{
-					endToken = true;
-					delimiter = true;
-					break;
-				}
-			}
-
-			// check if reserved token
-			bool reserved = false;
-			for (uint32_t i = 0; i < _countof(reservedTokens); i++)
-			{
-				if (c == reservedTokens[i])
-				{
-					reserved = true;
-					break;
-				}
-			}
-
-			// combine char with last
-			if (reserved && lastCharReserved && !endToken)
-			{
-				endToken = true;
-				//if (token.back() == '=')
-			}
-
-			if (lastCharReserved != reserved)
-				endToken = true;
-
-			if (endToken)
-			{
-				if (!token.empty())
-				{
-					tokens.push_back(token);
-					token.clear();
-				}
-				if (!delimiter)
-					token.push_back(c);
-				lastCharReserved = reserved;
+				entry.inputSigniture.push_back({ ps.SemanticName, ps.SemanticIndex, GetFormatFromDesc(ps) });
 			}
-			else
-				token.push_back(c);
 		}
+		pReflector->Release();
 
-		if (!token.empty())
-			tokens.push_back(token); // add the last token
+		entry.compileMilliseconds = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+		cache.Store(key, entry);
 
-		return tokens;
+		ApplyCacheEntry(entry, shader, type);
 	}
 
 }
@@ -2,6 +2,7 @@
 #include "Platform/Windows/Win.h"
 #include "Core/Core.h"
 #include "Shader.h"
+#include "ShaderReflection.h"
 
 namespace Engine
 {
@@ -62,6 +63,13 @@ namespace Engine
 		{
 			CullMode cullMode = CullMode::Back;
 			DepthTestFunc depthTestFunc = DepthTestFunc::Less;
+
+			// declared with "#pragma multi_compile A B C", bit i of a variant mask turns on keywords[i]
+			// "_" on a multi_compile line is the variant with none of that line's keywords
+			std::vector<std::string> keywords;
+			std::vector<uint64_t> keywordGroups; // keywords from the same line, only one of them can be on
+			std::vector<uint64_t> preloadVariants; // "#pragma preload A B" compiles that variant with the shader
+			uint32_t maxVariants = 32; // "#pragma max_variants N"
 		};
 
 		struct InputElement
@@ -79,15 +87,17 @@ namespace Engine
 			std::vector<InputElement> inputSigniture;
 			wrl::ComPtr<ID3DBlob> vertexShader;
 			wrl::ComPtr<ID3DBlob> pixelShader;
+			std::vector<fs::path> dependencies; // every file pulled in with #include
+			std::vector<ConstantBufferLayout> constantBuffers;
 		};
 
-		static CompiledShader Compile(const std::string& src);
+		// compiles the variant with every keyword set in the mask defined
+		// path is where the source came from, quoted includes are looked up next to it
+		static CompiledShader Compile(const std::string& src, uint64_t keywords = 0, const fs::path& path = fs::path());
 
 	private:
 
-		static void CompileShaderCode(const std::string& src, CompiledShader& shader, Shader::ShaderType type);
-
-		static std::vector<std::string> Tokenize(const std::string& line);
+		static void CompileShaderCode(const std::string& src, CompiledShader& shader, Shader::ShaderType type, const D3D_SHADER_MACRO* defines, const fs::path& path);
 
 	};
 }
\ No newline at end of file
@@ -0,0 +1,195 @@
+#include "ShaderHotReload.h"
+#include "ShaderInclude.h"
+#include "Core/AsyncFileReader.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace Engine
+{
+
+	ShaderHotReload::ShaderHotReload()
+	{
+#ifdef DEBUG
+		SetEnabled(true);
+#endif
+	}
+
+	void ShaderHotReload::SetEnabled(bool enabled)
+	{
+		if (enabled == m_Enabled)
+			return;
+
+		m_Enabled = enabled;
+		if (enabled)
+			StartThread();
+		else
+			StopThread();
+	}
+
+	void ShaderHotReload::Watch(const fs::path& path)
+	{
+		fs::path key = ShaderIncludeCache::GetKey(path);
+		std::error_code error;
+		fs::file_time_type time = fs::last_write_time(key, error);
+
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Files.emplace(key.string(), time);
+	}
+
+	void ShaderHotReload::Update()
+	{
+		if (!m_Enabled && m_Jobs.empty())
+			return;
+
+		std::vector<fs::path> changed;
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			changed.swap(m_Changed);
+		}
+
+		auto launch = [&](Shader* shader) {
+			// the program is compiled from copies so the worker never touches the live shader
+			std::vector<uint64_t> variants;
+			for (auto& variant : shader->m_Variants)
+			{
+				if (variant.first != 0)
+					variants.push_back(variant.first);
+			}
+
+			AsyncFileReader::Get().Forget(shader->m_Path);
+			uint64_t number = ++m_JobCount;
+			m_LatestJobs[shader->GetID()] = number;
+			m_Jobs.push_back({ shader->GetID(), number, std::async(std::launch::async, &ShaderHotReload::Compile, shader->m_Path, variants) });
+		};
+
+		std::vector<uint64_t> started;
+		for (const fs::path& path : changed)
+		{
+			// the next read of the file has to go to the disk
+			ShaderIncludeCache::Get().Invalidate(path);
+
+			for (Shader* shader : Shader::GetDependents(path))
+			{
+				if (shader->m_Path.empty() || std::find(started.begin(), started.end(), shader->GetID()) != started.end())
+					continue;
+				started.push_back(shader->GetID());
+				launch(shader);
+			}
+		}
+
+		// swap in everything that finished, only futures that are ready are dropped as dropping a running one would block
+		for (auto it = m_Jobs.begin(); it != m_Jobs.end();)
+		{
+			if (it->result.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+			{
+				it++;
+				continue;
+			}
+
+			Ref<Shader> program = it->result.get();
+			uint64_t shaderID = it->shaderID;
+			bool latest = m_LatestJobs[shaderID] == it->number; // a shader that changed again while compiling has a newer job
+			it = m_Jobs.erase(it);
+			if (!latest)
+				continue;
+			m_LatestJobs.erase(shaderID);
+
+			Shader* shader = Shader::Find(shaderID);
+			if (shader == nullptr)
+				continue; // destroyed while compiling
+
+			if (program == nullptr)
+			{
+				DBOUT("failed to reload shader " << shader->m_Path.c_str() << ", keeping the old program" << std::endl);
+				std::lock_guard<std::mutex> lock(m_Mutex);
+				m_Statistics.failures++;
+				continue;
+			}
+
+			shader->SwapProgram(*program);
+			DBOUT("reloaded shader " << shader->m_Path.c_str() << std::endl);
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Statistics.reloads++;
+		}
+
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Statistics.pending = (uint32_t)m_Jobs.size();
+	}
+
+	ShaderHotReload::Statistics ShaderHotReload::GetStatistics() const
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		return m_Statistics;
+	}
+
+	ShaderHotReload& ShaderHotReload::Get()
+	{
+		static ShaderHotReload* instance = new ShaderHotReload();
+		return *instance;
+	}
+
+	void ShaderHotReload::WatchLoop()
+	{
+		std::vector<std::pair<std::string, fs::file_time_type>> files;
+		while (!m_Stop)
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_Mutex);
+				files.assign(m_Files.begin(), m_Files.end());
+			}
+
+			// look at the files without the lock so Watch never waits on the disk
+			for (auto& file : files)
+			{
+				std::error_code error;
+				fs::file_time_type time = fs::last_write_time(file.first, error);
+				if (error || time == file.second)
+					continue;
+
+				std::lock_guard<std::mutex> lock(m_Mutex);
+				m_Files[file.first] = time;
+				if (std::find(m_Changed.begin(), m_Changed.end(), file.first) == m_Changed.end())
+					m_Changed.push_back(file.first);
+			}
+
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_Wake.wait_for(lock, std::chrono::duration<float>(m_PollInterval.load()), [&]() { return m_Stop.load(); });
+		}
+	}
+
+	void ShaderHotReload::StartThread()
+	{
+		m_Stop = false;
+		m_Thread = std::thread(&ShaderHotReload::WatchLoop, this);
+	}
+
+	void ShaderHotReload::StopThread()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Stop = true;
+		}
+		m_Wake.notify_all();
+
+		if (m_Thread.joinable())
+			m_Thread.join();
+	}
+
+	Ref<Shader> ShaderHotReload::Compile(const fs::path& path, const std::vector<uint64_t>& variants)
+	{
+		std::string src;
+		if (!Shader::ReadSource(path, src))
+			return nullptr;
+
+		Ref<Shader> program(new Shader());
+		program->m_Path = path;
+		program->LoadFromSrc(src);
+		if (!program->IsValid())
+			return nullptr;
+
+		program->Preload(variants);
+		return program;
+	}
+
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include "Core/Core.h"
+#include "Shader.h"
+
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <future>
+#include <atomic>
+#include <unordered_map>
+
+namespace Engine
+{
+	// watches the files shaders were loaded from and the files they include
+	// a change recompiles the shaders that use the file on a worker thread and the new program is
+	// swapped into the existing shader at the start of a frame, the render loop never waits on a compile
+	class ShaderHotReload
+	{
+	public:
+		struct Statistics
+		{
+			uint32_t reloads = 0;
+			uint32_t failures = 0; // compiles that failed so the old program was kept
+			uint32_t pending = 0;
+		};
+
+	public:
+		void SetEnabled(bool enabled);
+		bool IsEnabled() const { return m_Enabled; }
+		void SetPollInterval(float seconds) { m_PollInterval = seconds; }
+
+		void Watch(const fs::path& path); // safe to call from any thread
+
+		// starts compiles for the changed files and swaps in the ones that finished, call once per frame
+		void Update();
+
+		Statistics GetStatistics() const;
+
+		static ShaderHotReload& Get();
+
+	private:
+		ShaderHotReload();
+
+		void WatchLoop();
+		void StartThread();
+		void StopThread();
+
+		static Ref<Shader> Compile(const fs::path& path, const std::vector<uint64_t>& variants);
+
+	private:
+		struct Job
+		{
+			uint64_t shaderID;
+			uint64_t number;
+			std::future<Ref<Shader>> result;
+		};
+
+		mutable std::mutex m_Mutex;
+		std::condition_variable m_Wake;
+		std::unordered_map<std::string, fs::file_time_type> m_Files; // last write time of every watched file
+		std::vector<fs::path> m_Changed;
+		Statistics m_Statistics;
+
+		// only touched by the thread calling Update
+		std::vector<Job> m_Jobs;
+		std::unordered_map<uint64_t, uint64_t> m_LatestJobs; // newest job started for each shader
+		uint64_t m_JobCount = 0;
+
+		std::thread m_Thread;
+		std::atomic<bool> m_Stop = false;
+		std::atomic<bool> m_Enabled = false;
+		std::atomic<float> m_PollInterval = 0.25f;
+	};
+}
@@ -0,0 +1,149 @@
+#include "ShaderInclude.h"
+#include "ShaderCache.h"
+#include "Core/AsyncFileReader.h"
+
+#include <algorithm>
+
+namespace Engine
+{
+
+	// ------------------------------------- Shader Include Cache ------------------------------------- //
+
+#pragma region Shader Include Cache
+
+	Ref<const ShaderIncludeCache::File> ShaderIncludeCache::Load(const fs::path& path)
+	{
+		fs::path key = GetKey(path);
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			auto it = m_Files.find(key.string());
+			if (it != m_Files.end())
+				return it->second;
+		}
+
+		std::error_code error;
+		if (!fs::is_regular_file(key, error))
+			return nullptr;
+
+		AsyncFileReader::Handle handle = AsyncFileReader::Get().Read(key, AsyncFileReader::Priority::High);
+		const std::vector<uint8_t>& data = handle.Wait();
+		if (handle.GetState() != AsyncFileReader::State::Done)
+			return nullptr;
+
+		Ref<File> file = std::make_shared<File>();
+		file->path = key;
+		file->source.assign(data.begin(), data.end());
+		file->hash = ShaderCache::Hash(file->source.data(), file->source.size());
+
+		// another compile may have loaded it in the mean time, keep the first one so everyone shares it
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		auto inserted = m_Files.emplace(key.string(), file);
+		return inserted.first->second;
+	}
+
+	uint64_t ShaderIncludeCache::GetHash(const fs::path& path)
+	{
+		Ref<const File> file = Load(path);
+		return file == nullptr ? 0 : file->hash;
+	}
+
+	void ShaderIncludeCache::Invalidate(const fs::path& path)
+	{
+		fs::path key = GetKey(path);
+		AsyncFileReader::Get().Forget(key);
+
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Files.erase(key.string());
+	}
+
+	void ShaderIncludeCache::AddIncludeDirectory(const fs::path& directory)
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		if (std::find(m_IncludeDirectories.begin(), m_IncludeDirectories.end(), directory) == m_IncludeDirectories.end())
+			m_IncludeDirectories.push_back(directory);
+	}
+
+	std::vector<fs::path> ShaderIncludeCache::GetIncludeDirectories()
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		return m_IncludeDirectories;
+	}
+
+	fs::path ShaderIncludeCache::GetKey(const fs::path& path)
+	{
+		std::error_code error;
+		fs::path absolute = fs::absolute(path, error);
+		return (error ? path : absolute).lexically_normal();
+	}
+
+	ShaderIncludeCache& ShaderIncludeCache::Get()
+	{
+		static ShaderIncludeCache* instance = new ShaderIncludeCache();
+		return *instance;
+	}
+
+#pragma endregion
+
+	// ------------------------------------- End Shader Include Cache ------------------------------------- //
+
+	// ------------------------------------- Shader Include ------------------------------------- //
+
+#pragma region Shader Include
+
+	ShaderInclude::ShaderInclude(const fs::path& sourcePath) :
+		m_SourceDirectory(sourcePath.parent_path())
+	{}
+
+	HRESULT STDMETHODCALLTYPE ShaderInclude::Open(D3D_INCLUDE_TYPE type, LPCSTR fileName, LPCVOID parentData, LPCVOID* data, UINT* bytes)
+	{
+		ShaderIncludeCache& cache = ShaderIncludeCache::Get();
+
+		// quoted includes look next to the file doing the include first
+		std::vector<fs::path> directories;
+		if (type == D3D_INCLUDE_LOCAL)
+		{
+			fs::path parentDirectory = m_SourceDirectory;
+			for (const Ref<const ShaderIncludeCache::File>& file : m_Open)
+			{
+				if (file->source.data() == parentData)
+				{
+					parentDirectory = file->path.parent_path();
+					break;
+				}
+			}
+			directories.push_back(parentDirectory);
+		}
+		std::vector<fs::path> includeDirectories = cache.GetIncludeDirectories();
+		directories.insert(directories.end(), includeDirectories.begin(), includeDirectories.end());
+
+		for (const fs::path& directory : directories)
+		{
+			Ref<const ShaderIncludeCache::File> file = cache.Load(directory / fileName);
+			if (file == nullptr)
+				continue;
+
+			m_Open.push_back(file);
+			auto it = std::find_if(m_Dependencies.begin(), m_Dependencies.end(), [&](const Dependency& dependency) { return dependency.path == file->path; });
+			if (it == m_Dependencies.end())
+				m_Dependencies.push_back({ file->path, file->hash });
+
+			*data = file->source.data();
+			*bytes = (UINT)file->source.size();
+			return S_OK;
+		}
+
+		DBOUT("could not find shader include " << fileName << std::endl);
+		return E_FAIL;
+	}
+
+	HRESULT STDMETHODCALLTYPE ShaderInclude::Close(LPCVOID data)
+	{
+		// the files stay open until the compile is done, they are shared with the cache anyway
+		return S_OK;
+	}
+
+#pragma endregion
+
+	// ------------------------------------- End Shader Include ------------------------------------- //
+
+}
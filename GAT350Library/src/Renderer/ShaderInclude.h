@@ -0,0 +1,66 @@
+#pragma once
+#include "Platform/Windows/Win.h"
+#include "Core/Core.h"
+
+#include <mutex>
+#include <unordered_map>
+
+namespace Engine
+{
+	// contents of every file pulled in by a shader #include, shared between all the compiles
+	class ShaderIncludeCache
+	{
+	public:
+		struct File
+		{
+			fs::path path;
+			std::string source;
+			uint64_t hash;
+		};
+
+	public:
+		// reads the file the first time it is asked for, returns nullptr if it can not be read
+		Ref<const File> Load(const fs::path& path);
+		uint64_t GetHash(const fs::path& path); // 0 if the file can not be read
+
+		// drops the cached contents so the next compile reads the file again
+		void Invalidate(const fs::path& path);
+
+		// searched after the directory of the including file
+		void AddIncludeDirectory(const fs::path& directory);
+		std::vector<fs::path> GetIncludeDirectories();
+
+		static fs::path GetKey(const fs::path& path);
+
+		static ShaderIncludeCache& Get();
+
+	private:
+		std::mutex m_Mutex;
+		std::unordered_map<std::string, Ref<const File>> m_Files;
+		std::vector<fs::path> m_IncludeDirectories;
+	};
+
+	// resolves #include for one D3DCompile call and records every file it opened
+	class ShaderInclude : public ID3DInclude
+	{
+	public:
+		struct Dependency
+		{
+			fs::path path;
+			uint64_t hash;
+		};
+
+	public:
+		ShaderInclude(const fs::path& sourcePath);
+
+		HRESULT STDMETHODCALLTYPE Open(D3D_INCLUDE_TYPE type, LPCSTR fileName, LPCVOID parentData, LPCVOID* data, UINT* bytes) override;
+		HRESULT STDMETHODCALLTYPE Close(LPCVOID data) override;
+
+		const std::vector<Dependency>& GetDependencies() const { return m_Dependencies; }
+
+	private:
+		fs::path m_SourceDirectory;
+		std::vector<Ref<const ShaderIncludeCache::File>> m_Open; // keeps the data alive until the compile is done
+		std::vector<Dependency> m_Dependencies;
+	};
+}
@@ -0,0 +1,276 @@
+#include "ShaderPreprocessor.h"
+
+#include <string.h>
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <algorithm>
+
+namespace Engine
+{
+
+	enum CharClass : uint8_t
+	{
+		Text,
+		Space,
+		Reserved, // always a token on its own
+	};
+
+	static constexpr std::array<uint8_t, 256> s_CharClasses = []() {
+		std::array<uint8_t, 256> classes = {};
+		for (char c : std::string_view(" \t\r\n"))
+			classes[(uint8_t)c] = Space;
+		for (char c : std::string_view("={};\"(),"))
+			classes[(uint8_t)c] = Reserved;
+		return classes;
+	}();
+
+	static ShaderCompiler::SamplerInfo::WrapMode GetWrapMode(std::string_view str)
+	{
+		if (str == "repeat")
+			return ShaderCompiler::SamplerInfo::WrapMode::Repeat;
+		else if (str == "repeatMiror")
+			return ShaderCompiler::SamplerInfo::WrapMode::MirroredRepeat;
+		else if (str == "clamp")
+			return ShaderCompiler::SamplerInfo::WrapMode::Clamp;
+		return ShaderCompiler::SamplerInfo::WrapMode::Clamp;
+	}
+
+	static ShaderCompiler::SamplerInfo::MinMagFilter GetFilter(std::string_view str)
+	{
+		if (str == "point")
+			return ShaderCompiler::SamplerInfo::MinMagFilter::Point;
+		else if (str == "linear")
+			return ShaderCompiler::SamplerInfo::MinMagFilter::Linear;
+		else if (str == "anisotropic")
+			return ShaderCompiler::SamplerInfo::MinMagFilter::Anisotropic;
+		return ShaderCompiler::SamplerInfo::MinMagFilter::Linear;
+	}
+
+	void ShaderPreprocessor::Process(std::string_view src, ShaderCompiler::ShaderConfig& config)
+	{
+		m_SectionCount = 0;
+		uint32_t current = 0;
+		BeginSection("config", 1); // anything before the first #section is config
+
+		const char* end = src.data() + src.size();
+		const char* spanStart = src.data(); // start of the run of plain lines not copied yet
+		const char* lineStart = src.data();
+		auto flush = [&]() {
+			m_Sections[current].source.append(spanStart, lineStart - spanStart);
+		};
+
+		for (uint32_t lineNumber = 1; lineStart < end; lineNumber++)
+		{
+			const char* lineEnd = (const char*)memchr(lineStart, '\n', end - lineStart);
+			const char* next = lineEnd == nullptr ? end : lineEnd + 1;
+			if (lineEnd == nullptr)
+				lineEnd = end;
+
+			// only lines starting with # or S can be something the preprocessor handles
+			const char* first = lineStart;
+			while (first < lineEnd && s_CharClasses[(uint8_t)*first] == Space)
+				first++;
+
+			if (first < lineEnd && (*first == '#' || *first == 'S'))
+			{
+				Tokenize(std::string_view(first, lineEnd - first));
+
+				bool handled = true;
+				if (m_Tokens[0] == "#section" && m_Tokens.size() > 1)
+				{
+					flush();
+					current = (uint32_t)(&BeginSection(m_Tokens[1], lineNumber + 1) - m_Sections.data());
+				}
+				else if (m_Tokens[0] == "#pragma" && current == 0)
+				{
+					flush();
+					ParseConfig(config);
+				}
+				else if (m_Tokens[0] == "StaticSampler")
+				{
+					flush();
+					ParseSampler(m_Sections[current]);
+				}
+				else
+					handled = false;
+
+				if (handled)
+					spanStart = next;
+			}
+
+			lineStart = next;
+		}
+
+		flush();
+	}
+
+	const ShaderPreprocessor::Section* ShaderPreprocessor::GetSection(std::string_view name) const
+	{
+		for (uint32_t i = 0; i < m_SectionCount; i++)
+		{
+			if (m_Sections[i].name == name)
+				return &m_Sections[i];
+		}
+		return nullptr;
+	}
+
+	float ShaderPreprocessor::Benchmark(uint32_t lineCount, uint32_t iterations)
+	{
+		// roughly what a real shader looks like, mostly plain code with the odd sampler and comment
+		std::string src = "#section config\n#pragma multi_compile A B _\n#section common\n";
+		const char* sectionNames[] = { "#section vertex\n", "#section pixel\n" };
+		for (uint32_t i = 0; i < lineCount; i++)
+		{
+			if (i == lineCount / 3 || i == 2 * lineCount / 3)
+				src += sectionNames[i == lineCount / 3 ? 0 : 1];
+
+			switch (i % 8)
+			{
+			case 0: src += "\tfloat4 value" + std::to_string(i) + " = tex.Sample(textureSampler, input.uv);\n"; break;
+			case 1: src += "\t// lighting for light " + std::to_string(i) + "\n"; break;
+			case 2: src += "\tfloat3 normal = normalize(mul(input.normal, (float3x3)Model));\n"; break;
+			case 3: src += "#define VALUE_" + std::to_string(i) + " 1\n"; break;
+			case 4: src += "StaticSampler sampler" + std::to_string(i) + " = StaticSampler(repeat, clamp, linear, point);\n"; break;
+			case 5: src += "\n"; break;
+			case 6: src += "\tif (value.a < 0.5f) { discard; }\n"; break;
+			default: src += "\toutput.color = float4(value.rgb * max(dot(normal, lightDir), 0.0f), 1.0f);\n"; break;
+			}
+		}
+
+		ShaderPreprocessor preprocessor;
+		auto start = std::chrono::steady_clock::now();
+		for (uint32_t i = 0; i < iterations; i++)
+		{
+			ShaderCompiler::ShaderConfig config;
+			preprocessor.Process(src, config);
+		}
+		float seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+		return seconds <= 0.0f ? 0.0f : (float)src.size() * iterations / seconds / (1024.0f * 1024.0f);
+	}
+
+	ShaderPreprocessor::Section& ShaderPreprocessor::BeginSection(std::string_view name, uint32_t line)
+	{
+		Section* section = nullptr;
+		for (uint32_t i = 0; i < m_SectionCount && section == nullptr; i++)
+		{
+			if (m_Sections[i].name == name)
+				section = &m_Sections[i];
+		}
+
+		if (section == nullptr)
+		{
+			// reuse a section from an earlier run so its buffers keep their capacity
+			if (m_SectionCount == m_Sections.size())
+				m_Sections.emplace_back();
+			section = &m_Sections[m_SectionCount++];
+			section->name.assign(name);
+			section->source.clear();
+			section->samplers.clear();
+		}
+
+		// keeps the line numbers in compile errors pointing at the shader file
+		section->source += "#line " + std::to_string(line) + "\n";
+		return *section;
+	}
+
+	void ShaderPreprocessor::Tokenize(std::string_view line)
+	{
+		m_Tokens.clear();
+		size_t i = 0;
+		while (i < line.size())
+		{
+			uint8_t charClass = s_CharClasses[(uint8_t)line[i]];
+			if (charClass == Space)
+				i++;
+			else if (charClass == Reserved)
+			{
+				m_Tokens.push_back(line.substr(i, 1));
+				i++;
+			}
+			else
+			{
+				size_t start = i;
+				while (i < line.size() && s_CharClasses[(uint8_t)line[i]] == Text)
+					i++;
+				m_Tokens.push_back(line.substr(start, i - start));
+			}
+		}
+	}
+
+	void ShaderPreprocessor::ParseConfig(ShaderCompiler::ShaderConfig& config)
+	{
+		if (m_Tokens.size() < 2)
+			return;
+
+		if (m_Tokens[1] == "multi_compile")
+		{
+			uint64_t group = 0;
+			for (uint32_t i = 2; i < m_Tokens.size(); i++)
+			{
+				if (m_Tokens[i] == "_")
+					continue;
+				if (config.keywords.size() >= 64)
+				{
+					DBOUT("too many shader keywords, " << std::string(m_Tokens[i]).c_str() << " is ignored" << std::endl);
+					continue;
+				}
+				if (std::find(config.keywords.begin(), config.keywords.end(), m_Tokens[i]) != config.keywords.end())
+					continue;
+
+				group |= 1ull << config.keywords.size();
+				config.keywords.emplace_back(m_Tokens[i]);
+			}
+			if (group != 0)
+				config.keywordGroups.push_back(group);
+		}
+		else if (m_Tokens[1] == "preload")
+		{
+			uint64_t variant = 0;
+			for (uint32_t i = 2; i < m_Tokens.size(); i++)
+			{
+				auto it = std::find(config.keywords.begin(), config.keywords.end(), m_Tokens[i]);
+				if (it == config.keywords.end())
+				{
+					DBOUT("preload uses undeclared keyword " << std::string(m_Tokens[i]).c_str() << std::endl);
+					continue;
+				}
+				variant |= 1ull << (it - config.keywords.begin());
+			}
+			config.preloadVariants.push_back(variant);
+		}
+		else if (m_Tokens[1] == "max_variants" && m_Tokens.size() > 2)
+		{
+			uint32_t maxVariants = 0;
+			std::from_chars(m_Tokens[2].data(), m_Tokens[2].data() + m_Tokens[2].size(), maxVariants);
+			config.maxVariants = std::max(maxVariants, 1u);
+		}
+	}
+
+	void ShaderPreprocessor::ParseSampler(Section& section)
+	{
+		// 0			 1	  2 3			 4 5 6 7 8 9   10 11  12 13
+		// StaticSampler name = StaticSampler( U , V , Min ,  Mag )  ;
+		if (m_Tokens.size() < 13)
+		{
+			DBOUT("bad StaticSampler declaration" << std::endl);
+			section.source += "\n";
+			return;
+		}
+
+		ShaderCompiler::SamplerInfo info;
+		info.U = GetWrapMode(m_Tokens[5]);
+		info.V = GetWrapMode(m_Tokens[7]);
+
+		info.Min = GetFilter(m_Tokens[9]);
+		info.Mag = GetFilter(m_Tokens[11]);
+
+		info.bindInfo.name.assign(m_Tokens[1]);
+
+		// no check for a name used twice, the two SamplerState declarations would not compile anyway
+		section.samplers.push_back(info);
+
+		section.source.append("SamplerState ").append(m_Tokens[1]).append(";\n");
+	}
+
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include "Core/Core.h"
+#include "ShaderCompiler.h"
+
+#include <string_view>
+
+namespace Engine
+{
+	// splits a shader file into its sections in one pass over the source
+	// plain lines are copied as whole runs, only lines starting with # or StaticSampler are tokenized
+	// keep one around and reuse it, the section buffers and token list keep their memory between runs
+	class ShaderPreprocessor
+	{
+	public:
+		struct Section
+		{
+			std::string name;
+			std::string source;
+			std::vector<ShaderCompiler::SamplerInfo> samplers;
+		};
+
+	public:
+		void Process(std::string_view src, ShaderCompiler::ShaderConfig& config);
+
+		// nullptr if the source had no section with that name
+		const Section* GetSection(std::string_view name) const;
+
+		// preprocesses a generated shader with the given number of lines and returns MB/s
+		static float Benchmark(uint32_t lineCount, uint32_t iterations);
+
+	private:
+		Section& BeginSection(std::string_view name, uint32_t line);
+		void Tokenize(std::string_view line);
+		void ParseConfig(ShaderCompiler::ShaderConfig& config);
+		void ParseSampler(Section& section);
+
+	private:
+		std::vector<Section> m_Sections;
+		uint32_t m_SectionCount = 0; // sections past this are left over from an earlier run
+		std::vector<std::string_view> m_Tokens;
+	};
+}
@@ -0,0 +1,36 @@
+#include "ShaderProperty.h"
+
+namespace Engine
+{
+
+	PropertyID ShaderProperty::Intern(std::string_view name)
+	{
+		PropertyID id = ID(name);
+
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		auto inserted = m_Names.emplace(id, name);
+		if (!inserted.second && inserted.first->second != name)
+			DBOUT("shader properties " << inserted.first->second.c_str() << " and " << std::string(name).c_str() << " have the same id " << id << std::endl);
+		return id;
+	}
+
+	std::string ShaderProperty::GetName(PropertyID id)
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		auto it = m_Names.find(id);
+		return it == m_Names.end() ? std::string() : it->second;
+	}
+
+	uint32_t ShaderProperty::GetCount()
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		return (uint32_t)m_Names.size();
+	}
+
+	ShaderProperty& ShaderProperty::Get()
+	{
+		static ShaderProperty* instance = new ShaderProperty();
+		return *instance;
+	}
+
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include "Core/Core.h"
+
+#include <string_view>
+#include <mutex>
+#include <unordered_map>
+
+namespace Engine
+{
+	// a shader property name turned into a number, the same name always gives the same id
+	using PropertyID = uint32_t;
+
+	// every property name the shaders use, the id is a hash of the name so it can be made at compile time
+	//   static constexpr PropertyID texDef = ShaderProperty::ID("texDef");
+	// and looked up in a shader without ever touching the string
+	class ShaderProperty
+	{
+	public:
+		static constexpr PropertyID InvalidID = 0;
+
+		static constexpr PropertyID ID(std::string_view name)
+		{
+			// 32 bit FNV-1a, 0 is kept for invalid
+			uint32_t hash = 2166136261u;
+			for (char c : name)
+			{
+				hash ^= (uint8_t)c;
+				hash *= 16777619u;
+			}
+			return hash == InvalidID ? 1 : hash;
+		}
+
+		// remembers the name so it can be looked up again from the id, warns if two names hash to the same id
+		PropertyID Intern(std::string_view name);
+		std::string GetName(PropertyID id); // empty if the id was never interned
+
+		uint32_t GetCount();
+
+		static ShaderProperty& Get();
+
+	private:
+		std::mutex m_Mutex;
+		std::unordered_map<PropertyID, std::string> m_Names;
+	};
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include "Core/Core.h"
+#include "Buffer.h"
+
+namespace Engine
+{
+	// a variable inside a cbuffer as the shader compiler laid it out
+	struct ShaderVariable
+	{
+		std::string name;
+		uint32_t offset; // bytes from the start of the cbuffer
+		uint32_t size;
+		ShaderDataType type = ShaderDataType::None; // None for structs and anything else without a matching type
+		uint32_t elements = 0; // array length, 0 if it is not an array
+	};
+
+	struct ConstantBufferLayout
+	{
+		std::string name;
+		uint32_t size = 0;
+		std::vector<ShaderVariable> variables;
+
+		const ShaderVariable* Find(const std::string& variableName) const
+		{
+			for (const ShaderVariable& variable : variables)
+			{
+				if (variable.name == variableName)
+					return &variable;
+			}
+			return nullptr;
+		}
+	};
+}
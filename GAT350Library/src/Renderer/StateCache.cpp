@@ -0,0 +1,266 @@
+#include "StateCache.h"
+
+#include <string.h>
+#include <algorithm>
+
+namespace Engine
+{
+
+	// no object lives at this address so nothing compares equal to it and the next set always goes through
+	template<typename T>
+	static T* Unknown()
+	{
+		return reinterpret_cast<T*>(~(uintptr_t)0);
+	}
+
+	StateCache::StateCache()
+	{
+		Invalidate();
+	}
+
+	void StateCache::SetContext(wrl::ComPtr<ID3D11DeviceContext> context)
+	{
+		m_Context = context;
+		m_Context1 = nullptr;
+		if (m_Context != nullptr)
+			m_Context.As(&m_Context1);
+		Invalidate();
+	}
+
+	void StateCache::Invalidate()
+	{
+		m_InputLayout = Unknown<ID3D11InputLayout>();
+		for (VertexBufferBinding& binding : m_VertexBuffers)
+			binding = { Unknown<ID3D11Buffer>(), 0, 0 };
+		m_IndexBuffer = Unknown<ID3D11Buffer>();
+		m_IndexFormat = DXGI_FORMAT_UNKNOWN;
+		m_IndexOffset = 0;
+		m_VertexShader = Unknown<ID3D11VertexShader>();
+		m_PixelShader = Unknown<ID3D11PixelShader>();
+		m_RasterizerState = Unknown<ID3D11RasterizerState>();
+		m_DepthStencilState = Unknown<ID3D11DepthStencilState>();
+		m_StencilRef = 0;
+
+		for (uint32_t stage = 0; stage < (uint32_t)Stage::Count; stage++)
+		{
+			for (ConstantBufferBinding& binding : m_ConstantBuffers[stage])
+				binding = { Unknown<ID3D11Buffer>(), 0, 0 };
+			for (ID3D11SamplerState*& sampler : m_Samplers[stage])
+				sampler = Unknown<ID3D11SamplerState>();
+		}
+
+		InvalidateRenderTargets();
+	}
+
+	void StateCache::InvalidateRenderTargets()
+	{
+		m_RenderTargetCount = ~0u;
+		for (ID3D11RenderTargetView*& view : m_RenderTargets)
+			view = Unknown<ID3D11RenderTargetView>();
+		m_DepthStencil = Unknown<ID3D11DepthStencilView>();
+		m_ViewportKnown = false;
+
+		for (uint32_t stage = 0; stage < (uint32_t)Stage::Count; stage++)
+		{
+			for (ID3D11ShaderResourceView*& view : m_ShaderResources[stage])
+				view = Unknown<ID3D11ShaderResourceView>();
+		}
+	}
+
+	bool StateCache::SetInputLayout(ID3D11InputLayout* layout)
+	{
+		if (!Issue(layout == m_InputLayout))
+			return false;
+
+		m_Context->IASetInputLayout(layout);
+		m_InputLayout = layout;
+		return true;
+	}
+
+	bool StateCache::SetVertexBuffer(uint32_t slot, ID3D11Buffer* buffer, uint32_t stride, uint32_t offset)
+	{
+		if (slot < MaxVertexBuffers)
+		{
+			VertexBufferBinding& binding = m_VertexBuffers[slot];
+			if (!Issue(binding.buffer == buffer && binding.stride == stride && binding.offset == offset))
+				return false;
+			binding = { buffer, stride, offset };
+		}
+		else
+			Issue(false);
+
+		m_Context->IASetVertexBuffers(slot, 1u, &buffer, &stride, &offset);
+		return true;
+	}
+
+	bool StateCache::SetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format, uint32_t offset)
+	{
+		if (!Issue(buffer == m_IndexBuffer && format == m_IndexFormat && offset == m_IndexOffset))
+			return false;
+
+		m_Context->IASetIndexBuffer(buffer, format, offset);
+		m_IndexBuffer = buffer;
+		m_IndexFormat = format;
+		m_IndexOffset = offset;
+		return true;
+	}
+
+	bool StateCache::SetVertexShader(ID3D11VertexShader* shader)
+	{
+		if (!Issue(shader == m_VertexShader))
+			return false;
+
+		m_Context->VSSetShader(shader, nullptr, 0u);
+		m_VertexShader = shader;
+		return true;
+	}
+
+	bool StateCache::SetPixelShader(ID3D11PixelShader* shader)
+	{
+		if (!Issue(shader == m_PixelShader))
+			return false;
+
+		m_Context->PSSetShader(shader, nullptr, 0u);
+		m_PixelShader = shader;
+		return true;
+	}
+
+	bool StateCache::SetRasterizerState(ID3D11RasterizerState* state)
+	{
+		if (!Issue(state == m_RasterizerState))
+			return false;
+
+		m_Context->RSSetState(state);
+		m_RasterizerState = state;
+		return true;
+	}
+
+	bool StateCache::SetDepthStencilState(ID3D11DepthStencilState* state, uint32_t stencilRef)
+	{
+		if (!Issue(state == m_DepthStencilState && stencilRef == m_StencilRef))
+			return false;
+
+		m_Context->OMSetDepthStencilState(state, stencilRef);
+		m_DepthStencilState = state;
+		m_StencilRef = stencilRef;
+		return true;
+	}
+
+	bool StateCache::SetConstantBuffer(Stage stage, uint32_t slot, ID3D11Buffer* buffer, uint32_t firstConstant, uint32_t constantCount)
+	{
+		if (constantCount != 0 && m_Context1 == nullptr)
+		{
+			DBOUT("binding part of a constant buffer needs an 11.1 context" << std::endl);
+			return false;
+		}
+
+		if (slot < MaxConstantBuffers)
+		{
+			ConstantBufferBinding& binding = m_ConstantBuffers[(uint32_t)stage][slot];
+			if (!Issue(binding.buffer == buffer && binding.firstConstant == firstConstant && binding.constantCount == constantCount))
+				return false;
+			binding = { buffer, firstConstant, constantCount };
+		}
+		else
+			Issue(false);
+
+		if (constantCount == 0)
+		{
+			if (stage == Stage::Vertex)
+				m_Context->VSSetConstantBuffers(slot, 1u, &buffer);
+			else
+				m_Context->PSSetConstantBuffers(slot, 1u, &buffer);
+		}
+		else
+		{
+			if (stage == Stage::Vertex)
+				m_Context1->VSSetConstantBuffers1(slot, 1u, &buffer, &firstConstant, &constantCount);
+			else
+				m_Context1->PSSetConstantBuffers1(slot, 1u, &buffer, &firstConstant, &constantCount);
+		}
+		return true;
+	}
+
+	bool StateCache::SetSampler(Stage stage, uint32_t slot, ID3D11SamplerState* sampler)
+	{
+		if (slot < MaxSamplers)
+		{
+			ID3D11SamplerState*& bound = m_Samplers[(uint32_t)stage][slot];
+			if (!Issue(bound == sampler))
+				return false;
+			bound = sampler;
+		}
+		else
+			Issue(false);
+
+		if (stage == Stage::Vertex)
+			m_Context->VSSetSamplers(slot, 1u, &sampler);
+		else
+			m_Context->PSSetSamplers(slot, 1u, &sampler);
+		return true;
+	}
+
+	bool StateCache::SetShaderResource(Stage stage, uint32_t slot, ID3D11ShaderResourceView* view)
+	{
+		if (slot < MaxShaderResources)
+		{
+			ID3D11ShaderResourceView*& bound = m_ShaderResources[(uint32_t)stage][slot];
+			if (!Issue(bound == view))
+				return false;
+			bound = view;
+		}
+		else
+			Issue(false);
+
+		if (stage == Stage::Vertex)
+			m_Context->VSSetShaderResources(slot, 1u, &view);
+		else
+			m_Context->PSSetShaderResources(slot, 1u, &view);
+		return true;
+	}
+
+	bool StateCache::SetRenderTargets(uint32_t count, ID3D11RenderTargetView* const* views, ID3D11DepthStencilView* depth)
+	{
+		count = views == nullptr ? 0 : std::min(count, MaxRenderTargets);
+		bool bound = count == m_RenderTargetCount && depth == m_DepthStencil;
+		for (uint32_t i = 0; i < count && bound; i++)
+			bound = views[i] == m_RenderTargets[i];
+		if (!Issue(bound))
+			return false;
+
+		m_Context->OMSetRenderTargets(count, count == 0 ? nullptr : views, depth);
+		m_RenderTargetCount = count;
+		for (uint32_t i = 0; i < count; i++)
+			m_RenderTargets[i] = views[i];
+		m_DepthStencil = depth;
+
+		// the runtime unbinds shader resources that are now bound as targets, the shadow can not tell which ones
+		for (uint32_t stage = 0; stage < (uint32_t)Stage::Count; stage++)
+		{
+			for (ID3D11ShaderResourceView*& view : m_ShaderResources[stage])
+				view = Unknown<ID3D11ShaderResourceView>();
+		}
+		return true;
+	}
+
+	bool StateCache::SetViewport(const D3D11_VIEWPORT& viewport)
+	{
+		if (!Issue(m_ViewportKnown && memcmp(&viewport, &m_Viewport, sizeof(viewport)) == 0))
+			return false;
+
+		m_Context->RSSetViewports(1u, &viewport);
+		m_Viewport = viewport;
+		m_ViewportKnown = true;
+		return true;
+	}
+
+	bool StateCache::Issue(bool bound)
+	{
+		if (bound)
+			m_Statistics.skipped++;
+		else
+			m_Statistics.issued++;
+		return !bound;
+	}
+
+}
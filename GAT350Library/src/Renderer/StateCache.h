@@ -0,0 +1,107 @@
+#pragma once
+#include "Platform/Windows/Win.h"
+#include "Core/Core.h"
+
+namespace Engine
+{
+	// a shadow of what is bound to one device context, a set of something that is already bound is dropped
+	// pointers are safe to compare as the context keeps a reference to everything bound to it
+	// anything that binds to the context without going through the cache has to invalidate it
+	class StateCache
+	{
+	public:
+		enum class Stage
+		{
+			Vertex,
+			Pixel,
+			Count
+		};
+
+		// slots past these are always set
+		static constexpr uint32_t MaxVertexBuffers = 16;
+		static constexpr uint32_t MaxConstantBuffers = 14;
+		static constexpr uint32_t MaxSamplers = 16;
+		static constexpr uint32_t MaxShaderResources = 128;
+		static constexpr uint32_t MaxRenderTargets = 8;
+
+		struct Statistics
+		{
+			uint32_t issued = 0; // calls that went to the context
+			uint32_t skipped = 0; // calls that would have bound what was already bound
+
+			float GetSkipRate() const { return issued + skipped == 0 ? 0.0f : (float)skipped / (float)(issued + skipped); }
+		};
+
+	public:
+		StateCache();
+
+		void SetContext(wrl::ComPtr<ID3D11DeviceContext> context); // forgets everything
+		wrl::ComPtr<ID3D11DeviceContext> GetContext() const { return m_Context; }
+
+		// the next set of everything goes to the context
+		void Invalidate();
+		// for when views are made again, like after a resize, shader resources go too as they may be the old targets
+		void InvalidateRenderTargets();
+
+		// each returns true if the call went to the context
+		bool SetInputLayout(ID3D11InputLayout* layout);
+		bool SetVertexBuffer(uint32_t slot, ID3D11Buffer* buffer, uint32_t stride, uint32_t offset = 0);
+		bool SetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format, uint32_t offset = 0);
+		bool SetVertexShader(ID3D11VertexShader* shader);
+		bool SetPixelShader(ID3D11PixelShader* shader);
+		bool SetRasterizerState(ID3D11RasterizerState* state);
+		bool SetDepthStencilState(ID3D11DepthStencilState* state, uint32_t stencilRef = 0);
+		// a constant count of 0 binds the whole buffer, anything else needs the 11.1 context
+		bool SetConstantBuffer(Stage stage, uint32_t slot, ID3D11Buffer* buffer, uint32_t firstConstant = 0, uint32_t constantCount = 0);
+		bool SetSampler(Stage stage, uint32_t slot, ID3D11SamplerState* sampler);
+		bool SetShaderResource(Stage stage, uint32_t slot, ID3D11ShaderResourceView* view);
+		bool SetRenderTargets(uint32_t count, ID3D11RenderTargetView* const* views, ID3D11DepthStencilView* depth);
+		bool SetViewport(const D3D11_VIEWPORT& viewport);
+
+		const Statistics& GetStatistics() const { return m_Statistics; }
+		void ResetStatistics() { m_Statistics = Statistics(); }
+		void AddStatistics(const Statistics& other) { m_Statistics.issued += other.issued; m_Statistics.skipped += other.skipped; } // a command recorder's
+
+	private:
+		bool Issue(bool bound); // counts the call, true if it has to go to the context
+
+	private:
+		struct VertexBufferBinding
+		{
+			ID3D11Buffer* buffer;
+			uint32_t stride;
+			uint32_t offset;
+		};
+
+		struct ConstantBufferBinding
+		{
+			ID3D11Buffer* buffer;
+			uint32_t firstConstant;
+			uint32_t constantCount;
+		};
+
+		wrl::ComPtr<ID3D11DeviceContext> m_Context;
+		wrl::ComPtr<ID3D11DeviceContext1> m_Context1;
+
+		ID3D11InputLayout* m_InputLayout;
+		VertexBufferBinding m_VertexBuffers[MaxVertexBuffers];
+		ID3D11Buffer* m_IndexBuffer;
+		DXGI_FORMAT m_IndexFormat;
+		uint32_t m_IndexOffset;
+		ID3D11VertexShader* m_VertexShader;
+		ID3D11PixelShader* m_PixelShader;
+		ID3D11RasterizerState* m_RasterizerState;
+		ID3D11DepthStencilState* m_DepthStencilState;
+		uint32_t m_StencilRef;
+		ConstantBufferBinding m_ConstantBuffers[(uint32_t)Stage::Count][MaxConstantBuffers];
+		ID3D11SamplerState* m_Samplers[(uint32_t)Stage::Count][MaxSamplers];
+		ID3D11ShaderResourceView* m_ShaderResources[(uint32_t)Stage::Count][MaxShaderResources];
+		uint32_t m_RenderTargetCount;
+		ID3D11RenderTargetView* m_RenderTargets[MaxRenderTargets];
+		ID3D11DepthStencilView* m_DepthStencil;
+		D3D11_VIEWPORT m_Viewport;
+		bool m_ViewportKnown;
+
+		Statistics m_Statistics;
+	};
+}
@@ -52,8 +52,8 @@ namespace Engine
 			md.Scaling = DXGI_MODE_SCALING_UNSPECIFIED; // unspecified no scaling required 
 			md.ScanlineOrdering = DXGI_MODE_SCANLINE_ORDER_UNSPECIFIED; // unspecified 
 
-			// unbind the render target
-			graphics.GetContext()->OMSetRenderTargets(0, 0, 0);
+			// unbind the render target, through the state cache so it knows nothing is bound
+			graphics.GetStateCache().SetRenderTargets(0, nullptr, nullptr);
 			// release reference to the render target
 			m_RTV->Release();
 
@@ -68,6 +68,7 @@ namespace Engine
 			m_Swap->GetBuffer(0, __uuidof(ID3D11Resource), &m_BackBuffer);
 
 			graphics.GetDivice()->CreateRenderTargetView(m_BackBuffer.Get(), nullptr, m_RTV.GetAddressOf());
+			graphics.GetStateCache().InvalidateRenderTargets(); // the viewport has to be set again at the new size
 		}
 	}
 
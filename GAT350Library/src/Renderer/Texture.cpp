@@ -1,33 +1,29 @@
 #include "Texture.h"
 #include "RendererAPI.h"
+#include "TextureResidency.h"
+#include "TextureUploader.h"
+#include "Core/AsyncFileReader.h"
+#include "Util/HalfFloat.h"
 #include "stb_image.h"
+#include <algorithm>
 
-stbi_uc* T24To32(uint32_t width, uint32_t height, stbi_uc* data)
+// expands 1 to 3 channel float images to RGBA with an alpha of 1
+float* TFloatToRGBA(uint32_t width, uint32_t height, uint32_t channels, const float* data)
 {
-	struct Pixel32 {
-		uint8_t r, g, b, a;
-	};
-	struct Pixel24 {
-		uint8_t r, g, b;
-	};
+	size_t pixels = (size_t)width * height;
+	float* newImage = new float[pixels * 4];
 
-	Pixel32* newImage = new Pixel32[width * height];
-
-	for (uint32_t h = 0; h < height; h++)
+	for (size_t i = 0; i < pixels; i++)
 	{
-		for (uint32_t w = 0; w < width; w++)
-		{
-			Pixel32& np = newImage[(width * h) + w];
-			Pixel24& op = ((Pixel24*)data)[(width * h) + w];
-			np.r = op.r;
-			np.g = op.g;
-			np.b = op.b;
-			np.a = 255;
-		}
+		const float* op = data + i * channels;
+		float* np = newImage + i * 4;
+		np[0] = op[0];
+		np[1] = channels > 1 ? op[1] : 0.0f;
+		np[2] = channels > 2 ? op[2] : 0.0f;
+		np[3] = channels > 3 ? op[3] : 1.0f;
 	}
 
-	delete[] data;
-	return (stbi_uc*)newImage;
+	return newImage;
 }
 
 namespace Engine 
@@ -172,53 +168,178 @@ namespace Engine
 		return false;
 	}
 
+	uint32_t Texture::GetMipCount(uint32_t width, uint32_t height)
+	{
+		uint32_t size = std::max(width, height);
+		uint32_t count = 1;
+		while (size > 1)
+		{
+			size >>= 1;
+			count++;
+		}
+		return count;
+	}
+
 	Texture2D::Texture2D(const fs::path& path)
 	{
 		LoadFromFile(path);
 	}
 
-	Texture2D::Texture2D(uint32_t width, uint32_t height, Format format, unsigned char const* data) :
+	Texture2D::Texture2D(const fs::path& path, Format hdrFormat) :
+		m_HDRFormat(hdrFormat)
+	{
+		if (m_HDRFormat != Format::RGBA16_FLOAT && m_HDRFormat != Format::RGBA32_FLOAT)
+		{
+			DBOUT("hdr images can only be loaded as RGBA16_FLOAT or RGBA32_FLOAT" << std::endl);
+			m_HDRFormat = Format::RGBA16_FLOAT;
+		}
+		LoadFromFile(path);
+	}
+
+	Texture2D::Texture2D(uint32_t width, uint32_t height, Format format, unsigned char const* data, uint32_t mipLevels) :
 		m_Width(width), m_Height(height), m_Format(format)
 	{
-		GenTextureBuffer((void*)data);
+		GenTextureBuffer((void*)data, mipLevels);
 		GenSRV();
 	}
 
+	Texture2D::~Texture2D()
+	{
+		TextureResidency::Get().Unregister(this);
+		TextureUploader::Get().Cancel(this);
+	}
+
 	void Texture2D::SetData(void* data, uint32_t size)
 	{
-		// TODO
+		if (size < m_Width * m_Height * GetFormatSize(m_Format))
+		{
+			DBOUT("not enough data to fill the texture" << std::endl);
+			return;
+		}
+
+		SetRegion(data, 0, 0, m_Width, m_Height, 0);
 	}
 
-	void Texture2D::LoadFromFile(const fs::path& path)
+	void Texture2D::SetRegion(const void* data, uint32_t x, uint32_t y, uint32_t width, uint32_t height, uint32_t mip)
 	{
-		int width, height, channels;
-		stbi_uc* data = stbi_load(path.string().c_str(), &width, &height, &channels, 0);
+		if (IsDepthStencilTexture())
+		{
+			DBOUT("can not set the data of a depth stencil texture" << std::endl);
+			return;
+		}
 
-		if (data == nullptr)
+		uint32_t mipWidth = std::max(m_Width >> mip, 1u);
+		uint32_t mipHeight = std::max(m_Height >> mip, 1u);
+		if (mip >= m_MipLevels || x + width > mipWidth || y + height > mipHeight)
 		{
-			DBOUT("failed to load image " << path.c_str() << std::endl);
+			DBOUT("texture region is out of bounds" << std::endl);
 			return;
 		}
 
-		if (channels == 3)
+		// the file no longer describes the texture so bring back the evicted mips and stop evicting them
+		if (m_ResidentMip > 0)
+			SetResidentMip(0);
+		m_Path.clear();
+
+		TextureUploader::Get().Upload(this, mip, x, y, width, height, data);
+	}
+
+	void Texture2D::LoadFromFile(const fs::path& path)
+	{
+		// joins the read if a loader already asked for this file ahead of time
+		AsyncFileReader::Handle file = AsyncFileReader::Get().Read(path, AsyncFileReader::Priority::High);
+
+		Image image;
+		if (!Decode(path, file.Wait(), m_HDRFormat, image))
+			return;
+
+		m_Path = path;
+		SetImage(image);
+	}
+
+	void Texture2D::Restore(const Image& image)
+	{
+		if (m_ResidentMip == 0 || image.pixels.empty())
+			return;
+		SetImage(image);
+	}
+
+	bool Texture2D::Decode(const fs::path& path, const std::vector<uint8_t>& file, Format hdrFormat, Image& image)
+	{
+		int width, height, channels;
+		if (stbi_is_hdr_from_memory(file.data(), (int)file.size()))
 		{
-			channels = 4;
-			data = T24To32(width, height, data);
+			float* data = stbi_loadf_from_memory(file.data(), (int)file.size(), &width, &height, &channels, 0);
+			if (data == nullptr)
+			{
+				DBOUT("failed to load image " << path.c_str() << std::endl);
+				return false;
+			}
+
+			size_t pixels = (size_t)width * height;
+			image.format = hdrFormat;
+			if (hdrFormat == Format::RGBA32_FLOAT)
+			{
+				float* rgba = (channels == 4 ? data : TFloatToRGBA(width, height, channels, data));
+				image.pixels.assign((const uint8_t*)rgba, (const uint8_t*)(rgba + pixels * 4));
+				if (rgba != data)
+					delete[] rgba;
+			}
+			else
+			{
+				// half the memory of RGBA32_FLOAT and still plenty of range for lighting
+				image.pixels.resize(pixels * 4 * sizeof(uint16_t));
+				HalfFloat::ConvertToRGBA(data, channels, (uint16_t*)image.pixels.data(), pixels);
+			}
+			stbi_image_free(data);
 		}
-		m_Width = width; m_Height = height;
-		switch (channels)
+		else
 		{
-		case 1: m_Format = Format::R8_UNORM;
-		case 2: m_Format = Format::RG8_UNORM;
-		case 4: m_Format = Format::RGBA8_UNORM;
+			// there is no 24 bit format, stb adds the alpha to 3 channel images as it loads them
+			int desiredChannels = 0;
+			if (stbi_info_from_memory(file.data(), (int)file.size(), &width, &height, &channels) && channels == 3)
+				desiredChannels = 4;
+
+			stbi_uc* data = stbi_load_from_memory(file.data(), (int)file.size(), &width, &height, &channels, desiredChannels);
+			if (data == nullptr)
+			{
+				DBOUT("failed to load image " << path.c_str() << std::endl);
+				return false;
+			}
+
+			if (desiredChannels != 0)
+				channels = desiredChannels;
+			image.pixels.assign(data, data + (size_t)width * height * channels);
+			switch (channels)
+			{
+			case 1: image.format = Format::R8_UNORM; break;
+			case 2: image.format = Format::RG8_UNORM; break;
+			case 4: image.format = Format::RGBA8_UNORM; break;
+			}
+			stbi_image_free(data);
 		}
 
-		GenTextureBuffer(data);
+		image.width = width;
+		image.height = height;
+		return true;
+	}
+
+	void Texture2D::SetImage(const Image& image)
+	{
+		m_Width = image.width; m_Height = image.height;
+		m_Format = image.format;
+		m_ResidentMip = 0;
+
+		GenTextureBuffer((void*)image.pixels.data());
 		GenSRV();
 
 		RendererAPI::Get().GetContext()->GenerateMips(m_SRV.Get());
+	}
 
-		stbi_image_free(data);
+	void Texture2D::GenerateMips()
+	{
+		if (m_MipLevels > 1)
+			RendererAPI::Get().GetContext()->GenerateMips(m_SRV.Get());
 	}
 
 	bool Texture2D::operator==(const Texture& other) const
@@ -229,8 +350,12 @@ namespace Engine
 
 	void Texture2D::GenTextureBuffer(void* data, uint32_t numMipMaps)
 	{
+		std::vector<uint8_t> empty;
 		if (data == nullptr)
-			data = new uint8_t[m_Width * m_Height * GetFormatSize(m_Format)]{0};
+		{
+			empty.resize(m_Width * m_Height * GetFormatSize(m_Format), 0);
+			data = empty.data();
+		}
 
 		RendererAPI& graphics = RendererAPI::Get();
 
@@ -256,13 +381,55 @@ namespace Engine
 		textureDesc.CPUAccessFlags = 0;
 
 
-		HRESULT hr = graphics.GetDivice()->CreateTexture2D(&textureDesc, nullptr, m_Buffer.GetAddressOf());
+		HRESULT hr = graphics.GetDivice()->CreateTexture2D(&textureDesc, nullptr, m_Buffer.ReleaseAndGetAddressOf());
 		if (FAILED(hr)) {
 			DBOUT("failed to create texture");
 			return;
 		}
 
 		graphics.GetContext()->UpdateSubresource(m_Buffer.Get(), 0, nullptr, (const void*)data, m_Width * GetFormatSize(m_Format), 0);
+
+		m_MipLevels = (numMipMaps == 0 ? GetMipCount(m_Width, m_Height) : numMipMaps);
+		m_ResidentMip = 0;
+		TextureResidency::Get().Register(this);
+	}
+
+	void Texture2D::SetResidentMip(uint32_t mip)
+	{
+		if (mip == m_ResidentMip || mip >= m_MipLevels)
+			return;
+
+		if (mip < m_ResidentMip)
+		{
+			// the evicted mips are gone from the gpu so reload the whole image
+			LoadFromFile(m_Path);
+			if (mip == 0 || m_ResidentMip != 0)
+				return;
+		}
+
+		RendererAPI& graphics = RendererAPI::Get();
+
+		// create a smaller texture and copy the remaining mips over, no data has to go through the cpu
+		uint32_t dropped = mip - m_ResidentMip;
+		D3D11_TEXTURE2D_DESC textureDesc;
+		m_Buffer->GetDesc(&textureDesc);
+		textureDesc.Width = std::max(textureDesc.Width >> dropped, 1u);
+		textureDesc.Height = std::max(textureDesc.Height >> dropped, 1u);
+		textureDesc.MipLevels -= dropped;
+
+		wrl::ComPtr<ID3D11Texture2D> buffer;
+		HRESULT hr = graphics.GetDivice()->CreateTexture2D(&textureDesc, nullptr, buffer.GetAddressOf());
+		if (FAILED(hr)) {
+			DBOUT("failed to create texture");
+			return;
+		}
+
+		for (uint32_t i = 0; i < textureDesc.MipLevels; i++)
+			graphics.GetContext()->CopySubresourceRegion(buffer.Get(), i, 0, 0, 0, m_Buffer.Get(), i + dropped, nullptr);
+
+		m_Buffer = buffer;
+		m_ResidentMip = mip;
+		GenSRV();
 	}
 
 	void Texture2D::GenSRV()
@@ -274,7 +441,7 @@ namespace Engine
 		srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
 		srvDesc.Texture2D.MostDetailedMip = 0;
 		srvDesc.Texture2D.MipLevels = -1;
-		HRESULT hr = graphics.GetDivice()->CreateShaderResourceView(m_Buffer.Get(), &srvDesc, m_SRV.GetAddressOf());
+		HRESULT hr = graphics.GetDivice()->CreateShaderResourceView(m_Buffer.Get(), &srvDesc, m_SRV.ReleaseAndGetAddressOf());
 		if (FAILED(hr)) {
 			DBOUT("failed to create texture resorce");
 			return;
@@ -286,6 +453,11 @@ namespace Engine
 		return std::make_shared<Texture2D>(path);
 	}
 
+	Ref<Texture2D> Texture2D::Create(const fs::path& path, Format hdrFormat)
+	{
+		return std::make_shared<Texture2D>(path, hdrFormat);
+	}
+
 	Ref<Texture2D> Texture2D::Create(uint32_t width, uint32_t height, Format format)
 	{
 		unsigned char* data = new unsigned char[width*height*4*sizeof(uint8_t)];
@@ -299,11 +471,167 @@ namespace Engine
 		return tex;
 	}
 
-	Ref<Texture2D> Texture2D::Create(uint32_t width, uint32_t height, Format format, unsigned char const* data)
+	Ref<Texture2D> Texture2D::Create(uint32_t width, uint32_t height, Format format, unsigned char const* data, uint32_t mipLevels)
+	{
+		return std::make_shared<Texture2D>(width, height, format, data, mipLevels);
+	}
+
+	// ------------------------------------- Texture 2D Array ------------------------------------- //
+
+#pragma region Texture 2D Array
+
+	Texture2DArray::Texture2DArray(uint32_t width, uint32_t height, uint32_t layers, Format format) :
+		m_Width(width), m_Height(height), m_Layers(layers), m_Format(format)
+	{
+		GenTextureBuffer();
+		GenSRV();
+	}
+
+	Texture2DArray::Texture2DArray(const std::vector<fs::path>& paths)
+	{
+		LoadFromFiles(paths);
+	}
+
+	void Texture2DArray::SetData(void* data, uint32_t size)
+	{
+		uint32_t layerSize = m_Width * m_Height * GetFormatSize(m_Format);
+		if (size < layerSize * m_Layers)
+		{
+			DBOUT("not enough data to fill the texture array" << std::endl);
+			return;
+		}
+
+		for (uint32_t i = 0; i < m_Layers; i++)
+			SetLayerData(i, (uint8_t*)data + (size_t)layerSize * i);
+		GenerateMips();
+	}
+
+	void Texture2DArray::SetLayerData(uint32_t layer, const void* data)
+	{
+		if (layer >= m_Layers)
+			return;
+
+		RendererAPI& graphics = RendererAPI::Get();
+		uint32_t subresource = layer * m_MipLevels; // mip 0 of the layer
+		graphics.GetContext()->UpdateSubresource(m_Buffer.Get(), subresource, nullptr, data, m_Width * GetFormatSize(m_Format), 0);
+	}
+
+	void Texture2DArray::LoadFromFile(const fs::path& path)
+	{
+		LoadFromFiles({ path });
+	}
+
+	void Texture2DArray::LoadFromFiles(const std::vector<fs::path>& paths)
+	{
+		if (paths.empty())
+			return;
+
+		std::vector<AsyncFileReader::Handle> files = AsyncFileReader::Get().ReadBatch(paths, AsyncFileReader::Priority::High);
+
+		// the first image decides the size of every layer
+		int width, height, channels;
+		const std::vector<uint8_t>& first = files[0].Wait();
+		if (!stbi_info_from_memory(first.data(), (int)first.size(), &width, &height, &channels))
+		{
+			DBOUT("failed to load image " << paths[0].c_str() << std::endl);
+			return;
+		}
+
+		m_Width = width; m_Height = height;
+		m_Layers = (uint32_t)paths.size();
+		m_Format = Format::RGBA8_UNORM;
+		GenTextureBuffer();
+		GenSRV();
+
+		// the rest of the files keep being read while each layer is decoded
+		for (uint32_t i = 0; i < m_Layers; i++)
+		{
+			const std::vector<uint8_t>& buffer = files[i].Wait();
+			stbi_uc* data = stbi_load_from_memory(buffer.data(), (int)buffer.size(), &width, &height, &channels, 4);
+			if (data == nullptr)
+			{
+				DBOUT("failed to load image " << paths[i].c_str() << std::endl);
+				continue;
+			}
+
+			if ((uint32_t)width == m_Width && (uint32_t)height == m_Height)
+				SetLayerData(i, data);
+			else
+				DBOUT("image " << paths[i].c_str() << " does not match the size of the texture array" << std::endl);
+
+			stbi_image_free(data);
+		}
+
+		GenerateMips();
+	}
+
+	void Texture2DArray::GenerateMips()
+	{
+		RendererAPI::Get().GetContext()->GenerateMips(m_SRV.Get());
+	}
+
+	bool Texture2DArray::operator==(const Texture& other) const
+	{
+		Texture2DArray& o = (Texture2DArray&)other;
+		return (m_SRV == o.m_SRV);
+	}
+
+	void Texture2DArray::GenTextureBuffer()
+	{
+		RendererAPI& graphics = RendererAPI::Get();
+
+		m_MipLevels = GetMipCount(m_Width, m_Height);
+
+		D3D11_TEXTURE2D_DESC textureDesc = { 0 };
+		textureDesc.Width = m_Width;
+		textureDesc.Height = m_Height;
+		textureDesc.MipLevels = m_MipLevels;
+		textureDesc.ArraySize = m_Layers;
+		textureDesc.Format = GetDXGIBufferFormat(m_Format);
+		textureDesc.SampleDesc.Count = 1;
+		textureDesc.SampleDesc.Quality = 0;
+		textureDesc.Usage = D3D11_USAGE_DEFAULT;
+		textureDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_RENDER_TARGET;
+		textureDesc.MiscFlags = D3D11_RESOURCE_MISC_GENERATE_MIPS;
+		textureDesc.CPUAccessFlags = 0;
+
+		HRESULT hr = graphics.GetDivice()->CreateTexture2D(&textureDesc, nullptr, m_Buffer.GetAddressOf());
+		if (FAILED(hr)) {
+			DBOUT("failed to create texture array");
+			return;
+		}
+	}
+
+	void Texture2DArray::GenSRV()
+	{
+		RendererAPI& graphics = RendererAPI::Get();
+
+		D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = { };
+		srvDesc.Format = GetDXGISRVFormat(m_Format);
+		srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
+		srvDesc.Texture2DArray.MostDetailedMip = 0;
+		srvDesc.Texture2DArray.MipLevels = -1;
+		srvDesc.Texture2DArray.FirstArraySlice = 0;
+		srvDesc.Texture2DArray.ArraySize = m_Layers;
+		HRESULT hr = graphics.GetDivice()->CreateShaderResourceView(m_Buffer.Get(), &srvDesc, m_SRV.GetAddressOf());
+		if (FAILED(hr)) {
+			DBOUT("failed to create texture array resorce");
+			return;
+		}
+	}
+
+	Ref<Texture2DArray> Texture2DArray::Create(uint32_t width, uint32_t height, uint32_t layers, Format format)
+	{
+		return std::make_shared<Texture2DArray>(width, height, layers, format);
+	}
+
+	Ref<Texture2DArray> Texture2DArray::Create(const std::vector<fs::path>& paths)
 	{
-		return std::make_shared<Texture2D>(width, height, format, data);
+		return std::make_shared<Texture2DArray>(paths);
 	}
 
+#pragma endregion
 
+	// ------------------------------------- End Texture 2D Array ------------------------------------- //
 
 }
\ No newline at end of file
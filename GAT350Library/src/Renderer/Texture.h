@@ -86,6 +86,7 @@ namespace Engine
 		static DXGI_FORMAT GetDXGISRVFormat(Format format);
 		static uint32_t GetFormatSize(Format format);
 		static bool IsDepthOrStencil(Format format);
+		static uint32_t GetMipCount(uint32_t width, uint32_t height);
 
 	public:
 		virtual ~Texture() = default;
@@ -101,41 +102,123 @@ namespace Engine
 
 	class Texture2D : public Texture
 	{
+	public:
+		// the pixels of an image file as the texture stores them
+		struct Image
+		{
+			uint32_t width = 0, height = 0;
+			Format format = Format::RGBA8_UNORM;
+			std::vector<uint8_t> pixels;
+		};
+
 	protected:
 		Texture2D(Format format) : m_Format(format) {}; // WARNING : only use this if the resource is being created by the inherited class
 
 	public:
 		Texture2D(const fs::path& path);
-		Texture2D(uint32_t width, uint32_t height, Format format, unsigned char const* data);
-		virtual ~Texture2D() override = default;
+		Texture2D(const fs::path& path, Format hdrFormat); // format .hdr images are loaded as, RGBA16_FLOAT or RGBA32_FLOAT
+		Texture2D(uint32_t width, uint32_t height, Format format, unsigned char const* data, uint32_t mipLevels = 0); // 0 is a full mip chain
+		virtual ~Texture2D() override;
 
 		virtual uint32_t GetWidth() const override { return m_Width; };
 		virtual uint32_t GetHeight() const override { return m_Height; };
 
-		virtual void SetData(void* data, uint32_t size) override;
+		virtual void SetData(void* data, uint32_t size) override; // replaces mip 0
+		// data is tightly packed rows of the region
+		// big regions are uploaded over the next few frames (see TextureUploader)
+		void SetRegion(const void* data, uint32_t x, uint32_t y, uint32_t width, uint32_t height, uint32_t mip = 0);
 		virtual void LoadFromFile(const fs::path& path) override;
 
+		void GenerateMips();
+		// when off the uploader leaves the lower mips alone after mip 0 changes
+		void SetAutoGenerateMips(bool generate) { m_AutoGenerateMips = generate; }
+		bool GetAutoGenerateMips() const { return m_AutoGenerateMips; }
+
 		virtual bool IsDepthStencilTexture() { return IsDepthOrStencil(m_Format); }
 
+		Format GetFormat() const { return m_Format; }
+		uint32_t GetMipLevels() const { return m_MipLevels; }
+
+		// the most detailed mip that is in memory, mips above it were evicted to save memory
+		uint32_t GetResidentMip() const { return m_ResidentMip; }
+		bool CanEvictMips() const { return !m_Path.empty(); } // evicted mips are restored by reloading the file
+		void SetResidentMip(uint32_t mip); // restoring reloads the file on this thread, see Restore
+		// brings the evicted mips back from the file decoded with Decode, which can be done on another thread
+		void Restore(const Image& image);
+
+		const fs::path& GetPath() const { return m_Path; } // empty if the texture was not loaded from a file
+		Format GetHDRFormat() const { return m_HDRFormat; }
+
 		wrl::ComPtr<ID3D11Texture2D> GetBuffer() { return m_Buffer; }
 		wrl::ComPtr<ID3D11ShaderResourceView> GetSRV() { return m_SRV; }
 
 		virtual bool operator==(const Texture& other) const override;
 
 		static Ref<Texture2D> Create(const fs::path& path = "");
+		static Ref<Texture2D> Create(const fs::path& path, Format hdrFormat);
 		static Ref<Texture2D> Create(uint32_t width, uint32_t height, Format format);
-		static Ref<Texture2D> Create(uint32_t width, uint32_t height, Format format, unsigned char const* data);
+		static Ref<Texture2D> Create(uint32_t width, uint32_t height, Format format, unsigned char const* data, uint32_t mipLevels = 0);
+
+		// decodes an image file, does not touch the device so it is safe on any thread
+		static bool Decode(const fs::path& path, const std::vector<uint8_t>& file, Format hdrFormat, Image& image);
 
 	protected:
 		void GenTextureBuffer(void* data, uint32_t numMipMaps = 0);
 		void GenSRV();
+		void SetImage(const Image& image); // recreates the texture with a full mip chain
 
 	protected:
 		uint32_t m_Width = 0, m_Height = 0;
+		uint32_t m_MipLevels = 1;
+		uint32_t m_ResidentMip = 0;
+		bool m_AutoGenerateMips = true;
 		Format m_Format = Texture::Format::RGBA8_UNORM;
+		Format m_HDRFormat = Texture::Format::RGBA16_FLOAT;
+		fs::path m_Path;
 
 		wrl::ComPtr<ID3D11Texture2D> m_Buffer;
 		wrl::ComPtr<ID3D11ShaderResourceView> m_SRV;
 
 	};
+
+	class Texture2DArray : public Texture
+	{
+	public:
+		Texture2DArray(uint32_t width, uint32_t height, uint32_t layers, Format format);
+		Texture2DArray(const std::vector<fs::path>& paths);
+		virtual ~Texture2DArray() override = default;
+
+		virtual uint32_t GetWidth() const override { return m_Width; };
+		virtual uint32_t GetHeight() const override { return m_Height; };
+		uint32_t GetLayerCount() const { return m_Layers; }
+		Format GetFormat() const { return m_Format; }
+
+		virtual void SetData(void* data, uint32_t size) override; // data for every layer packed one after the other
+		void SetLayerData(uint32_t layer, const void* data);
+		virtual void LoadFromFile(const fs::path& path) override;
+		void LoadFromFiles(const std::vector<fs::path>& paths);
+
+		void GenerateMips();
+
+		wrl::ComPtr<ID3D11Texture2D> GetBuffer() { return m_Buffer; }
+		wrl::ComPtr<ID3D11ShaderResourceView> GetSRV() { return m_SRV; }
+
+		virtual bool operator==(const Texture& other) const override;
+
+		static Ref<Texture2DArray> Create(uint32_t width, uint32_t height, uint32_t layers, Format format);
+		static Ref<Texture2DArray> Create(const std::vector<fs::path>& paths);
+
+	private:
+		void GenTextureBuffer();
+		void GenSRV();
+
+	private:
+		uint32_t m_Width = 0, m_Height = 0;
+		uint32_t m_Layers = 0;
+		uint32_t m_MipLevels = 0;
+		Format m_Format = Texture::Format::RGBA8_UNORM;
+
+		wrl::ComPtr<ID3D11Texture2D> m_Buffer;
+		wrl::ComPtr<ID3D11ShaderResourceView> m_SRV;
+	};
 }
\ No newline at end of file
@@ -0,0 +1,293 @@
+#include "TextureAtlas.h"
+
+#include <algorithm>
+#include <numeric>
+
+namespace Engine
+{
+
+	static uint32_t AlignUp(uint32_t value, uint32_t alignment)
+	{
+		return ((value + alignment - 1) / alignment) * alignment;
+	}
+
+	static bool Intersects(const AtlasPacker::Rect& a, const AtlasPacker::Rect& b)
+	{
+		return a.x < b.x + b.width && b.x < a.x + a.width &&
+			a.y < b.y + b.height && b.y < a.y + a.height;
+	}
+
+	static bool Contains(const AtlasPacker::Rect& outer, const AtlasPacker::Rect& inner)
+	{
+		return inner.x >= outer.x && inner.y >= outer.y &&
+			inner.x + inner.width <= outer.x + outer.width &&
+			inner.y + inner.height <= outer.y + outer.height;
+	}
+
+	// ------------------------------------- Atlas Packer ------------------------------------- //
+
+#pragma region Atlas Packer
+
+	AtlasPacker::AtlasPacker(uint32_t pageWidth, uint32_t pageHeight, uint32_t padding, uint32_t alignment) :
+		m_PageWidth(pageWidth), m_PageHeight(pageHeight), m_Padding(padding), m_Alignment(std::max(alignment, 1u))
+	{}
+
+	bool AtlasPacker::Pack(uint32_t width, uint32_t height, Placement& placement)
+	{
+		uint32_t paddedWidth = AlignUp(width + m_Padding * 2, m_Alignment);
+		uint32_t paddedHeight = AlignUp(height + m_Padding * 2, m_Alignment);
+		if (paddedWidth > m_PageWidth || paddedHeight > m_PageHeight)
+			return false;
+
+		Rect rect;
+		uint32_t page = 0;
+		for (; page < m_Pages.size(); page++)
+		{
+			if (PackInPage(m_Pages[page], paddedWidth, paddedHeight, rect))
+				break;
+		}
+
+		// no room left in any page so open a new one
+		if (page == m_Pages.size())
+		{
+			Page& newPage = m_Pages.emplace_back();
+			newPage.freeRects.push_back({ 0, 0, m_PageWidth, m_PageHeight });
+			PackInPage(newPage, paddedWidth, paddedHeight, rect);
+		}
+
+		m_Pages[page].usedArea += (uint64_t)width * height;
+
+		placement.page = page;
+		placement.rect = { rect.x + m_Padding, rect.y + m_Padding, width, height };
+		return true;
+	}
+
+	float AtlasPacker::GetOccupancy() const
+	{
+		if (m_Pages.empty())
+			return 0.0f;
+
+		uint64_t used = 0;
+		for (const Page& page : m_Pages)
+			used += page.usedArea;
+		return (float)((double)used / ((double)m_PageWidth * m_PageHeight * m_Pages.size()));
+	}
+
+	bool AtlasPacker::PackInPage(Page& page, uint32_t width, uint32_t height, Rect& rect)
+	{
+		uint32_t bestShortSide = UINT32_MAX;
+		uint32_t bestLongSide = UINT32_MAX;
+		bool found = false;
+
+		for (const Rect& freeRect : page.freeRects)
+		{
+			if (freeRect.width < width || freeRect.height < height)
+				continue;
+
+			uint32_t leftoverX = freeRect.width - width;
+			uint32_t leftoverY = freeRect.height - height;
+			uint32_t shortSide = std::min(leftoverX, leftoverY);
+			uint32_t longSide = std::max(leftoverX, leftoverY);
+
+			if (shortSide < bestShortSide || (shortSide == bestShortSide && longSide < bestLongSide))
+			{
+				rect = { freeRect.x, freeRect.y, width, height };
+				bestShortSide = shortSide;
+				bestLongSide = longSide;
+				found = true;
+			}
+		}
+
+		if (!found)
+			return false;
+
+		SplitFreeRects(page, rect);
+		PruneFreeRects(page);
+		return true;
+	}
+
+	void AtlasPacker::SplitFreeRects(Page& page, const Rect& used)
+	{
+		std::vector<Rect> freeRects;
+		freeRects.reserve(page.freeRects.size() + 4);
+
+		for (const Rect& freeRect : page.freeRects)
+		{
+			if (!Intersects(freeRect, used))
+			{
+				freeRects.push_back(freeRect);
+				continue;
+			}
+
+			// keep whatever is left of the free rect on each side of the used rect
+			if (used.x > freeRect.x)
+				freeRects.push_back({ freeRect.x, freeRect.y, used.x - freeRect.x, freeRect.height });
+			if (used.x + used.width < freeRect.x + freeRect.width)
+				freeRects.push_back({ used.x + used.width, freeRect.y, (freeRect.x + freeRect.width) - (used.x + used.width), freeRect.height });
+			if (used.y > freeRect.y)
+				freeRects.push_back({ freeRect.x, freeRect.y, freeRect.width, used.y - freeRect.y });
+			if (used.y + used.height < freeRect.y + freeRect.height)
+				freeRects.push_back({ freeRect.x, used.y + used.height, freeRect.width, (freeRect.y + freeRect.height) - (used.y + used.height) });
+		}
+
+		page.freeRects = std::move(freeRects);
+	}
+
+	void AtlasPacker::PruneFreeRects(Page& page)
+	{
+		std::vector<Rect>& rects = page.freeRects;
+		for (size_t i = 0; i < rects.size(); i++)
+		{
+			for (size_t j = i + 1; j < rects.size(); j++)
+			{
+				if (Contains(rects[j], rects[i]))
+				{
+					rects.erase(rects.begin() + i);
+					i--;
+					break;
+				}
+				if (Contains(rects[i], rects[j]))
+				{
+					rects.erase(rects.begin() + j);
+					j--;
+				}
+			}
+		}
+	}
+
+#pragma endregion
+
+	// ------------------------------------- End Atlas Packer ------------------------------------- //
+
+	// ------------------------------------- Texture Atlas ------------------------------------- //
+
+#pragma region Texture Atlas
+
+	TextureAtlas::TextureAtlas(const Desc& desc) :
+		m_Desc(desc)
+	{}
+
+	uint32_t TextureAtlas::AddImage(uint32_t width, uint32_t height, const std::vector<const uint8_t*>& layers)
+	{
+		Image& image = m_Images.emplace_back();
+		image.width = width;
+		image.height = height;
+		image.layers.resize(m_Desc.layers);
+		for (uint32_t i = 0; i < layers.size() && i < m_Desc.layers; i++)
+		{
+			if (layers[i] != nullptr)
+				image.layers[i].assign(layers[i], layers[i] + (size_t)width * height * 4);
+		}
+
+		m_Regions.push_back({});
+		return (uint32_t)m_Regions.size() - 1;
+	}
+
+	void TextureAtlas::Build()
+	{
+		AtlasPacker packer(m_Desc.pageSize, m_Desc.pageSize, m_Desc.padding, m_Desc.alignment);
+
+		// pack the biggest images first
+		std::vector<uint32_t> order(m_Images.size());
+		std::iota(order.begin(), order.end(), 0);
+		std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+			const Image& ia = m_Images[a];
+			const Image& ib = m_Images[b];
+			uint32_t maxA = std::max(ia.width, ia.height);
+			uint32_t maxB = std::max(ib.width, ib.height);
+			if (maxA != maxB)
+				return maxA > maxB;
+			return ia.width * ia.height > ib.width * ib.height;
+		});
+
+		std::vector<AtlasPacker::Placement> placements(m_Images.size());
+		for (uint32_t id : order)
+		{
+			AtlasPacker::Placement& placement = placements[id];
+			if (!packer.Pack(m_Images[id].width, m_Images[id].height, placement))
+			{
+				DBOUT("image is too big for the texture atlas" << std::endl);
+				continue;
+			}
+
+			float pageSize = (float)m_Desc.pageSize;
+			Region& region = m_Regions[id];
+			region.page = placement.page;
+			region.offset = { placement.rect.x / pageSize, placement.rect.y / pageSize };
+			region.scale = { placement.rect.width / pageSize, placement.rect.height / pageSize };
+		}
+
+		m_PageCount = packer.GetPageCount();
+		m_Occupancy = packer.GetOccupancy();
+
+		// generate the page textures for every layer that has data
+		m_Pages.clear();
+		m_Pages.resize((size_t)m_PageCount * m_Desc.layers);
+		std::vector<uint8_t> pixels((size_t)m_Desc.pageSize * m_Desc.pageSize * 4);
+
+		// a mip only stays clean while the border is still a texel wide and images start on a texel of it,
+		// so the chain stops where the smaller of the padding and alignment halves down to one texel
+		uint32_t border = std::max(std::min(m_Desc.padding, m_Desc.alignment), 1u);
+		uint32_t mipLevels = 1;
+		while ((1u << mipLevels) <= border)
+			mipLevels++;
+
+		for (uint32_t page = 0; page < m_PageCount; page++)
+		{
+			for (uint32_t layer = 0; layer < m_Desc.layers; layer++)
+			{
+				bool used = false;
+				std::fill(pixels.begin(), pixels.end(), (uint8_t)0);
+				for (uint32_t id = 0; id < m_Images.size(); id++)
+				{
+					if (m_Regions[id].page != page || m_Images[id].layers[layer].empty())
+						continue;
+					BlitImage(pixels.data(), m_Images[id], layer, placements[id].rect);
+					used = true;
+				}
+
+				if (!used)
+					continue;
+
+				Ref<Texture2D> texture = Texture2D::Create(m_Desc.pageSize, m_Desc.pageSize, Texture::Format::RGBA8_UNORM, pixels.data(), mipLevels);
+				texture->GenerateMips();
+				m_Pages[page * m_Desc.layers + layer] = texture;
+			}
+		}
+
+		// the pixel data lives on the gpu now
+		m_Images.clear();
+		m_Images.shrink_to_fit();
+	}
+
+	void TextureAtlas::BlitImage(uint8_t* page, const Image& image, uint32_t layer, const AtlasPacker::Rect& rect)
+	{
+		const uint32_t* src = (const uint32_t*)image.layers[layer].data();
+		uint32_t* dst = (uint32_t*)page;
+		const int32_t padding = (int32_t)m_Desc.padding;
+		const int32_t width = (int32_t)image.width;
+		const int32_t height = (int32_t)image.height;
+
+		// copy the image and extrude its edges into the padding so filtering and lower mips sample the right color
+		for (int32_t y = -padding; y < height + padding; y++)
+		{
+			int32_t srcY = std::clamp(y, 0, height - 1);
+			uint32_t* dstRow = dst + (size_t)(rect.y + y) * m_Desc.pageSize + rect.x;
+			for (int32_t x = -padding; x < width + padding; x++)
+			{
+				int32_t srcX = std::clamp(x, 0, width - 1);
+				dstRow[x] = src[(size_t)srcY * image.width + srcX];
+			}
+		}
+	}
+
+	Ref<TextureAtlas> TextureAtlas::Create(const Desc& desc)
+	{
+		return std::make_shared<TextureAtlas>(desc);
+	}
+
+#pragma endregion
+
+	// ------------------------------------- End Texture Atlas ------------------------------------- //
+
+}
@@ -0,0 +1,114 @@
+#pragma once
+#include "Core/Core.h"
+#include "Texture.h"
+
+#include <vector>
+
+namespace Engine
+{
+	// max rects bin packer (best short side fit)
+	// all sizes get padded and rounded up to the alignment so every rect starts on an aligned texel
+	class AtlasPacker
+	{
+	public:
+		struct Rect
+		{
+			uint32_t x, y;
+			uint32_t width, height;
+		};
+
+		struct Placement
+		{
+			uint32_t page;
+			Rect rect; // the rect of the image without the padding
+		};
+
+		AtlasPacker(uint32_t pageWidth, uint32_t pageHeight, uint32_t padding = 0, uint32_t alignment = 1);
+
+		bool Pack(uint32_t width, uint32_t height, Placement& placement);
+
+		uint32_t GetPageCount() const { return (uint32_t)m_Pages.size(); }
+		uint32_t GetPageWidth() const { return m_PageWidth; }
+		uint32_t GetPageHeight() const { return m_PageHeight; }
+		float GetOccupancy() const; // fraction of the page area used by images (padding not included)
+
+	private:
+		struct Page
+		{
+			std::vector<Rect> freeRects;
+			uint64_t usedArea = 0;
+		};
+
+		bool PackInPage(Page& page, uint32_t width, uint32_t height, Rect& rect);
+		void SplitFreeRects(Page& page, const Rect& used);
+		void PruneFreeRects(Page& page);
+
+	private:
+		uint32_t m_PageWidth, m_PageHeight;
+		uint32_t m_Padding;
+		uint32_t m_Alignment;
+
+		std::vector<Page> m_Pages;
+	};
+
+	// packs many small RGBA8 images into shared pages
+	// every image can have multiple layers (one per material slot) that share the same region
+	// so a single uv remap is valid for all of them
+	class TextureAtlas
+	{
+	public:
+		struct Desc
+		{
+			uint32_t pageSize = 2048;
+			uint32_t padding = 4; // border texels extruded from the edge of each image
+			uint32_t alignment = 4; // keeps images on block boundaries so the first few mips do not bleed
+			// pages get log2(min(padding, alignment)) + 1 mips, the ones below would blend neighbouring images
+			uint32_t layers = 1;
+		};
+
+		struct Region
+		{
+			uint32_t page = UINT32_MAX;
+			glm::vec2 offset = { 0.0f, 0.0f };
+			glm::vec2 scale = { 1.0f, 1.0f };
+		};
+
+		TextureAtlas(const Desc& desc);
+
+		// layers are RGBA8 pixels, nullptr if the image does not use that layer
+		// returns the id of the region
+		uint32_t AddImage(uint32_t width, uint32_t height, const std::vector<const uint8_t*>& layers);
+
+		// packs all the added images and creates the page textures
+		void Build();
+
+		bool IsPacked(uint32_t id) const { return m_Regions[id].page != UINT32_MAX; }
+		const Region& GetRegion(uint32_t id) const { return m_Regions[id]; }
+		glm::vec2 RemapUV(uint32_t id, glm::vec2 uv) const { return m_Regions[id].offset + uv * m_Regions[id].scale; }
+
+		Ref<Texture2D> GetPage(uint32_t page, uint32_t layer) { return m_Pages[page * m_Desc.layers + layer]; }
+		uint32_t GetPageCount() const { return m_PageCount; }
+		uint32_t GetImageCount() const { return (uint32_t)m_Regions.size(); }
+		float GetOccupancy() const { return m_Occupancy; }
+
+		static Ref<TextureAtlas> Create(const Desc& desc);
+
+	private:
+		struct Image
+		{
+			uint32_t width, height;
+			std::vector<std::vector<uint8_t>> layers;
+		};
+
+		void BlitImage(uint8_t* page, const Image& image, uint32_t layer, const AtlasPacker::Rect& rect);
+
+	private:
+		Desc m_Desc;
+
+		std::vector<Image> m_Images; // cleared once the atlas is built
+		std::vector<Region> m_Regions;
+		std::vector<Ref<Texture2D>> m_Pages;
+		uint32_t m_PageCount = 0;
+		float m_Occupancy = 0.0f;
+	};
+}
@@ -0,0 +1,222 @@
+#include "TextureResidency.h"
+#include "RendererAPI.h"
+#include "Core/AsyncFileReader.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace Engine
+{
+
+	TextureResidency::TextureResidency()
+	{
+		// the rest is left for render targets, buffers and other programs
+		uint64_t videoMemory = RendererAPI::Get().GetVideoMemory();
+		if (videoMemory != 0)
+			m_Budget = videoMemory / 2;
+	}
+
+	void TextureResidency::Register(Texture2D* texture)
+	{
+		std::lock_guard<std::recursive_mutex> lock(m_Mutex);
+
+		// registering again updates the size after the texture was recreated
+		Entry& entry = m_Entries[texture];
+		m_Usage -= entry.size;
+		entry.size = CalculateSize(texture);
+		m_Usage += entry.size;
+		entry.lastUsedFrame = m_Frame;
+	}
+
+	void TextureResidency::Unregister(Texture2D* texture)
+	{
+		std::lock_guard<std::recursive_mutex> lock(m_Mutex);
+		auto it = m_Entries.find(texture);
+		if (it == m_Entries.end())
+			return;
+
+		m_Usage -= it->second.size;
+		if (it->second.restore.valid())
+			m_RestoringSize -= it->second.restoreSize;
+		m_Entries.erase(it);
+	}
+
+	void TextureResidency::Touch(Texture2D* texture)
+	{
+		std::lock_guard<std::recursive_mutex> lock(m_Mutex);
+		auto it = m_Entries.find(texture);
+		if (it == m_Entries.end())
+			return;
+
+		it->second.lastUsedFrame = m_Frame;
+		if (texture->GetResidentMip() > 0)
+			it->second.restoreRequested = true;
+	}
+
+	void TextureResidency::Update()
+	{
+		std::lock_guard<std::recursive_mutex> lock(m_Mutex);
+		FinishRestores();
+		StartRestores();
+
+		// anything not used this frame can lose mips
+		while (m_Usage + m_RestoringSize > m_Budget && EvictOne(m_Frame)) {}
+
+		m_Frame++;
+	}
+
+	void TextureResidency::StartRestores()
+	{
+		// restore the textures used most recently first
+		std::vector<std::pair<Texture2D*, Entry*>> requests;
+		for (auto& [texture, entry] : m_Entries)
+		{
+			if (entry.restoreRequested)
+				requests.push_back({ texture, &entry });
+		}
+		std::sort(requests.begin(), requests.end(), [](const auto& a, const auto& b) {
+			return a.second->lastUsedFrame > b.second->lastUsedFrame;
+		});
+
+		for (auto& [texture, entry] : requests)
+		{
+			entry->restoreRequested = false;
+			if (entry->restore.valid())
+				continue;
+
+			uint64_t restoredSize = CalculateSize(texture->GetWidth(), texture->GetHeight(), texture->GetFormat(), 0, texture->GetMipLevels());
+			uint64_t extra = restoredSize - entry->size;
+
+			// only make room by evicting textures that were not used last frame
+			while (m_Usage + m_RestoringSize + extra > m_Budget && EvictOne(m_Frame - 1)) {}
+			if (m_Usage + m_RestoringSize + extra > m_Budget)
+				continue;
+
+			entry->restoreSize = extra;
+			m_RestoringSize += extra;
+			entry->restore = std::async(std::launch::async, [path = texture->GetPath(), hdrFormat = texture->GetHDRFormat()]() {
+				AsyncFileReader::Handle file = AsyncFileReader::Get().Read(path, AsyncFileReader::Priority::Low);
+				Texture2D::Image image;
+				Texture2D::Decode(path, file.Wait(), hdrFormat, image);
+				return image;
+			});
+		}
+	}
+
+	void TextureResidency::FinishRestores()
+	{
+		uint64_t uploaded = 0;
+		for (auto& [texture, entry] : m_Entries)
+		{
+			// only futures that are ready are taken as waiting on a running one would block
+			if (!entry.restore.valid() || entry.restore.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+				continue;
+			if (uploaded >= m_RestoreBytesPerFrame)
+				break;
+
+			Texture2D::Image image = entry.restore.get();
+			m_RestoringSize -= entry.restoreSize;
+			entry.restoreSize = 0;
+			uploaded += image.pixels.size();
+
+			if (m_Frame - entry.lastEvictedFrame <= m_ThrashWindow)
+				m_Thrashes++;
+			m_Restores++;
+
+			// makes the texture again with every mip, registering it again updates the usage
+			texture->Restore(image);
+		}
+	}
+
+	TextureResidency::Statistics TextureResidency::GetStatistics() const
+	{
+		std::lock_guard<std::recursive_mutex> lock(m_Mutex);
+		Statistics stats;
+		stats.budget = m_Budget;
+		stats.usage = m_Usage;
+		stats.textures = (uint32_t)m_Entries.size();
+		for (auto& [texture, entry] : m_Entries)
+		{
+			if (texture->GetResidentMip() > 0)
+				stats.evictedTextures++;
+		}
+		stats.evictions = m_Evictions;
+		stats.restores = m_Restores;
+		stats.thrashes = m_Thrashes;
+		for (auto& [texture, entry] : m_Entries)
+		{
+			if (entry.restore.valid())
+				stats.pendingRestores++;
+		}
+		return stats;
+	}
+
+	uint64_t TextureResidency::CalculateSize(uint32_t width, uint32_t height, Texture::Format format, uint32_t firstMip, uint32_t mipLevels)
+	{
+		uint64_t size = 0;
+		for (uint32_t mip = firstMip; mip < mipLevels; mip++)
+		{
+			uint64_t w = std::max(width >> mip, 1u);
+			uint64_t h = std::max(height >> mip, 1u);
+			size += w * h * Texture::GetFormatSize(format);
+		}
+		return size;
+	}
+
+	uint64_t TextureResidency::CalculateSize(Texture2D* texture)
+	{
+		return CalculateSize(texture->GetWidth(), texture->GetHeight(), texture->GetFormat(), texture->GetResidentMip(), texture->GetMipLevels());
+	}
+
+	TextureResidency& TextureResidency::Get()
+	{
+		static TextureResidency* instance = new TextureResidency();
+		return *instance;
+	}
+
+	bool TextureResidency::CanEvict(Texture2D* texture, const Entry& entry) const
+	{
+		if (!texture->CanEvictMips() || entry.restore.valid())
+			return false;
+
+		uint32_t nextMip = texture->GetResidentMip() + 1;
+		if (nextMip >= texture->GetMipLevels())
+			return false;
+		return (std::max(texture->GetWidth(), texture->GetHeight()) >> nextMip) >= m_MinResidentSize;
+	}
+
+	bool TextureResidency::EvictOne(uint64_t usedBefore)
+	{
+		// find the least recently used texture that still has mips to give up
+		Texture2D* victim = nullptr;
+		Entry* victimEntry = nullptr;
+		for (auto& [texture, entry] : m_Entries)
+		{
+			if (entry.lastUsedFrame >= usedBefore || !CanEvict(texture, entry))
+				continue;
+			if (victimEntry == nullptr || entry.lastUsedFrame < victimEntry->lastUsedFrame)
+			{
+				victim = texture;
+				victimEntry = &entry;
+			}
+		}
+
+		if (victim == nullptr)
+			return false;
+
+		SetResidentMip(victim, *victimEntry, victim->GetResidentMip() + 1);
+		victimEntry->lastEvictedFrame = m_Frame;
+		m_Evictions++;
+		return true;
+	}
+
+	void TextureResidency::SetResidentMip(Texture2D* texture, Entry& entry, uint32_t mip)
+	{
+		texture->SetResidentMip(mip);
+
+		m_Usage -= entry.size;
+		entry.size = CalculateSize(texture);
+		m_Usage += entry.size;
+	}
+
+}
@@ -0,0 +1,93 @@
+#pragma once
+#include "Core/Core.h"
+#include "Texture.h"
+
+#include <unordered_map>
+#include <mutex>
+#include <future>
+
+namespace Engine
+{
+	// keeps the memory used by textures under a budget, half the adapter's memory unless it is set
+	// textures that have not been used for a while lose their most detailed mips first
+	// and get them back the next time they are bound and there is room for them
+	// restores read and decode the file on another thread, the texture keeps drawing with its low mips until it is ready
+	class TextureResidency
+	{
+	public:
+		struct Statistics
+		{
+			uint64_t budget = 0;
+			uint64_t usage = 0;
+			uint32_t textures = 0;
+			uint32_t evictedTextures = 0; // textures that currently have mips evicted
+			uint64_t evictions = 0; // mip levels evicted
+			uint64_t restores = 0;
+			uint64_t thrashes = 0; // restores of textures that were evicted within the thrash window
+			uint32_t pendingRestores = 0; // still being read or decoded
+
+			float GetThrashRate() const { return restores == 0 ? 0.0f : (float)thrashes / (float)restores; }
+		};
+
+	public:
+		void SetBudget(uint64_t bytes) { m_Budget = bytes; }
+		uint64_t GetBudget() const { return m_Budget; }
+
+		// mips are never evicted past this size
+		void SetMinResidentSize(uint32_t size) { m_MinResidentSize = size; }
+		void SetThrashWindow(uint32_t frames) { m_ThrashWindow = frames; }
+		// decoded restores past this many bytes wait for the next frame
+		void SetRestoreBytesPerFrame(uint64_t bytes) { m_RestoreBytesPerFrame = bytes; }
+
+		void Register(Texture2D* texture);
+		void Unregister(Texture2D* texture); // waits for a restore of the texture that is still decoding
+		void Touch(Texture2D* texture); // safe to call from command recorder threads
+
+		// starts restores of requested mips, finishes the ones that are decoded and evicts until the budget is met, call once per frame
+		void Update();
+
+		Statistics GetStatistics() const;
+
+		static uint64_t CalculateSize(uint32_t width, uint32_t height, Texture::Format format, uint32_t firstMip, uint32_t mipLevels);
+		static uint64_t CalculateSize(Texture2D* texture);
+
+		static TextureResidency& Get();
+
+	private:
+		TextureResidency();
+
+		struct Entry
+		{
+			uint64_t size = 0;
+			uint64_t lastUsedFrame = 0;
+			uint64_t lastEvictedFrame = 0;
+			bool restoreRequested = false;
+			uint64_t restoreSize = 0; // what the texture will grow by, held against the budget while restoring
+			std::future<Texture2D::Image> restore;
+		};
+
+		void StartRestores();
+		void FinishRestores();
+		bool CanEvict(Texture2D* texture, const Entry& entry) const;
+		bool EvictOne(uint64_t usedBefore);
+		void SetResidentMip(Texture2D* texture, Entry& entry, uint32_t mip);
+
+	private:
+		std::unordered_map<Texture2D*, Entry> m_Entries;
+		// textures are bound from the recording threads while others are made or destroyed, recursive as a restore
+		// in Update makes the texture again and that registers it
+		mutable std::recursive_mutex m_Mutex;
+
+		uint64_t m_Budget = UINT64_MAX;
+		uint64_t m_Usage = 0;
+		uint64_t m_RestoringSize = 0;
+		uint64_t m_RestoreBytesPerFrame = 64 * 1024 * 1024;
+		uint32_t m_MinResidentSize = 64;
+		uint32_t m_ThrashWindow = 60;
+		uint64_t m_Frame = 1;
+
+		uint64_t m_Evictions = 0;
+		uint64_t m_Restores = 0;
+		uint64_t m_Thrashes = 0;
+	};
+}
@@ -0,0 +1,237 @@
+#include "TextureUploader.h"
+#include "RendererAPI.h"
+
+#include <algorithm>
+
+namespace Engine
+{
+
+	static const uint32_t s_MaxStagingRows = 1024;
+	static const uint32_t s_MinStagingSize = 64;
+	static const uint64_t s_StagingTimeout = 120; // frames a staging texture can go unused before it is released
+
+	static uint32_t NextPowerOf2(uint32_t value)
+	{
+		uint32_t p = 1;
+		while (p < value)
+			p <<= 1;
+		return p;
+	}
+
+	static bool Overlaps(uint32_t ax, uint32_t ay, uint32_t aw, uint32_t ah, uint32_t bx, uint32_t by, uint32_t bw, uint32_t bh)
+	{
+		return ax < bx + bw && bx < ax + aw && ay < by + bh && by < ay + ah;
+	}
+
+	void TextureUploader::Upload(Texture2D* texture, uint32_t mip, uint32_t x, uint32_t y, uint32_t width, uint32_t height, const void* data)
+	{
+		if (width == 0 || height == 0)
+			return;
+
+		// queued data that the new upload fully covers would just get overwritten
+		m_Requests.erase(std::remove_if(m_Requests.begin(), m_Requests.end(), [&](const Request& r) {
+			return r.texture == texture && r.mip == mip &&
+				r.x >= x && r.y >= y && r.x + r.width <= x + width && r.y + r.height <= y + height;
+		}), m_Requests.end());
+
+		// anything still queued on the same region has to land first so the new data is not overwritten by older data
+		bool overlapsQueued = std::any_of(m_Requests.begin(), m_Requests.end(), [&](const Request& r) {
+			return r.texture == texture && r.mip == mip && Overlaps(r.x, r.y, r.width, r.height, x, y, width, height);
+		});
+
+		uint32_t rowSize = width * Texture::GetFormatSize(texture->GetFormat());
+		uint64_t size = (uint64_t)rowSize * height;
+
+		if (size <= m_DirectUploadLimit && !overlapsQueued)
+		{
+			if (mip < texture->GetResidentMip())
+				return;
+
+			D3D11_BOX box = { x, y, 0, x + width, y + height, 1 };
+			RendererAPI::Get().GetContext()->UpdateSubresource(texture->GetBuffer().Get(), mip - texture->GetResidentMip(), &box, data, rowSize, 0);
+
+			if (mip == 0 && texture->GetAutoGenerateMips())
+				m_DirtyMips.insert(texture);
+			m_Statistics.bytesUploaded += size;
+			m_Statistics.directUploads++;
+			return;
+		}
+
+		Request& request = m_Requests.emplace_back();
+		request.texture = texture;
+		request.mip = mip;
+		request.x = x; request.y = y;
+		request.width = width; request.height = height;
+		request.data.assign((const uint8_t*)data, (const uint8_t*)data + size);
+	}
+
+	void TextureUploader::Cancel(Texture2D* texture)
+	{
+		m_Requests.erase(std::remove_if(m_Requests.begin(), m_Requests.end(), [&](const Request& r) {
+			return r.texture == texture;
+		}), m_Requests.end());
+		m_DirtyMips.erase(texture);
+	}
+
+	void TextureUploader::Update()
+	{
+		m_Frame++;
+
+		uint64_t budget = m_FrameBudget;
+		bool uploaded = false;
+		while (!m_Requests.empty())
+		{
+			Request& request = m_Requests.front();
+			uint64_t rowSize = (uint64_t)request.width * Texture::GetFormatSize(request.texture->GetFormat());
+
+			uint32_t rows = request.height - request.rowsUploaded;
+			if (rows * rowSize > budget)
+				rows = (uint32_t)(budget / rowSize);
+
+			// always move forward even if a single row does not fit in the budget
+			if (rows == 0)
+			{
+				if (uploaded)
+					break;
+				rows = 1;
+			}
+
+			rows = CopyRows(request, rows);
+			budget -= std::min(budget, rows * rowSize);
+			request.rowsUploaded += rows;
+			uploaded = true;
+
+			if (request.rowsUploaded < request.height)
+			{
+				if (budget == 0)
+					break;
+				continue;
+			}
+
+			if (request.mip == 0 && request.texture->GetAutoGenerateMips())
+				m_DirtyMips.insert(request.texture);
+			m_Requests.pop_front();
+		}
+
+		// mips are rebuilt once per frame no matter how many times the texture was updated
+		for (Texture2D* texture : m_DirtyMips)
+			texture->GenerateMips();
+		m_DirtyMips.clear();
+
+		// release staging textures that have not been needed for a while
+		m_StagingTextures.erase(std::remove_if(m_StagingTextures.begin(), m_StagingTextures.end(), [&](const StagingTexture& s) {
+			return m_Frame - s.lastUsedFrame > s_StagingTimeout;
+		}), m_StagingTextures.end());
+
+		m_Statistics.pendingRequests = (uint32_t)m_Requests.size();
+		m_Statistics.pendingBytes = 0;
+		for (const Request& request : m_Requests)
+			m_Statistics.pendingBytes += request.data.size() / request.height * (request.height - request.rowsUploaded);
+		m_Statistics.stagingTextures = (uint32_t)m_StagingTextures.size();
+	}
+
+	void TextureUploader::EndFrame()
+	{
+		m_FrameStatistics = m_Statistics;
+		m_Statistics.bytesUploaded = 0;
+		m_Statistics.directUploads = 0;
+		m_Statistics.stagedCopies = 0;
+	}
+
+	TextureUploader& TextureUploader::Get()
+	{
+		static TextureUploader* instance = new TextureUploader();
+		return *instance;
+	}
+
+	uint32_t TextureUploader::CopyRows(Request& request, uint32_t rows)
+	{
+		Texture2D* texture = request.texture;
+		uint32_t remaining = request.height - request.rowsUploaded;
+
+		// the mip was evicted so there is nothing to write to
+		if (request.mip < texture->GetResidentMip())
+			return remaining;
+
+		rows = std::min(rows, s_MaxStagingRows);
+		StagingTexture* staging = AcquireStagingTexture(request.width, rows, Texture::GetDXGIBufferFormat(texture->GetFormat()));
+		if (staging == nullptr)
+			return remaining;
+
+		RendererAPI& graphics = RendererAPI::Get();
+
+		D3D11_MAPPED_SUBRESOURCE mapped;
+		HRESULT hr = graphics.GetContext()->Map(staging->texture.Get(), 0, D3D11_MAP_WRITE, 0, &mapped);
+		if (FAILED(hr))
+		{
+			DBOUT("failed to map staging texture" << std::endl);
+			return remaining;
+		}
+
+		uint32_t rowSize = (uint32_t)(request.data.size() / request.height);
+		const uint8_t* src = request.data.data() + (size_t)request.rowsUploaded * rowSize;
+		uint8_t* dst = (uint8_t*)mapped.pData;
+		for (uint32_t row = 0; row < rows; row++)
+			memcpy(dst + (size_t)row * mapped.RowPitch, src + (size_t)row * rowSize, rowSize);
+
+		graphics.GetContext()->Unmap(staging->texture.Get(), 0);
+
+		D3D11_BOX box = { 0, 0, 0, request.width, rows, 1 };
+		graphics.GetContext()->CopySubresourceRegion(texture->GetBuffer().Get(), request.mip - texture->GetResidentMip(),
+			request.x, request.y + request.rowsUploaded, 0, staging->texture.Get(), 0, &box);
+
+		staging->lastUsedFrame = m_Frame;
+		m_Statistics.bytesUploaded += (uint64_t)rows * rowSize;
+		m_Statistics.stagedCopies++;
+		return rows;
+	}
+
+	TextureUploader::StagingTexture* TextureUploader::AcquireStagingTexture(uint32_t width, uint32_t height, DXGI_FORMAT format)
+	{
+		// reuse the smallest free staging texture that fits
+		// one the gpu could still be copying from is not free since mapping it would stall
+		StagingTexture* best = nullptr;
+		for (StagingTexture& staging : m_StagingTextures)
+		{
+			if (staging.format != format || staging.width < width || staging.height < height)
+				continue;
+			if (staging.lastUsedFrame + m_FrameLatency > m_Frame)
+				continue;
+			if (best == nullptr || staging.width * staging.height < best->width * best->height)
+				best = &staging;
+		}
+
+		if (best != nullptr)
+			return best;
+
+		// round up so textures of similar sizes share staging textures
+		D3D11_TEXTURE2D_DESC textureDesc = { 0 };
+		textureDesc.Width = std::max(NextPowerOf2(width), s_MinStagingSize);
+		textureDesc.Height = std::max(NextPowerOf2(height), s_MinStagingSize);
+		textureDesc.MipLevels = 1;
+		textureDesc.ArraySize = 1;
+		textureDesc.Format = format;
+		textureDesc.SampleDesc.Count = 1;
+		textureDesc.SampleDesc.Quality = 0;
+		textureDesc.Usage = D3D11_USAGE_STAGING;
+		textureDesc.BindFlags = 0;
+		textureDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+		textureDesc.MiscFlags = 0;
+
+		StagingTexture staging;
+		HRESULT hr = RendererAPI::Get().GetDivice()->CreateTexture2D(&textureDesc, nullptr, staging.texture.GetAddressOf());
+		if (FAILED(hr))
+		{
+			DBOUT("failed to create staging texture" << std::endl);
+			return nullptr;
+		}
+		staging.width = textureDesc.Width;
+		staging.height = textureDesc.Height;
+		staging.format = format;
+		staging.lastUsedFrame = m_Frame;
+
+		m_StagingTextures.push_back(staging);
+		return &m_StagingTextures.back();
+	}
+
+}
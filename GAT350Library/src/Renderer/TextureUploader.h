@@ -0,0 +1,80 @@
+#pragma once
+#include "Platform/Windows/Win.h"
+#include "Core/Core.h"
+#include "Texture.h"
+
+#include <deque>
+#include <unordered_set>
+
+namespace Engine
+{
+	// moves texture data to the gpu
+	// small updates go straight through UpdateSubresource, bigger ones are copied through a pool of
+	// staging textures and spread across frames so a single frame never uploads more than the budget
+	class TextureUploader
+	{
+	public:
+		struct Statistics
+		{
+			uint64_t bytesUploaded = 0;
+			uint32_t directUploads = 0;
+			uint32_t stagedCopies = 0;
+			uint32_t pendingRequests = 0;
+			uint64_t pendingBytes = 0;
+			uint32_t stagingTextures = 0;
+		};
+
+	public:
+		void SetFrameBudget(uint64_t bytes) { m_FrameBudget = bytes; }
+		void SetDirectUploadLimit(uint64_t bytes) { m_DirectUploadLimit = bytes; }
+		void SetFrameLatency(uint32_t frames) { m_FrameLatency = frames; } // frames before a staging texture can be written again
+
+		// data is tightly packed rows of the region
+		void Upload(Texture2D* texture, uint32_t mip, uint32_t x, uint32_t y, uint32_t width, uint32_t height, const void* data);
+		void Cancel(Texture2D* texture);
+
+		// copies the queued data that fits in this frames budget, call once per frame
+		void Update();
+		// the frame was presented, everything uploaded since the last EndFrame is counted as that frame's
+		void EndFrame();
+
+		// of the last frame that ended
+		const Statistics& GetStatistics() const { return m_FrameStatistics; }
+
+		static TextureUploader& Get();
+
+	private:
+		struct Request
+		{
+			Texture2D* texture;
+			uint32_t mip;
+			uint32_t x, y, width, height;
+			uint32_t rowsUploaded = 0;
+			std::vector<uint8_t> data;
+		};
+
+		struct StagingTexture
+		{
+			wrl::ComPtr<ID3D11Texture2D> texture;
+			uint32_t width, height;
+			DXGI_FORMAT format;
+			uint64_t lastUsedFrame;
+		};
+
+		uint32_t CopyRows(Request& request, uint32_t rows);
+		StagingTexture* AcquireStagingTexture(uint32_t width, uint32_t height, DXGI_FORMAT format);
+
+	private:
+		std::deque<Request> m_Requests;
+		std::vector<StagingTexture> m_StagingTextures;
+		std::unordered_set<Texture2D*> m_DirtyMips; // textures that need their mips regenerated
+
+		uint64_t m_FrameBudget = 8 * 1024 * 1024;
+		uint64_t m_DirectUploadLimit = 64 * 1024;
+		uint32_t m_FrameLatency = 3;
+		uint64_t m_Frame = 0;
+
+		Statistics m_Statistics; // the frame being made
+		Statistics m_FrameStatistics;
+	};
+}
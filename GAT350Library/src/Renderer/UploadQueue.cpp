@@ -0,0 +1,259 @@
+#include "UploadQueue.h"
+#include "RendererAPI.h"
+
+#include <algorithm>
+#include <unordered_map>
+#include <string.h>
+
+namespace Engine
+{
+
+	void UploadQueue::Upload(wrl::ComPtr<ID3D11Buffer> buffer, uint32_t offset, const void* data, uint32_t size, Priority priority)
+	{
+		if (buffer == nullptr || size == 0)
+			return;
+
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		Request& request = m_Requests.emplace_back();
+		request.buffer = buffer;
+		request.offset = offset;
+		request.size = size;
+		request.dataOffset = m_Staging.size();
+		request.priority = priority;
+		request.sequence = m_Sequence++;
+		m_Staging.insert(m_Staging.end(), (const uint8_t*)data, (const uint8_t*)data + size);
+
+		if (priority == Priority::High)
+			m_HighPriorityCount++;
+		m_Statistics.requests++;
+		m_Statistics.bytesQueued += size;
+	}
+
+	void UploadQueue::Cancel(ID3D11Buffer* buffer)
+	{
+		// the staging data is left where it is, it goes away on the next flush
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Requests.erase(std::remove_if(m_Requests.begin(), m_Requests.end(), [&](const Request& r) {
+			return r.buffer.Get() == buffer;
+		}), m_Requests.end());
+	}
+
+	void UploadQueue::Update()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			Statistics pending;
+			pending.pendingRequests = m_Statistics.pendingRequests;
+			pending.pendingBytes = m_Statistics.pendingBytes;
+			m_Statistics = pending;
+		}
+		m_FrameBytes = 0;
+		Flush(false);
+	}
+
+	void UploadQueue::FlushHighPriority()
+	{
+		if (m_HighPriorityCount == 0)
+			return;
+		Flush(true);
+	}
+
+	UploadQueue::Statistics UploadQueue::GetStatistics()
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		return m_Statistics;
+	}
+
+	UploadQueue& UploadQueue::Get()
+	{
+		static UploadQueue* instance = new UploadQueue();
+		return *instance;
+	}
+
+	void UploadQueue::Flush(bool highPriorityOnly)
+	{
+		// take everything so other threads can keep queueing while this writes
+		std::vector<Request> requests;
+		std::vector<uint8_t> staging;
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			requests.swap(m_Requests);
+			staging.swap(m_Staging);
+		}
+		if (requests.empty())
+			return;
+
+		// a buffer is written at the highest priority of any of its updates so an older update never lands after a newer one
+		std::unordered_map<ID3D11Buffer*, Priority> bufferPriorities;
+		for (const Request& request : requests)
+		{
+			Priority& priority = bufferPriorities[request.buffer.Get()];
+			priority = std::max(priority, request.priority);
+		}
+
+		std::sort(requests.begin(), requests.end(), [&](const Request& a, const Request& b) {
+			Priority pa = bufferPriorities[a.buffer.Get()];
+			Priority pb = bufferPriorities[b.buffer.Get()];
+			if (pa != pb)
+				return pa > pb;
+			if (a.buffer.Get() != b.buffer.Get())
+				return a.buffer.Get() < b.buffer.Get();
+			if (a.offset != b.offset)
+				return a.offset < b.offset;
+			return a.sequence < b.sequence;
+		});
+
+		Statistics stats;
+		std::vector<Request> kept;
+		std::vector<uint8_t> keptStaging;
+		size_t i = 0;
+		while (i < requests.size())
+		{
+			ID3D11Buffer* buffer = requests[i].buffer.Get();
+			size_t end = i;
+			uint64_t bytes = 0;
+			while (end < requests.size() && requests[end].buffer.Get() == buffer)
+				bytes += requests[end++].size;
+
+			// something always gets written so a single large update can not get stuck
+			bool hold = bufferPriorities[buffer] != Priority::High &&
+				(highPriorityOnly || (m_FrameBytes > 0 && m_FrameBytes + bytes > m_FrameBudget));
+			if (hold)
+			{
+				for (size_t j = i; j < end; j++)
+				{
+					Request& request = kept.emplace_back(std::move(requests[j]));
+					keptStaging.insert(keptStaging.end(), staging.begin() + request.dataOffset, staging.begin() + request.dataOffset + request.size);
+					request.dataOffset = keptStaging.size() - request.size;
+				}
+			}
+			else
+			{
+				Write(&requests[i], end - i, staging, stats);
+				m_FrameBytes += bytes;
+			}
+			i = end;
+		}
+
+		// what was held goes back in front of anything queued while writing
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		for (Request& request : m_Requests)
+			request.dataOffset += keptStaging.size();
+		keptStaging.insert(keptStaging.end(), m_Staging.begin(), m_Staging.end());
+		kept.insert(kept.end(), std::make_move_iterator(m_Requests.begin()), std::make_move_iterator(m_Requests.end()));
+		m_Requests = std::move(kept);
+		m_Staging = std::move(keptStaging);
+
+		m_HighPriorityCount = (uint32_t)std::count_if(m_Requests.begin(), m_Requests.end(), [](const Request& r) { return r.priority == Priority::High; });
+		m_Statistics.calls += stats.calls;
+		m_Statistics.requestsMerged += stats.requestsMerged;
+		m_Statistics.bytesUploaded += stats.bytesUploaded;
+		m_Statistics.pendingRequests = (uint32_t)m_Requests.size();
+		m_Statistics.pendingBytes = 0;
+		for (const Request& request : m_Requests)
+			m_Statistics.pendingBytes += request.size;
+	}
+
+	void UploadQueue::Write(Request* requests, size_t count, const std::vector<uint8_t>& staging, Statistics& stats)
+	{
+		RendererAPI& graphics = RendererAPI::Get();
+		ID3D11Buffer* buffer = requests[0].buffer.Get();
+
+		D3D11_BUFFER_DESC desc;
+		buffer->GetDesc(&desc);
+
+		// updates past the end of the buffer are dropped
+		Request* last = std::remove_if(requests, requests + count, [&](const Request& r) {
+			if (r.offset + r.size <= desc.ByteWidth)
+				return false;
+			DBOUT("buffer update of " << r.size << " bytes at " << r.offset << " is past the end of the buffer" << std::endl);
+			return true;
+		});
+		count = last - requests;
+		if (count == 0)
+			return;
+
+		auto bySequence = [](const Request& a, const Request& b) { return a.sequence < b.sequence; };
+
+		if (desc.Usage == D3D11_USAGE_DYNAMIC)
+		{
+			// the requests are sorted by offset, find how far they write from the start without a gap
+			uint32_t covered = 0;
+			uint32_t end = 0;
+			for (size_t i = 0; i < count; i++)
+			{
+				if (requests[i].offset <= covered)
+					covered = std::max(covered, requests[i].offset + requests[i].size);
+				end = std::max(end, requests[i].offset + requests[i].size);
+			}
+
+			// a discard throws away everything that is not written, so the owners of dynamic buffers always write all
+			// of their data from the start (a pooled buffer can be bigger than what its owner uses). writing part of it
+			// in place could change data a draw that is still in flight reads, so those updates are dropped
+			if (covered < end)
+			{
+				DBOUT("dynamic buffer updates have to write all of its data, " << count << " updates were dropped" << std::endl);
+				return;
+			}
+
+			// every update goes into the same map
+			std::sort(requests, requests + count, bySequence);
+
+			D3D11_MAPPED_SUBRESOURCE msub = {};
+			HRESULT hr = graphics.GetContext()->Map(buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &msub);
+			if (FAILED(hr))
+			{
+				DBOUT("failed to map buffer for upload " << TranslateError(hr) << std::endl);
+				return;
+			}
+			for (size_t i = 0; i < count; i++)
+			{
+				memcpy((uint8_t*)msub.pData + requests[i].offset, staging.data() + requests[i].dataOffset, requests[i].size);
+				stats.bytesUploaded += requests[i].size;
+			}
+			graphics.GetContext()->Unmap(buffer, 0);
+
+			stats.calls++;
+			stats.requestsMerged += (uint32_t)count - 1;
+			return;
+		}
+
+		// the requests are sorted by offset, ranges that touch or overlap become one write
+		size_t runStart = 0;
+		while (runStart < count)
+		{
+			uint32_t start = requests[runStart].offset;
+			uint32_t end = start + requests[runStart].size;
+			size_t runEnd = runStart + 1;
+			while (runEnd < count && requests[runEnd].offset <= end)
+			{
+				end = std::max(end, requests[runEnd].offset + requests[runEnd].size);
+				runEnd++;
+			}
+
+			// newer data is copied last so it wins where the ranges overlap
+			std::sort(requests + runStart, requests + runEnd, bySequence);
+			m_Merged.resize(end - start);
+			for (size_t i = runStart; i < runEnd; i++)
+				memcpy(m_Merged.data() + (requests[i].offset - start), staging.data() + requests[i].dataOffset, requests[i].size);
+
+			// constant buffers can only be updated whole, with no box the update reads the full size of the buffer
+			bool constant = desc.BindFlags & D3D11_BIND_CONSTANT_BUFFER;
+			if (constant && (start != 0 || end < desc.ByteWidth))
+			{
+				DBOUT("constant buffer updates have to write the whole buffer, " << runEnd - runStart << " updates were dropped" << std::endl);
+				runStart = runEnd;
+				continue;
+			}
+
+			D3D11_BOX box = { start, 0, 0, end, 1, 1 };
+			graphics.GetContext()->UpdateSubresource(buffer, 0, constant ? nullptr : &box, m_Merged.data(), 0, 0);
+
+			stats.calls++;
+			stats.requestsMerged += (uint32_t)(runEnd - runStart) - 1;
+			stats.bytesUploaded += end - start;
+			runStart = runEnd;
+		}
+	}
+
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include "Platform/Windows/Win.h"
+#include "Core/Core.h"
+
+#include <mutex>
+#include <atomic>
+
+namespace Engine
+{
+	// collects buffer updates from any thread and writes them on the render thread once a frame
+	// updates to the same buffer are sorted by offset and touching or overlapping ranges are merged into
+	// one write, newer data wins where ranges overlap. dynamic buffers get one map for all their updates
+	class UploadQueue
+	{
+	public:
+		enum class Priority
+		{
+			Low,
+			Normal,
+			High, // never held back by the frame budget and written before the next draw
+		};
+
+		struct Statistics
+		{
+			uint32_t requests = 0; // queued this frame
+			uint32_t calls = 0; // UpdateSubresource and Map calls made this frame
+			uint32_t requestsMerged = 0; // requests that did not need a call of their own
+			uint64_t bytesQueued = 0;
+			uint64_t bytesUploaded = 0;
+			uint32_t pendingRequests = 0; // held back by the budget
+			uint64_t pendingBytes = 0;
+		};
+
+	public:
+		void SetFrameBudget(uint64_t bytes) { m_FrameBudget = bytes; }
+
+		// the data is copied so it can be freed as soon as this returns, safe to call from any thread
+		void Upload(wrl::ComPtr<ID3D11Buffer> buffer, uint32_t offset, const void* data, uint32_t size, Priority priority = Priority::Normal);
+		void Cancel(ID3D11Buffer* buffer);
+
+		// writes what fits in the frame budget, call once per frame on the render thread
+		void Update();
+		// writes only the high priority updates, cheap to call when there are none
+		void FlushHighPriority();
+
+		Statistics GetStatistics();
+
+		static UploadQueue& Get();
+
+	private:
+		struct Request
+		{
+			wrl::ComPtr<ID3D11Buffer> buffer;
+			uint32_t offset;
+			uint32_t size;
+			size_t dataOffset; // in the staging data
+			Priority priority;
+			uint64_t sequence; // later requests win where they overlap
+		};
+
+		void Flush(bool highPriorityOnly);
+		void Write(Request* requests, size_t count, const std::vector<uint8_t>& staging, Statistics& stats);
+
+	private:
+		std::mutex m_Mutex;
+		std::vector<Request> m_Requests;
+		std::vector<uint8_t> m_Staging;
+		uint64_t m_Sequence = 0;
+		std::atomic<uint32_t> m_HighPriorityCount = 0;
+		Statistics m_Statistics;
+
+		uint64_t m_FrameBudget = 4 * 1024 * 1024;
+		uint64_t m_FrameBytes = 0; // already written this frame
+		std::vector<uint8_t> m_Merged; // scratch for merging ranges, only used on the render thread
+	};
+}
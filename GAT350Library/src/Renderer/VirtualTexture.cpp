@@ -0,0 +1,414 @@
+#include "VirtualTexture.h"
+#include "RendererAPI.h"
+
+#include <algorithm>
+
+namespace Engine
+{
+
+	// ------------------------------------- Virtual Page Table ------------------------------------- //
+
+#pragma region Virtual Page Table
+
+	VirtualPageTable::VirtualPageTable(uint32_t pagesX, uint32_t pagesY)
+	{
+		uint32_t width = std::max(pagesX, 1u);
+		uint32_t height = std::max(pagesY, 1u);
+		while (true)
+		{
+			Mip& mip = m_Mips.emplace_back();
+			mip.width = width;
+			mip.height = height;
+			mip.slots.resize((size_t)width * height, InvalidSlot);
+
+			if (width == 1 && height == 1)
+				break;
+			width = std::max(width >> 1, 1u);
+			height = std::max(height >> 1, 1u);
+		}
+	}
+
+	bool VirtualPageTable::IsValid(VirtualPageID page) const
+	{
+		if (!page.IsValid() || page.GetMip() >= m_Mips.size())
+			return false;
+		const Mip& mip = m_Mips[page.GetMip()];
+		return page.GetX() < mip.width && page.GetY() < mip.height;
+	}
+
+	void VirtualPageTable::Map(VirtualPageID page, uint32_t slot)
+	{
+		Mip& mip = m_Mips[page.GetMip()];
+		mip.slots[(size_t)page.GetY() * mip.width + page.GetX()] = slot;
+	}
+
+	void VirtualPageTable::Unmap(VirtualPageID page)
+	{
+		Map(page, InvalidSlot);
+	}
+
+	uint32_t VirtualPageTable::GetSlot(VirtualPageID page) const
+	{
+		const Mip& mip = m_Mips[page.GetMip()];
+		return mip.slots[(size_t)page.GetY() * mip.width + page.GetX()];
+	}
+
+	VirtualPageID VirtualPageTable::FindResident(VirtualPageID page) const
+	{
+		while (true)
+		{
+			if (IsResident(page))
+				return page;
+			if (page.GetMip() + 1 >= m_Mips.size())
+				return VirtualPageID();
+			page = page.GetParent();
+		}
+	}
+
+	void VirtualPageTable::BuildIndirection(uint32_t mip, uint32_t slotsPerRow, std::vector<uint32_t>& texels) const
+	{
+		const Mip& m = m_Mips[mip];
+		texels.resize((size_t)m.width * m.height);
+		for (uint32_t y = 0; y < m.height; y++)
+		{
+			for (uint32_t x = 0; x < m.width; x++)
+			{
+				VirtualPageID resident = FindResident(VirtualPageID(x, y, mip));
+				uint32_t& texel = texels[(size_t)y * m.width + x];
+				if (!resident.IsValid())
+				{
+					texel = 0;
+					continue;
+				}
+
+				uint32_t slot = GetSlot(resident);
+				texel = (slot % slotsPerRow) | ((slot / slotsPerRow) << 8) | (resident.GetMip() << 16) | (0xffu << 24);
+			}
+		}
+	}
+
+#pragma endregion
+
+	// ------------------------------------- End Virtual Page Table ------------------------------------- //
+
+	// ------------------------------------- Virtual Page Cache ------------------------------------- //
+
+#pragma region Virtual Page Cache
+
+	VirtualPageCache::VirtualPageCache(uint32_t slotCount) :
+		m_Slots(slotCount)
+	{
+		for (uint32_t i = 0; i < slotCount; i++)
+			PushBack(i);
+	}
+
+	bool VirtualPageCache::Allocate(VirtualPageID page, uint64_t frame, uint32_t& slot, VirtualPageID& evicted)
+	{
+		if (m_Tail == s_Null)
+			return false;
+
+		Slot& s = m_Slots[m_Tail];
+		if (s.page.IsValid() && s.lastUsedFrame >= frame)
+			return false;
+
+		slot = m_Tail;
+		evicted = s.page;
+		if (!s.page.IsValid())
+			m_UsedSlots++;
+
+		s.page = page;
+		s.lastUsedFrame = frame;
+		Unlink(slot);
+		PushFront(slot);
+		return true;
+	}
+
+	void VirtualPageCache::Free(uint32_t slot)
+	{
+		Slot& s = m_Slots[slot];
+		if (!s.page.IsValid())
+			return;
+
+		s.page = VirtualPageID();
+		m_UsedSlots--;
+		if (s.locked)
+			s.locked = false;
+		else
+			Unlink(slot);
+		PushBack(slot);
+	}
+
+	void VirtualPageCache::Touch(uint32_t slot, uint64_t frame)
+	{
+		Slot& s = m_Slots[slot];
+		s.lastUsedFrame = frame;
+		if (s.locked)
+			return;
+
+		Unlink(slot);
+		PushFront(slot);
+	}
+
+	void VirtualPageCache::Lock(uint32_t slot)
+	{
+		Slot& s = m_Slots[slot];
+		if (s.locked)
+			return;
+
+		s.locked = true;
+		Unlink(slot);
+	}
+
+	void VirtualPageCache::Unlink(uint32_t slot)
+	{
+		Slot& s = m_Slots[slot];
+		if (s.prev != s_Null) m_Slots[s.prev].next = s.next;
+		else m_Head = s.next;
+		if (s.next != s_Null) m_Slots[s.next].prev = s.prev;
+		else m_Tail = s.prev;
+		s.prev = s.next = s_Null;
+	}
+
+	void VirtualPageCache::PushFront(uint32_t slot)
+	{
+		Slot& s = m_Slots[slot];
+		s.prev = s_Null;
+		s.next = m_Head;
+		if (m_Head != s_Null) m_Slots[m_Head].prev = slot;
+		else m_Tail = slot;
+		m_Head = slot;
+	}
+
+	void VirtualPageCache::PushBack(uint32_t slot)
+	{
+		Slot& s = m_Slots[slot];
+		s.next = s_Null;
+		s.prev = m_Tail;
+		if (m_Tail != s_Null) m_Slots[m_Tail].next = slot;
+		else m_Head = slot;
+		m_Tail = slot;
+	}
+
+#pragma endregion
+
+	// ------------------------------------- End Virtual Page Cache ------------------------------------- //
+
+	// ------------------------------------- Virtual Texture Feedback ------------------------------------- //
+
+#pragma region Virtual Texture Feedback
+
+	void VirtualTextureFeedback::Analyze(const uint32_t* feedback, size_t count, const VirtualPageTable& table)
+	{
+		m_Requests.clear();
+		m_VisiblePages.clear();
+		m_UniquePages = 0;
+
+		// sorting groups the duplicates together, the feedback buffer is mostly the same few pages
+		m_Sorted.assign(feedback, feedback + count);
+		std::sort(m_Sorted.begin(), m_Sorted.end());
+
+		for (size_t i = 0; i < m_Sorted.size();)
+		{
+			size_t end = i + 1;
+			while (end < m_Sorted.size() && m_Sorted[end] == m_Sorted[i])
+				end++;
+			uint32_t runCount = (uint32_t)(end - i);
+			VirtualPageID page(m_Sorted[i]);
+			i = end;
+
+			if (!table.IsValid(page))
+				continue;
+			m_UniquePages++;
+
+			if (table.IsResident(page))
+			{
+				m_VisiblePages.push_back(page);
+				continue;
+			}
+
+			// load the coarsest missing page first so the texture sharpens one mip at a time
+			VirtualPageID missing = page;
+			while (missing.GetMip() + 1 < table.GetMipCount() && !table.IsResident(missing.GetParent()))
+				missing = missing.GetParent();
+
+			// the fallback is what gets sampled until the page is loaded so keep it in the cache
+			uint32_t fallbackMip = table.GetMipCount();
+			if (missing.GetMip() + 1 < table.GetMipCount())
+			{
+				m_VisiblePages.push_back(missing.GetParent());
+				fallbackMip = missing.GetParent().GetMip();
+			}
+
+			Request& request = m_Requests.emplace_back();
+			request.page = missing;
+			request.count = runCount;
+			request.priority = (float)(fallbackMip - page.GetMip()); // mips of detail missing, combined below
+		}
+
+		// many requested pages can share the same missing ancestor
+		std::sort(m_Requests.begin(), m_Requests.end(), [](const Request& a, const Request& b) {
+			return a.page.id < b.page.id;
+		});
+		size_t merged = 0;
+		for (size_t i = 0; i < m_Requests.size(); i++)
+		{
+			if (merged > 0 && m_Requests[merged - 1].page == m_Requests[i].page)
+			{
+				Request& request = m_Requests[merged - 1];
+				request.count += m_Requests[i].count;
+				request.priority = std::max(request.priority, m_Requests[i].priority);
+				continue;
+			}
+			m_Requests[merged++] = m_Requests[i];
+		}
+		m_Requests.resize(merged);
+
+		// pages covering more of the screen and missing more detail go first
+		for (Request& request : m_Requests)
+			request.priority *= (float)request.count;
+		std::sort(m_Requests.begin(), m_Requests.end(), [](const Request& a, const Request& b) {
+			if (a.priority != b.priority)
+				return a.priority > b.priority;
+			return a.page.GetMip() > b.page.GetMip();
+		});
+
+		std::sort(m_VisiblePages.begin(), m_VisiblePages.end(), [](const VirtualPageID& a, const VirtualPageID& b) {
+			return a.id < b.id;
+		});
+		m_VisiblePages.erase(std::unique(m_VisiblePages.begin(), m_VisiblePages.end()), m_VisiblePages.end());
+	}
+
+#pragma endregion
+
+	// ------------------------------------- End Virtual Texture Feedback ------------------------------------- //
+
+	// ------------------------------------- Virtual Texture ------------------------------------- //
+
+#pragma region Virtual Texture
+
+	VirtualTexture::VirtualTexture(const Desc& desc, const PageLoader& loader) :
+		m_Desc(desc), m_Loader(loader),
+		m_PageTable((desc.width + desc.pageSize - 1) / desc.pageSize, (desc.height + desc.pageSize - 1) / desc.pageSize),
+		m_Cache(desc.cacheSize * desc.cacheSize)
+	{
+		uint32_t slotSize = m_Desc.pageSize + m_Desc.border * 2;
+		m_PageTexels.resize((size_t)slotSize * slotSize * 4);
+
+		// the cache only has one mip, pages are sampled with the mip picked by the indirection
+		m_PhysicalTexture = Texture2D::Create(m_Desc.cacheSize * slotSize, m_Desc.cacheSize * slotSize, Texture::Format::RGBA8_UNORM, nullptr, 1);
+		m_PhysicalTexture->SetAutoGenerateMips(false);
+
+		// every mip of the indirection texture is written by hand
+		m_IndirectionTexture = Texture2D::Create(m_PageTable.GetPagesX(0), m_PageTable.GetPagesY(0), Texture::Format::RGBA8_UNORM);
+		m_IndirectionTexture->SetAutoGenerateMips(false);
+
+		// the last mip is a single page that is always resident so there is always something to fall back to
+		VirtualPageID root(0, 0, m_PageTable.GetMipCount() - 1);
+		uint32_t slot;
+		VirtualPageID evicted;
+		m_Cache.Allocate(root, 0, slot, evicted);
+		m_Cache.Lock(slot);
+		if (LoadPage(root, slot))
+			m_PageTable.Map(root, slot);
+		else
+			DBOUT("failed to load the root page of the virtual texture" << std::endl);
+
+		UpdateIndirection();
+	}
+
+	void VirtualTexture::Update(const uint32_t* feedback, size_t count)
+	{
+		m_Statistics.loads = 0;
+		m_Statistics.evictions = 0;
+		m_Statistics.failedLoads = 0;
+
+		m_Feedback.Analyze(feedback, count, m_PageTable);
+
+		for (VirtualPageID page : m_Feedback.GetVisiblePages())
+			m_Cache.Touch(m_PageTable.GetSlot(page), m_Frame);
+
+		for (const VirtualTextureFeedback::Request& request : m_Feedback.GetRequests())
+		{
+			if (m_Statistics.loads >= m_Desc.maxLoadsPerFrame)
+				break;
+
+			uint32_t slot;
+			VirtualPageID evicted;
+			if (!m_Cache.Allocate(request.page, m_Frame, slot, evicted))
+				break; // everything in the cache is visible
+
+			if (evicted.IsValid())
+			{
+				m_PageTable.Unmap(evicted);
+				m_Statistics.evictions++;
+				m_IndirectionDirty = true;
+			}
+
+			if (!LoadPage(request.page, slot))
+			{
+				m_Cache.Free(slot);
+				m_Statistics.failedLoads++;
+				continue;
+			}
+
+			m_PageTable.Map(request.page, slot);
+			m_Statistics.loads++;
+			m_IndirectionDirty = true;
+		}
+
+		if (m_IndirectionDirty)
+			UpdateIndirection();
+
+		m_Statistics.requestedPages = m_Feedback.GetUniquePageCount();
+		m_Statistics.missingPages = (uint32_t)m_Feedback.GetRequests().size();
+		m_Statistics.residentPages = m_Cache.GetUsedSlots();
+		m_Frame++;
+	}
+
+	glm::vec4 VirtualTexture::GetShaderParams() const
+	{
+		float cacheSize = (float)(m_Desc.cacheSize * (m_Desc.pageSize + m_Desc.border * 2));
+		return {
+			(float)m_PageTable.GetPagesX(0),
+			(float)m_PageTable.GetPagesY(0),
+			1.0f / (float)m_Desc.cacheSize,
+			(float)m_Desc.border / cacheSize
+		};
+	}
+
+	Ref<VirtualTexture> VirtualTexture::Create(const Desc& desc, const PageLoader& loader)
+	{
+		return std::make_shared<VirtualTexture>(desc, loader);
+	}
+
+	bool VirtualTexture::LoadPage(VirtualPageID page, uint32_t slot)
+	{
+		if (!m_Loader || !m_Loader(page, m_PageTexels.data()))
+			return false;
+
+		// loads are already limited by maxLoadsPerFrame and the page table points at the slot right away
+		// so the texels are written now instead of going through the upload queue
+		uint32_t slotSize = m_Desc.pageSize + m_Desc.border * 2;
+		uint32_t x = (slot % m_Desc.cacheSize) * slotSize;
+		uint32_t y = (slot / m_Desc.cacheSize) * slotSize;
+		D3D11_BOX box = { x, y, 0, x + slotSize, y + slotSize, 1 };
+		RendererAPI::Get().GetContext()->UpdateSubresource(m_PhysicalTexture->GetBuffer().Get(), 0, &box, m_PageTexels.data(), slotSize * 4, 0);
+		return true;
+	}
+
+	void VirtualTexture::UpdateIndirection()
+	{
+		RendererAPI& graphics = RendererAPI::Get();
+		for (uint32_t mip = 0; mip < m_PageTable.GetMipCount(); mip++)
+		{
+			m_PageTable.BuildIndirection(mip, m_Desc.cacheSize, m_IndirectionTexels);
+			graphics.GetContext()->UpdateSubresource(m_IndirectionTexture->GetBuffer().Get(), mip, nullptr, m_IndirectionTexels.data(), m_PageTable.GetPagesX(mip) * 4, 0);
+		}
+		m_IndirectionDirty = false;
+	}
+
+#pragma endregion
+
+	// ------------------------------------- End Virtual Texture ------------------------------------- //
+
+}
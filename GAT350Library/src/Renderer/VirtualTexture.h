@@ -0,0 +1,198 @@
+#pragma once
+#include "Core/Core.h"
+#include "Texture.h"
+
+#include <vector>
+#include <functional>
+
+namespace Engine
+{
+	// identifies one page of a virtual texture
+	// packed as mip (8 bits) | y (12 bits) | x (12 bits) so the feedback pass can write it as a single uint
+	struct VirtualPageID
+	{
+		uint32_t id = UINT32_MAX;
+
+		VirtualPageID() = default;
+		explicit VirtualPageID(uint32_t packed) : id(packed) {}
+		VirtualPageID(uint32_t x, uint32_t y, uint32_t mip) : id((mip << 24) | ((y & 0xfff) << 12) | (x & 0xfff)) {}
+
+		uint32_t GetX() const { return id & 0xfff; }
+		uint32_t GetY() const { return (id >> 12) & 0xfff; }
+		uint32_t GetMip() const { return id >> 24; }
+		bool IsValid() const { return id != UINT32_MAX; }
+		VirtualPageID GetParent() const { return VirtualPageID(GetX() >> 1, GetY() >> 1, GetMip() + 1); }
+
+		bool operator==(const VirtualPageID& other) const { return id == other.id; }
+		bool operator!=(const VirtualPageID& other) const { return id != other.id; }
+	};
+
+	// maps virtual pages to slots in the physical cache
+	class VirtualPageTable
+	{
+	public:
+		static constexpr uint32_t InvalidSlot = UINT32_MAX;
+
+		VirtualPageTable(uint32_t pagesX, uint32_t pagesY);
+
+		uint32_t GetMipCount() const { return (uint32_t)m_Mips.size(); }
+		uint32_t GetPagesX(uint32_t mip) const { return m_Mips[mip].width; }
+		uint32_t GetPagesY(uint32_t mip) const { return m_Mips[mip].height; }
+		bool IsValid(VirtualPageID page) const;
+
+		void Map(VirtualPageID page, uint32_t slot);
+		void Unmap(VirtualPageID page);
+		uint32_t GetSlot(VirtualPageID page) const;
+		bool IsResident(VirtualPageID page) const { return GetSlot(page) != InvalidSlot; }
+
+		// the most detailed resident page that covers the page, falling back to coarser mips
+		VirtualPageID FindResident(VirtualPageID page) const;
+
+		// fills the indirection data of a mip, one RGBA8 texel per page
+		// r, g = slot position in the cache, b = mip of the page that was found, a = 255
+		void BuildIndirection(uint32_t mip, uint32_t slotsPerRow, std::vector<uint32_t>& texels) const;
+
+	private:
+		struct Mip
+		{
+			uint32_t width, height;
+			std::vector<uint32_t> slots;
+		};
+
+		std::vector<Mip> m_Mips;
+	};
+
+	// lru list of the slots in the physical cache
+	class VirtualPageCache
+	{
+	public:
+		VirtualPageCache(uint32_t slotCount);
+
+		// gives a free slot or the least recently used one, evicted is set to the page that was in it
+		// fails if every slot was used this frame since evicting one would just cause it to be loaded again
+		bool Allocate(VirtualPageID page, uint64_t frame, uint32_t& slot, VirtualPageID& evicted);
+		void Free(uint32_t slot);
+		void Touch(uint32_t slot, uint64_t frame);
+		void Lock(uint32_t slot); // locked slots are never evicted
+
+		uint32_t GetSlotCount() const { return (uint32_t)m_Slots.size(); }
+		uint32_t GetUsedSlots() const { return m_UsedSlots; }
+		VirtualPageID GetPage(uint32_t slot) const { return m_Slots[slot].page; }
+
+	private:
+		void Unlink(uint32_t slot);
+		void PushFront(uint32_t slot);
+		void PushBack(uint32_t slot);
+
+	private:
+		static constexpr uint32_t s_Null = UINT32_MAX;
+
+		struct Slot
+		{
+			VirtualPageID page;
+			uint64_t lastUsedFrame = 0;
+			uint32_t prev = s_Null, next = s_Null;
+			bool locked = false;
+		};
+
+		std::vector<Slot> m_Slots;
+		uint32_t m_Head = s_Null; // most recently used
+		uint32_t m_Tail = s_Null; // least recently used, free slots are kept at the back
+		uint32_t m_UsedSlots = 0;
+	};
+
+	// turns the page ids written by the feedback pass into load requests
+	class VirtualTextureFeedback
+	{
+	public:
+		struct Request
+		{
+			VirtualPageID page;
+			uint32_t count = 0; // how many feedback texels needed it
+			float priority = 0.0f;
+		};
+
+		// invalid ids (the clear value) are skipped
+		void Analyze(const uint32_t* feedback, size_t count, const VirtualPageTable& table);
+
+		// pages that are not resident yet, highest priority first
+		const std::vector<Request>& GetRequests() const { return m_Requests; }
+		// resident pages that were sampled
+		const std::vector<VirtualPageID>& GetVisiblePages() const { return m_VisiblePages; }
+		uint32_t GetUniquePageCount() const { return m_UniquePages; }
+
+	private:
+		std::vector<uint32_t> m_Sorted;
+		std::vector<Request> m_Requests;
+		std::vector<VirtualPageID> m_VisiblePages;
+		uint32_t m_UniquePages = 0;
+	};
+
+	// a texture too big to keep in memory, split into pages that are streamed into a physical cache texture on demand
+	// shaders look up the page in the indirection texture (see VirtualPageTable::BuildIndirection) then sample the cache
+	class VirtualTexture
+	{
+	public:
+		struct Desc
+		{
+			uint32_t width = 0, height = 0; // size of the virtual texture
+			uint32_t pageSize = 128;
+			uint32_t border = 4; // texels around each page so filtering does not sample the neighbors in the cache
+			uint32_t cacheSize = 16; // slots per side of the physical cache
+			uint32_t maxLoadsPerFrame = 16;
+		};
+
+		struct Statistics
+		{
+			uint32_t requestedPages = 0; // unique pages in the last feedback
+			uint32_t missingPages = 0;
+			uint32_t residentPages = 0;
+			uint32_t loads = 0; // this frame
+			uint32_t evictions = 0; // this frame
+			uint32_t failedLoads = 0; // this frame
+		};
+
+		// fills the RGBA8 texels of a page including the border, (pageSize + border * 2)^2 texels
+		using PageLoader = std::function<bool(VirtualPageID page, uint8_t* texels)>;
+
+	public:
+		VirtualTexture(const Desc& desc, const PageLoader& loader);
+
+		// feedback is the page ids the feedback pass read back this frame
+		void Update(const uint32_t* feedback, size_t count);
+
+		const Desc& GetDesc() const { return m_Desc; }
+		const VirtualPageTable& GetPageTable() const { return m_PageTable; }
+		const Statistics& GetStatistics() const { return m_Statistics; }
+
+		Ref<Texture2D> GetPhysicalTexture() { return m_PhysicalTexture; }
+		Ref<Texture2D> GetIndirectionTexture() { return m_IndirectionTexture; }
+
+		// x, y = pages at mip 0, z = slot size in cache uv, w = border size in cache uv
+		glm::vec4 GetShaderParams() const;
+
+		static Ref<VirtualTexture> Create(const Desc& desc, const PageLoader& loader);
+
+	private:
+		bool LoadPage(VirtualPageID page, uint32_t slot);
+		void UpdateIndirection();
+
+	private:
+		Desc m_Desc;
+		PageLoader m_Loader;
+
+		VirtualPageTable m_PageTable;
+		VirtualPageCache m_Cache;
+		VirtualTextureFeedback m_Feedback;
+
+		Ref<Texture2D> m_PhysicalTexture;
+		Ref<Texture2D> m_IndirectionTexture;
+
+		std::vector<uint8_t> m_PageTexels;
+		std::vector<uint32_t> m_IndirectionTexels;
+		bool m_IndirectionDirty = true;
+		uint64_t m_Frame = 1;
+
+		Statistics m_Statistics;
+	};
+}
@@ -0,0 +1,166 @@
+#include "HalfFloat.h"
+#include "Core/Core.h"
+#include "Parallel.h"
+
+#include <intrin.h>
+#include <immintrin.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include <random>
+#include <chrono>
+
+namespace Engine
+{
+
+	static const size_t s_MinPixelsPerThread = 64 * 1024;
+
+	uint16_t HalfFloat::FromFloat(float value)
+	{
+		const uint32_t infinity = 255u << 23;
+		const uint32_t halfMax = (127u + 16u) << 23; // smallest float that rounds to inf
+		const uint32_t denormMagic = ((127u - 15u) + (23u - 10u) + 1u) << 23;
+
+		uint32_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+		uint32_t sign = bits & 0x80000000u;
+		bits ^= sign;
+
+		uint16_t half;
+		if (bits >= halfMax)
+		{
+			half = bits > infinity ? 0x7e00 : 0x7c00; // nan stays nan
+		}
+		else if (bits < (113u << 23))
+		{
+			// too small for a normal half, let the float adder do the rounding into the denormal range
+			float f, magic;
+			memcpy(&f, &bits, sizeof(f));
+			memcpy(&magic, &denormMagic, sizeof(magic));
+			f += magic;
+			memcpy(&bits, &f, sizeof(bits));
+			half = (uint16_t)(bits - denormMagic);
+		}
+		else
+		{
+			uint32_t mantissaOdd = (bits >> 13) & 1;
+			bits += ((15u - 127u) << 23) + 0xfff;
+			bits += mantissaOdd;
+			half = (uint16_t)(bits >> 13);
+		}
+
+		return half | (uint16_t)(sign >> 16);
+	}
+
+	void HalfFloat::ConvertToRGBA(const float* src, uint32_t channels, uint16_t* dst, size_t pixels)
+	{
+		CREATE_PROFILE_SCOPEI("HalfFloat::ConvertToRGBA");
+
+		if (channels == 0 || channels > 4)
+			return;
+
+		auto convert = HasF16C() ? &ConvertToRGBAF16C : &ConvertToRGBAScalar;
+
+		size_t chunks = std::min<size_t>(Parallel::GetThreadCount(), pixels / s_MinPixelsPerThread);
+		if (chunks <= 1)
+		{
+			convert(src, channels, dst, pixels);
+			return;
+		}
+
+		// every chunk is a contiguous run of pixels
+		size_t chunk = (pixels + chunks - 1) / chunks;
+		Parallel::For((uint32_t)chunks, [&](uint32_t i) {
+			size_t start = i * chunk;
+			if (start < pixels)
+				convert(src + start * channels, channels, dst + start * 4, std::min(chunk, pixels - start));
+		});
+	}
+
+	bool HalfFloat::HasF16C()
+	{
+		static bool hasF16C = []() {
+			int info[4];
+			__cpuid(info, 1);
+			bool f16c = (info[2] & (1 << 29)) != 0;
+			bool avx = (info[2] & (1 << 28)) != 0;
+			bool osxsave = (info[2] & (1 << 27)) != 0;
+			if (!f16c || !avx || !osxsave)
+				return false;
+			// the os has to save the ymm registers on a context switch too
+			return (_xgetbv(0) & 0x6) == 0x6;
+		}();
+		return hasF16C;
+	}
+
+	float HalfFloat::Benchmark(size_t pixels, uint32_t channels, uint32_t iterations)
+	{
+		// hdr values, mostly in the normal half range with the odd one too big or too small for it
+		std::mt19937 random(1234);
+		std::uniform_real_distribution<float> distribution(0.0f, 100.0f);
+		std::vector<float> src(pixels * channels);
+		for (size_t i = 0; i < src.size(); i++)
+			src[i] = i % 1024 == 0 ? 1.0e6f : (i % 1024 == 1 ? 1.0e-6f : distribution(random));
+		std::vector<uint16_t> dst(pixels * 4);
+
+		float milliseconds = 0.0f;
+		for (uint32_t i = 0; i < iterations; i++)
+		{
+			auto start = std::chrono::steady_clock::now();
+			ConvertToRGBA(src.data(), channels, dst.data(), pixels);
+			milliseconds += std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+		}
+		return iterations == 0 ? 0.0f : milliseconds / iterations;
+	}
+
+	void HalfFloat::ConvertToRGBAScalar(const float* src, uint32_t channels, uint16_t* dst, size_t pixels)
+	{
+		const uint16_t one = 0x3c00;
+		for (size_t i = 0; i < pixels; i++)
+		{
+			const float* s = src + i * channels;
+			uint16_t* d = dst + i * 4;
+			d[0] = FromFloat(s[0]);
+			d[1] = channels > 1 ? FromFloat(s[1]) : 0;
+			d[2] = channels > 2 ? FromFloat(s[2]) : 0;
+			d[3] = channels > 3 ? FromFloat(s[3]) : one;
+		}
+	}
+
+	void HalfFloat::ConvertToRGBAF16C(const float* src, uint32_t channels, uint16_t* dst, size_t pixels)
+	{
+		// two pixels per iteration so every conversion fills a full 256 bit register
+		size_t i = 0;
+		if (channels == 4)
+		{
+			for (; i + 2 <= pixels; i += 2)
+			{
+				__m256 rgba = _mm256_loadu_ps(src + i * 4);
+				_mm_storeu_si128((__m128i*)(dst + i * 4), _mm256_cvtps_ph(rgba, _MM_FROUND_TO_NEAREST_INT));
+			}
+		}
+		else if (channels == 3)
+		{
+			for (; i + 2 <= pixels; i += 2)
+			{
+				const float* s = src + i * 3;
+				__m256 rgba = _mm256_setr_ps(s[0], s[1], s[2], 1.0f, s[3], s[4], s[5], 1.0f);
+				_mm_storeu_si128((__m128i*)(dst + i * 4), _mm256_cvtps_ph(rgba, _MM_FROUND_TO_NEAREST_INT));
+			}
+		}
+		else
+		{
+			for (; i + 2 <= pixels; i += 2)
+			{
+				const float* s = src + i * channels;
+				__m256 rgba = channels == 2 ?
+					_mm256_setr_ps(s[0], s[1], 0.0f, 1.0f, s[2], s[3], 0.0f, 1.0f) :
+					_mm256_setr_ps(s[0], 0.0f, 0.0f, 1.0f, s[1], 0.0f, 0.0f, 1.0f);
+				_mm_storeu_si128((__m128i*)(dst + i * 4), _mm256_cvtps_ph(rgba, _MM_FROUND_TO_NEAREST_INT));
+			}
+		}
+
+		ConvertToRGBAScalar(src + i * channels, channels, dst + i * 4, pixels - i);
+	}
+
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+namespace Engine
+{
+	class HalfFloat
+	{
+	public:
+		// round to nearest even, out of range values become inf
+		static uint16_t FromFloat(float value);
+
+		// converts 1 to 4 channel floats to RGBA halfs, missing color channels are 0 and missing alpha is 1
+		// uses F16C when the cpu has it and splits big images across threads
+		static void ConvertToRGBA(const float* src, uint32_t channels, uint16_t* dst, size_t pixels);
+
+		static bool HasF16C();
+
+		// average milliseconds to convert an image with the given number of pixels and channels
+		static float Benchmark(size_t pixels, uint32_t channels, uint32_t iterations);
+
+	private:
+		static void ConvertToRGBAScalar(const float* src, uint32_t channels, uint16_t* dst, size_t pixels);
+		static void ConvertToRGBAF16C(const float* src, uint32_t channels, uint16_t* dst, size_t pixels);
+	};
+}
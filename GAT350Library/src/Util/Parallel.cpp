@@ -0,0 +1,129 @@
+#include "Parallel.h"
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <algorithm>
+
+namespace Engine
+{
+
+	static thread_local bool s_InParallelFor = false;
+
+	// ------------------------------------- Worker Pool ------------------------------------- //
+#pragma region Worker Pool
+
+	// the workers are started once and sleep between jobs so a For only costs a wake up
+	class WorkerPool
+	{
+	public:
+		static WorkerPool& Get()
+		{
+			static WorkerPool* instance = new WorkerPool();
+			return *instance;
+		}
+
+		void Run(uint32_t count, const std::function<void(uint32_t)>& func)
+		{
+			// one job at a time, a second caller waits for the pool instead of starting more threads
+			std::lock_guard<std::mutex> jobLock(m_JobMutex);
+
+			{
+				std::lock_guard<std::mutex> lock(m_Mutex);
+				m_Func = &func;
+				m_Count = count;
+				m_Next = 0;
+				m_Working = (uint32_t)m_Threads.size();
+				m_Job++;
+			}
+			m_Wake.notify_all();
+
+			Work();
+
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_Done.wait(lock, [this]() { return m_Working == 0; });
+			m_Func = nullptr;
+		}
+
+	private:
+		WorkerPool()
+		{
+			uint32_t workers = Parallel::GetThreadCount() - 1;
+			m_Threads.reserve(workers);
+			for (uint32_t i = 0; i < workers; i++)
+			{
+				m_Threads.emplace_back([this]() { WorkerLoop(); });
+				m_Threads.back().detach();
+			}
+		}
+
+		void WorkerLoop()
+		{
+			uint64_t job = 0;
+			while (true)
+			{
+				{
+					std::unique_lock<std::mutex> lock(m_Mutex);
+					m_Wake.wait(lock, [&]() { return m_Job != job; });
+					job = m_Job;
+				}
+
+				Work();
+
+				std::lock_guard<std::mutex> lock(m_Mutex);
+				if (--m_Working == 0)
+					m_Done.notify_one();
+			}
+		}
+
+		// every thread takes the next index until they run out so uneven work still balances
+		void Work()
+		{
+			s_InParallelFor = true;
+			for (uint32_t i = m_Next++; i < m_Count; i = m_Next++)
+				(*m_Func)(i);
+			s_InParallelFor = false;
+		}
+
+	private:
+		std::vector<std::thread> m_Threads;
+
+		std::mutex m_JobMutex;
+		std::mutex m_Mutex;
+		std::condition_variable m_Wake;
+		std::condition_variable m_Done;
+
+		uint64_t m_Job = 0;
+		uint32_t m_Working = 0;
+		const std::function<void(uint32_t)>* m_Func = nullptr;
+		uint32_t m_Count = 0;
+		std::atomic<uint32_t> m_Next = 0;
+	};
+
+#pragma endregion
+
+	// ------------------------------------- Parallel ------------------------------------- //
+#pragma region Parallel
+
+	void Parallel::For(uint32_t count, const std::function<void(uint32_t)>& func)
+	{
+		if (s_InParallelFor || count <= 1 || GetThreadCount() <= 1)
+		{
+			for (uint32_t i = 0; i < count; i++)
+				func(i);
+			return;
+		}
+
+		WorkerPool::Get().Run(count, func);
+	}
+
+	uint32_t Parallel::GetThreadCount()
+	{
+		return std::max(std::thread::hardware_concurrency(), 1u);
+	}
+
+#pragma endregion
+
+}
@@ -0,0 +1,16 @@
+#pragma once
+#include <stdint.h>
+#include <functional>
+
+namespace Engine
+{
+	class Parallel
+	{
+	public:
+		// calls func for every index in [0, count) spread over a pool of worker threads started on the first call, the calling thread helps
+		// calls made from inside another For run on the calling thread so nested work does not oversubscribe the cpu
+		static void For(uint32_t count, const std::function<void(uint32_t)>& func);
+
+		static uint32_t GetThreadCount();
+	};
+}
@@ -23,6 +23,12 @@ struct VS_Output
 
 typedef VS_Output PS_Input;
 
+cbuffer Model
+{
+	float4x4 Transform;
+	int TextureLayer; // layer in the texture arrays, -1 when the material has its own textures
+};
+
 #section vertex
 
 cbuffer Camera
@@ -32,11 +38,6 @@ cbuffer Camera
 	float3 CameraPosition;
 };
 
-cbuffer Model
-{
-	float4x4 Transform;
-};
-
 VS_Output main(VS_Input input)
 {
 	VS_Output output;
@@ -69,6 +70,7 @@ struct PS_Output
 };
 
 Texture2D<float4> texDef : register(t0);
+Texture2DArray<float4> texDefArray : register(t1);
 
 StaticSampler textureSampler = StaticSampler(repeat, repeat, anisotropic, anisotropic);
 
@@ -76,7 +78,10 @@ PS_Output main(PS_Input input)
 {
 	PS_Output output;
 
-	output.color = texDef.Sample(textureSampler, input.uv);
+	if (TextureLayer >= 0)
+		output.color = texDefArray.Sample(textureSampler, float3(input.uv, TextureLayer));
+	else
+		output.color = texDef.Sample(textureSampler, input.uv);
 	if (output.color.a < 0.5)
 		discard;
 
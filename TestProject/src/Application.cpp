@@ -22,11 +22,13 @@ namespace Engine
 		while (!window->CloseRequested())
 		{
 			Time::UpdateDeltaTime();
+			RendererCommand::BeginFrame();
 			window->Update();
 
 			OnUpdate();
 
 			window->SwapBuffers();
+			RendererCommand::EndFrame();
 
 			DBOUT("FPS: " << Time::GetFPS() << std::endl);
 		}
@@ -4,14 +4,16 @@
 #include "Application.h"
 
 #include "Renderer/RendererCommand.h"
+#include "Renderer/RendererAPI.h"
+#include "Renderer/ShaderCache.h"
+#include "Renderer/CommandRecorder.h"
+#include "Util/Parallel.h"
 
-struct CameraData
-{
-	glm::mat4 view;
-	glm::mat4 viewPorjection;
-	glm::vec3 Position;
-	float padding;
-};
+// hashed at compile time, binding them is an array index instead of a string lookup
+static constexpr Engine::PropertyID s_CameraID = Engine::ShaderProperty::ID("Camera");
+static constexpr Engine::PropertyID s_ModelID = Engine::ShaderProperty::ID("Model");
+static constexpr Engine::PropertyID s_TexDefID = Engine::ShaderProperty::ID("texDef");
+static constexpr Engine::PropertyID s_TexDefArrayID = Engine::ShaderProperty::ID("texDefArray");
 
 void MainWindow::OnCreate()
 {
@@ -24,13 +26,30 @@ void MainWindow::OnCreate()
 
 	m_Shader = Engine::Shader::Create("Assets/Shaders/TestShader.hlsl");
 
-	m_Camera = Engine::Camera::Create(Engine::Camera::ProjectionType::Perspective, glm::radians(45.0f), 0.01f, 100.0f, GetAspect());
-	m_CameraBuffer = Engine::ConstantBuffer::Create(sizeof(CameraData));
+	Engine::ShaderCache::Statistics shaderStats = Engine::ShaderCache::Get().GetStatistics();
+	DBOUT("shader cache hit rate: " << shaderStats.GetHitRate() * 100.0f << "% compile time: " << shaderStats.compileMilliseconds << "ms saved: " << shaderStats.savedMilliseconds << "ms" << std::endl);
 
-	m_Model = Engine::Model::Create("Assets/Models/Sponza/Sponza.gltf");
+	m_Camera = Engine::Camera::Create(Engine::Camera::ProjectionType::Perspective, glm::radians(45.0f), 0.01f, 100.0f, GetAspect());
+	m_CameraBlock = Engine::ParameterBlock::Create(m_Shader, "Camera");
+	m_ViewID = m_CameraBlock->GetVariableID("View");
+	m_ViewProjectionID = m_CameraBlock->GetVariableID("ViewProjection");
+	m_CameraPositionID = m_CameraBlock->GetVariableID("CameraPosition");
+
+	Engine::ModelLoadOptions modelOptions;
+	modelOptions.packAtlas = true;
+	m_Model = Engine::Model::Create("Assets/Models/Sponza/Sponza.gltf", modelOptions);
 	//m_Model = Engine::Model::Create("Assets/Models/Suzanne/Suzanne.gltf");
-	m_ModelBuffer = Engine::ConstantBuffer::Create(sizeof(glm::mat4));
-	m_ModelBuffer2 = Engine::ConstantBuffer::Create(sizeof(glm::mat4));
+
+	m_RenderQueue = Engine::RenderQueue::Create();
+	Engine::RenderQueue::Bindings bindings;
+	bindings.transform = s_ModelID;
+	bindings.diffuse = s_TexDefID;
+	bindings.diffuseArray = s_TexDefArrayID;
+	m_RenderQueue->SetBindings(bindings);
+	m_RenderQueue->SetDepthRange(m_Camera->GetPerspectiveNearClip(), m_Camera->GetPerspectiveFarClip());
+
+	Engine::BufferHeap::Statistics vertexHeapStats = Engine::Mesh::GetVertexHeap().GetStatistics();
+	DBOUT("vertex heap pages: " << vertexHeapStats.pages << " meshes: " << vertexHeapStats.elements.allocations << " fragmentation: " << vertexHeapStats.elements.GetFragmentation() * 100.0f << "%" << std::endl);
 }
 
 void MainWindow::OnUpdate()
@@ -69,36 +88,51 @@ void MainWindow::OnUpdate()
 	glm::mat4 projectionMatrix = m_Camera->GetProjectionMatrix();
 	glm::mat4 viewPorjectionMatrix = projectionMatrix * viewMatrix;
 
-	CameraData camData = {};
-	camData.view = viewMatrix;
-	camData.viewPorjection = viewPorjectionMatrix;
-	camData.Position = glm::vec4(m_CameraPosition, 1);
-	m_CameraBuffer->SetData(&camData);
+	// only uploads when the camera moved
+	m_CameraBlock->Set(m_ViewID, viewMatrix);
+	m_CameraBlock->Set(m_ViewProjectionID, viewPorjectionMatrix);
+	m_CameraBlock->Set(m_CameraPositionID, m_CameraPosition);
 
 	// update model
 	const float scale = 0.2f;
 	glm::mat4 scalemat = glm::scale(glm::mat4(1.0f), { scale, scale, scale });
 
 	glm::mat4 transform = glm::translate(glm::mat4(1.0f), { 0.0f, 0.0f, 0.0f }) * scalemat;
-	m_ModelBuffer->SetData(&transform);
 
 	// render
 	Engine::RendererCommand::ClearSwapChain(m_NativeWindow.GetSwapChain(), { 1,0,0 });
 	Engine::RendererCommand::SetFrameBuffer(m_FrameBuffer);
+
+	// B prints how recording 50k draws scales with the number of command lists, the clear below hides what it drew
+	if (m_Input.GetKeyPressed('B'))
+	{
+		for (uint32_t lists = 1; lists <= Engine::Parallel::GetThreadCount(); lists *= 2)
+			DBOUT("50k draws in " << lists << " lists: " << Engine::CommandRecorder::Benchmark(m_Shader, m_Model->GetNode(0).m_Mesh, s_ModelID, 50000, lists, 5) << "ms" << std::endl);
+	}
+
 	Engine::RendererCommand::ClearRenderTarget(m_FrameBuffer->GetRenderTargets()[0], {0,1,0,1}); // clear color
 	Engine::RendererCommand::ClearRenderTarget(m_FrameBuffer->GetDepthBuffer(), {1,0,0,0}); // clear depth
-	Engine::RendererCommand::SetShader(m_Shader);
-	Engine::RendererCommand::SetConstantBuffer(m_Shader->GetBindPoint("Camera"), m_CameraBuffer);
-	Engine::RendererCommand::SetConstantBuffer(m_Shader->GetBindPoint("Model"), m_ModelBuffer);
+
+	// the queue groups the nodes by shader and material, the camera is bound for each shader it switches to
+	float depth = glm::length(glm::vec3(transform[3]) - m_CameraPosition);
 	for (uint32_t i = 0; i < m_Model->GetNumberOfNodes(); i++)
 	{
-		Engine::RendererCommand::SetTexture(m_Shader->GetBindPoint("texDef"), m_Model->GetNode(i).m_Material->m_Diffuse);
-		Engine::RendererCommand::DrawMesh(m_Model->GetNode(i).m_Mesh);
+		Engine::Model::Node& node = m_Model->GetNode(i);
+		m_RenderQueue->Submit({ m_Shader, node.m_Mesh, node.m_Material, transform }, depth);
 	}
+	// big queues are split into command lists recorded on every thread, the recording threads can only read the camera block
+	m_CameraBlock->Upload();
+	m_RenderQueue->Execute([&](const Engine::Ref<Engine::Shader>& shader) {
+		Engine::RendererCommand::SetParameterBlock(shader->GetBindPoint(s_CameraID), m_CameraBlock);
+	}, Engine::Parallel::GetThreadCount());
 
 	Engine::RendererCommand::BlitToSwapChain(m_NativeWindow.GetSwapChain(), m_FrameBuffer->GetRenderTargets()[0]);
 
 	DBOUT(Time::GetFPS());
+	DBOUT(" draws: " << Engine::RendererCommand::GetStatistics().drawCalls << " texture binds: " << Engine::RendererCommand::GetStatistics().textureBinds << " parameter bytes skipped: " << Engine::RendererCommand::GetStatistics().parameterBytesSkipped);
+	const Engine::StateCache::Statistics& stateStats = Engine::RendererAPI::Get().GetStateCache().GetStatistics();
+	DBOUT(" state calls skipped: " << stateStats.skipped << "/" << stateStats.issued + stateStats.skipped);
+	DBOUT(" command lists: " << Engine::CommandRecorder::GetStatistics().lists << std::endl);
 }
 
 void MainWindow::OnClose()
@@ -6,10 +6,12 @@
 #include "Renderer/Model.h"
 #include "Renderer/RendererCommand.h"
 #include "Renderer/Shader.h"
+#include "Renderer/ParameterBlock.h"
 #include "Renderer/Camera.h"
 #include "Renderer/Texture.h"
 #include "Renderer/RenderTarget.h"
 #include "Renderer/FrameBuffer.h"
+#include "Renderer/RenderQueue.h"
 
 
 class MainWindow : public Engine::Window
@@ -37,8 +39,10 @@ private:
 
 	Engine::Ref<Engine::Camera> m_Camera;
 	glm::vec3 m_CameraPosition = { 0.0f, 0.0f, 4.0f };
-	Engine::Ref<Engine::ConstantBuffer> m_CameraBuffer;
-	Engine::Ref<Engine::ConstantBuffer> m_ModelBuffer;
-	Engine::Ref<Engine::ConstantBuffer> m_ModelBuffer2;
+	Engine::Ref<Engine::ParameterBlock> m_CameraBlock;
+	uint32_t m_ViewID = Engine::ParameterBlock::InvalidID;
+	uint32_t m_ViewProjectionID = Engine::ParameterBlock::InvalidID;
+	uint32_t m_CameraPositionID = Engine::ParameterBlock::InvalidID;
 	Engine::Ref<Engine::FrameBuffer> m_FrameBuffer;
+	Engine::Ref<Engine::RenderQueue> m_RenderQueue;
 };
\ No newline at end of file
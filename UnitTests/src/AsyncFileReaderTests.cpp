@@ -0,0 +1,77 @@
+#include "Test.h"
+#include "Core/AsyncFileReader.h"
+
+#include <fstream>
+
+using namespace Engine;
+
+static fs::path WriteTestFile(const char* name, const std::string& contents)
+{
+	fs::path path = fs::temp_directory_path() / name;
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	file << contents;
+	return path;
+}
+
+static std::string ToString(const std::vector<uint8_t>& data)
+{
+	return std::string(data.begin(), data.end());
+}
+
+TEST(FileReaderSharesFinishedRead)
+{
+	AsyncFileReader& reader = AsyncFileReader::Get();
+	fs::path path = WriteTestFile("AsyncFileReaderShared.txt", "first");
+
+	AsyncFileReader::Handle first = reader.Read(path);
+	CHECK_EQUAL(ToString(first.Wait()), "first");
+
+	uint32_t shared = reader.GetStatistics().sharedRequests;
+	AsyncFileReader::Handle second = reader.Read(path);
+	CHECK_EQUAL(reader.GetStatistics().sharedRequests, shared + 1);
+	CHECK_EQUAL(ToString(second.Wait()), "first");
+
+	fs::remove(path);
+}
+
+TEST(FileReaderRereadsChangedFile)
+{
+	AsyncFileReader& reader = AsyncFileReader::Get();
+	fs::path path = WriteTestFile("AsyncFileReaderChanged.txt", "old");
+
+	AsyncFileReader::Handle first = reader.Read(path);
+	CHECK_EQUAL(ToString(first.Wait()), "old");
+
+	// the first handle keeps the request alive, a new write time has to make the next read go to the disk
+	WriteTestFile("AsyncFileReaderChanged.txt", "new contents");
+	fs::last_write_time(path, fs::last_write_time(path) + std::chrono::seconds(2));
+
+	AsyncFileReader::Handle second = reader.Read(path);
+	CHECK_EQUAL(ToString(second.Wait()), "new contents");
+	CHECK_EQUAL(ToString(first.Wait()), "old");
+
+	fs::remove(path);
+}
+
+TEST(FileReaderDoesNotJoinCancelledRead)
+{
+	AsyncFileReader& reader = AsyncFileReader::Get();
+	fs::path path = WriteTestFile("AsyncFileReaderCancelled.txt", "data");
+
+	AsyncFileReader::Handle cancelled = reader.Read(path, AsyncFileReader::Priority::Low);
+	cancelled.Cancel();
+
+	AsyncFileReader::Handle fresh = reader.Read(path);
+	CHECK_EQUAL(ToString(fresh.Wait()), "data");
+	cancelled.Wait();
+	CHECK(cancelled.GetState() == AsyncFileReader::State::Cancelled || cancelled.GetState() == AsyncFileReader::State::Done);
+
+	fs::remove(path);
+}
+
+TEST(FileReaderMissingFile)
+{
+	AsyncFileReader::Handle handle = AsyncFileReader::Get().Read(fs::temp_directory_path() / "AsyncFileReaderMissing.txt");
+	CHECK(handle.Wait().empty());
+	CHECK(handle.GetState() == AsyncFileReader::State::Failed);
+}
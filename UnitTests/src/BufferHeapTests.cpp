@@ -0,0 +1,234 @@
+#include "Test.h"
+#include "Renderer/BufferHeap.h"
+
+#include <random>
+
+using namespace Engine;
+
+// ------------------------------------- Range Allocator ------------------------------------- //
+
+TEST(RangeAllocatorMergesFreedBlocks)
+{
+	RangeAllocator allocator(100);
+	RangeAllocator::Allocation a, b, c;
+	CHECK(allocator.Allocate(10, a));
+	CHECK(allocator.Allocate(20, b));
+	CHECK(allocator.Allocate(30, c));
+	CHECK_EQUAL(a.offset, 0u);
+	CHECK_EQUAL(b.offset, 10u);
+	CHECK_EQUAL(c.offset, 30u);
+	CHECK_EQUAL(allocator.GetStatistics().used, 60u);
+
+	// a hole in the middle, then both sides of it
+	allocator.Free(b);
+	CHECK(!b.IsValid());
+	CHECK_EQUAL(allocator.GetStatistics().freeBlocks, 2u);
+	allocator.Free(a);
+	CHECK_EQUAL(allocator.GetStatistics().freeBlocks, 2u);
+	CHECK_EQUAL(allocator.GetStatistics().largestFreeBlock, 40u);
+	allocator.Free(c);
+
+	RangeAllocator::Statistics stats = allocator.GetStatistics();
+	CHECK(allocator.IsEmpty());
+	CHECK_EQUAL(stats.freeBlocks, 1u);
+	CHECK_EQUAL(stats.largestFreeBlock, 100u);
+	CHECK_EQUAL(stats.GetFragmentation(), 0.0f);
+
+	// the whole range again
+	RangeAllocator::Allocation all;
+	CHECK(allocator.Allocate(100, all));
+	CHECK_EQUAL(all.offset, 0u);
+}
+
+TEST(RangeAllocatorFailsWhenNothingFits)
+{
+	RangeAllocator allocator(64);
+	RangeAllocator::Allocation allocations[4];
+	for (RangeAllocator::Allocation& allocation : allocations)
+		CHECK(allocator.Allocate(16, allocation));
+
+	// 32 free but split in two
+	allocator.Free(allocations[0]);
+	allocator.Free(allocations[2]);
+	RangeAllocator::Allocation big;
+	CHECK(!allocator.Allocate(32, big));
+	CHECK(!big.IsValid());
+	CHECK_EQUAL(allocator.GetStatistics().GetFragmentation(), 0.5f);
+
+	CHECK(!allocator.Allocate(0, big));
+	CHECK(!allocator.Allocate(65, big));
+	CHECK(allocator.Allocate(16, big));
+
+	RangeAllocator empty(0);
+	CHECK(!empty.Allocate(1, big));
+}
+
+TEST(RangeAllocatorRandomNeverOverlaps)
+{
+	// checks every allocation against a map of which elements are taken
+	const uint32_t capacity = 4096;
+	RangeAllocator allocator(capacity);
+	std::vector<bool> taken(capacity, false);
+	std::vector<RangeAllocator::Allocation> live;
+	std::mt19937 random(350);
+
+	uint32_t used = 0, failed = 0;
+	for (uint32_t i = 0; i < 20000; i++)
+	{
+		if (live.empty() || random() % 3 != 0)
+		{
+			uint32_t size = 1 + random() % 100;
+			RangeAllocator::Allocation allocation;
+			if (!allocator.Allocate(size, allocation))
+			{
+				failed++;
+				continue;
+			}
+
+			CHECK_EQUAL(allocation.size, size);
+			CHECK(allocation.offset + size <= capacity);
+			for (uint32_t e = allocation.offset; e < allocation.offset + size && e < capacity; e++)
+			{
+				CHECK(!taken[e]);
+				taken[e] = true;
+			}
+			used += size;
+			live.push_back(allocation);
+		}
+		else
+		{
+			size_t index = random() % live.size();
+			RangeAllocator::Allocation allocation = live[index];
+			live[index] = live.back();
+			live.pop_back();
+
+			for (uint32_t e = allocation.offset; e < allocation.offset + allocation.size; e++)
+				taken[e] = false;
+			used -= allocation.size;
+			allocator.Free(allocation);
+		}
+		CHECK_EQUAL(allocator.GetStatistics().used, used);
+	}
+	CHECK(failed > 0); // it did fill up
+
+	for (RangeAllocator::Allocation& allocation : live)
+		allocator.Free(allocation);
+	CHECK(allocator.IsEmpty());
+	CHECK_EQUAL(allocator.GetStatistics().largestFreeBlock, capacity);
+}
+
+// ------------------------------------- Range Heap ------------------------------------- //
+
+TEST(RangeHeapAddsAndReleasesPages)
+{
+	RangeHeap heap(100);
+	bool newPage;
+	uint32_t a = heap.Allocate(60, &newPage);
+	CHECK(newPage);
+	uint32_t b = heap.Allocate(60, &newPage);
+	CHECK(newPage);
+	uint32_t c = heap.Allocate(30, &newPage);
+	CHECK(!newPage);
+	CHECK_EQUAL(heap.GetRange(a).page, 0u);
+	CHECK_EQUAL(heap.GetRange(b).page, 1u);
+	CHECK_EQUAL(heap.GetRange(c).page, 0u);
+	CHECK_EQUAL(heap.GetRange(c).offset, 60u);
+
+	// too big for a page, it gets its own
+	uint32_t big = heap.Allocate(250, &newPage);
+	CHECK(newPage);
+	CHECK_EQUAL(heap.GetPageCapacity(heap.GetRange(big).page), 250u);
+	CHECK_EQUAL(heap.GetStatistics().pages, 3u);
+
+	CHECK(heap.Free(big));
+	CHECK(heap.Free(b));
+	CHECK(!heap.Free(a));
+	CHECK(!heap.Free(c)); // the first page stays
+	CHECK(!heap.Free(c));
+	CHECK_EQUAL(heap.GetStatistics().pages, 1u);
+	CHECK_EQUAL(heap.GetStatistics().elements.used, 0u);
+
+	// the released slots are reused
+	heap.Allocate(150, &newPage);
+	CHECK(newPage);
+	CHECK_EQUAL(heap.GetPageCount(), 3u);
+	CHECK(heap.Allocate(0) == RangeHeap::InvalidHandle);
+}
+
+TEST(RangeHeapCompactEmptiesSparsePage)
+{
+	RangeHeap heap(100);
+	std::vector<uint32_t> first, second;
+	for (uint32_t i = 0; i < 10; i++)
+		first.push_back(heap.Allocate(10));
+	for (uint32_t i = 0; i < 10; i++)
+		second.push_back(heap.Allocate(10));
+	CHECK_EQUAL(heap.GetRange(second[0]).page, 1u);
+
+	// nothing is sparse enough to move yet
+	std::vector<RangeHeap::Move> moves;
+	std::vector<uint32_t> released;
+	CHECK_EQUAL(heap.Compact(1000, moves, released), 0u);
+	CHECK(moves.empty());
+
+	for (uint32_t i = 0; i < 7; i++)
+		heap.Free(first[i]);
+	for (uint32_t i = 0; i < 7; i++)
+		heap.Free(second[i]);
+
+	// page 1 is 30% used and page 0 has room for all of it
+	CHECK_EQUAL(heap.Compact(1000, moves, released), 30u);
+	CHECK_EQUAL(moves.size(), 3u);
+	CHECK_EQUAL(released.size(), 1u);
+	CHECK_EQUAL(heap.GetStatistics().pages, 1u);
+	for (const RangeHeap::Move& move : moves)
+	{
+		CHECK_EQUAL(move.from.page, 1u);
+		CHECK_EQUAL(move.to.page, 0u);
+		CHECK_EQUAL(move.to.size, move.from.size);
+
+		// the handle now points at the new place
+		RangeHeap::Range range = heap.GetRange(move.handle);
+		CHECK_EQUAL(range.page, 0u);
+		CHECK_EQUAL(range.offset, move.to.offset);
+	}
+	for (uint32_t i = 7; i < 10; i++)
+		CHECK_EQUAL(heap.GetRange(second[i]).page, 0u);
+	CHECK_EQUAL(heap.GetStatistics().elements.used, 60u);
+}
+
+TEST(RangeHeapCompactKeepsToBudget)
+{
+	RangeHeap heap(100);
+	uint32_t fill = heap.Allocate(100);
+	uint32_t big = heap.Allocate(40);
+	uint32_t small[3];
+	for (uint32_t& handle : small)
+		handle = heap.Allocate(3);
+	heap.Free(fill);
+	fill = heap.Allocate(80);
+	CHECK_EQUAL(heap.GetRange(fill).page, 0u);
+	CHECK_EQUAL(heap.GetRange(big).page, 1u);
+
+	// page 1 is 49% used, the big range does not fit in page 0 so the small ones after it go first
+	std::vector<RangeHeap::Move> moves;
+	std::vector<uint32_t> released;
+	CHECK_EQUAL(heap.Compact(3, moves, released), 3u);
+	CHECK_EQUAL(moves.size(), 1u);
+	CHECK_EQUAL(heap.GetRange(small[0]).page, 0u);
+	CHECK_EQUAL(heap.GetRange(small[1]).page, 1u);
+
+	CHECK_EQUAL(heap.Compact(100, moves, released), 6u);
+	CHECK_EQUAL(moves.size(), 3u);
+	CHECK(released.empty());
+	CHECK_EQUAL(heap.GetRange(big).page, 1u);
+
+	// with room in the first page the rest moves and the page goes
+	heap.Free(fill);
+	CHECK_EQUAL(heap.Compact(100, moves, released), 40u);
+	CHECK_EQUAL(heap.GetRange(big).page, 0u);
+	CHECK_EQUAL(released.size(), 1u);
+	CHECK_EQUAL(heap.GetStatistics().pages, 1u);
+	CHECK_EQUAL(heap.GetStatistics().elements.used, 49u);
+	CHECK_EQUAL(heap.Compact(100, moves, released), 0u);
+}
@@ -0,0 +1,66 @@
+#include "Test.h"
+#include "Util/HalfFloat.h"
+#include "Util/Parallel.h"
+
+#include <string.h>
+#include <limits>
+
+using namespace Engine;
+
+static float FromBits(uint32_t bits)
+{
+	float value;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+TEST(HalfFromFloat)
+{
+	CHECK_EQUAL(HalfFloat::FromFloat(0.0f), 0x0000);
+	CHECK_EQUAL(HalfFloat::FromFloat(-0.0f), 0x8000);
+	CHECK_EQUAL(HalfFloat::FromFloat(1.0f), 0x3c00);
+	CHECK_EQUAL(HalfFloat::FromFloat(-2.0f), 0xc000);
+	CHECK_EQUAL(HalfFloat::FromFloat(65504.0f), 0x7bff); // largest half
+	CHECK_EQUAL(HalfFloat::FromFloat(65520.0f), 0x7c00); // rounds up to inf
+	CHECK_EQUAL(HalfFloat::FromFloat(std::numeric_limits<float>::infinity()), 0x7c00);
+	CHECK_EQUAL(HalfFloat::FromFloat(std::numeric_limits<float>::quiet_NaN()), 0x7e00);
+	CHECK_EQUAL(HalfFloat::FromFloat(FromBits(0x33800000)), 0x0001); // 2^-24, smallest denormal
+	CHECK_EQUAL(HalfFloat::FromFloat(FromBits(0x33000000)), 0x0000); // half of it rounds to even
+	CHECK_EQUAL(HalfFloat::FromFloat(1.0f + 1.0f / 2048.0f), 0x3c00); // tie rounds to even
+	CHECK_EQUAL(HalfFloat::FromFloat(1.0f + 3.0f / 2048.0f), 0x3c02);
+}
+
+TEST(HalfConvertToRGBA)
+{
+	// big enough to be split into chunks, with an odd count so the last pixel misses the simd loop
+	const size_t pixels = 512 * 1024 + 1;
+	for (uint32_t channels = 1; channels <= 4; channels++)
+	{
+		std::vector<float> src(pixels * channels);
+		for (size_t i = 0; i < src.size(); i++)
+			src[i] = (float)(i % 4099) * 0.37f - 500.0f;
+
+		std::vector<uint16_t> dst(pixels * 4, 0xffff);
+		HalfFloat::ConvertToRGBA(src.data(), channels, dst.data(), pixels);
+
+		size_t mismatches = 0;
+		for (size_t i = 0; i < pixels; i++)
+		{
+			for (uint32_t c = 0; c < 4; c++)
+			{
+				uint16_t expected = c < channels ? HalfFloat::FromFloat(src[i * channels + c]) : (c == 3 ? 0x3c00 : 0);
+				if (dst[i * 4 + c] != expected)
+					mismatches++;
+			}
+		}
+		CHECK_EQUAL(mismatches, 0u);
+	}
+}
+
+BENCHMARK(HalfConvertBenchmark)
+{
+	std::cout << "  f16c: " << (HalfFloat::HasF16C() ? "yes" : "no") << std::endl;
+	std::cout << "  threads: " << Parallel::GetThreadCount() << std::endl;
+	for (uint32_t channels = 3; channels <= 4; channels++)
+		std::cout << "  4096x2048 " << channels << " channels: " << HalfFloat::Benchmark(4096 * 2048, channels, 10) << "ms" << std::endl;
+}
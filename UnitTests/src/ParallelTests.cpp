@@ -0,0 +1,28 @@
+#include "Test.h"
+#include "Util/Parallel.h"
+
+#include <atomic>
+#include <vector>
+
+using namespace Engine;
+
+TEST(ParallelForVisitsEveryIndexOnce)
+{
+	// run it a few times so the pool is woken more than once
+	for (uint32_t run = 0; run < 8; run++)
+	{
+		std::vector<std::atomic<uint32_t>> hits(1000);
+		Parallel::For((uint32_t)hits.size(), [&](uint32_t i) { hits[i]++; });
+		for (std::atomic<uint32_t>& hit : hits)
+			CHECK_EQUAL(hit.load(), 1u);
+	}
+}
+
+TEST(ParallelForNestedRunsInline)
+{
+	std::atomic<uint32_t> total = 0;
+	Parallel::For(16, [&](uint32_t) {
+		Parallel::For(16, [&](uint32_t i) { total += i; });
+	});
+	CHECK_EQUAL(total.load(), 16u * 120u);
+}
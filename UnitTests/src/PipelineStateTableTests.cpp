@@ -0,0 +1,101 @@
+#include "Test.h"
+#include "Renderer/PipelineStateTable.h"
+
+#include <string.h>
+
+using namespace Engine;
+
+static D3D11_SAMPLER_DESC MakeSampler()
+{
+	D3D11_SAMPLER_DESC desc = {};
+	desc.Filter = D3D11_FILTER_ANISOTROPIC;
+	desc.AddressU = D3D11_TEXTURE_ADDRESS_WRAP;
+	desc.AddressV = D3D11_TEXTURE_ADDRESS_CLAMP;
+	desc.AddressW = D3D11_TEXTURE_ADDRESS_WRAP;
+	desc.MaxAnisotropy = 8;
+	desc.MaxLOD = D3D11_FLOAT32_MAX;
+	return desc;
+}
+
+TEST(StateTableDedupsSameDesc)
+{
+	PipelineStateTable<D3D11_SAMPLER_DESC> table;
+	bool added = false;
+	PipelineStateTable<D3D11_SAMPLER_DESC>::StateID first = table.GetID(MakeSampler(), &added);
+	CHECK(added);
+	CHECK(first != PipelineStateTable<D3D11_SAMPLER_DESC>::InvalidID);
+
+	PipelineStateTable<D3D11_SAMPLER_DESC>::StateID second = table.GetID(MakeSampler(), &added);
+	CHECK(!added);
+	CHECK_EQUAL(first, second);
+	CHECK_EQUAL(table.GetCount(), 1u);
+
+	D3D11_SAMPLER_DESC other = MakeSampler();
+	other.MaxAnisotropy = 4;
+	CHECK(table.GetID(other) != first);
+	CHECK_EQUAL(table.GetCount(), 2u);
+
+	const D3D11_SAMPLER_DESC* desc = table.GetDesc(first);
+	CHECK(desc != nullptr && desc->MaxAnisotropy == 8);
+	CHECK(table.GetDesc(PipelineStateTable<D3D11_SAMPLER_DESC>::InvalidID) == nullptr);
+	CHECK(table.GetDesc(3) == nullptr);
+}
+
+TEST(StateTableIgnoresPadding)
+{
+	// the same fields over different garbage in the padding
+	D3D11_DEPTH_STENCIL_DESC a, b;
+	memset(&a, 0x00, sizeof(a));
+	memset(&b, 0xcd, sizeof(b));
+	for (D3D11_DEPTH_STENCIL_DESC* desc : { &a, &b })
+	{
+		desc->DepthEnable = TRUE;
+		desc->DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ALL;
+		desc->DepthFunc = D3D11_COMPARISON_LESS;
+		desc->StencilEnable = FALSE;
+		desc->StencilReadMask = 0xff;
+		desc->StencilWriteMask = 0xff;
+		desc->FrontFace = { D3D11_STENCIL_OP_KEEP, D3D11_STENCIL_OP_KEEP, D3D11_STENCIL_OP_KEEP, D3D11_COMPARISON_ALWAYS };
+		desc->BackFace = desc->FrontFace;
+	}
+
+	CHECK_EQUAL(PipelineStateTable<D3D11_DEPTH_STENCIL_DESC>::Hash(a), PipelineStateTable<D3D11_DEPTH_STENCIL_DESC>::Hash(b));
+	PipelineStateTable<D3D11_DEPTH_STENCIL_DESC> table;
+	CHECK_EQUAL(table.GetID(a), table.GetID(b));
+
+	b.DepthFunc = D3D11_COMPARISON_LESS_EQUAL;
+	CHECK(PipelineStateTable<D3D11_DEPTH_STENCIL_DESC>::Hash(a) != PipelineStateTable<D3D11_DEPTH_STENCIL_DESC>::Hash(b));
+	CHECK(table.GetID(a) != table.GetID(b));
+}
+
+TEST(StateTableEveryFieldCounts)
+{
+	PipelineStateTable<D3D11_RASTERIZER_DESC> table;
+	D3D11_RASTERIZER_DESC base = {};
+	base.FillMode = D3D11_FILL_SOLID;
+	base.CullMode = D3D11_CULL_BACK;
+	table.GetID(base);
+
+	// changing any one field gives a new state
+	D3D11_RASTERIZER_DESC changed[10];
+	for (D3D11_RASTERIZER_DESC& desc : changed)
+		desc = base;
+	changed[0].FillMode = D3D11_FILL_WIREFRAME;
+	changed[1].CullMode = D3D11_CULL_NONE;
+	changed[2].FrontCounterClockwise = TRUE;
+	changed[3].DepthBias = 1;
+	changed[4].DepthBiasClamp = 0.5f;
+	changed[5].SlopeScaledDepthBias = 1.0f;
+	changed[6].DepthClipEnable = TRUE;
+	changed[7].ScissorEnable = TRUE;
+	changed[8].MultisampleEnable = TRUE;
+	changed[9].AntialiasedLineEnable = TRUE;
+	for (const D3D11_RASTERIZER_DESC& desc : changed)
+		table.GetID(desc);
+	CHECK_EQUAL(table.GetCount(), 11u);
+
+	// and asking again finds them all
+	for (const D3D11_RASTERIZER_DESC& desc : changed)
+		table.GetID(desc);
+	CHECK_EQUAL(table.GetCount(), 11u);
+}
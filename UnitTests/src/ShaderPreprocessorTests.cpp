@@ -0,0 +1,222 @@
+#include "Test.h"
+#include "Renderer/ShaderPreprocessor.h"
+
+#include <sstream>
+#include <map>
+
+using namespace Engine;
+
+// ------------------------------------- Reference ------------------------------------- //
+
+// the tokenizer ShaderCompiler used before the preprocessor, kept here to check the new one against
+static std::vector<std::string> ReferenceTokenize(const std::string& line)
+{
+	const char delimiters[] = { ' ', '\t', '\r', '\n' };
+	const char reservedTokens[] = { "={};\"()," };
+
+	std::vector<std::string> tokens;
+
+	bool lastCharReserved = false;
+	std::string token;
+	for (const char& c : line)
+	{
+		bool endToken = false;
+		bool delimiter = false;
+		for (char d : delimiters)
+		{
+			if (c == d)
+			{
+				endToken = true;
+				delimiter = true;
+				break;
+			}
+		}
+
+		bool reserved = false;
+		for (uint32_t i = 0; i < sizeof(reservedTokens) - 1; i++)
+		{
+			if (c == reservedTokens[i])
+			{
+				reserved = true;
+				break;
+			}
+		}
+
+		if (reserved && lastCharReserved && !endToken)
+			endToken = true;
+
+		if (lastCharReserved != reserved)
+			endToken = true;
+
+		if (endToken)
+		{
+			if (!token.empty())
+			{
+				tokens.push_back(token);
+				token.clear();
+			}
+			if (!delimiter)
+				token.push_back(c);
+			lastCharReserved = reserved;
+		}
+		else
+			token.push_back(c);
+	}
+
+	if (!token.empty())
+		tokens.push_back(token);
+
+	return tokens;
+}
+
+struct ReferenceSection
+{
+	std::stringstream src;
+	std::map<std::string, std::vector<std::string>> samplers; // name to U, V, Min, Mag
+};
+
+// the old getline loop from ShaderCompiler::Compile
+static void ReferenceProcess(const std::string& src, std::map<std::string, ReferenceSection>& sections)
+{
+	std::stringstream srcStream(src);
+	ReferenceSection* current = &sections["config"];
+
+	std::string line;
+	while (getline(srcStream, line))
+	{
+		std::vector<std::string> tokens = ReferenceTokenize(line);
+		if (tokens.empty())
+			continue;
+
+		if (tokens[0] == "#section")
+			current = &sections[tokens[1]];
+		else if (tokens[0] == "#pragma" && current == &sections["config"])
+			continue;
+		else if (tokens[0] == "StaticSampler")
+		{
+			current->samplers[tokens[1]] = { tokens[5], tokens[7], tokens[9], tokens[11] };
+			current->src << "SamplerState " << tokens[1] << ";\n";
+		}
+		else
+			current->src << line << '\n';
+	}
+}
+
+// the new sections start with #line and keep blank lines, the old ones did neither
+static std::string StripLines(const std::string& src)
+{
+	std::stringstream in(src);
+	std::string line, out;
+	while (getline(in, line))
+	{
+		if (line.rfind("#line", 0) == 0 || line.find_first_not_of(" \t\r") == std::string::npos)
+			continue;
+		out += line + "\n";
+	}
+	return out;
+}
+
+static const char* WrapModeName(ShaderCompiler::SamplerInfo::WrapMode mode)
+{
+	switch (mode)
+	{
+	case ShaderCompiler::SamplerInfo::WrapMode::Repeat: return "repeat";
+	case ShaderCompiler::SamplerInfo::WrapMode::MirroredRepeat: return "repeatMiror";
+	default: return "clamp";
+	}
+}
+
+static const char* FilterName(ShaderCompiler::SamplerInfo::MinMagFilter filter)
+{
+	switch (filter)
+	{
+	case ShaderCompiler::SamplerInfo::MinMagFilter::Point: return "point";
+	case ShaderCompiler::SamplerInfo::MinMagFilter::Anisotropic: return "anisotropic";
+	default: return "linear";
+	}
+}
+
+// ------------------------------------- Preprocessor ------------------------------------- //
+
+static const char* s_Shader =
+	"#pragma multi_compile SHADOWS _\n"
+	"#pragma preload SHADOWS\n"
+	"\n"
+	"#section common\n"
+	"cbuffer Transform\n"
+	"{\n"
+	"\tfloat4x4 Model;\n"
+	"};\n"
+	"#section vertex\n"
+	"  #define SCALE 2\n"
+	"StaticSampler vertexSampler = StaticSampler(clamp, repeat, point, linear);\n"
+	"float4 main(float3 pos : POSITION) : SV_POSITION { return mul(float4(pos * SCALE, 1), Model); }\n"
+	"#section pixel\n"
+	"\tStaticSampler  textureSampler=StaticSampler(repeatMiror,clamp,anisotropic,point);\n"
+	"Texture2D tex;\n"
+	"\n"
+	"Shadows shadow; // a line starting with S that is not a sampler\n"
+	"#ifdef SHADOWS\n"
+	"float4 main(float2 uv : UV) : SV_TARGET { return tex.Sample(textureSampler, uv); }\n"
+	"#endif\n"
+	"#section common\n"
+	"static const float pi = 3.14159f;\n"
+	"StaticSampler commonSampler = StaticSampler(repeat, repeat, linear, linear);\n";
+
+TEST(ShaderPreprocessorMatchesTokenize)
+{
+	std::map<std::string, ReferenceSection> reference;
+	ReferenceProcess(s_Shader, reference);
+
+	// run twice so the second run goes through the reused buffers
+	ShaderPreprocessor preprocessor;
+	for (uint32_t run = 0; run < 2; run++)
+	{
+		ShaderCompiler::ShaderConfig config;
+		preprocessor.Process(s_Shader, config);
+		CHECK_EQUAL(config.keywords.size(), 1u);
+		CHECK_EQUAL(config.preloadVariants.size(), 1u);
+
+		for (auto& [name, expected] : reference)
+		{
+			const ShaderPreprocessor::Section* section = preprocessor.GetSection(name);
+			CHECK(section != nullptr);
+			if (section == nullptr)
+				continue;
+
+			CHECK_EQUAL(StripLines(section->source), StripLines(expected.src.str()));
+
+			CHECK_EQUAL(section->samplers.size(), expected.samplers.size());
+			for (const ShaderCompiler::SamplerInfo& sampler : section->samplers)
+			{
+				auto it = expected.samplers.find(sampler.bindInfo.name);
+				CHECK(it != expected.samplers.end());
+				if (it == expected.samplers.end())
+					continue;
+
+				std::vector<std::string> settings = { WrapModeName(sampler.U), WrapModeName(sampler.V), FilterName(sampler.Min), FilterName(sampler.Mag) };
+				CHECK(settings == it->second);
+			}
+		}
+		CHECK(preprocessor.GetSection("geometry") == nullptr);
+	}
+}
+
+TEST(ShaderPreprocessorLineNumbers)
+{
+	ShaderPreprocessor preprocessor;
+	ShaderCompiler::ShaderConfig config;
+	preprocessor.Process(s_Shader, config);
+
+	// a section picks up on the line after its #section, a repeated one adds another #line
+	CHECK_EQUAL(preprocessor.GetSection("vertex")->source.rfind("#line 10\n", 0), 0u);
+	const std::string& common = preprocessor.GetSection("common")->source;
+	CHECK_EQUAL(common.rfind("#line 5\n", 0), 0u);
+	CHECK(common.find("#line 22\n") != std::string::npos);
+}
+
+BENCHMARK(ShaderPreprocessorBenchmark)
+{
+	std::cout << "  1k lines: " << ShaderPreprocessor::Benchmark(1000, 2000) << " MB/s" << std::endl;
+	std::cout << "  100k lines: " << ShaderPreprocessor::Benchmark(100000, 20) << " MB/s" << std::endl;
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <vector>
+#include <iostream>
+
+// cpu only tests for the parts of the engine that do not need a device
+// a test is a function registered with TEST, CHECK reports the failure and keeps going
+// benchmarks are registered with BENCHMARK and only run when the tests are started with --benchmark
+namespace Test
+{
+	struct Case
+	{
+		const char* name;
+		void(*func)();
+	};
+
+	inline std::vector<Case>& GetCases() { static std::vector<Case> cases; return cases; }
+	inline std::vector<Case>& GetBenchmarks() { static std::vector<Case> benchmarks; return benchmarks; }
+	inline int& GetFailures() { static int failures = 0; return failures; }
+
+	struct Register
+	{
+		Register(std::vector<Case>& cases, const char* name, void(*func)()) { cases.push_back({ name, func }); }
+	};
+}
+
+#define TEST(name) \
+	static void name(); \
+	static Test::Register name##_register(Test::GetCases(), #name, name); \
+	static void name()
+
+#define BENCHMARK(name) \
+	static void name(); \
+	static Test::Register name##_register(Test::GetBenchmarks(), #name, name); \
+	static void name()
+
+#define CHECK(x) \
+	do { if (!(x)) { Test::GetFailures()++; std::cout << "  " << __FILE__ << "(" << __LINE__ << "): CHECK(" #x ") failed" << std::endl; } } while (0)
+
+#define CHECK_EQUAL(a, b) CHECK((a) == (b))
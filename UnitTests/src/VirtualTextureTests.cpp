@@ -0,0 +1,222 @@
+#include "Test.h"
+#include "Renderer/VirtualTexture.h"
+
+using namespace Engine;
+
+// ------------------------------------- Virtual Page Table ------------------------------------- //
+
+TEST(PageTableMipChain)
+{
+	VirtualPageTable table(16, 8);
+	CHECK_EQUAL(table.GetMipCount(), 5u); // 16x8, 8x4, 4x2, 2x1, 1x1
+	CHECK_EQUAL(table.GetPagesX(3), 2u);
+	CHECK_EQUAL(table.GetPagesY(3), 1u);
+	CHECK_EQUAL(table.GetPagesX(4), 1u);
+
+	CHECK(table.IsValid(VirtualPageID(15, 7, 0)));
+	CHECK(!table.IsValid(VirtualPageID(16, 0, 0)));
+	CHECK(!table.IsValid(VirtualPageID(0, 0, 5)));
+	CHECK(!table.IsValid(VirtualPageID()));
+}
+
+TEST(PageTableFindResident)
+{
+	VirtualPageTable table(16, 8);
+	CHECK(!table.FindResident(VirtualPageID(3, 2, 0)).IsValid());
+
+	table.Map(VirtualPageID(0, 0, 4), 0);
+	CHECK(table.FindResident(VirtualPageID(3, 2, 0)) == VirtualPageID(0, 0, 4));
+
+	table.Map(VirtualPageID(1, 1, 1), 1);
+	CHECK(table.FindResident(VirtualPageID(3, 2, 0)) == VirtualPageID(1, 1, 1));
+	CHECK(table.FindResident(VirtualPageID(4, 2, 0)) == VirtualPageID(0, 0, 4)); // a different parent
+
+	table.Unmap(VirtualPageID(1, 1, 1));
+	CHECK(!table.IsResident(VirtualPageID(1, 1, 1)));
+	CHECK(table.FindResident(VirtualPageID(3, 2, 0)) == VirtualPageID(0, 0, 4));
+}
+
+TEST(PageTableIndirection)
+{
+	VirtualPageTable table(16, 8);
+	table.Map(VirtualPageID(0, 0, 4), 5);
+	table.Map(VirtualPageID(1, 1, 1), 2);
+
+	std::vector<uint32_t> texels;
+	table.BuildIndirection(0, 4, texels);
+	CHECK_EQUAL(texels.size(), 16u * 8u);
+
+	// slot 5 in a cache 4 slots wide is x 1 y 1
+	uint32_t root = 1 | (1 << 8) | (4 << 16) | (0xffu << 24);
+	uint32_t page = 2 | (0 << 8) | (1 << 16) | (0xffu << 24);
+	CHECK_EQUAL(texels[0], root);
+	CHECK_EQUAL(texels[2 * 16 + 2], page);
+	CHECK_EQUAL(texels[3 * 16 + 3], page);
+	CHECK_EQUAL(texels[3 * 16 + 4], root);
+
+	VirtualPageTable empty(4, 4);
+	empty.BuildIndirection(1, 4, texels);
+	CHECK_EQUAL(texels.size(), 4u);
+	CHECK_EQUAL(texels[0], 0u);
+}
+
+// ------------------------------------- Virtual Page Cache ------------------------------------- //
+
+TEST(PageCacheEvictsLeastRecentlyUsed)
+{
+	VirtualPageCache cache(3);
+	uint32_t slots[3];
+	VirtualPageID evicted;
+	for (uint32_t i = 0; i < 3; i++)
+	{
+		CHECK(cache.Allocate(VirtualPageID(i, 0, 0), 1, slots[i], evicted));
+		CHECK(!evicted.IsValid());
+	}
+	CHECK_EQUAL(cache.GetUsedSlots(), 3u);
+
+	// everything was used this frame
+	uint32_t slot;
+	CHECK(!cache.Allocate(VirtualPageID(3, 0, 0), 1, slot, evicted));
+
+	cache.Touch(slots[0], 2);
+	CHECK(cache.Allocate(VirtualPageID(3, 0, 0), 2, slot, evicted));
+	CHECK(evicted == VirtualPageID(1, 0, 0));
+	CHECK_EQUAL(slot, slots[1]);
+	CHECK(cache.GetPage(slot) == VirtualPageID(3, 0, 0));
+
+	CHECK(cache.Allocate(VirtualPageID(4, 0, 0), 3, slot, evicted));
+	CHECK(evicted == VirtualPageID(2, 0, 0));
+	CHECK_EQUAL(cache.GetUsedSlots(), 3u);
+}
+
+TEST(PageCacheLockAndFree)
+{
+	VirtualPageCache cache(2);
+	uint32_t locked, other, slot;
+	VirtualPageID evicted;
+	CHECK(cache.Allocate(VirtualPageID(0, 0, 1), 1, locked, evicted));
+	cache.Lock(locked);
+	CHECK(cache.Allocate(VirtualPageID(0, 0, 0), 1, other, evicted));
+
+	// the locked slot is never handed out even when it is the oldest
+	for (uint64_t frame = 2; frame < 6; frame++)
+	{
+		CHECK(cache.Allocate(VirtualPageID((uint32_t)frame, 0, 0), frame, slot, evicted));
+		CHECK_EQUAL(slot, other);
+	}
+
+	cache.Free(other);
+	CHECK_EQUAL(cache.GetUsedSlots(), 1u);
+	CHECK(!cache.GetPage(other).IsValid());
+	CHECK(cache.Allocate(VirtualPageID(9, 0, 0), 6, slot, evicted));
+	CHECK_EQUAL(slot, other);
+	CHECK(!evicted.IsValid());
+
+	// every other slot is locked or in use this frame
+	CHECK(!cache.Allocate(VirtualPageID(10, 0, 0), 6, slot, evicted));
+}
+
+// ------------------------------------- Virtual Texture Feedback ------------------------------------- //
+
+static void AddFeedback(std::vector<uint32_t>& feedback, VirtualPageID page, uint32_t count)
+{
+	feedback.insert(feedback.end(), count, page.id);
+}
+
+TEST(FeedbackRequestsCoarsestMissingPage)
+{
+	VirtualPageTable table(16, 8);
+	table.Map(VirtualPageID(0, 0, 4), 0);
+
+	std::vector<uint32_t> feedback;
+	AddFeedback(feedback, VirtualPageID(3, 2, 0), 100);
+	AddFeedback(feedback, VirtualPageID(15, 7, 0), 10);
+	feedback.insert(feedback.end(), 50, UINT32_MAX); // the clear value
+	AddFeedback(feedback, VirtualPageID(20, 0, 0), 5); // outside the texture
+	AddFeedback(feedback, VirtualPageID(0, 0, 9), 5); // past the last mip
+
+	VirtualTextureFeedback analysis;
+	analysis.Analyze(feedback.data(), feedback.size(), table);
+	CHECK_EQUAL(analysis.GetUniquePageCount(), 2u);
+
+	// both fall back to the root so the mip below it is loaded first, the one covering more texels goes first
+	const std::vector<VirtualTextureFeedback::Request>& requests = analysis.GetRequests();
+	CHECK_EQUAL(requests.size(), 2u);
+	if (requests.size() == 2)
+	{
+		CHECK(requests[0].page == VirtualPageID(0, 0, 3));
+		CHECK_EQUAL(requests[0].count, 100u);
+		CHECK(requests[1].page == VirtualPageID(1, 0, 3));
+		CHECK(requests[0].priority > requests[1].priority);
+	}
+
+	CHECK_EQUAL(analysis.GetVisiblePages().size(), 1u);
+	if (!analysis.GetVisiblePages().empty())
+		CHECK(analysis.GetVisiblePages()[0] == VirtualPageID(0, 0, 4));
+}
+
+TEST(FeedbackMergesSharedAncestors)
+{
+	VirtualPageTable table(16, 8);
+	table.Map(VirtualPageID(0, 0, 4), 0);
+	table.Map(VirtualPageID(0, 0, 3), 1);
+
+	std::vector<uint32_t> feedback;
+	AddFeedback(feedback, VirtualPageID(2, 2, 0), 7);
+	AddFeedback(feedback, VirtualPageID(3, 2, 0), 3);
+	AddFeedback(feedback, VirtualPageID(0, 0, 3), 4); // resident
+
+	VirtualTextureFeedback analysis;
+	analysis.Analyze(feedback.data(), feedback.size(), table);
+	CHECK_EQUAL(analysis.GetUniquePageCount(), 3u);
+
+	const std::vector<VirtualTextureFeedback::Request>& requests = analysis.GetRequests();
+	CHECK_EQUAL(requests.size(), 1u);
+	if (!requests.empty())
+	{
+		CHECK(requests[0].page == VirtualPageID(0, 0, 2));
+		CHECK_EQUAL(requests[0].count, 10u);
+	}
+
+	// the sampled page and the fallback are the same page, listed once
+	CHECK_EQUAL(analysis.GetVisiblePages().size(), 1u);
+	if (!analysis.GetVisiblePages().empty())
+		CHECK(analysis.GetVisiblePages()[0] == VirtualPageID(0, 0, 3));
+}
+
+TEST(FeedbackStreamsInOverFrames)
+{
+	// drives the table and cache the way VirtualTexture::Update does until the sampled page is resident
+	VirtualPageTable table(16, 8);
+	VirtualPageCache cache(5);
+	uint32_t slot;
+	VirtualPageID evicted;
+	CHECK(cache.Allocate(VirtualPageID(0, 0, 4), 0, slot, evicted));
+	cache.Lock(slot);
+	table.Map(VirtualPageID(0, 0, 4), slot);
+
+	std::vector<uint32_t> feedback;
+	AddFeedback(feedback, VirtualPageID(3, 2, 0), 64);
+
+	VirtualTextureFeedback analysis;
+	uint64_t frame = 1;
+	for (; frame < 10 && !table.IsResident(VirtualPageID(3, 2, 0)); frame++)
+	{
+		analysis.Analyze(feedback.data(), feedback.size(), table);
+		for (VirtualPageID page : analysis.GetVisiblePages())
+			cache.Touch(table.GetSlot(page), frame);
+		for (const VirtualTextureFeedback::Request& request : analysis.GetRequests())
+		{
+			if (!cache.Allocate(request.page, frame, slot, evicted))
+				break;
+			if (evicted.IsValid())
+				table.Unmap(evicted);
+			table.Map(request.page, slot);
+		}
+	}
+
+	// one mip a frame, the cache has room for the whole chain
+	CHECK(table.IsResident(VirtualPageID(3, 2, 0)));
+	CHECK_EQUAL(frame, 5u);
+	CHECK_EQUAL(cache.GetUsedSlots(), 5u);
+}
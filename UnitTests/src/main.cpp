@@ -0,0 +1,30 @@
+#include "Test.h"
+
+#include <string.h>
+
+int main(int argc, char** argv)
+{
+	if (argc > 1 && strcmp(argv[1], "--benchmark") == 0)
+	{
+		for (const Test::Case& benchmark : Test::GetBenchmarks())
+		{
+			std::cout << benchmark.name << std::endl;
+			benchmark.func();
+		}
+		return 0;
+	}
+
+	int failedTests = 0;
+	for (const Test::Case& test : Test::GetCases())
+	{
+		int failures = Test::GetFailures();
+		test.func();
+		bool passed = failures == Test::GetFailures();
+		if (!passed)
+			failedTests++;
+		std::cout << (passed ? "passed " : "FAILED ") << test.name << std::endl;
+	}
+
+	std::cout << Test::GetCases().size() - failedTests << "/" << Test::GetCases().size() << " tests passed" << std::endl;
+	return failedTests == 0 ? 0 : 1;
+}